@@ -7,18 +7,59 @@
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
-#include <map>
 #include <memory>
 #include <mutex>
-#include <set>
 #include <utility>
 #include <vector>
 
 #include <sys/mman.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 namespace eosio {
 namespace vm {
+
+constexpr std::size_t huge_page_size = std::size_t{2} * 1024 * 1024;
+
+inline bool &huge_pages_flag() {
+  static thread_local bool flag = false;
+  return flag;
+}
+// Selects whether reservations made from now on by the wasm, growable and
+// jit allocators on the calling thread are aligned to huge pages and advised
+// for transparent huge pages. Explicit MAP_HUGETLB mappings are not used,
+// they would not allow the page granular mprotect() of linear memory growth
+// and guard pages.
+inline void set_huge_pages(bool enable) { huge_pages_flag() = enable; }
+inline bool huge_pages_enabled() { return huge_pages_flag(); }
+
+// Maps @size bytes of anonymous memory with @prot, @returns MAP_FAILED on
+// failure. With huge pages enabled, base + @offset is aligned to a huge page
+// and the memory above it is advised for transparent huge pages. Kernels
+// without them keep backing it with small pages.
+inline void *map_reservation(std::size_t size, int prot,
+                             std::size_t offset = 0) {
+  if (!huge_pages_enabled())
+    return mmap(nullptr, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  const std::size_t padded = size + huge_page_size;
+  char *base = (char *)mmap(nullptr, padded, prot, MAP_PRIVATE | MAP_ANONYMOUS,
+                            -1, 0);
+  if (base == MAP_FAILED)
+    return MAP_FAILED;
+  const std::uintptr_t start = reinterpret_cast<std::uintptr_t>(base) + offset;
+  char *aligned =
+      base + (((start + huge_page_size - 1) & ~(huge_page_size - 1)) - start);
+  // trim the padding on both sides
+  if (aligned != base)
+    munmap(base, aligned - base);
+  if (aligned + size != base + padded)
+    munmap(aligned + size, base + padded - (aligned + size));
+#ifdef MADV_HUGEPAGE
+  madvise(aligned + offset, size - offset, MADV_HUGEPAGE);
+#endif
+  return aligned;
+}
+
 class bounded_allocator {
 public:
   bounded_allocator(size_t size) {
@@ -97,43 +138,65 @@ private:
   char *_base;
 };
 
+// Allocates page aligned blocks for machine code. Blocks are rounded up to
+// a size class and bump allocated from large segments, so that code compiled
+// one after another stays dense. Freed blocks are reused most recently freed
+// first, while their pages are likely still cached, from a small per-thread
+// list before the shared one. Blocks larger than the largest class are
+// mapped on their own. Code is protected per block, since the watchdog
+// revokes execution rights of a single module.
 class jit_allocator {
   static constexpr std::size_t segment_size = std::size_t{64u} * 1024u * 1024u;
+  // four classes per doubling up to 256 pages
+  static constexpr std::size_t class_count = 28;
+  static constexpr std::size_t max_class_pages = 256;
+  // blocks per class kept by a thread before they go to the shared lists
+  static constexpr std::size_t thread_cache_size = 8;
 
 public:
-  // allocates page aligned memory with executable permission
+  // @returns size bytes, rounded up to pages, of readable and writable
+  // memory for the caller to fill in and mprotect.
   void *alloc(std::size_t size) {
-    std::lock_guard l{_mutex};
-    size = round_to_page(size);
-    auto best = free_blocks_by_size.lower_bound(size);
-    if (best == free_blocks_by_size.end()) {
-      best = allocate_segment(size);
-    }
-    if (best->first > size) {
-      best = split_block(best, size);
+    const std::size_t pages = page_count(size);
+    if (pages > max_class_pages)
+      return alloc_large(pages * page_bytes());
+    const std::size_t index = class_index(pages);
+    void *ptr = nullptr;
+    auto &cached = thread_cache().blocks[index];
+    if (!cached.empty()) {
+      ptr = cached.back();
+      cached.pop_back();
+    } else {
+      std::lock_guard l{_mutex};
+      auto &free_list = _free_blocks[index];
+      if (!free_list.empty()) {
+        ptr = free_list.back();
+        free_list.pop_back();
+      } else {
+        // fresh pages of a segment are still writable
+        return bump(class_pages(index) * page_bytes());
+      }
     }
-    transfer_node(free_blocks, allocated_blocks, best->second);
-    best = transfer_node(free_blocks_by_size, allocated_blocks_by_size, *best);
-    return best->second;
+    int err = mprotect(ptr, class_pages(index) * page_bytes(),
+                       PROT_READ | PROT_WRITE);
+    EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
+    return ptr;
   }
-  // ptr must be previously allocated by a call to alloc
-  void free(void *ptr) noexcept {
-    std::lock_guard l{_mutex};
-    auto pos = transfer_node(allocated_blocks, free_blocks, ptr);
-    transfer_node(allocated_blocks_by_size, free_blocks_by_size,
-                  {pos->second, pos->first});
-
-    // merge the freed block with adjacent free blocks
-    if (pos != free_blocks.begin()) {
-      auto prev = pos;
-      --prev;
-      pos = maybe_consolidate_blocks(prev, pos);
+  // ptr must be previously allocated by a call to alloc with the same size
+  void free(void *ptr, std::size_t size) noexcept {
+    const std::size_t pages = page_count(size);
+    if (pages > max_class_pages) {
+      ::munmap(ptr, pages * page_bytes());
+      return;
     }
-    auto next = pos;
-    ++next;
-    if (next != free_blocks.end()) {
-      maybe_consolidate_blocks(pos, next);
+    const std::size_t index = class_index(pages);
+    auto &cached = thread_cache().blocks[index];
+    if (cached.size() < thread_cache_size && cached.capacity() > 0) {
+      cached.push_back(ptr);
+      return;
     }
+    std::lock_guard l{_mutex};
+    _free_blocks[index].push_back(ptr);
   }
   static jit_allocator &instance() {
     static jit_allocator the_jit_allocator;
@@ -156,120 +219,147 @@ private:
     void *base;
     std::size_t size;
   };
-  using block = std::pair<std::size_t, void *>;
-  struct by_size {
-    using is_transparent = void;
-    bool operator()(const block &lhs, const block &rhs) const {
-      return lhs.first < rhs.first ||
-             (lhs.first == rhs.first &&
-              std::less<void *>{}(lhs.second, rhs.second));
-    }
-    bool operator()(const block &lhs, std::size_t rhs) const {
-      return lhs.first < rhs;
+
+  // Freed blocks of the calling thread, handed to the shared lists when
+  // the thread exits.
+  struct thread_blocks {
+    thread_blocks() {
+      for (auto &cached : blocks)
+        cached.reserve(thread_cache_size);
     }
-    bool operator()(std::size_t lhs, const block &rhs) const {
-      return lhs < rhs.first;
+    ~thread_blocks() {
+      auto &self = instance();
+      std::lock_guard l{self._mutex};
+      for (std::size_t i = 0; i < class_count; i++)
+        self._free_blocks[i].insert(self._free_blocks[i].end(),
+                                    blocks[i].begin(), blocks[i].end());
     }
+    std::vector<void *> blocks[class_count];
   };
+
+  static thread_blocks &thread_cache() {
+    static thread_local thread_blocks cache;
+    return cache;
+  }
+
+  static std::size_t page_bytes() {
+    static const std::size_t pagesize =
+        static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    return pagesize;
+  }
+  static std::size_t page_count(std::size_t size) {
+    return (size + page_bytes() - 1) / page_bytes();
+  }
+
+  // Classes 0-3 are 1-4 pages, then every doubling from 4 pages on is split
+  // in four steps: 5, 6, 7, 8, 10, 12, 14, 16, 20, ...
+  static constexpr std::size_t class_pages(std::size_t index) {
+    if (index < 4)
+      return index + 1;
+    const std::size_t octave = (index - 4) / 4;
+    const std::size_t step = (index - 4) % 4 + 1;
+    return (std::size_t{4} << octave) + step * (std::size_t{1} << octave);
+  }
+  static std::size_t class_index(std::size_t pages) {
+    static_assert(class_pages(class_count - 1) == max_class_pages);
+    if (pages <= 4)
+      return pages - 1;
+    std::size_t octave = 0;
+    while ((std::size_t{8} << octave) < pages)
+      octave++;
+    const std::size_t unit = std::size_t{1} << octave;
+    const std::size_t step = (pages - (std::size_t{4} << octave) + unit - 1) /
+                             unit;
+    return 4 + octave * 4 + step - 1;
+  }
+
+  // @pre _mutex is held
+  void *bump(std::size_t size) {
+    if (_bump_left < size) {
+      void *base = map_reservation(segment_size, PROT_READ | PROT_WRITE);
+      EOS_VM_ASSERT(base != MAP_FAILED, wasm_bad_alloc,
+                    "failed to allocate jit segment");
+      _segments.emplace_back(base, segment_size);
+      // the tail of the previous segment is abandoned
+      _bump = static_cast<char *>(base);
+      _bump_left = segment_size;
+    }
+    void *ptr = _bump;
+    _bump += size;
+    _bump_left -= size;
+    return ptr;
+  }
+
+  static void *alloc_large(std::size_t size) {
+    void *ptr = map_reservation(size, PROT_READ | PROT_WRITE);
+    EOS_VM_ASSERT(ptr != MAP_FAILED, wasm_bad_alloc,
+                  "failed to allocate jit code");
+    return ptr;
+  }
+
   std::vector<segment> _segments;
-  std::set<block, by_size> free_blocks_by_size;
-  std::set<block, by_size> allocated_blocks_by_size;
-  std::map<void *, std::size_t> free_blocks;
-  std::map<void *, std::size_t> allocated_blocks;
+  std::vector<void *> _free_blocks[class_count];
+  char *_bump = nullptr;
+  std::size_t _bump_left = 0;
   std::mutex _mutex;
-  using blocks_by_size_t = std::set<block, by_size>;
-  using blocks_t = std::map<void *, size_t>;
-
-  // moves an element from one associative container to another
-  // @pre key must be present in from, but not in to
-  template <typename C>
-  static typename C::iterator transfer_node(C &from, C &to,
-                                            typename C::key_type key) noexcept {
-    auto node = from.extract(key);
-    assert(node);
-    auto [pos, inserted, _] = to.insert(std::move(node));
-    assert(inserted);
-    return pos;
-  }
-
-  blocks_by_size_t::iterator allocate_segment(std::size_t min_size) {
-    std::size_t size = std::max(min_size, segment_size);
-    void *base =
-        mmap(nullptr, size, PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    segment s{base, size};
-    EOS_VM_ASSERT(base != MAP_FAILED, wasm_bad_alloc,
-                  "failed to allocate jit segment");
-    _segments.emplace_back(std::move(s));
-    bool success = true;
-    auto guard_1 = scope_guard{[&] {
-      if (!success) {
-        _segments.pop_back();
-      }
-    }};
-    auto pos2 = free_blocks_by_size.insert({size, base}).first;
-    auto guard_2 = scope_guard{[&] {
-      if (!success) {
-        free_blocks_by_size.erase(pos2);
-      }
-    }};
-    free_blocks.insert({base, size});
-    success = true;
-    return pos2;
-  }
-
-  blocks_by_size_t::iterator split_block(blocks_by_size_t::iterator pos,
-                                         std::size_t size) {
-    bool success = false;
-    auto new1 = free_blocks_by_size.insert({size, pos->second}).first;
-    auto guard1 = scope_guard{[&] {
-      if (!success) {
-        free_blocks_by_size.erase(new1);
-      }
-    }};
-    auto new2 = free_blocks_by_size
-                    .insert({pos->first - size,
-                             static_cast<char *>(pos->second) + size})
-                    .first;
-    auto guard2 = scope_guard{[&] {
-      if (!success) {
-        free_blocks_by_size.erase(new2);
+};
+
+// Process wide pool of growable_allocator reservations, so that parsing a
+// module does not map and unmap one. A released reservation keeps its
+// mapping and protection, the pages it used are handed back to the kernel
+// and read as zero again when it is reused.
+class arena_pool {
+public:
+  static constexpr std::size_t reservation_size = 128 * 1024 * 1024; // 128MB
+  static constexpr std::size_t capacity = 16;
+
+  static arena_pool &instance() {
+    static arena_pool pool;
+    return pool;
+  }
+
+  // @returns false if no reservation is pooled, otherwise sets @base and the
+  // size of its readable and writable prefix @size.
+  bool acquire(char *&base, std::size_t &size) {
+    std::lock_guard l{_mutex};
+    if (_free.empty())
+      return false;
+    base = _free.back().base;
+    size = _free.back().size;
+    _free.pop_back();
+    return true;
+  }
+
+  void release(char *base, std::size_t size) {
+    madvise(base, size, MADV_DONTNEED);
+    {
+      std::lock_guard l{_mutex};
+      if (_free.size() < capacity) {
+        _free.push_back({base, size});
+        return;
       }
-    }};
-    free_blocks.insert({new2->second, new2->first});
-    // the rest is nothrow
-    free_blocks_by_size.erase(pos);
-    free_blocks[new1->second] = new1->first;
-    success = true;
-    return new1;
-  }
-
-  blocks_t::iterator maybe_consolidate_blocks(blocks_t::iterator lhs,
-                                              blocks_t::iterator rhs) noexcept {
-    if (static_cast<char *>(lhs->first) + lhs->second == rhs->first) {
-      // merge blocks in free_blocks_by_size
-      auto node = free_blocks_by_size.extract({lhs->second, lhs->first});
-      assert(node);
-      node.value().first += rhs->second;
-      free_blocks_by_size.insert(std::move(node));
-      free_blocks_by_size.erase({rhs->second, rhs->first});
-      // merge the blocks in free_blocks
-      lhs->second += rhs->second;
-      free_blocks.erase(rhs);
-      return lhs;
-    } else {
-      return rhs;
     }
+    munmap(base, reservation_size);
   }
 
-  static std::size_t round_to_page(std::size_t offset) {
-    std::size_t pagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
-    return (offset + pagesize - 1) & ~(pagesize - 1);
+private:
+  struct arena {
+    char *base;
+    std::size_t size;
+  };
+
+  ~arena_pool() {
+    for (auto &a : _free)
+      munmap(a.base, reservation_size);
   }
+
+  std::mutex _mutex;
+  std::vector<arena> _free;
 };
 
 class growable_allocator {
 public:
-  static constexpr size_t max_memory_size = 128 * 1024 * 1024; // 128MB
+  static constexpr size_t max_memory_size = arena_pool::reservation_size;
   static constexpr size_t chunk_size = 128 * 1024;             // 128KB
   template <std::size_t align_amt>
   static constexpr size_t align_offset(size_t offset) {
@@ -286,22 +376,30 @@ public:
   growable_allocator(size_t size) {
     EOS_VM_ASSERT(size <= max_memory_size, wasm_bad_alloc,
                   "Too large initial memory size");
-    _base = (char *)mmap(NULL, max_memory_size, PROT_NONE,
-                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    EOS_VM_ASSERT(_base != MAP_FAILED, wasm_bad_alloc,
-                  "growable_allocator mmap failed.");
+    if (!arena_pool::instance().acquire(_base, _size)) {
+      _base = (char *)map_reservation(max_memory_size, PROT_NONE);
+      EOS_VM_ASSERT(_base != MAP_FAILED, wasm_bad_alloc,
+                    "growable_allocator mmap failed.");
+    }
     if (size != 0) {
       size_t chunks_to_alloc = (align_offset<chunk_size>(size) / chunk_size);
-      _size += (chunk_size * chunks_to_alloc);
-      mprotect((char *)_base, _size, PROT_READ | PROT_WRITE);
+      if (chunk_size * chunks_to_alloc > _size) {
+        mprotect((char *)_base + _size, chunk_size * chunks_to_alloc - _size,
+                 PROT_READ | PROT_WRITE);
+        _size = chunk_size * chunks_to_alloc;
+      }
     }
     _capacity = max_memory_size;
   }
 
   ~growable_allocator() {
-    munmap(_base, _capacity);
+    // compacted allocators no longer span a whole reservation
+    if (_capacity == max_memory_size)
+      arena_pool::instance().release(_base, _size);
+    else
+      munmap(_base, _capacity);
     if (is_jit) {
-      jit_allocator::instance().free(_code_base);
+      jit_allocator::instance().free(_code_base, _code_size);
     }
   }
 
@@ -342,8 +440,6 @@ public:
     if constexpr (IsJit) {
       auto &jit_alloc = jit_allocator::instance();
       void *executable_code = jit_alloc.alloc(_code_size);
-      int err = mprotect(executable_code, _code_size, PROT_READ | PROT_WRITE);
-      EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
       std::memcpy(executable_code, _code_base, _code_size);
       is_jit = true;
       _code_base = (char *)executable_code;
@@ -352,11 +448,27 @@ public:
     enable_code(IsJit);
   }
 
+  // Allocates the code segment for prebuilt jit code.  The memory stays
+  // writable for patching until enable_code() is called.
+  unsigned char *alloc_jit_code(std::size_t size) {
+    EOS_VM_ASSERT(_code_base == nullptr, wasm_bad_alloc,
+                  "code segment already allocated");
+    auto &jit_alloc = jit_allocator::instance();
+    _code_size = align_to_page(size);
+    _code_base = (char *)jit_alloc.alloc(_code_size);
+    is_jit = true;
+    return (unsigned char *)_code_base;
+  }
+
   // Sets protection on code pages to allow them to be executed.
   void enable_code(bool is_jit_) {
     mprotect(_code_base, _code_size,
              is_jit_ ? PROT_EXEC : (PROT_READ | PROT_WRITE));
   }
+  // Allows reading executable code pages until enable_code() is called.
+  void enable_code_read() {
+    mprotect(_code_base, _code_size, PROT_READ | PROT_EXEC);
+  }
   // Make code pages unexecutable
   void disable_code() { mprotect(_code_base, _code_size, PROT_NONE); }
 
@@ -373,10 +485,16 @@ public:
   }
 
   /*
-   * Finalize the memory by unmapping any excess pages, this means that the
-   * allocator will no longer grow
+   * Finalize the memory, this means that the allocator will no longer grow.
+   * The reservation is kept, in order to be pooled once the module is gone.
    */
-  void finalize() {
+  void finalize() {}
+
+  /*
+   * Compact the memory by unmapping any excess pages, for long-lived
+   * modules. The reservation is not pooled then.
+   */
+  void compact() {
     if (_capacity != _offset) {
       std::size_t final_size = align_to_page(_offset);
       EOS_VM_ASSERT(munmap(_base + final_size, _capacity - final_size) == 0,
@@ -415,6 +533,64 @@ public:
   inline T *get_base_ptr() const { return raw; }
 };
 
+// Copy of the first pages of a linear memory in a memfd, which
+// wasm_allocator::reset(const memory_image &) maps copy-on-write. Zero pages
+// are left as holes in the file.
+class memory_image {
+public:
+  memory_image(const char *base, uint32_t pages) : _pages(pages) {
+    _fd = memfd_create("eos-vm-memory-image", MFD_CLOEXEC);
+    EOS_VM_ASSERT(_fd >= 0, wasm_bad_alloc, "memfd_create failed");
+    auto close_fd = scope_guard{[this]() {
+      if (_fd >= 0 && !_complete)
+        ::close(_fd);
+    }};
+    const std::size_t size = static_cast<std::size_t>(page_size) * pages;
+    EOS_VM_ASSERT(ftruncate(_fd, size) == 0, wasm_bad_alloc,
+                  "ftruncate failed");
+    const std::size_t chunk =
+        static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    std::size_t offset = 0;
+    while (offset < size) {
+      if (is_zero(base + offset, chunk)) {
+        offset += chunk;
+        continue;
+      }
+      std::size_t end = offset + chunk;
+      while (end < size && !is_zero(base + end, chunk))
+        end += chunk;
+      write_all(base + offset, end - offset, offset);
+      offset = end;
+    }
+    _complete = true;
+  }
+  ~memory_image() { ::close(_fd); }
+  memory_image(const memory_image &) = delete;
+  memory_image &operator=(const memory_image &) = delete;
+
+  int fd() const { return _fd; }
+  uint32_t pages() const { return _pages; }
+
+private:
+  static bool is_zero(const char *ptr, std::size_t size) {
+    return ptr[0] == 0 && std::memcmp(ptr, ptr + 1, size - 1) == 0;
+  }
+
+  void write_all(const char *ptr, std::size_t size, std::size_t offset) {
+    while (size > 0) {
+      ssize_t n = pwrite(_fd, ptr, size, offset);
+      EOS_VM_ASSERT(n > 0, wasm_bad_alloc, "pwrite failed");
+      ptr += n;
+      size -= n;
+      offset += n;
+    }
+  }
+
+  int _fd = -1;
+  uint32_t _pages;
+  bool _complete = false;
+};
+
 class wasm_allocator {
 private:
   char *raw = nullptr;
@@ -430,8 +606,12 @@ public:
     int err = mprotect(raw + (page_size * page), (page_size * size),
                        PROT_READ | PROT_WRITE);
     EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
-    T *ptr = (T *)(raw + (page_size * page));
-    memset(ptr, 0, page_size * size);
+    // pages above the current size are only non-zero if reset() zeroed
+    // them eagerly, discarded pages are zero filled by the kernel on access
+    if (!lazy_zero) {
+      T *ptr = (T *)(raw + (page_size * page));
+      zero_pages(ptr, page_size * size);
+    }
     page += size;
   }
   template <typename T> void free(std::size_t size) {
@@ -440,7 +620,11 @@ public:
     EOS_VM_ASSERT(page != -1, wasm_bad_alloc, "require memory to deallocate");
     EOS_VM_ASSERT(size <= page, wasm_bad_alloc, "freed too many pages");
     page -= size;
-    int err = mprotect(raw + (page_size * page), (page_size * size), PROT_NONE);
+    // keep everything above the current size zero for a lazy alloc()
+    const uint32_t discarded = discard_image(page);
+    char *ptr = raw + (page_size * (page + discarded));
+    zero_pages(ptr, page_size * (size - discarded));
+    int err = mprotect(ptr, page_size * (size - discarded), PROT_NONE);
     EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
   }
   void free() {
@@ -449,8 +633,9 @@ public:
   }
   wasm_allocator() {
     std::size_t syspagesize = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
-    raw = (char *)mmap(NULL, max_memory + 2 * syspagesize, PROT_NONE,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    // the guard page is below the huge page aligned linear memory
+    raw = (char *)map_reservation(max_memory + 2 * syspagesize, PROT_NONE,
+                                  syspagesize);
     EOS_VM_ASSERT(raw != MAP_FAILED, wasm_bad_alloc,
                   "wasm_allocator mmap failed to alloca pages");
     int err = mprotect(raw, syspagesize, PROT_READ);
@@ -460,7 +645,9 @@ public:
   }
   void reset(uint32_t new_pages) {
     if (page != -1) {
-      memset(raw, '\0', page_size * page); // zero the memory
+      const uint32_t discarded = discard_image(0);
+      zero_pages(raw + page_size * discarded,
+                 page_size * (page - discarded)); // zero the memory
     } else {
       std::size_t syspagesize =
           static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
@@ -480,13 +667,27 @@ public:
     if (page != -1) {
       std::size_t syspagesize =
           static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
-      memset(raw, '\0', page_size * page); // zero the memory
+      const uint32_t discarded = discard_image(0);
+      zero_pages(raw + page_size * discarded,
+                 page_size * (page - discarded)); // zero the memory
       int err = mprotect(raw - syspagesize, page_size * page + syspagesize,
                          PROT_NONE);
       EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "mprotect failed");
     }
     page = -1;
   }
+  // Resets like reset(uint32_t) and maps @image copy-on-write as the first
+  // pages, writes to them are private to this allocator.
+  void reset(const memory_image &image) {
+    reset(image.pages());
+    if (image.pages() == 0)
+      return;
+    void *addr = mmap(raw, page_size * image.pages(), PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_FIXED, image.fd(), 0);
+    EOS_VM_ASSERT(addr != MAP_FAILED, wasm_bad_alloc,
+                  "mmap of memory image failed");
+    page = image_pages = image.pages();
+  }
   template <typename T> inline T *get_base_ptr() const {
     return reinterpret_cast<T *>(raw);
   }
@@ -495,6 +696,49 @@ public:
   }
   inline int32_t get_current_page() const { return page; }
   bool is_in_region(char *p) { return p >= raw && p < raw + max_memory; }
+
+  // When enabled, used memory is handed back to the kernel on reset
+  // instead of being cleared, and zeroing happens lazily on first touch.
+  void set_lazy_zero(bool enable) { lazy_zero = enable; }
+  uint64_t get_bytes_zeroed() const { return bytes_zeroed; }
+  uint64_t get_bytes_discarded() const { return bytes_discarded; }
+  void clear_stats() { bytes_zeroed = bytes_discarded = 0; }
+
+private:
+  // Replaces the pages of a mapped image from @first on with fresh
+  // anonymous memory, which is zero and PROT_NONE. madvise() would bring
+  // the contents of the image back instead of zeroing them.
+  // @returns the number of pages replaced.
+  uint32_t discard_image(uint32_t first) {
+    if (first >= image_pages)
+      return 0;
+    const uint32_t count = image_pages - first;
+    void *addr = mmap(raw + page_size * first, page_size * count, PROT_NONE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+    EOS_VM_ASSERT(addr != MAP_FAILED, wasm_bad_alloc, "mmap failed");
+    bytes_discarded += page_size * count;
+    image_pages = first;
+    return count;
+  }
+
+  void zero_pages(void *ptr, std::size_t size) {
+    if (size == 0)
+      return;
+    if (lazy_zero) {
+      int err = madvise(ptr, size, MADV_DONTNEED);
+      EOS_VM_ASSERT(err == 0, wasm_bad_alloc, "madvise failed");
+      bytes_discarded += size;
+    } else {
+      memset(ptr, 0, size);
+      bytes_zeroed += size;
+    }
+  }
+
+  bool lazy_zero = false;
+  // pages at the start mapped from a memory_image
+  uint32_t image_pages = 0;
+  uint64_t bytes_zeroed = 0;
+  uint64_t bytes_discarded = 0;
 };
 } // namespace vm
 } // namespace eosio
@@ -7,6 +7,7 @@
 #include <eosio/vm/execution_context.hpp>
 #include <eosio/vm/interpret_visitor.hpp>
 #include <eosio/vm/parser.hpp>
+#include <eosio/vm/threaded_code.hpp>
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/x86_64.hpp>
 
@@ -36,6 +37,15 @@ struct interpreter {
   static constexpr bool is_jit = false;
 };
 
+// Interprets direct-threaded code, see threaded_code.hpp.
+struct threaded {
+  template <typename Host> using context = threaded_execution_context<Host>;
+  template <typename Host>
+  using parser =
+      binary_parser<threaded_code_writer<threaded_execution_context<Host>>>;
+  static constexpr bool is_jit = false;
+};
+
 template <typename Host, typename Impl = interpreter> class backend {
 public:
   using host_t = Host;
@@ -57,13 +67,71 @@ public:
     _mod.finalize();
   }
 
+  // Parses the module in @ptr but takes its machine code from @image, which
+  // must have been saved from a backend of the same module.
+  template <typename HostFunctions = nullptr_t>
+  backend(wasm_code_ptr &ptr, size_t sz, const jit_code_image &image,
+          HostFunctions hf = nullptr)
+      : backend(ptr, sz, &image, false, {}, hf) {}
+
+  // With @gas_metering the jit code charges the cost of every block to the
+  // gas counter of the context, see machine_code_writer. A non-null @image
+  // must have been saved from a backend of the same module and metering.
+  // A non-empty @parallel_for compiles the functions concurrently, see
+  // binary_parser::set_parallel_for.
+  template <typename HostFunctions = nullptr_t>
+  backend(wasm_code_ptr &ptr, size_t sz, const jit_code_image *image,
+          bool gas_metering, const parallel_for_t &parallel_for = {},
+          HostFunctions = nullptr)
+      : _ctx([&]() -> module & {
+          EOS_VM_ASSERT(Impl::is_jit || !gas_metering, wasm_parse_exception,
+                        "gas metering requires the jit");
+          _mod.gas_metering = gas_metering;
+          typename Impl::template parser<Host> parser{_mod.allocator};
+          if (image)
+            parser.set_code_image(image);
+          if (parallel_for)
+            parser.set_parallel_for(parallel_for);
+          return parser.parse_module2(ptr, sz, _mod);
+        }()) {
+    if constexpr (!std::is_same_v<HostFunctions, nullptr_t>)
+      HostFunctions::resolve(_mod);
+    _mod.finalize();
+  }
+
+  // Calls @f with the image of the machine code of this backend, the code
+  // is readable for the duration of the call.
+  template <typename F> void visit_code_image(F &&f) {
+    static_assert(Impl::is_jit, "code images are only supported by the jit");
+    jit_code_image image;
+    image.code = (const unsigned char *)_mod.allocator._code_base;
+    image.code_size = _mod.allocator._code_size;
+    for (uint32_t i = 0; i < _mod.code.size(); ++i)
+      image.function_offsets.push_back(_mod.code[i].jit_code_offset);
+    image.relocations = _mod.jit_relocations.data();
+    image.relocation_count = _mod.jit_relocations.size();
+    image.maximum_stack = _mod.maximum_stack;
+    _mod.allocator.enable_code_read();
+    auto restore = scope_guard{[this]() { _mod.allocator.enable_code(true); }};
+    static_cast<F &&>(f)(static_cast<const jit_code_image &>(image));
+  }
+
   template <typename... Args>
   inline bool operator()(Host *host, const std::string_view &mod,
                          const std::string_view &func, Args... args) {
     return call(host, mod, func, args...);
   }
 
+  // Instantiates the module, from the snapshot if one was taken.
   inline backend &initialize(Host *host = nullptr) {
+    if (_snapshot) {
+      if (_snapshot->memory)
+        _walloc->reset(*_snapshot->memory);
+      else
+        _walloc->reset();
+      _ctx.reset(_snapshot.get());
+      return *this;
+    }
     if (_mod.memories.size())
       _walloc->reset(_mod.memories[0].limits.initial);
     else
@@ -73,6 +141,25 @@ public:
     return *this;
   }
 
+  // Captures the linear memory and globals of the instance initialized
+  // last, before it executed anything else. Later initialize() calls map
+  // that memory copy-on-write instead of applying the data segments and
+  // running the start function again.
+  void take_snapshot() {
+    auto snapshot = std::make_unique<instance_snapshot>();
+    if (_mod.memories.size())
+      snapshot->memory = std::make_unique<memory_image>(
+          _walloc->get_base_ptr<char>(), _walloc->get_current_page());
+    for (uint32_t i = 0; i < _mod.globals.size(); i++)
+      snapshot->globals.push_back(_mod.globals[i].current);
+    _snapshot = std::move(snapshot);
+  }
+  inline bool has_snapshot() const { return static_cast<bool>(_snapshot); }
+
+  // Gives back the unused part of the parse arena of a long-lived module,
+  // the arena is unmapped instead of pooled once the module is gone.
+  void compact() { _mod.allocator.compact(); }
+
   template <typename... Args>
   inline bool call_indirect(Host *host, uint32_t func_index, Args... args) {
     try {
@@ -221,6 +308,7 @@ private:
   wasm_allocator *_walloc = nullptr; // non owning pointer
   module _mod;
   typename Impl::template context<Host> _ctx;
+  std::unique_ptr<instance_snapshot> _snapshot;
 };
 } // namespace vm
 } // namespace eosio
@@ -53,6 +53,8 @@ struct base_visitor {
   [[gnu::always_inline]] inline void operator()(const f64_store_t &) {}
   [[gnu::always_inline]] inline void operator()(const current_memory_t &) {}
   [[gnu::always_inline]] inline void operator()(const grow_memory_t &) {}
+  [[gnu::always_inline]] inline void operator()(const memory_copy_t &) {}
+  [[gnu::always_inline]] inline void operator()(const memory_fill_t &) {}
   [[gnu::always_inline]] inline void operator()(const i32_const_t &) {}
   [[gnu::always_inline]] inline void operator()(const i64_const_t &) {}
   [[gnu::always_inline]] inline void operator()(const f32_const_t &) {}
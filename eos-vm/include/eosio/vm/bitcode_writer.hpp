@@ -24,11 +24,17 @@ public:
       : _allocator(alloc), _code_segment_base(alloc.start_code()),
         fb(alloc, source_bytes), _mod(&mod) {}
   ~bitcode_writer() { _allocator.end_code<false>(_code_segment_base); }
+  static void load_code_image(growable_allocator &, module &,
+                              const jit_code_image &) {
+    EOS_VM_ASSERT(false, wasm_parse_exception,
+                  "code images are only supported by the jit");
+  }
   void emit_unreachable() { fb[op_index++] = unreachable_t{}; };
   void emit_nop() { fb[op_index++] = nop_t{}; }
   uint32_t emit_end() { return op_index; }
   uint32_t *emit_return(uint32_t depth_change) { return emit_br(depth_change); }
   void emit_block() {}
+  void meter_instruction() {}
   uint32_t emit_loop() { return op_index; }
   uint32_t *emit_if() {
     if_t &instr = append_instr(if_t{});
@@ -150,6 +156,8 @@ public:
 
   void emit_current_memory() { fb[op_index++] = current_memory_t{}; }
   void emit_grow_memory() { fb[op_index++] = grow_memory_t{}; }
+  void emit_memory_copy() { fb[op_index++] = memory_copy_t{}; }
+  void emit_memory_fill() { fb[op_index++] = memory_fill_t{}; }
 
   void emit_i32_const(uint32_t value) { fb[op_index++] = i32_const_t{value}; }
   void emit_i64_const(uint64_t value) { fb[op_index++] = i64_const_t{value}; }
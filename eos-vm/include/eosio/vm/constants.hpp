@@ -19,7 +19,9 @@ enum constants {
   max_useable_memory = (33 * 1024 * 1024), // 33mb
   // max_useable_memory    = (17 * 1024 * 1024), //33mb
   page_size = 64ull * 1024, // 64kb
-  max_pages = (max_useable_memory / page_size)
+  max_pages = (max_useable_memory / page_size),
+  // memory.copy and memory.fill charge one unit of gas per this many bytes
+  bulk_memory_bytes_per_gas = 8
 };
 }
 } // namespace eosio
@@ -48,5 +48,6 @@ DECLARE_EXCEPTION(wasm_link_exception, 4000010, "wasm linked function failure")
 DECLARE_EXCEPTION(guarded_ptr_exception, 4010000, "pointer out of bounds")
 DECLARE_EXCEPTION(timeout_exception, 4010001, "timeout")
 DECLARE_EXCEPTION(wasm_exit_exception, 4010002, "exit")
+DECLARE_EXCEPTION(out_of_gas_exception, 4010003, "out of gas")
 } // namespace vm
 } // namespace eosio
@@ -6,6 +6,7 @@
 #include <eosio/vm/host_function.hpp>
 #include <eosio/vm/opcodes.hpp>
 #include <eosio/vm/signals.hpp>
+#include <eosio/vm/threaded_code.hpp>
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/utils.hpp>
 #include <eosio/vm/wasm_stack.hpp>
@@ -16,16 +17,26 @@
 #include <cstdint>
 #include <cstring>
 #include <iostream>
+#include <iterator>
 #include <limits>
+#include <memory>
 #include <optional>
 #include <signal.h>
 #include <string_view>
 #include <system_error>
 #include <utility>
+#include <vector>
 
 namespace eosio {
 namespace vm {
 
+// The linear memory and globals of an instance after initialization, see
+// backend::take_snapshot().
+struct instance_snapshot {
+  std::unique_ptr<memory_image> memory;
+  std::vector<init_expr> globals;
+};
+
 template <typename Derived, typename Host> class execution_context_base {
 public:
   Derived &derived() { return static_cast<Derived &>(*this); }
@@ -38,7 +49,7 @@ public:
         return -1;
       _wasm_alloc->free<char>(-pages);
     } else {
-      if (!_mod.memories.size() || max_pages - sz < pages ||
+      if (!_mod.memories.size() || int32_t(_max_pages) - sz < pages ||
           (_mod.memories[0].limits.flags &&
            (static_cast<int32_t>(_mod.memories[0].limits.maximum) - sz <
             pages)))
@@ -51,6 +62,21 @@ public:
   inline int32_t current_linear_memory() const {
     return _wasm_alloc->get_current_page();
   }
+
+  // memory.copy and memory.fill, both ranges are checked before anything is
+  // written so an out of bounds instruction has no effect.
+  inline void copy_linear_memory(uint32_t dest, uint32_t src, uint32_t count) {
+    check_linear_memory_range(dest, count);
+    check_linear_memory_range(src, count);
+    charge_bulk_memory(count);
+    std::memmove(_linear_memory + dest, _linear_memory + src, count);
+  }
+  inline void fill_linear_memory(uint32_t dest, uint8_t value,
+                                 uint32_t count) {
+    check_linear_memory_range(dest, count);
+    charge_bulk_memory(count);
+    std::memset(_linear_memory + dest, value, count);
+  }
   inline void exit(std::error_code err = std::error_code()) {
     // FIXME: system_error?
     _error_code = err;
@@ -58,18 +84,52 @@ public:
   }
 
   inline module &get_module() { return _mod; }
+  // Charged by jit code of modules compiled with gas metering, which raises
+  // out_of_gas_exception when the counter drops below zero.
+  inline void set_gas_counter(int64_t *counter) { _gas_counter = counter; }
+  inline int64_t *get_gas_counter() const { return _gas_counter; }
   inline void set_wasm_allocator(wasm_allocator *alloc) { _wasm_alloc = alloc; }
+
+  // Limits of this context, at most the compile time maxima in constants.
+  // Modules with more initial pages fail to instantiate, calls nested deeper
+  // than the call depth trap like a stack overflow.
+  inline void set_max_pages(uint32_t pages) {
+    _max_pages = std::min<uint32_t>(pages, max_pages);
+  }
+  inline uint32_t get_max_pages() const { return _max_pages; }
+  inline void set_max_call_depth(uint32_t depth) {
+    _max_call_depth = std::min<uint32_t>(depth, constants::max_call_depth);
+  }
+  inline uint32_t get_max_call_depth() const { return _max_call_depth; }
+  // Set by a host function to end the execution without an exception, the
+  // contexts leave the running call when it returns.
+  inline bool &exit_requested() { return _exit_requested; }
   inline auto get_wasm_allocator() { return _wasm_alloc; }
   inline char *linear_memory() { return _linear_memory; }
 
   inline std::error_code get_error_code() const { return _error_code; }
 
-  inline void reset() {
+  // With a @snapshot the allocator must have mapped its memory, only the
+  // globals are restored. The snapshot may have been taken under a larger
+  // page limit.
+  inline void reset(const instance_snapshot *snapshot = nullptr) {
     _linear_memory = _wasm_alloc->get_base_ptr<char>();
+    _exit_requested = false;
+    if (snapshot) {
+      EOS_VM_ASSERT(uint32_t(_wasm_alloc->get_current_page()) <= _max_pages,
+                    wasm_bad_alloc, "initial memory exceeds the page limit");
+      for (uint32_t i = 0; i < _mod.globals.size(); i++) {
+        if (_mod.globals[i].type.mutability)
+          _mod.globals[i].current = snapshot->globals[i];
+      }
+      return;
+    }
     if (_mod.memories.size()) {
       // We'd better have reset the allocator before we get here
       assert(_mod.memories[0].limits.initial >=
              _wasm_alloc->get_current_page());
+      EOS_VM_ASSERT(_mod.memories[0].limits.initial <= _max_pages,
+                    wasm_bad_alloc, "initial memory exceeds the page limit");
       int err = grow_linear_memory(_mod.memories[0].limits.initial -
                                    _wasm_alloc->get_current_page());
       EOS_VM_ASSERT(err != -1, wasm_bad_alloc,
@@ -112,6 +172,21 @@ public:
   }
 
 protected:
+  inline void check_linear_memory_range(uint32_t offset, uint32_t count) const {
+    EOS_VM_ASSERT(static_cast<uint64_t>(offset) + count <=
+                      current_linear_memory() *
+                          static_cast<uint64_t>(page_size),
+                  wasm_memory_exception, "wasm memory out-of-bounds");
+  }
+  // The instruction itself is charged like any other, this adds the part
+  // proportional to its length.
+  inline void charge_bulk_memory(uint32_t count) {
+    if (!_mod.gas_metering || !_gas_counter)
+      return;
+    *_gas_counter -= count / constants::bulk_memory_bytes_per_gas;
+    EOS_VM_ASSERT(*_gas_counter >= 0, out_of_gas_exception, "out of gas");
+  }
+
   static void handle_signal(int sig) {
     switch (sig) {
     case SIGSEGV:
@@ -125,11 +200,17 @@ protected:
     throw wasm_memory_exception{"wasm memory out-of-bounds"};
   }
 
+  // The jit code finds this at offset 0 of the context, it must stay the
+  // first member and the contexts must not have virtual functions.
+  int64_t *_gas_counter = nullptr;
   char *_linear_memory = nullptr;
   module &_mod;
   wasm_allocator *_wasm_alloc;
   registered_host_functions<Host> _rhf;
   std::error_code _error_code;
+  uint32_t _max_pages = max_pages;
+  uint32_t _max_call_depth = constants::max_call_depth;
+  bool _exit_requested = false;
 };
 
 struct jit_visitor {
@@ -153,60 +234,11 @@ public:
   inline operand_stack &get_operand_stack() { return _os; }
 
   inline native_value call_host_function(native_value *stack, uint32_t index) {
-    const auto &ft = _mod.get_function_type(index);
-    uint32_t num_params = ft.param_types.size();
-#ifndef NDEBUG
-    uint32_t original_operands = _os.size();
-#endif
-    for (uint32_t i = 0; i < ft.param_types.size(); ++i) {
-      switch (ft.param_types[i]) {
-      case i32:
-        _os.push(i32_const_t{stack[num_params - i - 1].i32});
-        break;
-      case i64:
-        _os.push(i64_const_t{stack[num_params - i - 1].i64});
-        break;
-      case f32:
-        _os.push(f32_const_t{stack[num_params - i - 1].f32});
-        break;
-      case f64:
-        _os.push(f64_const_t{stack[num_params - i - 1].f64});
-        break;
-      default:
-        assert(!"Unexpected type in param_types.");
-      }
-    }
-    _rhf(_host, *this, _mod.import_functions[index]);
-    native_value result{uint32_t{0}};
-    // guarantee that the junk bits are zero, to avoid problems.
-    auto set_result = [&result](auto val) {
-      std::memcpy(&result, &val, sizeof(val));
-    };
-    if (ft.return_count) {
-      operand_stack_elem el = _os.pop();
-      switch (ft.return_type) {
-      case i32:
-        set_result(el.to_ui32());
-        break;
-      case i64:
-        set_result(el.to_ui64());
-        break;
-      case f32:
-        set_result(el.to_f32());
-        break;
-      case f64:
-        set_result(el.to_f64());
-        break;
-      default:
-        assert(!"Unexpected function return type.");
-      }
-    }
-    assert(_os.size() == original_operands);
-    return result;
+    return _rhf.call_native(_host, *this, stack, _mod.import_functions[index]);
   }
 
-  inline void reset() {
-    base_type::reset();
+  inline void reset(const instance_snapshot *snapshot = nullptr) {
+    base_type::reset(snapshot);
     _os.eat(0);
   }
 
@@ -234,7 +266,7 @@ public:
         constexpr std::size_t stack_cutoff = std::max(252144, SIGSTKSZ);
         std::size_t maximum_stack_usage =
             (_mod.maximum_stack + 2 /*frame ptr + return ptr*/) *
-                (constants::max_call_depth + 1) +
+                (this->_max_call_depth + 1) +
             sizeof...(Args) + 4 /* scratch space */;
         void *stack = nullptr;
         std::unique_ptr<native_value[]> alt_stack;
@@ -258,6 +290,10 @@ public:
     } catch (wasm_exit_exception &) {
       return {};
     }
+    if (this->_exit_requested) {
+      this->_exit_requested = false;
+      return {};
+    }
 
     if (!ft.return_count)
       return {};
@@ -297,7 +333,7 @@ protected:
     static_assert(sizeof(native_value) == 8,
                   "8-bytes expected for native_value");
     native_value result;
-    unsigned stack_check = constants::max_call_depth + 1;
+    unsigned stack_check = context->_max_call_depth + 1;
     void *stack_top asm("r12") = stack;
     // 0x1f80 is the default MXCSR value
     asm volatile(
@@ -352,10 +388,648 @@ protected:
 
   // This is only needed because the host function api uses operand stack
   bounded_allocator _base_allocator = {constants::max_stack_size *
-                                       sizeof(operand_stack_elem)};
+                                       sizeof(stack_slot)};
   operand_stack _os;
 };
 
+// Runs the code of threaded_code_writer.  A frame on the value stack is the
+// params and locals of a function followed by its operands, fp points to
+// the first param and sp to the top operand.
+template <typename Host>
+class threaded_execution_context
+    : public execution_context_base<threaded_execution_context<Host>, Host> {
+  using base_type =
+      execution_context_base<threaded_execution_context<Host>, Host>;
+
+public:
+  using base_type::_error_code;
+  using base_type::_linear_memory;
+  using base_type::_mod;
+  using base_type::_rhf;
+  using base_type::execute;
+  using base_type::handle_signal;
+
+  threaded_execution_context(module &m)
+      : base_type(m), _imported_functions(m.get_imported_functions_size()),
+        _stack_size(stack_size(m, constants::max_call_depth)),
+        _stack(new native_value[_stack_size]) {
+    _halt.handler = handler(tc_op::halt);
+    _sp = _stack.get();
+  }
+
+  // The value stack is sized for the call depth.
+  inline void set_max_call_depth(uint32_t depth) {
+    base_type::set_max_call_depth(depth);
+    const std::size_t size = stack_size(_mod, this->_max_call_depth);
+    if (size != _stack_size) {
+      _stack.reset(new native_value[size]);
+      _stack_size = size;
+      _sp = _stack.get();
+    }
+  }
+
+  static const void *handler(tc_op op) {
+    static const void *const *table = []() {
+      const void *const *result = nullptr;
+      run(nullptr, nullptr, nullptr, nullptr, &result);
+      return result;
+    }();
+    return table[static_cast<uint16_t>(op)];
+  }
+
+  inline void reset(const instance_snapshot *snapshot = nullptr) {
+    base_type::reset(snapshot);
+    _sp = _stack.get();
+    _csp = _frames;
+  }
+
+  template <typename Visitor, typename... Args>
+  inline std::optional<operand_stack_elem>
+  execute(Host *host, Visitor &&, uint32_t func_index, Args... args) {
+    EOS_VM_ASSERT(func_index < _mod.get_functions_total(),
+                  wasm_interpreter_exception,
+                  "cannot execute function, function not found");
+    const func_type &ft = _mod.get_function_type(func_index);
+    EOS_VM_ASSERT(ft.param_types.size() == sizeof...(Args),
+                  wasm_interpreter_exception, "function param type mismatch");
+    EOS_VM_ASSERT(_stack_size - (_sp - _stack.get()) > sizeof...(Args) + 1 &&
+                      _csp != _frames + this->_max_call_depth + 1,
+                  wasm_interpreter_exception, "stack overflow");
+
+    auto saved_host = _host;
+    auto saved_sp = _sp;
+    auto saved_csp = _csp;
+    auto g = scope_guard([&]() {
+      _host = saved_host;
+      _sp = saved_sp;
+      _csp = saved_csp;
+    });
+
+    _host = host;
+    native_value *fp = _sp + 1;
+    native_value *sp = _sp;
+    ((*++sp = to_native_value(detail::resolve_result(static_cast<Args &&>(args),
+                                                     this->_wasm_alloc))),
+     ...);
+
+    try {
+      if (func_index < _imported_functions) {
+        std::reverse(fp, sp + 1);
+        _sp = sp;
+        *fp = _rhf.call_native(_host, *this, fp,
+                               _mod.import_functions[func_index]);
+        sp = fp;
+      } else {
+        *_csp++ = frame{&_halt, nullptr};
+        const tc_slot *pc = function_code(func_index);
+        vm::invoke_with_signal_handler([&]() { sp = run(this, pc, fp, sp); },
+                                       &handle_signal);
+      }
+    } catch (wasm_exit_exception &) {
+      return {};
+    }
+    if (this->_exit_requested) {
+      this->_exit_requested = false;
+      return {};
+    }
+
+    if (!ft.return_count)
+      return {};
+    else
+      switch (ft.return_type) {
+      case i32:
+        return {i32_const_t{sp->i32}};
+      case i64:
+        return {i64_const_t{sp->i64}};
+      case f32:
+        return {f32_const_t{sp->f32}};
+      case f64:
+        return {f64_const_t{sp->f64}};
+      default:
+        assert(!"Unexpected function return type");
+      }
+    __builtin_unreachable();
+  }
+
+private:
+  struct frame {
+    const tc_slot *pc;
+    native_value *fp;
+  };
+
+  inline const tc_slot *function_code(uint32_t func_index) const {
+    return reinterpret_cast<const tc_slot *>(
+        _mod.allocator._code_base +
+        _mod.code[func_index - _imported_functions].jit_code_offset);
+  }
+
+  template <typename T> static inline T tc_get(const native_value &v) {
+    if constexpr (std::is_same_v<T, float>)
+      return v.f32;
+    else if constexpr (std::is_same_v<T, double>)
+      return v.f64;
+    else if constexpr (sizeof(T) == 4)
+      return static_cast<T>(v.i32);
+    else
+      return static_cast<T>(v.i64);
+  }
+  static inline void tc_put(native_value &v, bool x) { v.i32 = x; }
+  static inline void tc_put(native_value &v, uint32_t x) { v.i32 = x; }
+  static inline void tc_put(native_value &v, int32_t x) { v.i32 = x; }
+  static inline void tc_put(native_value &v, uint64_t x) { v.i64 = x; }
+  static inline void tc_put(native_value &v, int64_t x) { v.i64 = x; }
+  static inline void tc_put(native_value &v, float x) { v.f32 = x; }
+  static inline void tc_put(native_value &v, double x) { v.f64 = x; }
+
+  // Executes the code at @pc until the frame of the caller is popped and
+  // returns the top of the stack.  Called with a null @self it only stores
+  // the handler table to @table.  It runs under the signal handler, which
+  // uses longjmp, so all locals must be trivially destructible.
+  EOS_VM_THREADED_NOINLINE static native_value *
+  run(threaded_execution_context *self, const tc_slot *pc, native_value *fp,
+      native_value *sp, const void *const **table = nullptr) {
+#define EOS_VM_TC_ENTRY(name) &&tc_##name,
+#define EOS_VM_TC_WASM_ENTRY(name, code) &&tc_##name,
+    static const void *const handlers[] = {
+        EOS_VM_THREADED_OPS(EOS_VM_TC_ENTRY, EOS_VM_TC_WASM_ENTRY)};
+#undef EOS_VM_TC_WASM_ENTRY
+#undef EOS_VM_TC_ENTRY
+    if (table) {
+      *table = handlers;
+      return nullptr;
+    }
+
+#define TC_NEXT(n)                                                             \
+  do {                                                                         \
+    pc += (n);                                                                 \
+    goto *pc->handler;                                                         \
+  } while (0)
+#define TC_JUMP(dest)                                                          \
+  do {                                                                         \
+    pc = (dest);                                                               \
+    goto *pc->handler;                                                         \
+  } while (0)
+#define TC_UNOP(name, T, expr)                                                 \
+  tc_##name : {                                                                \
+    const T x = tc_get<T>(*sp);                                                \
+    tc_put(*sp, expr);                                                         \
+    TC_NEXT(1);                                                                \
+  }
+#define TC_BINOP(name, T, expr)                                                \
+  tc_##name : {                                                                \
+    const T rhs = tc_get<T>(*sp--);                                            \
+    const T lhs = tc_get<T>(*sp);                                              \
+    tc_put(*sp, expr);                                                         \
+    TC_NEXT(1);                                                                \
+  }
+#define TC_DIVOP(name, T, zero_msg, expr)                                      \
+  tc_##name : {                                                                \
+    const T rhs = tc_get<T>(*sp--);                                            \
+    const T lhs = tc_get<T>(*sp);                                              \
+    EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception, zero_msg);             \
+    tc_put(*sp, expr);                                                         \
+    TC_NEXT(1);                                                                \
+  }
+#define TC_TRUNC(name, F, I, overflow, msg)                                    \
+  tc_##name : {                                                                \
+    const F x = tc_get<F>(*sp);                                                \
+    EOS_VM_ASSERT(!(overflow), wasm_interpreter_exception,                     \
+                  "Error, " msg " overflow");                                  \
+    EOS_VM_ASSERT(!__builtin_isnan(x), wasm_interpreter_exception,             \
+                  "Error, " msg " unrepresentable");                           \
+    tc_put(*sp, static_cast<I>(x));                                            \
+    TC_NEXT(1);                                                                \
+  }
+#define TC_LOAD(name, T, R)                                                    \
+  tc_##name : {                                                                \
+    T v;                                                                       \
+    std::memcpy(&v, mem + pc[1].u32[0] + sp->i32, sizeof(T));                  \
+    tc_put(*sp, static_cast<R>(v));                                            \
+    TC_NEXT(2);                                                                \
+  }
+#define TC_STORE(name, T, A)                                                   \
+  tc_##name : {                                                                \
+    const T v = static_cast<T>(tc_get<A>(*sp--));                              \
+    std::memcpy(mem + pc[1].u32[0] + sp->i32, &v, sizeof(T));                  \
+    --sp;                                                                      \
+    TC_NEXT(2);                                                                \
+  }
+
+    char *const mem = self->_linear_memory;
+    frame *csp = self->_csp;
+    frame *const csp_end = self->_frames + self->_max_call_depth + 1;
+    // shared by the call instructions
+    const tc_slot *target;
+    native_value *args;
+    uint32_t params, host_index, host_result;
+    goto *pc->handler;
+
+  tc_halt:
+    self->_csp = csp;
+    return sp;
+  tc_unreachable:
+    throw wasm_interpreter_exception{"unreachable"};
+  tc_error:
+    throw wasm_interpreter_exception{"invalid opcode"};
+  tc_enter:
+    for (uint32_t i = pc[1].u32[0]; i; --i)
+      (++sp)->i64 = 0;
+    TC_NEXT(2);
+
+  tc_br:
+    TC_JUMP(pc[1].target);
+  tc_br_drop:
+    sp -= pc[2].u32[0];
+    TC_JUMP(pc[1].target);
+  tc_br_keep : {
+    const native_value v = *sp;
+    sp -= pc[2].u32[0];
+    *sp = v;
+    TC_JUMP(pc[1].target);
+  }
+  tc_br_if:
+    if ((sp--)->i32)
+      TC_JUMP(pc[1].target);
+    TC_NEXT(2);
+  tc_br_if_drop:
+    if ((sp--)->i32) {
+      sp -= pc[2].u32[0];
+      TC_JUMP(pc[1].target);
+    }
+    TC_NEXT(3);
+  tc_br_if_keep:
+    if ((sp--)->i32) {
+      const native_value v = *sp;
+      sp -= pc[2].u32[0];
+      *sp = v;
+      TC_JUMP(pc[1].target);
+    }
+    TC_NEXT(3);
+  tc_if_:
+    if ((sp--)->i32)
+      TC_NEXT(2);
+    TC_JUMP(pc[1].target);
+  tc_br_table : {
+    const uint32_t i = (sp--)->i32;
+    const uint32_t size = pc[1].u32[0];
+    const tc_slot *elem = pc + 2 + 2 * (i < size ? i : size);
+    const uint32_t pop_info = elem[1].u32[0];
+    if (pop_info & tc_keep_result) {
+      const native_value v = *sp;
+      sp -= (pop_info & ~tc_keep_result) - 1;
+      *sp = v;
+    } else {
+      sp -= pop_info;
+    }
+    TC_JUMP(elem[0].target);
+  }
+
+  tc_ret:
+    if (pc[1].u32[0]) {
+      *fp = *sp;
+      sp = fp;
+    } else {
+      sp = fp - 1;
+    }
+    --csp;
+    fp = csp->fp;
+    TC_JUMP(csp->pc);
+  tc_call:
+    target = pc[1].target;
+    params = pc[2].u32[0];
+    goto do_call;
+  tc_call_host:
+    host_index = self->_mod.import_functions[pc[1].u32[0]];
+    params = pc[2].u32[0];
+    host_result = pc[2].u32[1];
+    goto do_call_host;
+  tc_call_indirect : {
+    const uint32_t elem = (sp--)->i32;
+    const auto &table = self->_mod.tables[0].table;
+    const auto &fast_functions = self->_mod.fast_functions;
+    EOS_VM_ASSERT(elem < table.size() && table[elem] < fast_functions.size(),
+                  wasm_interpreter_exception, "call_indirect out of range");
+    const uint32_t fn = table.at_no_check(elem);
+    EOS_VM_ASSERT(fast_functions.at_no_check(fn) == pc[1].u32[0],
+                  wasm_interpreter_exception,
+                  "call_indirect incorrect function type");
+    params = pc[2].u32[0];
+    if (fn < self->_imported_functions) {
+      host_index = self->_mod.import_functions[fn];
+      host_result = pc[2].u32[1];
+      goto do_call_host;
+    }
+    target = self->function_code(fn);
+    goto do_call;
+  }
+
+  do_call:
+    EOS_VM_ASSERT(csp != csp_end, wasm_interpreter_exception,
+                  "stack overflow");
+    *csp++ = frame{pc + 3, fp};
+    fp = sp - params + 1;
+    TC_JUMP(target);
+  do_call_host:
+    // host functions take the last param first
+    args = sp - params + 1;
+    std::reverse(args, sp + 1);
+    self->_sp = sp;
+    self->_csp = csp;
+    *args = self->_rhf.call_native(self->_host, *self, args, host_index);
+    if (self->_exit_requested)
+      goto tc_halt;
+    sp = host_result ? args : args - 1;
+    TC_NEXT(3);
+
+  tc_drop:
+    --sp;
+    TC_NEXT(1);
+  tc_select : {
+    const uint32_t cond = (sp--)->i32;
+    const native_value v = *sp--;
+    if (!cond)
+      *sp = v;
+    TC_NEXT(1);
+  }
+  tc_get_local:
+    *++sp = fp[pc[1].u32[0]];
+    TC_NEXT(2);
+  tc_set_local:
+    fp[pc[1].u32[0]] = *sp--;
+    TC_NEXT(2);
+  tc_tee_local:
+    fp[pc[1].u32[0]] = *sp;
+    TC_NEXT(2);
+  tc_get_global:
+    std::memcpy(++sp, pc[1].ptr, sizeof(native_value));
+    TC_NEXT(2);
+  tc_set_global:
+    std::memcpy(pc[1].ptr, sp--, sizeof(native_value));
+    TC_NEXT(2);
+  tc_constant:
+    *++sp = pc[1].value;
+    TC_NEXT(2);
+
+    TC_LOAD(i32_load, uint32_t, uint32_t)
+    TC_LOAD(i64_load, uint64_t, uint64_t)
+    TC_LOAD(f32_load, float, float)
+    TC_LOAD(f64_load, double, double)
+    TC_LOAD(i32_load8_s, int8_t, uint32_t)
+    TC_LOAD(i32_load8_u, uint8_t, uint32_t)
+    TC_LOAD(i32_load16_s, int16_t, uint32_t)
+    TC_LOAD(i32_load16_u, uint16_t, uint32_t)
+    TC_LOAD(i64_load8_s, int8_t, uint64_t)
+    TC_LOAD(i64_load8_u, uint8_t, uint64_t)
+    TC_LOAD(i64_load16_s, int16_t, uint64_t)
+    TC_LOAD(i64_load16_u, uint16_t, uint64_t)
+    TC_LOAD(i64_load32_s, int32_t, uint64_t)
+    TC_LOAD(i64_load32_u, uint32_t, uint64_t)
+    TC_STORE(i32_store, uint32_t, uint32_t)
+    TC_STORE(i64_store, uint64_t, uint64_t)
+    TC_STORE(f32_store, float, float)
+    TC_STORE(f64_store, double, double)
+    TC_STORE(i32_store8, uint8_t, uint32_t)
+    TC_STORE(i32_store16, uint16_t, uint32_t)
+    TC_STORE(i64_store8, uint8_t, uint64_t)
+    TC_STORE(i64_store16, uint16_t, uint64_t)
+    TC_STORE(i64_store32, uint32_t, uint64_t)
+  tc_current_memory:
+    (++sp)->i32 = self->current_linear_memory();
+    TC_NEXT(1);
+  tc_grow_memory:
+    sp->i32 = self->grow_linear_memory(static_cast<int32_t>(sp->i32));
+    TC_NEXT(1);
+  tc_memory_copy:
+    self->copy_linear_memory(sp[-2].i32, sp[-1].i32, sp->i32);
+    sp -= 3;
+    TC_NEXT(1);
+  tc_memory_fill:
+    self->fill_linear_memory(sp[-2].i32, static_cast<uint8_t>(sp[-1].i32),
+                             sp->i32);
+    sp -= 3;
+    TC_NEXT(1);
+
+    TC_UNOP(i32_eqz, uint32_t, x == 0)
+    TC_BINOP(i32_eq, uint32_t, lhs == rhs)
+    TC_BINOP(i32_ne, uint32_t, lhs != rhs)
+    TC_BINOP(i32_lt_s, int32_t, lhs < rhs)
+    TC_BINOP(i32_lt_u, uint32_t, lhs < rhs)
+    TC_BINOP(i32_gt_s, int32_t, lhs > rhs)
+    TC_BINOP(i32_gt_u, uint32_t, lhs > rhs)
+    TC_BINOP(i32_le_s, int32_t, lhs <= rhs)
+    TC_BINOP(i32_le_u, uint32_t, lhs <= rhs)
+    TC_BINOP(i32_ge_s, int32_t, lhs >= rhs)
+    TC_BINOP(i32_ge_u, uint32_t, lhs >= rhs)
+    TC_UNOP(i64_eqz, uint64_t, x == 0)
+    TC_BINOP(i64_eq, uint64_t, lhs == rhs)
+    TC_BINOP(i64_ne, uint64_t, lhs != rhs)
+    TC_BINOP(i64_lt_s, int64_t, lhs < rhs)
+    TC_BINOP(i64_lt_u, uint64_t, lhs < rhs)
+    TC_BINOP(i64_gt_s, int64_t, lhs > rhs)
+    TC_BINOP(i64_gt_u, uint64_t, lhs > rhs)
+    TC_BINOP(i64_le_s, int64_t, lhs <= rhs)
+    TC_BINOP(i64_le_u, uint64_t, lhs <= rhs)
+    TC_BINOP(i64_ge_s, int64_t, lhs >= rhs)
+    TC_BINOP(i64_ge_u, uint64_t, lhs >= rhs)
+    TC_BINOP(f32_eq, float, lhs == rhs)
+    TC_BINOP(f32_ne, float, lhs != rhs)
+    TC_BINOP(f32_lt, float, lhs < rhs)
+    TC_BINOP(f32_gt, float, lhs > rhs)
+    TC_BINOP(f32_le, float, lhs <= rhs)
+    TC_BINOP(f32_ge, float, lhs >= rhs)
+    TC_BINOP(f64_eq, double, lhs == rhs)
+    TC_BINOP(f64_ne, double, lhs != rhs)
+    TC_BINOP(f64_lt, double, lhs < rhs)
+    TC_BINOP(f64_gt, double, lhs > rhs)
+    TC_BINOP(f64_le, double, lhs <= rhs)
+    TC_BINOP(f64_ge, double, lhs >= rhs)
+
+    // __builtin_clz(0) is undefined
+    TC_UNOP(i32_clz, uint32_t, x == 0 ? 32u : uint32_t(__builtin_clz(x)))
+    TC_UNOP(i32_ctz, uint32_t, x == 0 ? 32u : uint32_t(__builtin_ctz(x)))
+    TC_UNOP(i32_popcnt, uint32_t, uint32_t(__builtin_popcount(x)))
+    TC_BINOP(i32_add, uint32_t, lhs + rhs)
+    TC_BINOP(i32_sub, uint32_t, lhs - rhs)
+    TC_BINOP(i32_mul, uint32_t, lhs * rhs)
+  tc_i32_div_s : {
+    const int32_t rhs = tc_get<int32_t>(*sp--);
+    const int32_t lhs = tc_get<int32_t>(*sp);
+    EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception,
+                  "i32.div_s divide by zero");
+    EOS_VM_ASSERT(!(lhs == std::numeric_limits<int32_t>::min() && rhs == -1),
+                  wasm_interpreter_exception,
+                  "i32.div_s traps when I32_MAX/-1");
+    tc_put(*sp, lhs / rhs);
+    TC_NEXT(1);
+  }
+    TC_DIVOP(i32_div_u, uint32_t, "i32.div_u divide by zero", lhs / rhs)
+    TC_DIVOP(i32_rem_s, int32_t, "i32.rem_s divide by zero",
+             UNLIKELY(lhs == std::numeric_limits<int32_t>::min() && rhs == -1)
+                 ? 0
+                 : lhs % rhs)
+    TC_DIVOP(i32_rem_u, uint32_t, "i32.rem_u divide by zero", lhs % rhs)
+    TC_BINOP(i32_and, uint32_t, lhs & rhs)
+    TC_BINOP(i32_or, uint32_t, lhs | rhs)
+    TC_BINOP(i32_xor, uint32_t, lhs ^ rhs)
+    TC_BINOP(i32_shl, uint32_t, lhs << (rhs & 31))
+    TC_BINOP(i32_shr_s, int32_t, lhs >> (rhs & 31))
+    TC_BINOP(i32_shr_u, uint32_t, lhs >> (rhs & 31))
+    TC_BINOP(i32_rotl, uint32_t, (lhs << (rhs & 31)) | (lhs >> (-rhs & 31)))
+    TC_BINOP(i32_rotr, uint32_t, (lhs >> (rhs & 31)) | (lhs << (-rhs & 31)))
+    TC_UNOP(i64_clz, uint64_t, x == 0 ? 64u : uint64_t(__builtin_clzll(x)))
+    TC_UNOP(i64_ctz, uint64_t, x == 0 ? 64u : uint64_t(__builtin_ctzll(x)))
+    TC_UNOP(i64_popcnt, uint64_t, uint64_t(__builtin_popcountll(x)))
+    TC_BINOP(i64_add, uint64_t, lhs + rhs)
+    TC_BINOP(i64_sub, uint64_t, lhs - rhs)
+    TC_BINOP(i64_mul, uint64_t, lhs * rhs)
+  tc_i64_div_s : {
+    const int64_t rhs = tc_get<int64_t>(*sp--);
+    const int64_t lhs = tc_get<int64_t>(*sp);
+    EOS_VM_ASSERT(rhs != 0, wasm_interpreter_exception,
+                  "i64.div_s divide by zero");
+    EOS_VM_ASSERT(!(lhs == std::numeric_limits<int64_t>::min() && rhs == -1),
+                  wasm_interpreter_exception,
+                  "i64.div_s traps when I64_MAX/-1");
+    tc_put(*sp, lhs / rhs);
+    TC_NEXT(1);
+  }
+    TC_DIVOP(i64_div_u, uint64_t, "i64.div_u divide by zero", lhs / rhs)
+    TC_DIVOP(i64_rem_s, int64_t, "i64.rem_s divide by zero",
+             UNLIKELY(lhs == std::numeric_limits<int64_t>::min() && rhs == -1)
+                 ? 0
+                 : lhs % rhs)
+    TC_DIVOP(i64_rem_u, uint64_t, "i64.rem_u divide by zero", lhs % rhs)
+    TC_BINOP(i64_and, uint64_t, lhs & rhs)
+    TC_BINOP(i64_or, uint64_t, lhs | rhs)
+    TC_BINOP(i64_xor, uint64_t, lhs ^ rhs)
+    TC_BINOP(i64_shl, uint64_t, lhs << (rhs & 63))
+    TC_BINOP(i64_shr_s, int64_t, lhs >> (rhs & 63))
+    TC_BINOP(i64_shr_u, uint64_t, lhs >> (rhs & 63))
+    TC_BINOP(i64_rotl, uint64_t, (lhs << (rhs & 63)) | (lhs >> (-rhs & 63)))
+    TC_BINOP(i64_rotr, uint64_t, (lhs >> (rhs & 63)) | (lhs << (-rhs & 63)))
+
+    TC_UNOP(f32_abs, float, __builtin_fabsf(x))
+    TC_UNOP(f32_neg, float, -x)
+    TC_UNOP(f32_ceil, float, __builtin_ceilf(x))
+    TC_UNOP(f32_floor, float, __builtin_floorf(x))
+    TC_UNOP(f32_trunc, float, __builtin_truncf(x))
+    TC_UNOP(f32_nearest, float, __builtin_nearbyintf(x))
+    TC_UNOP(f32_sqrt, float, __builtin_sqrtf(x))
+    TC_BINOP(f32_add, float, lhs + rhs)
+    TC_BINOP(f32_sub, float, lhs - rhs)
+    TC_BINOP(f32_mul, float, lhs * rhs)
+    TC_BINOP(f32_div, float, lhs / rhs)
+    TC_BINOP(f32_min, float, __builtin_fminf(lhs, rhs))
+    TC_BINOP(f32_max, float, __builtin_fmaxf(lhs, rhs))
+    TC_BINOP(f32_copysign, float, __builtin_copysignf(lhs, rhs))
+    TC_UNOP(f64_abs, double, __builtin_fabs(x))
+    TC_UNOP(f64_neg, double, -x)
+    TC_UNOP(f64_ceil, double, __builtin_ceil(x))
+    TC_UNOP(f64_floor, double, __builtin_floor(x))
+    TC_UNOP(f64_trunc, double, __builtin_trunc(x))
+    TC_UNOP(f64_nearest, double, __builtin_nearbyint(x))
+    TC_UNOP(f64_sqrt, double, __builtin_sqrt(x))
+    TC_BINOP(f64_add, double, lhs + rhs)
+    TC_BINOP(f64_sub, double, lhs - rhs)
+    TC_BINOP(f64_mul, double, lhs * rhs)
+    TC_BINOP(f64_div, double, lhs / rhs)
+    TC_BINOP(f64_min, double, __builtin_fmin(lhs, rhs))
+    TC_BINOP(f64_max, double, __builtin_fmax(lhs, rhs))
+    TC_BINOP(f64_copysign, double, __builtin_copysign(lhs, rhs))
+
+    TC_UNOP(i32_wrap_i64, uint64_t, static_cast<uint32_t>(x))
+    TC_TRUNC(i32_trunc_s_f32, float, int32_t,
+             x >= 2147483648.0f || x < -2147483648.0f, "f32.trunc_s/i32")
+    TC_TRUNC(i32_trunc_u_f32, float, uint32_t,
+             x >= 4294967296.0f || x <= -1.0f, "f32.trunc_u/i32")
+    TC_TRUNC(i32_trunc_s_f64, double, int32_t,
+             x >= 2147483648.0 || x < -2147483648.0, "f64.trunc_s/i32")
+    TC_TRUNC(i32_trunc_u_f64, double, uint32_t,
+             x >= 4294967296.0 || x <= -1.0, "f64.trunc_u/i32")
+    TC_UNOP(i64_extend_s_i32, int32_t, static_cast<int64_t>(x))
+    TC_UNOP(i64_extend_u_i32, uint32_t, static_cast<uint64_t>(x))
+    TC_TRUNC(i64_trunc_s_f32, float, int64_t,
+             x >= 9223372036854775808.0f || x < -9223372036854775808.0f,
+             "f32.trunc_s/i64")
+    TC_TRUNC(i64_trunc_u_f32, float, uint64_t,
+             x >= 18446744073709551616.0f || x <= -1.0f, "f32.trunc_u/i64")
+    TC_TRUNC(i64_trunc_s_f64, double, int64_t,
+             x >= 9223372036854775808.0 || x < -9223372036854775808.0,
+             "f64.trunc_s/i64")
+    TC_TRUNC(i64_trunc_u_f64, double, uint64_t,
+             x >= 18446744073709551616.0 || x <= -1.0, "f64.trunc_u/i64")
+    TC_UNOP(f32_convert_s_i32, int32_t, static_cast<float>(x))
+    TC_UNOP(f32_convert_u_i32, uint32_t, static_cast<float>(x))
+    TC_UNOP(f32_convert_s_i64, int64_t, static_cast<float>(x))
+    TC_UNOP(f32_convert_u_i64, uint64_t, static_cast<float>(x))
+    TC_UNOP(f32_demote_f64, double, static_cast<float>(x))
+    TC_UNOP(f64_convert_s_i32, int32_t, static_cast<double>(x))
+    TC_UNOP(f64_convert_u_i32, uint32_t, static_cast<double>(x))
+    TC_UNOP(f64_convert_s_i64, int64_t, static_cast<double>(x))
+    TC_UNOP(f64_convert_u_i64, uint64_t, static_cast<double>(x))
+    TC_UNOP(f64_promote_f32, float, static_cast<double>(x))
+    // the bits are kept as they are
+  tc_i32_reinterpret_f32:
+  tc_i64_reinterpret_f64:
+  tc_f32_reinterpret_i32:
+  tc_f64_reinterpret_i64:
+    TC_NEXT(1);
+
+  tc_i32_add_local:
+    sp->i32 += fp[pc[1].u32[0]].i32;
+    TC_NEXT(2);
+  tc_i64_add_local:
+    sp->i64 += fp[pc[1].u32[0]].i64;
+    TC_NEXT(2);
+  tc_i32_add_imm:
+    sp->i32 += pc[1].u32[0];
+    TC_NEXT(2);
+  tc_i64_load_local : {
+    const uint32_t addr = fp[pc[1].u32[0]].i32;
+    ++sp;
+    std::memcpy(&sp->i64, mem + pc[2].u32[0] + addr, sizeof(uint64_t));
+    TC_NEXT(3);
+  }
+  tc_i64_load_store : {
+    uint64_t v;
+    std::memcpy(&v, mem + pc[1].u32[0] + sp->i32, sizeof(v));
+    --sp;
+    std::memcpy(mem + pc[2].u32[0] + sp->i32, &v, sizeof(v));
+    --sp;
+    TC_NEXT(3);
+  }
+  tc_br_unless:
+    if (!(sp--)->i32)
+      TC_JUMP(pc[1].target);
+    TC_NEXT(2);
+  tc_copy_local:
+    fp[pc[2].u32[0]] = fp[pc[1].u32[0]];
+    TC_NEXT(3);
+
+#undef TC_STORE
+#undef TC_LOAD
+#undef TC_TRUNC
+#undef TC_DIVOP
+#undef TC_BINOP
+#undef TC_UNOP
+#undef TC_JUMP
+#undef TC_NEXT
+  }
+
+  static std::size_t stack_size(const module &m, uint32_t depth) {
+    return (m.maximum_stack + 2) * (depth + 1) + 1;
+  }
+
+  Host *_host = nullptr;
+  uint32_t _imported_functions;
+  std::size_t _stack_size;
+  std::unique_ptr<native_value[]> _stack;
+  native_value *_sp;
+  frame _frames[constants::max_call_depth + 1];
+  frame *_csp = _frames;
+  tc_slot _halt;
+};
+
 template <typename Host>
 class execution_context
     : public execution_context_base<execution_context<Host>, Host> {
@@ -373,15 +1047,16 @@ public:
     // TODO validate index is valid
     if (index < _mod.get_imported_functions_size()) {
       // TODO validate only importing functions
-      const auto &ft = _mod.types[_mod.imports[index].type.func_t];
-      type_check(ft);
       inc_pc();
       push_call(activation_frame{nullptr, 0});
       _rhf(_state.host, *this, _mod.import_functions[index]);
       pop_call();
+      // the host function ended the execution, see exit_requested()
+      if (this->_exit_requested) {
+        this->_exit_requested = false;
+        exit();
+      }
     } else {
-      // const auto& ft = _mod.types[_mod.functions[index -
-      // _mod.get_imported_functions_size()]]; type_check(ft);
       push_call(index);
       setup_locals(index);
       set_pc(_mod.get_function_pc(index));
@@ -390,33 +1065,21 @@ public:
 
   void print_stack() {
     std::cout << "STACK { ";
-    for (int i = 0; i < _os.size(); i++) {
-      std::cout << "(" << i << ")";
-      visit(
-          overloaded{
-              [&](i32_const_t el) {
-                std::cout << "i32:" << el.data.ui << ", ";
-              },
-              [&](i64_const_t el) {
-                std::cout << "i64:" << el.data.ui << ", ";
-              },
-              [&](f32_const_t el) { std::cout << "f32:" << el.data.f << ", "; },
-              [&](f64_const_t el) { std::cout << "f64:" << el.data.f << ", "; },
-              [&](auto el) { std::cout << "(INDEX " << el.index() << "), "; }},
-          _os.get(i));
-    }
+    for (int i = 0; i < _os.size(); i++)
+      std::cout << "(" << i << ")" << std::hex << _os.get(i).to_ui64()
+                << std::dec << ", ";
     std::cout << " }\n";
   }
 
   inline operand_stack &get_operand_stack() { return _os; }
   inline uint32_t table_elem(uint32_t i) { return _mod.tables[0].table[i]; }
-  inline void push_operand(operand_stack_elem el) { _os.push(std::move(el)); }
-  inline operand_stack_elem get_operand(uint16_t index) const {
+  inline void push_operand(stack_slot el) { _os.push(std::move(el)); }
+  inline stack_slot get_operand(uint16_t index) const {
     return _os.get(_last_op_index + index);
   }
   inline void eat_operands(uint16_t index) { _os.eat(index); }
   inline void compact_operand(uint16_t index) { _os.compact(index); }
-  inline void set_operand(uint16_t index, const operand_stack_elem &el) {
+  inline void set_operand(uint16_t index, const stack_slot &el) {
     _os.set(_last_op_index + index, el);
   }
   inline uint16_t current_operands_index() const { return _os.current_index(); }
@@ -428,6 +1091,8 @@ public:
     if constexpr (!Should_Exit)
       return_pc = _state.pc + 1;
 
+    EOS_VM_ASSERT(_as.size() <= this->_max_call_depth,
+                  wasm_interpreter_exception, "call depth exceeded");
     _as.push(activation_frame{return_pc, _last_op_index});
     _last_op_index =
         _os.size() - _mod.get_function_type(index).param_types.size();
@@ -442,103 +1107,47 @@ public:
     else
       eat_operands(_os.size() - num_locals);
   }
-  inline operand_stack_elem pop_operand() { return _os.pop(); }
-  inline operand_stack_elem &peek_operand(size_t i = 0) { return _os.peek(i); }
-  inline operand_stack_elem get_global(uint32_t index) {
+  inline stack_slot pop_operand() { return _os.pop(); }
+  inline stack_slot &peek_operand(size_t i = 0) { return _os.peek(i); }
+  inline stack_slot get_global(uint32_t index) {
     EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception,
                   "global index out of range");
-    const auto &gl = _mod.globals[index];
+    const auto &gl = _mod.globals.at_no_check(index);
     switch (gl.type.content_type) {
     case types::i32:
+    case types::f32:
       return i32_const_t{*(uint32_t *)&gl.current.value.i32};
     case types::i64:
-      return i64_const_t{*(uint64_t *)&gl.current.value.i64};
-    case types::f32:
-      return f32_const_t{gl.current.value.f32};
     case types::f64:
-      return f64_const_t{gl.current.value.f64};
+      return i64_const_t{*(uint64_t *)&gl.current.value.i64};
     default:
       throw wasm_interpreter_exception{"invalid global type"};
     }
   }
 
-  inline void set_global(uint32_t index, const operand_stack_elem &el) {
+  // the operand type is guaranteed by validation
+  inline void set_global(uint32_t index, const stack_slot &el) {
     EOS_VM_ASSERT(index < _mod.globals.size(), wasm_interpreter_exception,
                   "global index out of range");
-    auto &gl = _mod.globals[index];
+    auto &gl = _mod.globals.at_no_check(index);
     EOS_VM_ASSERT(gl.type.mutability, wasm_interpreter_exception,
                   "global is not mutable");
-    visit(overloaded{[&](const i32_const_t &i) {
-                       EOS_VM_ASSERT(gl.type.content_type == types::i32,
-                                     wasm_interpreter_exception,
-                                     "expected i32 global type");
-                       gl.current.value.i32 = i.data.ui;
-                     },
-                     [&](const i64_const_t &i) {
-                       EOS_VM_ASSERT(gl.type.content_type == types::i64,
-                                     wasm_interpreter_exception,
-                                     "expected i64 global type");
-                       gl.current.value.i64 = i.data.ui;
-                     },
-                     [&](const f32_const_t &f) {
-                       EOS_VM_ASSERT(gl.type.content_type == types::f32,
-                                     wasm_interpreter_exception,
-                                     "expected f32 global type");
-                       gl.current.value.f32 = f.data.ui;
-                     },
-                     [&](const f64_const_t &f) {
-                       EOS_VM_ASSERT(gl.type.content_type == types::f64,
-                                     wasm_interpreter_exception,
-                                     "expected f64 global type");
-                       gl.current.value.f64 = f.data.ui;
-                     },
-                     [](auto) {
-                       throw wasm_interpreter_exception{"invalid global type"};
-                     }},
-          el);
-  }
-
-  inline bool is_true(const operand_stack_elem &el) {
-    bool ret_val = false;
-    visit(overloaded{[&](const i32_const_t &i32) { ret_val = i32.data.ui; },
-                     [&](auto) {
-                       throw wasm_invalid_element{"should be an i32 type"};
-                     }},
-          el);
-    return ret_val;
-  }
-
-  inline void type_check(const func_type &ft) {
-    for (uint32_t i = 0; i < ft.param_types.size(); i++) {
-      const auto &op = peek_operand((ft.param_types.size() - 1) - i);
-      visit(overloaded{[&](const i32_const_t &) {
-                         EOS_VM_ASSERT(ft.param_types[i] == types::i32,
-                                       wasm_interpreter_exception,
-                                       "function param type mismatch");
-                       },
-                       [&](const f32_const_t &) {
-                         EOS_VM_ASSERT(ft.param_types[i] == types::f32,
-                                       wasm_interpreter_exception,
-                                       "function param type mismatch");
-                       },
-                       [&](const i64_const_t &) {
-                         EOS_VM_ASSERT(ft.param_types[i] == types::i64,
-                                       wasm_interpreter_exception,
-                                       "function param type mismatch");
-                       },
-                       [&](const f64_const_t &) {
-                         EOS_VM_ASSERT(ft.param_types[i] == types::f64,
-                                       wasm_interpreter_exception,
-                                       "function param type mismatch");
-                       },
-                       [&](auto) {
-                         throw wasm_interpreter_exception{
-                             "function param invalid type"};
-                       }},
-            op);
+    switch (gl.type.content_type) {
+    case types::i32:
+    case types::f32:
+      gl.current.value.i32 = el.to_ui32();
+      break;
+    case types::i64:
+    case types::f64:
+      gl.current.value.i64 = el.to_ui64();
+      break;
+    default:
+      throw wasm_interpreter_exception{"invalid global type"};
     }
   }
 
+  inline bool is_true(const stack_slot &el) { return el.to_ui32() != 0; }
+
   inline opcode *get_pc() const { return _state.pc; }
   inline void set_relative_pc(uint32_t pc_offset) {
     _state.pc = _mod.code[0].code + pc_offset;
@@ -551,8 +1160,8 @@ public:
     _state.exiting = true;
   }
 
-  inline void reset() {
-    base_type::reset();
+  inline void reset(const instance_snapshot *snapshot = nullptr) {
+    base_type::reset(snapshot);
     _state = execution_state{};
     _os.eat(_state.os_index);
     _as.eat(_state.as_index);
@@ -605,12 +1214,16 @@ public:
       _last_op_index = last_last_op_index;
     });
 
-    push_args(args...);
+    const func_type &ft = _mod.get_function_type(func_index);
+    push_args(ft, args...);
     push_call<true>(func_index);
-    type_check(_mod.get_function_type(func_index));
 
     if (func_index < _mod.get_imported_functions_size()) {
       _rhf(_state.host, *this, _mod.import_functions[func_index]);
+      if (this->_exit_requested) {
+        this->_exit_requested = false;
+        exit();
+      }
     } else {
       _state.pc = _mod.get_function_pc(func_index);
       setup_locals(func_index);
@@ -618,8 +1231,8 @@ public:
                                      &handle_signal);
     }
 
-    if (_mod.get_function_type(func_index).return_count && !_state.exiting) {
-      return pop_operand();
+    if (ft.return_count && !_state.exiting) {
+      return pop_operand().to_elem(ft.return_type);
     } else {
       return {};
     }
@@ -637,32 +1250,35 @@ public:
   }
 
 private:
-  template <typename... Args> void push_args(Args &&... args) {
-    (...,
-     push_operand(detail::resolve_result(std::move(args), this->_wasm_alloc)));
+  // Operands are untyped once they are on the stack, the arguments from the
+  // caller are the only ones that have not been validated.
+  template <typename... Args>
+  void push_args(const func_type &ft, Args &&... args) {
+    EOS_VM_ASSERT(sizeof...(Args) == ft.param_types.size(),
+                  wasm_interpreter_exception, "function param count mismatch");
+    uint32_t i = 0;
+    (..., push_arg(ft.param_types[i++],
+                   detail::resolve_result(std::move(args), this->_wasm_alloc)));
   }
 
+  template <typename T> void push_arg(uint8_t type, const T &arg) {
+    constexpr uint8_t arg_type = std::is_same_v<T, i32_const_t>   ? types::i32
+                                 : std::is_same_v<T, i64_const_t> ? types::i64
+                                 : std::is_same_v<T, f32_const_t> ? types::f32
+                                                                  : types::f64;
+    EOS_VM_ASSERT(type == arg_type, wasm_interpreter_exception,
+                  "function param type mismatch");
+    push_operand(arg);
+  }
+
+  // the params and locals of a function are contiguous raw slots, addressed
+  // relative to _last_op_index
   inline void setup_locals(uint32_t index) {
     const auto &fn = _mod.code[index - _mod.get_imported_functions_size()];
-    for (uint32_t i = 0; i < fn.locals.size(); i++) {
-      for (uint32_t j = 0; j < fn.locals[i].count; j++)
-        switch (fn.locals[i].type) {
-        case types::i32:
-          push_operand(i32_const_t{(uint32_t)0});
-          break;
-        case types::i64:
-          push_operand(i64_const_t{(uint64_t)0});
-          break;
-        case types::f32:
-          push_operand(f32_const_t{(uint32_t)0});
-          break;
-        case types::f64:
-          push_operand(f64_const_t{(uint64_t)0});
-          break;
-        default:
-          throw wasm_interpreter_exception{"invalid function param type"};
-        }
-    }
+    uint32_t count = 0;
+    for (uint32_t i = 0; i < fn.locals.size(); i++)
+      count += fn.locals.at_no_check(i).count;
+    _os.push_zeroed(count);
   }
 
 #define CREATE_TABLE_ENTRY(NAME, CODE) &&ev_label_##NAME,
@@ -693,6 +1309,8 @@ private:
                                                 CREATE_TABLE_ENTRY)
                                                 EOS_VM_EXIT_OP(
                                                     CREATE_TABLE_ENTRY)
+                                                    EOS_VM_BULK_MEMORY_OPS(
+                                                        CREATE_TABLE_ENTRY)
                                                     EOS_VM_EMPTY_OPS(
                                                         CREATE_TABLE_ENTRY)
                                                         EOS_VM_ERROR_OPS(
@@ -717,6 +1335,7 @@ private:
       EOS_VM_NUMERIC_OPS(CREATE_LABEL);
       EOS_VM_CONVERSION_OPS(CREATE_LABEL);
       EOS_VM_EXIT_OP(CREATE_EXIT_LABEL);
+      EOS_VM_BULK_MEMORY_OPS(CREATE_LABEL);
       EOS_VM_EMPTY_OPS(CREATE_EMPTY_LABEL);
       EOS_VM_ERROR_OPS(CREATE_LABEL);
     __ev_last:
@@ -738,7 +1357,7 @@ private:
 
   bounded_allocator _base_allocator = {
       (constants::max_stack_size + constants::max_call_depth + 1) *
-      (std::max(sizeof(operand_stack_elem), sizeof(activation_frame)))};
+      (std::max(sizeof(stack_slot), sizeof(activation_frame)))};
   execution_state _state;
   uint16_t _last_op_index = 0;
   call_stack _as = {_base_allocator};
@@ -92,6 +92,14 @@ template <typename T> struct guarded_ptr {
 
   inline size_t bounds() { return bnds - orig_ptr; }
 
+  // The elements left before the bounds.
+  inline size_t remaining() const { return bnds - raw_ptr; }
+
+  // Unchecked reads, for callers which made sure that remaining() covers
+  // them.
+  inline T peek_unchecked() const { return *raw_ptr; }
+  inline T next_unchecked() { return *raw_ptr++; }
+
   inline T at(size_t index) const {
     EOS_VM_ASSERT(index < static_cast<std::size_t>(bnds - raw_ptr),
                   guarded_ptr_exception, "accessing out of bounds");
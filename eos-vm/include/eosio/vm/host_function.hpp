@@ -6,6 +6,7 @@
 
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <functional>
 #include <limits>
 #include <memory>
@@ -496,6 +497,62 @@ auto create_function(std::index_sequence<Is...>) {
       }};
 }
 
+// Arguments as the jit passes them to host functions, the last parameter
+// first.  get_back() mirrors operand_stack so that pack_args and the
+// wasm_type_converter lookups are shared with the interpreter.
+struct native_arg {
+  const native_value &value;
+  template <typename T> T get() const {
+    if constexpr (std::is_same_v<T, i32_const_t>)
+      return T{value.i32};
+    else if constexpr (std::is_same_v<T, i64_const_t>)
+      return T{value.i64};
+    else if constexpr (std::is_same_v<T, f32_const_t>)
+      return T{value.f32};
+    else
+      return T{value.f64};
+  }
+};
+
+struct native_args {
+  const native_value *stack;
+  native_arg get_back(std::size_t i) const { return {stack[i]}; }
+};
+
+template <typename T> native_value to_native_value(const T &res) {
+  // guarantee that the junk bits are zero, to avoid problems.
+  native_value result{uint64_t{0}};
+  std::memcpy(&result, &res.data, sizeof(res.data));
+  return result;
+}
+
+template <typename Walloc, typename Cls, typename Cls2, auto F, typename R,
+          typename Args, size_t... Is>
+native_value call_native_function(Cls *self, Walloc *walloc,
+                                  const native_value *stack) {
+  native_args args{stack};
+  if constexpr (std::is_void_v<R>) {
+    invoke_with_cons<F, Cls2>(self,
+                              detail::pack_args<Args>::apply(walloc, args),
+                              std::index_sequence<Is...>{});
+    return native_value{uint64_t{0}};
+  } else {
+    return to_native_value(detail::resolve_result(
+        invoke_with_cons<F, Cls2>(self,
+                                  detail::pack_args<Args>::apply(walloc, args),
+                                  std::index_sequence<Is...>{}),
+        walloc));
+  }
+}
+
+// A direct trampoline for the jit, which has the arguments in native form
+// already and does not need to go through an operand_stack.
+template <typename Walloc, typename Cls, typename Cls2, auto F, typename R,
+          typename Args, size_t... Is>
+auto create_native_function(std::index_sequence<Is...>) {
+  return &call_native_function<Walloc, Cls, Cls2, F, R, Args, Is...>;
+}
+
 template <typename T> constexpr auto to_wasm_type_v = to_wasm_type<T>();
 
 struct host_function {
@@ -541,6 +598,8 @@ template <typename Cls> struct registered_host_functions {
     std::vector<host_function> host_functions;
     std::vector<std::function<void(Cls *, WAlloc *, operand_stack &)>>
         functions;
+    std::vector<native_value (*)(Cls *, WAlloc *, const native_value *)>
+        native_functions;
     size_t current_index = 0;
   };
 
@@ -561,6 +620,9 @@ template <typename Cls> struct registered_host_functions {
         current_mappings.current_index++;
     current_mappings.functions.push_back(
         create_function<WAlloc, Cls, Cls2, Func, res_t, deduced_full_ts>(is));
+    current_mappings.native_functions.push_back(
+        create_native_function<WAlloc, Cls, Cls2, Func, res_t,
+                               deduced_full_ts>(is));
   }
 
   template <typename Module> static void resolve(Module &mod) {
@@ -587,6 +649,14 @@ template <typename Cls> struct registered_host_functions {
     const auto &_func = get_mappings<wasm_allocator>().functions[index];
     std::invoke(_func, host, ctx.get_wasm_allocator(), ctx.get_operand_stack());
   }
+
+  // @args holds the arguments last parameter first, as laid out by the jit.
+  template <typename Execution_Context>
+  native_value call_native(Cls *host, Execution_Context &ctx,
+                           const native_value *args, uint32_t index) {
+    const auto _func = get_mappings<wasm_allocator>().native_functions[index];
+    return _func(host, ctx.get_wasm_allocator(), args);
+  }
 };
 
 template <typename Cls, typename Cls2, auto F> struct registered_function {
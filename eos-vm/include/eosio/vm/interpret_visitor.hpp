@@ -289,6 +289,20 @@ template <typename ExecutionContext> struct interpret_visitor : base_visitor {
     auto &oper = context.peek_operand().to_ui32();
     oper = context.grow_linear_memory(oper);
   }
+  [[gnu::always_inline]] inline void operator()(const memory_copy_t &op) {
+    context.inc_pc();
+    uint32_t count = context.pop_operand().to_ui32();
+    uint32_t src = context.pop_operand().to_ui32();
+    uint32_t dest = context.pop_operand().to_ui32();
+    context.copy_linear_memory(dest, src, count);
+  }
+  [[gnu::always_inline]] inline void operator()(const memory_fill_t &op) {
+    context.inc_pc();
+    uint32_t count = context.pop_operand().to_ui32();
+    uint32_t value = context.pop_operand().to_ui32();
+    uint32_t dest = context.pop_operand().to_ui32();
+    context.fill_linear_memory(dest, static_cast<uint8_t>(value), count);
+  }
   [[gnu::always_inline]] inline void operator()(const i32_const_t &op) {
     context.inc_pc();
     context.push_operand(op);
@@ -6,9 +6,18 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <type_traits>
 
+#if defined(__x86_64__)
+#define EOS_VM_LEB128_FAST 1
+#include <emmintrin.h>
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif
+#endif
+
 namespace eosio {
 namespace vm {
 template <size_t N> inline size_t constexpr bytes_needed() {
@@ -216,5 +225,99 @@ private:
   uint8_t bytes_used = bytes_needed<N>();
 };
 
+#ifdef EOS_VM_LEB128_FAST
+namespace detail {
+// A single unaligned load covers the longest encoding, so the fast path
+// needs no bound checks while this many bytes remain.
+constexpr size_t leb128_fast_bytes = 16;
+
+// @returns the length of the encoding starting at @p, one more than the
+// longest encoding when none of the 16 bytes terminates it.
+inline uint32_t leb128_length(const uint8_t *p) {
+  uint32_t more = _mm_movemask_epi8(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)));
+  return __builtin_ctz(~more) + 1;
+}
+
+// Packs the low seven bits of the eight bytes of @x into 56 bits.
+inline uint64_t leb128_pack(uint64_t x) {
+#ifdef __BMI2__
+  return _pext_u64(x, 0x7f7f7f7f7f7f7f7full);
+#else
+  x &= 0x7f7f7f7f7f7f7f7full;
+  x = ((x & 0x7f007f007f007f00ull) >> 1) | (x & 0x007f007f007f007full);
+  x = ((x & 0x3fff00003fff0000ull) >> 2) | (x & 0x00003fff00003fffull);
+  x = ((x & 0x0fffffff00000000ull) >> 4) | (x & 0x000000000fffffffull);
+  return x;
+#endif
+}
+
+// Same checks and result as varuint<N> / varint<N>, for a buffer with at
+// least leb128_fast_bytes left.
+template <size_t N, bool Signed>
+inline uint64_t leb128_decode_fast(guarded_ptr<uint8_t> &code) {
+  const uint8_t *p = code.raw();
+  uint32_t len = leb128_length(p);
+  EOS_VM_ASSERT(len <= bytes_needed<N>(), wasm_interpreter_exception,
+                "incorrect leb128 encoding");
+  uint64_t word;
+  memcpy(&word, p, sizeof(word));
+  if (len < 8)
+    word &= (uint64_t(1) << (8 * len)) - 1;
+  uint64_t ret = leb128_pack(word);
+  if constexpr (bytes_needed<N>() > 8) {
+    if (len > 8)
+      ret |= (uint64_t(p[8] & 0x7f) | (len > 9 ? uint64_t(p[9]) << 7 : 0))
+             << 56;
+  }
+
+  uint8_t last = p[len - 1];
+  if (len == bytes_needed<N>()) {
+    uint32_t offset = N - 7 * (bytes_needed<N>() - 1);
+    uint8_t mask = static_cast<uint8_t>(~(uint32_t)0 << offset) & 0x7F;
+    if constexpr (Signed) {
+      uint8_t expected = (last & (uint32_t(1) << (offset - 1))) ? mask : 0;
+      EOS_VM_ASSERT(
+          (mask & last) == expected, wasm_parse_exception,
+          "unused bits of signed leb128 must be the same as the sign bit");
+    } else {
+      EOS_VM_ASSERT((mask & last) == 0, wasm_parse_exception,
+                    "unused bits of unsigned leb128 must be 0");
+    }
+  } else if (Signed && (last & 0x40)) {
+    ret |= (-1ull) << (7 * len);
+  }
+  code += len;
+  return ret;
+}
+} // namespace detail
+#endif
+
+// Decoders used by the binary parser. They take the branch-light fast path
+// away from the end of the buffer and the checked byte-wise one near it.
+inline uint32_t read_varuint32(guarded_ptr<uint8_t> &code) {
+#ifdef EOS_VM_LEB128_FAST
+  if (code.bounds() - code.offset() >= detail::leb128_fast_bytes)
+    return static_cast<uint32_t>(detail::leb128_decode_fast<32, false>(code));
+#endif
+  return varuint<32>(code).to();
+}
+
+inline int32_t read_varint32(guarded_ptr<uint8_t> &code) {
+#ifdef EOS_VM_LEB128_FAST
+  if (code.bounds() - code.offset() >= detail::leb128_fast_bytes)
+    return static_cast<int32_t>(detail::leb128_decode_fast<32, true>(code));
+#endif
+  return varint<32>(code).to();
+}
+
+inline int64_t read_varint64(guarded_ptr<uint8_t> &code) {
+#ifdef EOS_VM_LEB128_FAST
+  if (code.bounds() - code.offset() >= detail::leb128_fast_bytes)
+    return static_cast<int64_t>(detail::leb128_decode_fast<64, true>(code));
+#endif
+  return varint<64>(code).to();
+}
+
 } // namespace vm
 } // namespace eosio
@@ -70,6 +70,7 @@ template <typename Stream> struct memory_dump_visitor {
   EOS_VM_NUMERIC_OPS(MEMORY_DUMP_OP_VISIT)
   EOS_VM_CONVERSION_OPS(MEMORY_DUMP_OP_VISIT)
   EOS_VM_EXIT_OP(MEMORY_DUMP_OP_VISIT)
+  EOS_VM_BULK_MEMORY_OPS(MEMORY_DUMP_OP_VISIT)
   EOS_VM_EMPTY_OPS(MEMORY_DUMP_OP_VISIT)
   EOS_VM_ERROR_OPS(MEMORY_DUMP_OP_VISIT)
   template <typename T> inline void operator()(T) {
@@ -20,9 +20,13 @@ enum opcodes {
                               EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_ENUM)
                                   EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_ENUM)
                                       EOS_VM_EXIT_OP(EOS_VM_CREATE_ENUM)
+                                          EOS_VM_BULK_MEMORY_OPS(EOS_VM_CREATE_ENUM)
                                           EOS_VM_EMPTY_OPS(EOS_VM_CREATE_ENUM)
                                               EOS_VM_ERROR_OPS(
                                                   EOS_VM_CREATE_ENUM)
+
+  // Prefix byte of the bulk memory instructions.
+  misc_prefix = 0xFC
 };
 
 struct opcode_utils {
@@ -40,6 +44,8 @@ struct opcode_utils {
                                   EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_MAP)
                                       EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_MAP)
                                           EOS_VM_EXIT_OP(EOS_VM_CREATE_MAP)
+                                              EOS_VM_BULK_MEMORY_OPS(
+                                                  EOS_VM_CREATE_MAP)
                                               EOS_VM_EMPTY_OPS(
                                                   EOS_VM_CREATE_MAP)
                                                   EOS_VM_ERROR_OPS(
@@ -69,6 +75,7 @@ EOS_VM_COMPARISON_OPS(EOS_VM_CREATE_TYPES)
 EOS_VM_NUMERIC_OPS(EOS_VM_CREATE_TYPES)
 EOS_VM_CONVERSION_OPS(EOS_VM_CREATE_TYPES)
 EOS_VM_EXIT_OP(EOS_VM_CREATE_EXIT_TYPE)
+EOS_VM_BULK_MEMORY_OPS(EOS_VM_CREATE_BULK_MEMORY_TYPES)
 EOS_VM_EMPTY_OPS(EOS_VM_CREATE_TYPES)
 EOS_VM_ERROR_OPS(EOS_VM_CREATE_TYPES)
 
@@ -85,6 +92,8 @@ using opcode = variant<
                                 EOS_VM_NUMERIC_OPS(EOS_VM_IDENTITY)
                                     EOS_VM_CONVERSION_OPS(EOS_VM_IDENTITY)
                                         EOS_VM_EXIT_OP(EOS_VM_IDENTITY)
+                                            EOS_VM_BULK_MEMORY_OPS(
+                                                EOS_VM_IDENTITY)
                                             EOS_VM_EMPTY_OPS(EOS_VM_IDENTITY)
                                                 EOS_VM_ERROR_OPS(
                                                     EOS_VM_IDENTITY_END)>;
@@ -212,6 +212,10 @@
    opcode_macro(f64_reinterpret_i64, 0xBF)
 #define EOS_VM_EXIT_OP(opcode_macro)            \
    opcode_macro(exit, 0xC0)
+/* 0xFC prefix followed by the sub-opcode */
+#define EOS_VM_BULK_MEMORY_OPS(opcode_macro)    \
+   opcode_macro(memory_copy, 0xFC0A)            \
+   opcode_macro(memory_fill, 0xFC0B)
 #define EOS_VM_EMPTY_OPS(opcode_macro)          \
    opcode_macro(empty0xC1, 0xC1)                \
    opcode_macro(empty0xC2, 0xC2)                \
@@ -272,8 +276,6 @@
    opcode_macro(empty0xF9, 0xF9)                \
    opcode_macro(empty0xFA, 0xFA)                \
    opcode_macro(empty0xFB, 0xFB)                \
-   opcode_macro(empty0xFC, 0xFC)                \
-   opcode_macro(empty0xFD, 0xFD)                \
    opcode_macro(empty0xFE, 0xFE)
 #define EOS_VM_ERROR_OPS(opcode_macro)          \
    opcode_macro(error, 0xFF)
@@ -350,6 +352,12 @@
     static constexpr uint8_t opcode = code;                                    \
   };
 
+#define EOS_VM_CREATE_BULK_MEMORY_TYPES(name, code)                            \
+  struct EOS_VM_OPCODE_T(name) {                                               \
+    EOS_VM_OPCODE_T(name)() = default;                                         \
+    static constexpr uint16_t opcode = code;                                   \
+  };
+
 #define EOS_VM_CREATE_CALL_TYPES(name, code)                                   \
   struct EOS_VM_OPCODE_T(name) {                                               \
     EOS_VM_OPCODE_T(name)() = default;                                         \
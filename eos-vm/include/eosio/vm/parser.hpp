@@ -10,8 +10,11 @@
 #include <eosio/vm/vector.hpp>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <cstdint>
+#include <exception>
+#include <functional>
 #include <utility>
 #include <variant>
 #include <vector>
@@ -19,10 +22,35 @@
 namespace eosio {
 namespace vm {
 
+// Runs body(i) for every i in [0, count), possibly concurrently, and returns
+// when all calls are done.
+using parallel_for_t =
+    std::function<void(std::size_t, const std::function<void(std::size_t)> &)>;
+
+namespace detail {
+// Writers able to compile a function apart, see machine_code_writer.
+template <typename Writer, typename = void>
+struct is_parallel_writer : std::false_type {};
+template <typename Writer>
+struct is_parallel_writer<Writer, std::void_t<typename Writer::function_code>>
+    : std::true_type {};
+} // namespace detail
+
 template <typename Writer> class binary_parser {
 public:
   binary_parser(growable_allocator &alloc) : _allocator(alloc) {}
 
+  // Validates and compiles the function bodies through @parallel_for, if
+  // the writer supports it.  The code is the same as when compiled in order.
+  void set_parallel_for(parallel_for_t parallel_for) {
+    _parallel_for = std::move(parallel_for);
+  }
+
+  // Installs the machine code of @image instead of generating it when the
+  // code section is reached.  The image must outlive the call to
+  // parse_module.
+  void set_code_image(const jit_code_image *image) { _code_image = image; }
+
   template <typename T> using vec = guarded_vector<T>;
 
   static inline uint8_t parse_varuint1(wasm_code_ptr &code) {
@@ -34,7 +62,7 @@ public:
   }
 
   static inline uint32_t parse_varuint32(wasm_code_ptr &code) {
-    return varuint<32>(code).to();
+    return read_varuint32(code);
   }
 
   static inline int8_t parse_varint7(wasm_code_ptr &code) {
@@ -42,11 +70,11 @@ public:
   }
 
   static inline int32_t parse_varint32(wasm_code_ptr &code) {
-    return varint<32>(code).to();
+    return read_varint32(code);
   }
 
   static inline int64_t parse_varint64(wasm_code_ptr &code) {
-    return varint<64>(code).to();
+    return read_varint64(code);
   }
 
   int validate_utf8_code_point(wasm_code_ptr &code) {
@@ -99,7 +127,15 @@ public:
     EOS_VM_ASSERT(false, wasm_parse_exception, "invalid utf8 encoding");
   }
 
+  // The @bytes are within the bounds of @code, a leading ASCII run is
+  // skipped without checking them one by one.
   void validate_utf8_string(wasm_code_ptr &code, uint32_t bytes) {
+    const uint8_t *ascii_end = code.raw();
+    while (bytes != 0 && *ascii_end < 0x80) {
+      ascii_end++;
+      bytes--;
+    }
+    code += ascii_end - code.raw();
     while (bytes != 0) {
       bytes -= validate_utf8_code_point(code);
     }
@@ -135,23 +171,35 @@ public:
     return mod;
   }
 
+  // Checks the ids, order and lengths of all sections before any of them is
+  // parsed, a truncated module is rejected before its code is compiled.
+  void validate_sections(wasm_code_ptr code_ptr, size_t sz) {
+    uint8_t highest_section_id = 0;
+    while (code_ptr.offset() != sz) {
+      auto id = parse_section_id(code_ptr);
+      auto len = parse_section_payload_len(code_ptr);
+      EOS_VM_ASSERT(id <= section_id::data_section, wasm_parse_exception,
+                    "error invalid section id");
+      EOS_VM_ASSERT(id == 0 || id > highest_section_id, wasm_parse_exception,
+                    "section out of order");
+      highest_section_id = std::max(highest_section_id, id);
+      code_ptr += len;
+    }
+  }
+
   void parse_module(wasm_code_ptr &code_ptr, size_t sz, module &mod) {
     _mod = &mod;
     EOS_VM_ASSERT(parse_magic(code_ptr) == constants::magic,
                   wasm_parse_exception, "magic number did not match");
     EOS_VM_ASSERT(parse_version(code_ptr) == constants::version,
                   wasm_parse_exception, "version number did not match");
-    uint8_t highest_section_id = 0;
+    validate_sections(code_ptr, sz);
     for (;;) {
       if (code_ptr.offset() == sz)
         break;
       auto id = parse_section_id(code_ptr);
       auto len = parse_section_payload_len(code_ptr);
 
-      EOS_VM_ASSERT(id == 0 || id > highest_section_id, wasm_parse_exception,
-                    "section out of order");
-      highest_section_id = std::max(highest_section_id, id);
-
       auto section_guard = code_ptr.scoped_consume_items(len);
 
       switch (id) {
@@ -313,7 +361,7 @@ public:
     decltype(ft.param_types) param_types = {_allocator, parse_varuint32(code)};
     for (size_t i = 0; i < param_types.size(); i++) {
       uint8_t pt = *code++;
-      param_types.at(i) = pt;
+      param_types.at_no_check(i) = pt;
       EOS_VM_ASSERT(pt == types::i32 || pt == types::i64 || pt == types::f32 ||
                         pt == types::f64,
                     wasm_parse_exception, "invalid function param type");
@@ -349,7 +397,7 @@ public:
       tt->table[es.offset.value.i32 + i] =
           index; // FIXME: integer overflow?  Not possible because 0xFFFFFFFF is
                  // never a valid table address???
-      elems.at(i) = index;
+      elems.at_no_check(i) = index;
       EOS_VM_ASSERT(index < _mod->get_functions_total(), wasm_parse_exception,
                     "elem for undefined function");
     }
@@ -404,8 +452,8 @@ public:
       EOS_VM_ASSERT(type == types::i32 || type == types::i64 ||
                         type == types::f32 || type == types::f64,
                     wasm_parse_exception, "invalid local type");
-      locals.at(i).count = count;
-      locals.at(i).type = type;
+      locals.at_no_check(i).count = count;
+      locals.at_no_check(i).type = type;
     }
     fb.locals = std::move(locals);
 
@@ -520,9 +568,10 @@ public:
       _boundaries.push_back(count);
       for (uint32_t i = 0; i < locals_arg.size(); ++i) {
         // This test cannot overflow.
-        EOS_VM_ASSERT(count <= 0xFFFFFFFFu - locals_arg[i].count,
+        const uint32_t local_count = locals_arg.at_no_check(i).count;
+        EOS_VM_ASSERT(count <= 0xFFFFFFFFu - local_count,
                       wasm_parse_exception, "too many locals");
-        count += locals_arg[i].count;
+        count += local_count;
         _boundaries.push_back(count);
       }
     }
@@ -545,9 +594,12 @@ public:
     std::vector<uint32_t> _boundaries;
   };
 
-  void parse_function_body_code(wasm_code_ptr &code, size_t bounds,
-                                Writer &code_writer, const func_type &fnt,
-                                const local_types_t &local_types) {
+  // @returns the stack usage of the function, in operands and locals.
+  // Only reads the parser and module state, so that function bodies can be
+  // parsed concurrently.
+  uint64_t parse_function_body_code(wasm_code_ptr &code, size_t bounds,
+                                    Writer &code_writer, const func_type &fnt,
+                                    const local_types_t &local_types) {
     // Initialize the control stack with the current function as the sole
     // element
     operand_stack_type_tracker op_stack;
@@ -616,12 +668,27 @@ public:
       pc_stack.pop_back();
     };
 
+    // Away from the end of the body the opcode and the bytes an instruction
+    // reads one at a time, at most an opcode, a varuint32 and two reserved
+    // bytes, are read without bound checks.
+    constexpr std::size_t unchecked_instruction_bytes = 8;
+    bool unchecked = false;
+    auto read_byte = [&]() -> uint8_t {
+      return unchecked ? code.next_unchecked() : *code++;
+    };
+
     while (code.offset() < bounds) {
       EOS_VM_ASSERT(pc_stack.size() <= constants::max_nested_structures,
                     wasm_parse_exception,
                     "nested structures validation failure");
 
-      switch (*code++) {
+      unchecked = code.remaining() >= unchecked_instruction_bytes;
+      const uint8_t op = read_byte();
+      // end and else close a metered block and are not charged
+      if (op != opcodes::end && op != opcodes::else_)
+        code_writer.meter_instruction();
+
+      switch (op) {
       case opcodes::unreachable:
         code_writer.emit_unreachable();
         op_stack.start_unreachable();
@@ -642,7 +709,7 @@ public:
         op_stack.start_unreachable();
       } break;
       case opcodes::block: {
-        uint32_t expected_result = *code++;
+        uint32_t expected_result = read_byte();
         if (expected_result == 0)
           expected_result = types::pseudo;
         EOS_VM_ASSERT(expected_result == types::i32 ||
@@ -657,7 +724,7 @@ public:
         op_stack.push_scope();
       } break;
       case opcodes::loop: {
-        uint32_t expected_result = *code++;
+        uint32_t expected_result = read_byte();
         if (expected_result == 0)
           expected_result = types::pseudo;
         EOS_VM_ASSERT(expected_result == types::i32 ||
@@ -672,7 +739,7 @@ public:
         op_stack.push_scope();
       } break;
       case opcodes::if_: {
-        uint32_t expected_result = *code++;
+        uint32_t expected_result = read_byte();
         if (expected_result == 0)
           expected_result = types::pseudo;
         EOS_VM_ASSERT(expected_result == types::i32 ||
@@ -747,7 +814,8 @@ public:
         uint32_t funcnum = parse_varuint32(code);
         const func_type &ft = _mod->get_function_type(funcnum);
         for (uint32_t i = 0; i < ft.param_types.size(); ++i)
-          op_stack.pop(ft.param_types[ft.param_types.size() - i - 1]);
+          op_stack.pop(
+              ft.param_types.at_no_check(ft.param_types.size() - i - 1));
         EOS_VM_ASSERT(ft.return_count <= 1, wasm_parse_exception,
                       "unsupported");
         if (ft.return_count)
@@ -761,15 +829,15 @@ public:
                       "call_indirect requires a table");
         op_stack.pop(types::i32);
         for (uint32_t i = 0; i < ft.param_types.size(); ++i)
-          op_stack.pop(ft.param_types[ft.param_types.size() - i - 1]);
+          op_stack.pop(
+              ft.param_types.at_no_check(ft.param_types.size() - i - 1));
         EOS_VM_ASSERT(ft.return_count <= 1, wasm_parse_exception,
                       "unsupported");
         if (ft.return_count)
           op_stack.push(ft.return_type);
         code_writer.emit_call_indirect(ft, functypeidx);
-        EOS_VM_ASSERT(*code == 0, wasm_parse_exception,
+        EOS_VM_ASSERT(read_byte() == 0, wasm_parse_exception,
                       "call_indirect must end with 0x00.");
-        code++; // 0x00
         break;
       }
       case opcodes::drop:
@@ -871,9 +939,8 @@ public:
         EOS_VM_ASSERT(_mod->memories.size() != 0, wasm_parse_exception,
                       "memory.size requires memory");
         op_stack.push(types::i32);
-        EOS_VM_ASSERT(*code == 0, wasm_parse_exception,
+        EOS_VM_ASSERT(read_byte() == 0, wasm_parse_exception,
                       "memory.size must end with 0x00");
-        code++;
         code_writer.emit_current_memory();
         break;
       case opcodes::grow_memory:
@@ -881,11 +948,38 @@ public:
                       "memory.grow requires memory");
         op_stack.pop(types::i32);
         op_stack.push(types::i32);
-        EOS_VM_ASSERT(*code == 0, wasm_parse_exception,
+        EOS_VM_ASSERT(read_byte() == 0, wasm_parse_exception,
                       "memory.grow must end with 0x00");
-        code++;
         code_writer.emit_grow_memory();
         break;
+      case opcodes::misc_prefix:
+        switch (parse_varuint32(code)) {
+        case opcodes::memory_copy & 0xFF:
+          EOS_VM_ASSERT(_mod->memories.size() != 0, wasm_parse_exception,
+                        "memory.copy requires memory");
+          op_stack.pop(types::i32);
+          op_stack.pop(types::i32);
+          op_stack.pop(types::i32);
+          EOS_VM_ASSERT(read_byte() == 0 && read_byte() == 0,
+                        wasm_parse_exception,
+                        "memory.copy must end with 0x00 0x00");
+          code_writer.emit_memory_copy();
+          break;
+        case opcodes::memory_fill & 0xFF:
+          EOS_VM_ASSERT(_mod->memories.size() != 0, wasm_parse_exception,
+                        "memory.fill requires memory");
+          op_stack.pop(types::i32);
+          op_stack.pop(types::i32);
+          op_stack.pop(types::i32);
+          EOS_VM_ASSERT(read_byte() == 0, wasm_parse_exception,
+                        "memory.fill must end with 0x00");
+          code_writer.emit_memory_fill();
+          break;
+        default:
+          EOS_VM_ASSERT(false, wasm_parse_exception,
+                        "unsupported 0xFC prefixed instruction");
+        }
+        break;
       case opcodes::i32_const:
         code_writer.emit_i32_const(parse_varint32(code));
         op_stack.push(types::i32);
@@ -1078,10 +1172,50 @@ public:
     }
     EOS_VM_ASSERT(pc_stack.empty(), wasm_parse_exception,
                   "function body too long");
-    _mod->maximum_stack =
-        std::max(_mod->maximum_stack,
-                 static_cast<uint64_t>(op_stack.maximum_operand_depth) +
-                     local_types.locals_count());
+    return static_cast<uint64_t>(op_stack.maximum_operand_depth) +
+           local_types.locals_count();
+  }
+
+  uint64_t compile_function(Writer &code_writer, std::size_t i) {
+    function_body &fb = _mod->code[i];
+    func_type &ft = _mod->types.at(_mod->functions.at(i));
+    local_types_t local_types(ft, fb.locals);
+    code_writer.emit_prologue(ft, fb.locals, i);
+    // a copy, the position of the shared one must not change
+    wasm_code_ptr body = _function_bodies[i];
+    uint64_t stack_usage = parse_function_body_code(body, fb.size, code_writer,
+                                                    ft, local_types);
+    code_writer.emit_epilogue(ft, fb.locals, i);
+    code_writer.finalize(fb);
+    return stack_usage;
+  }
+
+  void compile_functions_parallel(Writer &code_writer) {
+    const std::size_t count = _function_bodies.size();
+    std::vector<typename Writer::function_code> functions(count);
+    std::vector<uint64_t> stack_usage(count);
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<bool> failed{false};
+    _parallel_for(count, [&](std::size_t i) {
+      if (failed.load(std::memory_order_relaxed))
+        return;
+      try {
+        Writer function_writer(code_writer, functions[i]);
+        stack_usage[i] = compile_function(function_writer, i);
+      } catch (...) {
+        errors[i] = std::current_exception();
+        failed = true;
+      }
+    });
+    // report the first invalid function, as compiling in order would
+    for (const auto &error : errors)
+      if (error)
+        std::rethrow_exception(error);
+    for (std::size_t i = 0; i < count; i++) {
+      code_writer.merge(functions[i], _mod->code[i]);
+      _mod->maximum_stack = std::max(_mod->maximum_stack, stack_usage[i]);
+      functions[i] = {};
+    }
   }
 
   void parse_data_segment(wasm_code_ptr &code, data_segment &ds) {
@@ -1102,7 +1236,7 @@ public:
     auto count = parse_varuint32(code);
     elems = vec<Elem>{_allocator, count};
     for (size_t i = 0; i < count; i++) {
-      elem_parse(code, elems.at(i), i);
+      elem_parse(code, elems.at_no_check(i), i);
     }
   }
 
@@ -1214,17 +1348,20 @@ public:
     EOS_VM_ASSERT(
         elems.size() == _mod->functions.size(), wasm_parse_exception,
         "code section must have the same size as the function section");
+    if (_code_image) {
+      Writer::load_code_image(_allocator, *_mod, *_code_image);
+      return;
+    }
     Writer code_writer(_allocator, code.bounds() - code.offset(), *_mod);
-    for (size_t i = 0; i < _function_bodies.size(); i++) {
-      function_body &fb = _mod->code[i];
-      func_type &ft = _mod->types.at(_mod->functions.at(i));
-      local_types_t local_types(ft, fb.locals);
-      code_writer.emit_prologue(ft, fb.locals, i);
-      parse_function_body_code(_function_bodies[i], fb.size, code_writer, ft,
-                               local_types);
-      code_writer.emit_epilogue(ft, fb.locals, i);
-      code_writer.finalize(fb);
+    if constexpr (detail::is_parallel_writer<Writer>::value) {
+      if (_parallel_for && _function_bodies.size() > 1) {
+        compile_functions_parallel(code_writer);
+        return;
+      }
     }
+    for (size_t i = 0; i < _function_bodies.size(); i++)
+      _mod->maximum_stack =
+          std::max(_mod->maximum_stack, compile_function(code_writer, i));
   }
   template <uint8_t id>
   inline void
@@ -1258,6 +1395,8 @@ private:
   int64_t _current_function_index = -1;
   uint64_t _maximum_function_stack_usage = 0; // non-parameter locals + stack
   std::vector<wasm_code_ptr> _function_bodies;
+  const jit_code_image *_code_image = nullptr;
+  parallel_for_t _parallel_for;
 };
 } // namespace vm
 } // namespace eosio
@@ -85,6 +85,13 @@ template <typename E>[[noreturn]] inline void throw_(const char *msg) {
   siglongjmp(*dest, -1);
 }
 
+// Makes invoke_with_signal_handler return normally, for host functions
+// ending the execution. Only valid where throw_ is.
+[[noreturn]] inline void longjmp_exit() {
+  sigjmp_buf *dest = std::atomic_load(&signal_dest);
+  siglongjmp(*dest, -2);
+}
+
 inline void setup_signal_handler_impl() {
   struct sigaction sa;
   sa.sa_sigaction = &signal_handler;
@@ -149,7 +156,7 @@ template <typename F, typename E>
       std::exception_ptr exception = std::move(saved_exception);
       saved_exception = nullptr;
       std::rethrow_exception(exception);
-    } else {
+    } else if (sig != -2) {
       e(sig);
     }
   }
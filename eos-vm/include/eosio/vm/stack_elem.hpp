@@ -1,9 +1,12 @@
 #pragma once
 
+#include <eosio/vm/exceptions.hpp>
 #include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/types.hpp>
 #include <eosio/vm/variant.hpp>
 
 #include <cstdint>
+#include <type_traits>
 
 namespace eosio {
 namespace vm {
@@ -32,5 +35,75 @@ public:
   inline double to_f64() const & { return get<f64_const_t>().data.f; }
   inline uint64_t to_fui64() const & { return get<f64_const_t>().data.ui; }
 };
+
+// An untyped operand of the interpreter.  Validation already guarantees the
+// type of every operand, so only the raw 64 bits are kept and the i32/f32
+// views alias the low half of the slot.  get<T>() mirrors operand_stack_elem
+// for the host function argument packing.
+class stack_slot {
+public:
+  stack_slot() = default;
+  stack_slot(const i32_const_t &c) : _value{c.data.ui} {}
+  stack_slot(const i64_const_t &c) : _value{c.data.ui} {}
+  stack_slot(const f32_const_t &c) : _value{c.data.ui} {}
+  stack_slot(const f64_const_t &c) : _value{c.data.ui} {}
+
+  inline int32_t &to_i32() & { return _value.i32; }
+  inline uint32_t &to_ui32() & { return _value.ui32; }
+  inline float &to_f32() & { return _value.f32; }
+  inline uint32_t &to_fui32() & { return _value.ui32; }
+
+  inline int64_t &to_i64() & { return _value.i64; }
+  inline uint64_t &to_ui64() & { return _value.ui64; }
+  inline double &to_f64() & { return _value.f64; }
+  inline uint64_t &to_fui64() & { return _value.ui64; }
+
+  inline int32_t to_i32() const & { return _value.i32; }
+  inline uint32_t to_ui32() const & { return _value.ui32; }
+  inline float to_f32() const & { return _value.f32; }
+  inline uint32_t to_fui32() const & { return _value.ui32; }
+
+  inline int64_t to_i64() const & { return _value.i64; }
+  inline uint64_t to_ui64() const & { return _value.ui64; }
+  inline double to_f64() const & { return _value.f64; }
+  inline uint64_t to_fui64() const & { return _value.ui64; }
+
+  template <typename T> inline T get() const {
+    if constexpr (std::is_same_v<T, i32_const_t> ||
+                  std::is_same_v<T, f32_const_t>)
+      return T{_value.ui32};
+    else
+      return T{_value.ui64};
+  }
+
+  // Restores the type tag once the wasm type is known again.
+  inline operand_stack_elem to_elem(uint8_t type) const {
+    switch (type) {
+    case types::i32:
+      return i32_const_t{_value.ui32};
+    case types::i64:
+      return i64_const_t{_value.ui64};
+    case types::f32:
+      return f32_const_t{_value.ui32};
+    case types::f64:
+      return f64_const_t{_value.ui64};
+    default:
+      throw wasm_interpreter_exception{"invalid operand type"};
+    }
+  }
+
+private:
+  union {
+    uint64_t ui64;
+    int64_t i64;
+    double f64;
+    uint32_t ui32;
+    int32_t i32;
+    float f32;
+  } _value;
+};
+static_assert(sizeof(stack_slot) == 8 &&
+                  std::is_trivially_copyable_v<stack_slot>,
+              "stack_slot must be a raw 64 bit value");
 } // namespace vm
 } // namespace eosio
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <eosio/vm/allocator.hpp>
+#include <eosio/vm/exceptions.hpp>
+#include <eosio/vm/opcodes.hpp>
+#include <eosio/vm/types.hpp>
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+// Direct-threaded code for the interpreter.  Every instruction is the
+// address of its handler followed by its immediates, all in 8 byte slots,
+// so dispatch is a single indirect jump and no decoding is needed at run
+// time.  Values on the operand stack are untyped native_values, an i32 only
+// uses the low 4 bytes.
+
+// Instructions without a Wasm counterpart, or which take other immediates
+// than the Wasm instruction of the same name.
+#define EOS_VM_THREADED_CONTROL_OPS(op)                                        \
+  op(halt) op(unreachable) op(error) op(enter) op(br) op(br_drop) op(br_keep)  \
+      op(br_if) op(br_if_drop) op(br_if_keep) op(if_) op(br_table) op(ret)     \
+          op(call) op(call_host) op(call_indirect) op(drop) op(select)         \
+              op(get_local) op(set_local) op(tee_local) op(get_global)         \
+                  op(set_global) op(constant)
+
+// Super-instructions replacing common pairs of instructions.
+#define EOS_VM_THREADED_FUSED_OPS(op)                                          \
+  op(i32_add_local) op(i64_add_local) op(i32_add_imm) op(i64_load_local)       \
+      op(i64_load_store) op(br_unless) op(copy_local)
+
+// Expands @op for the custom instructions and @wasm_op for the ones taken
+// from opcodes_def.hpp, in the order of tc_op.
+#define EOS_VM_THREADED_OPS(op, wasm_op)                                       \
+  EOS_VM_THREADED_CONTROL_OPS(op)                                              \
+  EOS_VM_MEMORY_OPS(wasm_op)                                                   \
+  EOS_VM_COMPARISON_OPS(wasm_op)                                               \
+  EOS_VM_NUMERIC_OPS(wasm_op)                                                  \
+  EOS_VM_CONVERSION_OPS(wasm_op)                                               \
+  EOS_VM_BULK_MEMORY_OPS(wasm_op)                                              \
+  EOS_VM_THREADED_FUSED_OPS(op)
+
+// The handler addresses are only stable if the function holding the labels
+// is neither inlined nor cloned.
+#if defined(__clang__)
+#define EOS_VM_THREADED_NOINLINE __attribute__((noinline))
+#else
+#define EOS_VM_THREADED_NOINLINE __attribute__((noinline, noclone))
+#endif
+
+namespace eosio {
+namespace vm {
+
+enum class tc_op : uint16_t {
+#define EOS_VM_THREADED_ENUM(name) name,
+#define EOS_VM_THREADED_WASM_ENUM(name, code) name,
+  EOS_VM_THREADED_OPS(EOS_VM_THREADED_ENUM, EOS_VM_THREADED_WASM_ENUM)
+#undef EOS_VM_THREADED_WASM_ENUM
+#undef EOS_VM_THREADED_ENUM
+      none
+};
+
+union tc_slot {
+  const void *handler;
+  const tc_slot *target;
+  void *ptr;
+  native_value value;
+  uint32_t u32[2];
+  uint64_t u64;
+};
+static_assert(sizeof(tc_slot) == 8, "8-bytes expected for tc_slot");
+
+// Pops for a branch, encoded as by the parser: the number of operands to
+// drop, the high bit is set if the top value is kept.
+constexpr uint32_t tc_keep_result = 0x80000000u;
+
+// Emits the threaded code of each function into the code segment, using
+// the handler addresses of Context.  Function starts are recorded in
+// jit_code_offset, relative to the code segment, as the jit does.
+template <typename Context> class threaded_code_writer {
+public:
+  threaded_code_writer(growable_allocator &alloc, std::size_t source_bytes,
+                       module &mod)
+      : _allocator(alloc), _code_segment_base(alloc.start_code()), _mod(mod),
+        _function_starts(mod.code.size()) {}
+  ~threaded_code_writer() {
+    // direct calls to functions defined later in the module
+    for (auto [slot, funcnum] : _calls)
+      slot->target = _function_starts[funcnum];
+    _allocator.end_code<false>(_code_segment_base);
+  }
+  static void load_code_image(growable_allocator &, module &,
+                              const jit_code_image &) {
+    EOS_VM_ASSERT(false, wasm_parse_exception,
+                  "code images are only supported by the jit");
+  }
+
+  void emit_unreachable() { emit(tc_op::unreachable); }
+  void emit_nop() {}
+  tc_slot *emit_end() {
+    _last = tc_op::none;
+    return _code;
+  }
+  tc_slot *emit_return(uint32_t) {
+    // ret restores the frame itself, no branch to fix
+    emit(tc_op::ret, 1)->u32[0] = _ft->return_count;
+    return nullptr;
+  }
+  void emit_block() {}
+  void meter_instruction() {}
+  tc_slot *emit_loop() {
+    _last = tc_op::none;
+    return _code;
+  }
+  tc_slot *emit_if() { return emit(tc_op::if_, 1); }
+  tc_slot *emit_else(tc_slot *if_loc) {
+    tc_slot *branch = emit(tc_op::br, 1);
+    fix_branch(if_loc, _code);
+    _last = tc_op::none;
+    return branch;
+  }
+  tc_slot *emit_br(uint32_t depth_change) {
+    return emit_branch(tc_op::br, tc_op::br_drop, tc_op::br_keep,
+                       depth_change);
+  }
+  tc_slot *emit_br_if(uint32_t depth_change) {
+    if (_last == tc_op::i32_eqz && is_plain_branch(depth_change)) {
+      _code = _last_pos;
+      return emit(tc_op::br_unless, 1);
+    }
+    return emit_branch(tc_op::br_if, tc_op::br_if_drop, tc_op::br_if_keep,
+                       depth_change);
+  }
+
+  // br_table is followed by the target and the pops of each case and of
+  // the default.
+  struct br_table_parser {
+    br_table_parser(threaded_code_writer &base, uint32_t table_size)
+        : _this{&base} {
+      _this->emit(tc_op::br_table, 1 + 2 * (table_size + 1))->u32[0] =
+          table_size;
+      _elems = _this->_last_pos + 2;
+    }
+    tc_slot *emit_case(uint32_t depth_change) {
+      tc_slot *elem = _elems;
+      _elems += 2;
+      elem[1].u32[0] = depth_change;
+      return elem;
+    }
+    // Must be called after all cases
+    tc_slot *emit_default(uint32_t depth_change) {
+      tc_slot *result = emit_case(depth_change);
+      assert(_elems == _this->_code);
+      return result;
+    }
+    threaded_code_writer *_this;
+    tc_slot *_elems;
+    br_table_parser(const br_table_parser &) = delete;
+    br_table_parser &operator=(const br_table_parser &) = delete;
+  };
+  auto emit_br_table(uint32_t table_size) {
+    return br_table_parser{*this, table_size};
+  }
+
+  void emit_call(const func_type &ft, uint32_t funcnum) {
+    const uint32_t imports = _mod.get_imported_functions_size();
+    if (funcnum < imports) {
+      tc_slot *slot = emit(tc_op::call_host, 2);
+      slot[0].u32[0] = funcnum;
+      slot[1].u32[0] = ft.param_types.size();
+      slot[1].u32[1] = ft.return_count;
+    } else {
+      tc_slot *slot = emit(tc_op::call, 2);
+      slot[1].u32[0] = ft.param_types.size();
+      _calls.emplace_back(slot, funcnum - imports);
+    }
+  }
+  void emit_call_indirect(const func_type &ft, uint32_t functypeidx) {
+    tc_slot *slot = emit(tc_op::call_indirect, 2);
+    slot[0].u32[0] = _mod.type_aliases[functypeidx];
+    slot[1].u32[0] = ft.param_types.size();
+    slot[1].u32[1] = ft.return_count;
+  }
+
+  void emit_drop() { emit(tc_op::drop); }
+  void emit_select() { emit(tc_op::select); }
+  void emit_get_local(uint32_t localidx) {
+    emit(tc_op::get_local, 1)->u32[0] = localidx;
+  }
+  void emit_set_local(uint32_t localidx) {
+    if (_last == tc_op::get_local) {
+      uint32_t src = _last_pos[1].u32[0];
+      _code = _last_pos;
+      tc_slot *slot = emit(tc_op::copy_local, 2);
+      slot[0].u32[0] = src;
+      slot[1].u32[0] = localidx;
+      return;
+    }
+    emit(tc_op::set_local, 1)->u32[0] = localidx;
+  }
+  void emit_tee_local(uint32_t localidx) {
+    emit(tc_op::tee_local, 1)->u32[0] = localidx;
+  }
+  void emit_get_global(uint32_t globalidx) {
+    emit(tc_op::get_global, 1)->ptr = &_mod.globals[globalidx].current.value;
+  }
+  void emit_set_global(uint32_t globalidx) {
+    emit(tc_op::set_global, 1)->ptr = &_mod.globals[globalidx].current.value;
+  }
+
+#define MEM_OP(op_name)                                                        \
+  void emit_##op_name(uint32_t, uint32_t offset) {                             \
+    emit_memory_op(tc_op::op_name, offset);                                    \
+  }
+  MEM_OP(i32_load)
+  MEM_OP(i64_load)
+  MEM_OP(f32_load)
+  MEM_OP(f64_load)
+  MEM_OP(i32_load8_s)
+  MEM_OP(i32_load16_s)
+  MEM_OP(i32_load8_u)
+  MEM_OP(i32_load16_u)
+  MEM_OP(i64_load8_s)
+  MEM_OP(i64_load16_s)
+  MEM_OP(i64_load32_s)
+  MEM_OP(i64_load8_u)
+  MEM_OP(i64_load16_u)
+  MEM_OP(i64_load32_u)
+  MEM_OP(i32_store)
+  MEM_OP(i64_store)
+  MEM_OP(f32_store)
+  MEM_OP(f64_store)
+  MEM_OP(i32_store8)
+  MEM_OP(i32_store16)
+  MEM_OP(i64_store8)
+  MEM_OP(i64_store16)
+  MEM_OP(i64_store32)
+#undef MEM_OP
+
+  void emit_current_memory() { emit(tc_op::current_memory); }
+  void emit_grow_memory() { emit(tc_op::grow_memory); }
+  void emit_memory_copy() { emit(tc_op::memory_copy); }
+  void emit_memory_fill() { emit(tc_op::memory_fill); }
+
+  void emit_i32_const(uint32_t value) {
+    emit(tc_op::constant, 1)->u64 = value;
+  }
+  void emit_i64_const(uint64_t value) {
+    emit(tc_op::constant, 1)->u64 = value;
+  }
+  void emit_f32_const(float value) {
+    tc_slot *slot = emit(tc_op::constant, 1);
+    slot->u64 = 0;
+    std::memcpy(slot, &value, sizeof(value));
+  }
+  void emit_f64_const(double value) {
+    std::memcpy(emit(tc_op::constant, 1), &value, sizeof(value));
+  }
+
+#define OP(opname, code)                                                       \
+  void emit_##opname() { emit_op(tc_op::opname); }
+  EOS_VM_COMPARISON_OPS(OP)
+  EOS_VM_NUMERIC_OPS(OP)
+  EOS_VM_CONVERSION_OPS(OP)
+#undef OP
+
+  void emit_error() { emit(tc_op::error); }
+
+  void fix_branch(tc_slot *branch, tc_slot *target) {
+    if (branch)
+      branch->target = target;
+  }
+  void emit_prologue(const func_type &ft,
+                     const guarded_vector<local_entry> &locals,
+                     uint32_t idx) {
+    // An instruction takes at most 2 slots per byte of its encoding, plus
+    // the enter and the final ret.
+    const std::size_t max_slots = 2 * _mod.code[idx].size + 8;
+    _code_start = _code = _allocator.alloc<tc_slot>(max_slots);
+    _code_end = _code_start + max_slots;
+    _function_starts[idx] = _code_start;
+    _ft = &ft;
+    uint32_t locals_count = 0;
+    for (uint32_t i = 0; i < locals.size(); ++i)
+      locals_count += locals[i].count;
+    if (locals_count)
+      emit(tc_op::enter, 1)->u32[0] = locals_count;
+    _last = tc_op::none;
+  }
+  void emit_epilogue(const func_type &ft, const guarded_vector<local_entry> &,
+                     uint32_t) {
+    emit(tc_op::ret, 1)->u32[0] = ft.return_count;
+  }
+
+  void finalize(function_body &body) {
+    assert(_code <= _code_end);
+    _allocator.reclaim(_code, _code_end - _code);
+    body.jit_code_offset = reinterpret_cast<char *>(_code_start) -
+                           static_cast<char *>(_code_segment_base);
+  }
+
+private:
+  // Appends @op with @immediates slots and returns the first of them.
+  tc_slot *emit(tc_op op, std::size_t immediates = 0) {
+    _last = op;
+    _last_pos = _code;
+    _code->handler = Context::handler(op);
+    tc_slot *result = _code + 1;
+    _code = result + immediates;
+    return result;
+  }
+
+  // Fuses @op with the preceding get_local or i32 constant when possible.
+  void emit_op(tc_op op) {
+    if (op == tc_op::i32_add && _last == tc_op::get_local)
+      return fuse(tc_op::i32_add_local);
+    if (op == tc_op::i64_add && _last == tc_op::get_local)
+      return fuse(tc_op::i64_add_local);
+    if (op == tc_op::i32_add && _last == tc_op::constant)
+      return fuse(tc_op::i32_add_imm);
+    emit(op);
+  }
+
+  // Replaces the previous instruction by @op, keeping its immediate.
+  void fuse(tc_op op) {
+    tc_slot immediate = _last_pos[1];
+    _code = _last_pos;
+    *emit(op, 1) = immediate;
+    _last = tc_op::none;
+  }
+
+  void emit_memory_op(tc_op op, uint32_t offset) {
+    if (op == tc_op::i64_load && _last == tc_op::get_local) {
+      uint32_t local = _last_pos[1].u32[0];
+      _code = _last_pos;
+      tc_slot *slot = emit(tc_op::i64_load_local, 2);
+      slot[0].u32[0] = local;
+      slot[1].u32[0] = offset;
+      _last = tc_op::none;
+      return;
+    }
+    if (op == tc_op::i64_store && _last == tc_op::i64_load) {
+      uint32_t load_offset = _last_pos[1].u32[0];
+      _code = _last_pos;
+      tc_slot *slot = emit(tc_op::i64_load_store, 2);
+      slot[0].u32[0] = load_offset;
+      slot[1].u32[0] = offset;
+      _last = tc_op::none;
+      return;
+    }
+    emit(op, 1)->u32[0] = offset;
+  }
+
+  static bool is_plain_branch(uint32_t depth_change) {
+    const uint32_t count = depth_change & ~tc_keep_result;
+    return (depth_change & tc_keep_result) ? count <= 1 : count == 0;
+  }
+
+  // Picks the cheapest of the three forms of a branch for @depth_change and
+  // returns the slot of its target.
+  tc_slot *emit_branch(tc_op plain, tc_op drop, tc_op keep,
+                       uint32_t depth_change) {
+    tc_slot *target;
+    if (is_plain_branch(depth_change)) {
+      target = emit(plain, 1);
+    } else if (depth_change & tc_keep_result) {
+      target = emit(keep, 2);
+      target[1].u32[0] = (depth_change & ~tc_keep_result) - 1;
+    } else {
+      target = emit(drop, 2);
+      target[1].u32[0] = depth_change;
+    }
+    _last = tc_op::none;
+    return target;
+  }
+
+  growable_allocator &_allocator;
+  void *_code_segment_base;
+  module &_mod;
+  const func_type *_ft = nullptr;
+  tc_slot *_code_start = nullptr;
+  tc_slot *_code = nullptr;
+  tc_slot *_code_end = nullptr;
+  // the last instruction emitted since a label, for fusion
+  tc_op _last = tc_op::none;
+  tc_slot *_last_pos = nullptr;
+  std::vector<tc_slot *> _function_starts;
+  std::vector<std::pair<tc_slot *, uint32_t>> _calls;
+};
+
+} // namespace vm
+} // namespace eosio
@@ -160,6 +160,26 @@ struct data_segment {
 using wasm_code = std::vector<uint8_t>;
 using wasm_code_ptr = guarded_ptr<uint8_t>;
 
+// An absolute address embedded in jit code, patched when the code is loaded
+// from a code image.
+struct jit_relocation {
+  uint32_t offset; // from the start of the code segment
+  uint32_t symbol;
+  uint32_t index; // global index for global variables
+};
+
+// Machine code generated for a module, as needed to rebuild the module
+// without running the code generator.  The code and relocations are views
+// of memory owned by the caller.
+struct jit_code_image {
+  const unsigned char *code = nullptr;
+  std::size_t code_size = 0;
+  std::vector<uint64_t> function_offsets; // per function body
+  const jit_relocation *relocations = nullptr;
+  std::size_t relocation_count = 0;
+  uint64_t maximum_stack = 0;
+};
+
 struct module {
   growable_allocator allocator = {constants::initial_module_size};
   uint32_t start = std::numeric_limits<uint32_t>::max();
@@ -179,6 +199,10 @@ struct module {
   guarded_vector<uint32_t> type_aliases = {allocator, 0};
   guarded_vector<uint32_t> fast_functions = {allocator, 0};
   uint64_t maximum_stack = 0;
+  std::vector<jit_relocation> jit_relocations;
+  // The jit code charges the cost of every block to the gas counter of the
+  // execution context.
+  bool gas_metering = false;
 
   void finalize() {
     import_functions.resize(get_imported_functions_size());
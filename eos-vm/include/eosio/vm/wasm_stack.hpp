@@ -12,6 +12,8 @@
 #include <eosio/vm/types.hpp>
 #include <eosio/vm/vector.hpp>
 
+#include <algorithm>
+
 namespace eosio {
 namespace vm {
 using namespace std;
@@ -34,6 +36,16 @@ public:
     _store[_index++] = std::forward<ElemT>(e);
   }
 
+  // push @amt value initialized elements
+  void push_zeroed(size_t amt) {
+    if constexpr (std::is_same_v<Allocator, nullptr_t>) {
+      if (_index + amt > _store.size())
+        _store.resize(std::max(_store.size() * 2, _index + amt));
+    }
+    for (size_t i = 0; i < amt; i++)
+      _store[_index++] = ElemT{};
+  }
+
   ElemT pop() { return _store[--_index]; }
 
   ElemT &get(uint32_t index) const {
@@ -70,7 +82,7 @@ private:
   size_t _index = 0;
 };
 
-using operand_stack = stack<operand_stack_elem, constants::max_stack_size>;
+using operand_stack = stack<stack_slot, constants::max_stack_size>;
 using call_stack =
     stack<activation_frame, constants::max_call_depth + 1, bounded_allocator>;
 
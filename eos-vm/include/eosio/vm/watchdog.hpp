@@ -1,7 +1,9 @@
 #pragma once
 
+#include <array>
 #include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <functional>
 #include <mutex>
 #include <thread>
@@ -53,8 +55,8 @@ private:
   private:
     // worker thread
     // Implementation notes: This implementation creates a thread for
-    // each watchdog.  If there are many watchdogs, it might be more
-    // efficient to create a single thread for them all.
+    // each watchdog.  shared_watchdog serves any number of watchdogs from
+    // a single thread.
     void runner() {
       auto _lock = std::unique_lock(_mutex);
       // wait until the timer expires or someone stops it.
@@ -79,6 +81,224 @@ private:
   std::chrono::steady_clock::duration _duration;
 };
 
+/// \brief A hierarchical timer wheel run by one process-wide thread.
+///
+/// Timers are intrusive and owned by the caller, arming and cancelling one
+/// is O(1) under a mutex.  Expired callbacks run on the timer thread with
+/// the mutex held, so cancel() never returns while the callback runs.
+class timer_wheel {
+public:
+  using clock = std::chrono::steady_clock;
+  static constexpr auto tick = std::chrono::microseconds(100);
+
+  struct timer {
+    timer *prev = nullptr;
+    timer *next = nullptr;
+    uint64_t expiry = 0; // in ticks
+    void (*callback)(timer *) = nullptr;
+    bool pending = false;
+  };
+
+  static timer_wheel &instance() {
+    static timer_wheel wheel;
+    return wheel;
+  }
+
+  timer_wheel(const timer_wheel &) = delete;
+  timer_wheel &operator=(const timer_wheel &) = delete;
+
+  ~timer_wheel() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _cond.notify_one();
+    if (_thread.joinable())
+      _thread.join();
+  }
+
+  /// Arms @t to expire at @deadline.
+  void arm(timer &t, clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_thread.joinable())
+      _thread = std::thread(&timer_wheel::run, this);
+    if (_count == 0)
+      _current = ticks(clock::now());
+    // Round up, a deadline never fires early.
+    t.expiry = std::max(ticks(deadline + tick - clock::duration(1)),
+                        _current + 1);
+    insert(t);
+    ++_count;
+    const bool wake = t.expiry < _wake;
+    lock.unlock();
+    if (wake)
+      _cond.notify_one();
+  }
+
+  /// Disarms @t if it has not expired yet.
+  void cancel(timer &t) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (t.pending) {
+      unlink(t);
+      --_count;
+    }
+  }
+
+private:
+  static constexpr unsigned level_bits = 8;
+  static constexpr unsigned slot_count = 1u << level_bits;
+  static constexpr unsigned level_count = 4;
+
+  // Slots are circular lists headed by a sentinel.
+  struct slot : timer {
+    slot() { prev = next = this; }
+  };
+
+  timer_wheel() = default;
+
+  static uint64_t ticks(clock::time_point t) {
+    return uint64_t(t.time_since_epoch() / tick);
+  }
+
+  // A timer goes to the lowest level whose slot it cannot share with the
+  // current tick.
+  void insert(timer &t) {
+    unsigned level = 0;
+    uint64_t index = t.expiry;
+    while ((index - (_current >> (level_bits * level))) >= slot_count) {
+      if (++level == level_count) {
+        // beyond the top level, wait in its farthest slot and cascade
+        --level;
+        index = (_current >> (level_bits * level)) + slot_count - 1;
+        break;
+      }
+      index = t.expiry >> (level_bits * level);
+    }
+    timer &head = _slots[level][index & (slot_count - 1)];
+    t.prev = &head;
+    t.next = head.next;
+    head.next->prev = &t;
+    head.next = &t;
+    t.pending = true;
+  }
+
+  static void unlink(timer &t) {
+    t.prev->next = t.next;
+    t.next->prev = t.prev;
+    t.prev = t.next = nullptr;
+    t.pending = false;
+  }
+
+  // Moves the timers of @head to the lower levels.
+  void cascade(timer &head) {
+    while (head.next != &head) {
+      timer &t = *head.next;
+      unlink(t);
+      insert(t);
+    }
+  }
+
+  // Advances the wheel by one tick and fires what expired.
+  void advance() {
+    ++_current;
+    // Higher levels first, their timers may move into lower level slots
+    // that are due now.
+    unsigned top = 0;
+    while (top + 1 < level_count &&
+           (_current & ((uint64_t(1) << (level_bits * (top + 1))) - 1)) == 0)
+      ++top;
+    for (unsigned level = top; level > 0; level--)
+      cascade(_slots[level][(_current >> (level_bits * level)) &
+                            (slot_count - 1)]);
+    timer &head = _slots[0][_current & (slot_count - 1)];
+    while (head.next != &head) {
+      timer &t = *head.next;
+      unlink(t);
+      --_count;
+      t.callback(&t);
+    }
+  }
+
+  // @returns the tick to wake up at: the first non-empty slot of the
+  // lowest level, or the next cascade.
+  uint64_t next_wake() const {
+    for (uint64_t t = _current + 1; t <= _current + slot_count; t++) {
+      timer const &head = _slots[0][t & (slot_count - 1)];
+      if (head.next != &head || (t & (slot_count - 1)) == 0)
+        return t;
+    }
+    return _current + slot_count;
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stop) {
+      if (_count == 0) {
+        _wake = UINT64_MAX;
+        _cond.wait(lock);
+        continue;
+      }
+      const uint64_t now = ticks(clock::now());
+      while (_current < now && _count)
+        advance();
+      if (_count == 0)
+        continue;
+      _wake = next_wake();
+      _cond.wait_until(lock, clock::time_point(std::chrono::duration_cast<
+                                 clock::duration>(tick * _wake)));
+    }
+  }
+
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  std::thread _thread;
+  std::array<std::array<slot, slot_count>, level_count> _slots;
+  uint64_t _current = 0;
+  uint64_t _wake = UINT64_MAX;
+  size_t _count = 0;
+  bool _stop = false;
+};
+
+/// \brief A watchdog with the interface of watchdog, served by the shared
+/// timer_wheel instead of a thread per run.
+class shared_watchdog {
+  template <typename F> class guard;
+
+public:
+  template <typename TimeUnits>
+  explicit shared_watchdog(const TimeUnits &duration)
+      : _duration(std::chrono::duration_cast<timer_wheel::clock::duration>(
+            duration)) {}
+
+  template <typename F>[[nodiscard]] guard<F> scoped_run(F &&callback) {
+    return guard<F>(_duration, static_cast<F &&>(callback));
+  }
+
+private:
+  template <typename F> class guard : timer_wheel::timer {
+  public:
+    guard(const guard &) = delete;
+    guard &operator=(const guard &) = delete;
+
+    guard(timer_wheel::clock::duration duration, F &&callback)
+        : _callback(static_cast<F &&>(callback)) {
+      this->callback = &guard::expired;
+      timer_wheel::instance().arm(*this,
+                                  timer_wheel::clock::now() + duration);
+    }
+    ~guard() { timer_wheel::instance().cancel(*this); }
+
+  private:
+    static void expired(timer_wheel::timer *t) {
+      static_cast<guard *>(t)->_callback();
+    }
+
+    std::decay_t<F> _callback;
+  };
+
+  timer_wheel::clock::duration _duration;
+};
+
 class null_watchdog {
 public:
   template <typename F> null_watchdog scoped_run(F &&) { return *this; }
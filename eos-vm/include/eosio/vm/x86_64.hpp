@@ -10,7 +10,11 @@
 #include <cpuid.h>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -21,28 +25,81 @@ namespace vm {
 // - branch instructions return the address that will need to be updated
 // - label instructions return the address of the target
 // - fix_branch will be called when the branch target is resolved
-// - It would make everything more efficient to make RAX always represent the
-// top of
-//   the stack.
+// - The top of the stack is not pushed right away when it is a constant, a
+//   local, the result in RAX or the flags of a comparison.  The instruction
+//   that consumes it uses it in place instead, e.g. add $1, %eax or a fused
+//   compare and branch.  Anything else emitted pushes it first.
 //
 // - The base of memory is stored in rsi
 //
 // - FIXME: Factor the machine instructions into a separate assembler class.
+//
+// - Every absolute address is recorded in module::jit_relocations, so the
+//   code segment can be saved as a jit_code_image and loaded again with
+//   load_code_image().
+//
+// - Function bodies can be compiled in parallel, each into a private
+//   function_code buffer by a writer constructed from the module writer.
+//   Calls, branches to the shared handlers and absolute addresses in the
+//   buffer are recorded and resolved by merge(), in function order.
+//
+// - With module::gas_metering, the function body and every block, loop, if
+//   and else arm start with a charge of one gas per instruction directly in
+//   them, nested blocks counting as one. The cost is only known at the end
+//   of the block, so the immediate of the charge is patched then.
+
+// Targets of the absolute addresses embedded in the generated code.
+enum class jit_symbol : uint32_t {
+  global_value,
+  current_memory,
+  grow_memory,
+  call_host_function,
+  on_unreachable,
+  on_fp_error,
+  on_call_indirect_error,
+  on_type_error,
+  on_stack_overflow,
+  on_out_of_gas,
+  memory_copy,
+  memory_fill,
+};
+
 template <typename Context> class machine_code_writer {
 public:
+  // Bump whenever the generated code changes, code images of other versions
+  // must not be loaded.
+  static constexpr uint32_t code_image_version = 4;
+
+  // The code of one function, compiled apart from the code segment.  All
+  // offsets are relative to the start of the code.
+  struct function_code {
+    struct free_deleter {
+      void operator()(unsigned char *ptr) const { std::free(ptr); }
+    };
+    std::unique_ptr<unsigned char[], free_deleter> code;
+    std::size_t size = 0;
+    uint32_t funcnum = 0;
+    std::vector<std::pair<uint32_t, void *>> branches;
+    std::vector<std::pair<uint32_t, uint32_t>> calls;
+    std::vector<jit_relocation> relocations;
+  };
+
   machine_code_writer(growable_allocator &alloc, std::size_t source_bytes,
                       module &mod)
       : _mod(mod), _code_segment_base(alloc.start_code()) {
-    const std::size_t code_size = 4 * 16; // 4 error handlers, each is 16 bytes.
+    const std::size_t code_size = 5 * 16; // 5 error handlers, each is 16 bytes.
     _code_start = _mod.allocator.alloc<unsigned char>(code_size);
     _code_end = _code_start + code_size;
     code = _code_start;
+    _mod.jit_relocations.clear();
 
     // always emit these functions
-    fpe_handler = emit_error_handler(&on_fp_error);
-    call_indirect_handler = emit_error_handler(&on_call_indirect_error);
-    type_error_handler = emit_error_handler(&on_type_error);
-    stack_overflow_handler = emit_error_handler(&on_stack_overflow);
+    fpe_handler = emit_error_handler(jit_symbol::on_fp_error);
+    call_indirect_handler =
+        emit_error_handler(jit_symbol::on_call_indirect_error);
+    type_error_handler = emit_error_handler(jit_symbol::on_type_error);
+    stack_overflow_handler = emit_error_handler(jit_symbol::on_stack_overflow);
+    out_of_gas_handler = emit_error_handler(jit_symbol::on_out_of_gas);
 
     assert(code ==
            _code_end); // verify that the manual instruction count is correct
@@ -96,14 +153,32 @@ public:
       assert(code == _code_end);
     }
   }
-  ~machine_code_writer() { _mod.allocator.end_code<true>(_code_segment_base); }
-
-  static constexpr std::size_t max_prologue_size = 21;
+  // Compiles into @out instead of the code segment, @parent must be the
+  // writer of the module and stay alive.  Only one function can be compiled,
+  // and nothing but @mod is shared with the parent.
+  machine_code_writer(const machine_code_writer &parent, function_code &out)
+      : _mod(parent._mod), _code_segment_base(parent._code_segment_base),
+        _out(&out), fpe_handler(parent.fpe_handler),
+        call_indirect_handler(parent.call_indirect_handler),
+        type_error_handler(parent.type_error_handler),
+        stack_overflow_handler(parent.stack_overflow_handler),
+        out_of_gas_handler(parent.out_of_gas_handler),
+        jmp_table(parent.jmp_table),
+        _table_element_size(parent._table_element_size) {}
+
+  ~machine_code_writer() {
+    if (!_out)
+      _mod.allocator.end_code<true>(_code_segment_base);
+  }
+
+  static constexpr std::size_t gas_charge_size = 16;
+  static constexpr std::size_t max_prologue_size = 21 + gas_charge_size;
   static constexpr std::size_t max_epilogue_size = 10;
   void emit_prologue(const func_type & /*ft*/,
                      const guarded_vector<local_entry> &locals,
                      uint32_t funcnum) {
     _ft = &_mod.types[_mod.functions[funcnum]];
+    _top = {};
     // FIXME: This is not a tight upper bound
     // const std::size_t instruction_size_ratio_upper_bound =
     // use_softfloat?49:79;
@@ -112,10 +187,19 @@ public:
         max_prologue_size +
         _mod.code[funcnum].size * instruction_size_ratio_upper_bound +
         max_epilogue_size;
-    _code_start = _mod.allocator.alloc<unsigned char>(code_size);
+    if (_out) {
+      auto buffer = static_cast<unsigned char *>(std::malloc(code_size));
+      EOS_VM_ASSERT(buffer, wasm_bad_alloc, "failed to allocate function code");
+      _out->code.reset(buffer);
+      _out->funcnum = funcnum;
+      _code_start = buffer;
+    } else {
+      _code_start = _mod.allocator.alloc<unsigned char>(code_size);
+    }
     _code_end = _code_start + code_size;
     code = _code_start;
-    start_function(code, funcnum + _mod.get_imported_functions_size());
+    if (!_out)
+      start_function(code, funcnum + _mod.get_imported_functions_size());
     // pushq RBP
     emit_bytes(0x55);
     // movq RSP, RBP
@@ -150,6 +234,7 @@ public:
         }
       }
     }
+    start_gas_block();
     assert((char *)code <= (char *)_code_start + max_prologue_size);
   }
   void emit_epilogue(const func_type &ft,
@@ -160,7 +245,7 @@ public:
 #endif
     if (ft.return_count != 0) {
       // pop RAX
-      emit_bytes(0x58);
+      pop_rax();
     }
     if (_local_count & 0xF0000000u)
       unimplemented();
@@ -172,29 +257,47 @@ public:
     assert((char *)code <= (char *)epilogue_start + max_epilogue_size);
   }
 
-  void emit_unreachable() { emit_error_handler(&on_unreachable); }
+  void emit_unreachable() { emit_error_handler(jit_symbol::on_unreachable); }
   void emit_nop() {}
-  void *emit_end() { return code; }
+  void *emit_end() {
+    // the label is the target of branches, which leave the result pushed
+    flush_top();
+    end_gas_block();
+    return code;
+  }
   void *emit_return(uint32_t depth_change) {
     // Return is defined as equivalent to branching to the outermost label
     return emit_br(depth_change);
   }
-  void emit_block() {}
-  void *emit_loop() { return code; }
+  void emit_block() { start_gas_block(); }
+  void *emit_loop() {
+    // branches to the loop charge again
+    flush_top();
+    void *result = code;
+    start_gas_block();
+    return result;
+  }
   void *emit_if() {
-    // pop RAX
-    emit_bytes(0x58);
-    // test EAX, EAX
-    emit_bytes(0x85, 0xC0);
+    uint8_t cc = emit_condition();
     // jz DEST
-    emit_bytes(0x0F, 0x84);
-    return emit_branch_target32();
+    emit_bytes(0x0F, jcc(cc ^ 1));
+    void *result = emit_branch_target32();
+    start_gas_block();
+    return result;
   }
   void *emit_else(void *if_loc) {
+    end_gas_block();
     void *result = emit_br(0);
     fix_branch(if_loc, code);
+    start_gas_block();
     return result;
   }
+
+  // Counts an instruction of the current metered block.
+  void meter_instruction() {
+    if (!_gas_blocks.empty())
+      ++_gas_blocks.back().cost;
+  }
   void *emit_br(uint32_t depth_change) {
     auto icount = variable_size_instr(5, 17);
     // add RSP, depth_change * 8
@@ -204,19 +307,16 @@ public:
     return emit_branch_target32();
   }
   void *emit_br_if(uint32_t depth_change) {
-    auto icount = variable_size_instr(9, 26);
-    // pop RAX
-    emit_bytes(0x58);
-    // test EAX, EAX
-    emit_bytes(0x85, 0xC0);
+    uint8_t cc = emit_condition();
+    auto icount = variable_size_instr(6, 23);
 
     if (depth_change == 0u || depth_change == 0x80000001u) {
       // jnz DEST
-      emit_bytes(0x0F, 0x85);
+      emit_bytes(0x0F, jcc(cc));
       return emit_branch_target32();
     } else {
       // jz SKIP
-      emit_bytes(0x0f, 0x84);
+      emit_bytes(0x0f, jcc(cc ^ 1));
       void *skip = emit_branch_target32();
       // add depth_change*8, %rsp
       emit_multipop(depth_change);
@@ -291,7 +391,7 @@ public:
   };
   br_table_generator emit_br_table(uint32_t table_size) {
     // pop %rax
-    emit_bytes(0x58);
+    pop_rax();
     // Increase the size by one to account for the default.
     // The current algorithm handles this correctly, without
     // any special cases.
@@ -299,6 +399,11 @@ public:
   }
 
   void register_call(void *ptr, uint32_t funcnum) {
+    if (_out) {
+      _out->calls.emplace_back(
+          static_cast<unsigned char *>(ptr) - _code_start, funcnum);
+      return;
+    }
     auto &vec = _function_relocations;
     if (funcnum >= vec.size())
       vec.resize(funcnum + 1);
@@ -319,21 +424,20 @@ public:
   }
 
   void emit_call(const func_type &ft, uint32_t funcnum) {
-    auto icount = variable_size_instr(15, 23);
+    auto icount = variable_size_instr(15, 22);
     emit_check_call_depth();
     // callq TARGET
     emit_bytes(0xe8);
     void *branch = emit_branch_target32();
     emit_multipop(ft.param_types.size());
     register_call(branch, funcnum);
-    if (ft.return_count != 0)
-      // pushq %rax
-      emit_bytes(0x50);
     emit_check_call_depth_end();
+    if (ft.return_count != 0)
+      defer_result();
   }
 
   void emit_call_indirect(const func_type &ft, uint32_t functypeidx) {
-    auto icount = variable_size_instr(43, 51);
+    auto icount = variable_size_instr(43, 50);
     emit_check_call_depth();
     auto &table = _mod.tables[0].table;
     functypeidx = _mod.type_aliases[functypeidx];
@@ -344,10 +448,10 @@ public:
     emit_operand32(table.size());
     // jae ERROR
     emit_bytes(0x0f, 0x83);
-    fix_branch(emit_branch_target32(), call_indirect_handler);
+    fix_external_branch(emit_branch_target32(), call_indirect_handler);
     // leaq table(%rip), %rdx
     emit_bytes(0x48, 0x8d, 0x15);
-    fix_branch(emit_branch_target32(), jmp_table);
+    fix_external_branch(emit_branch_target32(), jmp_table);
     // imul $17, %eax, %eax
     assert(_table_element_size <=
            127); // must fit in 8-bit signed value for imul
@@ -360,28 +464,29 @@ public:
     // callq *%rax
     emit_bytes(0xff, 0xd0);
     emit_multipop(ft.param_types.size());
-    if (ft.return_count != 0)
-      // pushq %rax
-      emit_bytes(0x50);
     emit_check_call_depth_end();
+    if (ft.return_count != 0)
+      defer_result();
   }
 
   void emit_drop() {
+    if (_top.kind != operand_kind::none) {
+      _top = {};
+      return;
+    }
     // pop RAX
     emit_bytes(0x58);
   }
 
   void emit_select() {
-    // popq RAX
-    emit_bytes(0x58);
+    uint8_t cc = emit_condition();
     // popq RCX
     emit_bytes(0x59);
-    // test EAX, EAX
-    emit_bytes(0x85, 0xc0);
-    // cmovnzq RCX, (RSP)
-    emit_bytes(0x48, 0x0f, 0x45, 0x0c, 0x24);
-    // movq (RSP), RCX
-    emit_bytes(0x48, 0x89, 0x0c, 0x24);
+    // popq RAX
+    emit_bytes(0x58);
+    // cmovzq RCX, RAX
+    emit_bytes(0x48, 0x0f, cmovcc(cc ^ 1), 0xc1);
+    defer_result();
   }
 
   void emit_get_local(uint32_t local_idx) {
@@ -397,59 +502,47 @@ public:
     //   local1
     //   ...
     //   localN
-    if (local_idx < _ft->param_types.size()) {
-      // mov 8*(local_idx)(%RBP), RAX
-      emit_bytes(0x48, 0x8b, 0x85);
-      emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
-      // push RAX
-      emit_bytes(0x50);
-    } else {
-      // mov -8*(local_idx+1)(%RBP), RAX
-      emit_bytes(0x48, 0x8b, 0x85);
-      emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
-      // push RAX
-      emit_bytes(0x50);
-    }
+    defer_local(local_offset(local_idx));
   }
 
   void emit_set_local(uint32_t local_idx) {
-    if (local_idx < _ft->param_types.size()) {
-      // pop RAX
-      emit_bytes(0x58);
-      // mov RAX, -8*local_idx(EBP)
-      emit_bytes(0x48, 0x89, 0x85);
-      emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
+    int32_t offset = local_offset(local_idx);
+    if (_top.kind == operand_kind::constant && is_simm32(_top.value)) {
+      uint64_t value = take_top().value;
+      // movq $value, offset(%RBP)
+      emit_bytes(0x48, 0xc7, 0x85);
+      emit_operand32(offset);
+      emit_operand32(value);
     } else {
       // pop RAX
-      emit_bytes(0x58);
-      // mov RAX, -8*local_idx(EBP)
+      pop_rax();
+      // mov RAX, offset(%RBP)
       emit_bytes(0x48, 0x89, 0x85);
-      emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
+      emit_operand32(offset);
     }
   }
 
   void emit_tee_local(uint32_t local_idx) {
-    if (local_idx < _ft->param_types.size()) {
-      // pop RAX
-      emit_bytes(0x58);
-      // push RAX
-      emit_bytes(0x50);
-      // mov RAX, -8*local_idx(EBP)
-      emit_bytes(0x48, 0x89, 0x85);
-      emit_operand32(8 * (_ft->param_types.size() - local_idx + 1));
+    int32_t offset = local_offset(local_idx);
+    if (_top.kind == operand_kind::constant && is_simm32(_top.value)) {
+      uint64_t value = take_top().value;
+      // movq $value, offset(%RBP)
+      emit_bytes(0x48, 0xc7, 0x85);
+      emit_operand32(offset);
+      emit_operand32(value);
+      defer_constant(value);
     } else {
       // pop RAX
-      emit_bytes(0x58);
-      // push RAX
-      emit_bytes(0x50);
-      // mov RAX, -8*local_idx(EBP)
+      pop_rax();
+      // mov RAX, offset(%RBP)
       emit_bytes(0x48, 0x89, 0x85);
-      emit_operand32(-8 * (local_idx - _ft->param_types.size() + 1));
+      emit_operand32(offset);
+      defer_result();
     }
   }
 
   void emit_get_global(uint32_t globalidx) {
-    auto icount = variable_size_instr(13, 14);
+    auto icount = variable_size_instr(12, 13);
     auto &gl = _mod.globals[globalidx];
     void *ptr = &gl.current.value;
     switch (gl.type.content_type) {
@@ -457,163 +550,192 @@ public:
     case types::f32:
       // movabsq $ptr, %rax
       emit_bytes(0x48, 0xb8);
-      emit_operand_ptr(ptr);
+      emit_relocated_ptr(jit_symbol::global_value, globalidx, ptr);
       // movl (%rax), eax
       emit_bytes(0x8b, 0x00);
-      // push %rax
-      emit_bytes(0x50);
       break;
     case types::i64:
     case types::f64:
       // movabsq $ptr, %rax
       emit_bytes(0x48, 0xb8);
-      emit_operand_ptr(ptr);
+      emit_relocated_ptr(jit_symbol::global_value, globalidx, ptr);
       // movl (%rax), %rax
       emit_bytes(0x48, 0x8b, 0x00);
-      // push %rax
-      emit_bytes(0x50);
       break;
     }
+    defer_result();
   }
   void emit_set_global(uint32_t globalidx) {
     auto &gl = _mod.globals[globalidx];
     void *ptr = &gl.current.value;
     // popq %rcx
-    emit_bytes(0x59);
+    pop_rcx();
     // movabsq $ptr, %rax
     emit_bytes(0x48, 0xb8);
-    emit_operand_ptr(ptr);
+    emit_relocated_ptr(jit_symbol::global_value, globalidx, ptr);
     // movq %rcx, (%rax)
     emit_bytes(0x48, 0x89, 0x08);
   }
 
   void emit_i32_load(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(7, 15);
+    pop_rax();
+    auto icount = variable_size_instr(5, 13);
     // movl (RAX), EAX
     emit_load_impl(offset, 0x8b, 0x00);
   }
 
   void emit_i64_load(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movq (RAX), RAX
     emit_load_impl(offset, 0x48, 0x8b, 0x00);
   }
 
   void emit_f32_load(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(7, 15);
+    pop_rax();
+    auto icount = variable_size_instr(5, 13);
     // movl (RAX), EAX
     emit_load_impl(offset, 0x8b, 0x00);
   }
 
   void emit_f64_load(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movq (RAX), RAX
     emit_load_impl(offset, 0x48, 0x8b, 0x00);
   }
 
   void emit_i32_load8_s(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movsbl (RAX), EAX;
     emit_load_impl(offset, 0x0F, 0xbe, 0x00);
   }
 
   void emit_i32_load16_s(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movswl (RAX), EAX;
     emit_load_impl(offset, 0x0F, 0xbf, 0x00);
   }
 
   void emit_i32_load8_u(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movzbl (RAX), EAX;
     emit_load_impl(offset, 0x0f, 0xb6, 0x00);
   }
 
   void emit_i32_load16_u(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movzwl (RAX), EAX;
     emit_load_impl(offset, 0x0f, 0xb7, 0x00);
   }
 
   void emit_i64_load8_s(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(9, 17);
+    pop_rax();
+    auto icount = variable_size_instr(7, 15);
     // movsbq (RAX), RAX;
     emit_load_impl(offset, 0x48, 0x0F, 0xbe, 0x00);
   }
 
   void emit_i64_load16_s(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(9, 17);
+    pop_rax();
+    auto icount = variable_size_instr(7, 15);
     // movswq (RAX), RAX;
     emit_load_impl(offset, 0x48, 0x0F, 0xbf, 0x00);
   }
 
   void emit_i64_load32_s(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movslq (RAX), RAX
     emit_load_impl(offset, 0x48, 0x63, 0x00);
   }
 
   void emit_i64_load8_u(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movzbl (RAX), EAX;
     emit_load_impl(offset, 0x0f, 0xb6, 0x00);
   }
 
   void emit_i64_load16_u(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movzwl (RAX), EAX;
     emit_load_impl(offset, 0x0f, 0xb7, 0x00);
   }
 
   void emit_i64_load32_u(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(7, 15);
+    pop_rax();
+    auto icount = variable_size_instr(5, 13);
     // movl (RAX), EAX
     emit_load_impl(offset, 0x8b, 0x00);
   }
 
   void emit_i32_store(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(7, 15);
+    pop_rcx();
+    pop_rax();
+    auto icount = variable_size_instr(5, 13);
     // movl ECX, (RAX)
     emit_store_impl(offset, 0x89, 0x08);
   }
 
   void emit_i64_store(uint32_t /*alignment*/, uint32_t offset) {
-    auto icount = variable_size_instr(8, 16);
+    pop_rcx();
+    pop_rax();
+    auto icount = variable_size_instr(6, 14);
     // movl ECX, (RAX)
     emit_store_impl(offset, 0x48, 0x89, 0x08);
   }
 
   void emit_f32_store(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movl ECX, (RAX)
     emit_store_impl(offset, 0x89, 0x08);
   }
 
   void emit_f64_store(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movl ECX, (RAX)
     emit_store_impl(offset, 0x48, 0x89, 0x08);
   }
 
   void emit_i32_store8(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movb CL, (RAX)
     emit_store_impl(offset, 0x88, 0x08);
   }
 
   void emit_i32_store16(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movb CX, (RAX)
     emit_store_impl(offset, 0x66, 0x89, 0x08);
   }
 
   void emit_i64_store8(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movb CL, (RAX)
     emit_store_impl(offset, 0x88, 0x08);
   }
 
   void emit_i64_store16(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movb CX, (RAX)
     emit_store_impl(offset, 0x66, 0x89, 0x08);
   }
 
   void emit_i64_store32(uint32_t /*alignment*/, uint32_t offset) {
+    pop_rcx();
+    pop_rax();
     // movl ECX, (RAX)
     emit_store_impl(offset, 0x89, 0x08);
   }
@@ -625,7 +747,7 @@ public:
     emit_bytes(0x56);
     // movabsq $current_memory, %rax
     emit_bytes(0x48, 0xb8);
-    emit_operand_ptr(&current_memory);
+    emit_relocated_ptr(jit_symbol::current_memory, 0, &current_memory);
     // call *%rax
     emit_bytes(0xff, 0xd0);
     // pop %rsi
@@ -646,7 +768,7 @@ public:
     emit_bytes(0x48, 0x89, 0xc6);
     // movabsq $grow_memory, %rax
     emit_bytes(0x48, 0xb8);
-    emit_operand_ptr(&grow_memory);
+    emit_relocated_ptr(jit_symbol::grow_memory, 0, &grow_memory);
     // call *%rax
     emit_bytes(0xff, 0xd0);
     // pop %rsi
@@ -657,21 +779,12 @@ public:
     emit_bytes(0x50);
   }
 
-  void emit_i32_const(uint32_t value) {
-    // mov $value, %eax
-    emit_bytes(0xb8);
-    emit_operand32(value);
-    // push %rax
-    emit_bytes(0x50);
-  }
+  void emit_memory_copy() { emit_bulk_memory(jit_symbol::memory_copy); }
+  void emit_memory_fill() { emit_bulk_memory(jit_symbol::memory_fill); }
 
-  void emit_i64_const(uint64_t value) {
-    // movabsq $value, %rax
-    emit_bytes(0x48, 0xb8);
-    emit_operand64(value);
-    // push %rax
-    emit_bytes(0x50);
-  }
+  void emit_i32_const(uint32_t value) { defer_constant(value); }
+
+  void emit_i64_const(uint64_t value) { defer_constant(value); }
 
   void emit_f32_const(float value) {
     // mov $value, %eax
@@ -689,16 +802,8 @@ public:
   }
 
   void emit_i32_eqz() {
-    // pop %rax
-    emit_bytes(0x58);
-    // xor %rcx, %rcx
-    emit_bytes(0x48, 0x31, 0xc9);
-    // test %eax, %eax
-    emit_bytes(0x85, 0xc0);
-    // setz %cl
-    emit_bytes(0x0f, 0x94, 0xc1);
-    // push %rcx
-    emit_bytes(0x51);
+    // setz
+    defer_condition(emit_condition() ^ 1);
   }
 
   // i32 relops
@@ -753,16 +858,8 @@ public:
   }
 
   void emit_i64_eqz() {
-    // pop %rax
-    emit_bytes(0x58);
-    // xor %rcx, %rcx
-    emit_bytes(0x48, 0x31, 0xc9);
-    // test %rax, %rax
-    emit_bytes(0x48, 0x85, 0xc0);
-    // setz %cl
-    emit_bytes(0x0f, 0x94, 0xc1);
-    // push %rcx
-    emit_bytes(0x51);
+    // setz
+    defer_condition(emit_condition(true) ^ 1);
   }
   // i64 relops
   void emit_i64_eq() {
@@ -925,9 +1022,9 @@ public:
   void emit_i32_div_u() { emit_i32_binop(0x31, 0xd2, 0xf7, 0xf1, 0x50); }
   void emit_i32_rem_s() {
     // pop %rcx
-    emit_bytes(0x59);
+    pop_rcx();
     // pop %rax
-    emit_bytes(0x58);
+    pop_rax();
     // cmp $-1, %edx
     emit_bytes(0x83, 0xf9, 0xff);
     // je MINUS1
@@ -1030,9 +1127,9 @@ public:
   }
   void emit_i64_rem_s() {
     // pop %rcx
-    emit_bytes(0x59);
+    pop_rcx();
     // pop %rax
-    emit_bytes(0x58);
+    pop_rax();
     // cmp $-1, %rcx
     emit_bytes(0x48, 0x83, 0xf9, 0xff);
     // je MINUS1
@@ -1350,11 +1447,20 @@ public:
   // --------------- conversions --------------------
 
   void emit_i32_wrap_i64() {
-    // Zero out the high 4 bytes
-    // xor %eax, %eax
-    emit_bytes(0x31, 0xc0);
-    // mov %eax, 4(%rsp)
-    emit_bytes(0x89, 0x44, 0x24, 0x04);
+    if (_top.kind == operand_kind::constant) {
+      _top.value &= 0xffffffffu;
+    } else if (_top.kind != operand_kind::none) {
+      pop_rax();
+      // mov %eax, %eax
+      emit_bytes(0x89, 0xc0);
+      defer_result();
+    } else {
+      // Zero out the high 4 bytes
+      // xor %eax, %eax
+      emit_bytes(0x31, 0xc0);
+      // mov %eax, 4(%rsp)
+      emit_bytes(0x89, 0x44, 0x24, 0x04);
+    }
   }
 
   void emit_i32_trunc_s_f32() {
@@ -1375,7 +1481,7 @@ public:
     emit_bytes(0x85, 0xc0);
     // jnz FP_ERROR_HANDLER
     emit_bytes(0x0f, 0x85);
-    fix_branch(emit_branch_target32(), fpe_handler);
+    fix_external_branch(emit_branch_target32(), fpe_handler);
   }
   void emit_i32_trunc_s_f64() {
     // cvttsd2si 8(%rsp), %eax
@@ -1395,14 +1501,23 @@ public:
     emit_bytes(0x85, 0xc0);
     // jnz FP_ERROR_HANDLER
     emit_bytes(0x0f, 0x85);
-    fix_branch(emit_branch_target32(), fpe_handler);
+    fix_external_branch(emit_branch_target32(), fpe_handler);
   }
 
   void emit_i64_extend_s_i32() {
-    // movslq (%rsp), %rax
-    emit_bytes(0x48, 0x63, 0x04, 0x24);
-    // mov %rax, (%rsp)
-    emit_bytes(0x48, 0x89, 0x04, 0x24);
+    if (_top.kind == operand_kind::constant) {
+      _top.value = static_cast<int32_t>(_top.value);
+    } else if (_top.kind != operand_kind::none) {
+      pop_rax();
+      // movslq %eax, %rax
+      emit_bytes(0x48, 0x63, 0xc0);
+      defer_result();
+    } else {
+      // movslq (%rsp), %rax
+      emit_bytes(0x48, 0x63, 0x04, 0x24);
+      // mov %rax, (%rsp)
+      emit_bytes(0x48, 0x89, 0x04, 0x24);
+    }
   }
 
   void emit_i64_extend_u_i32() { /* Nothing to do */
@@ -1451,7 +1566,7 @@ public:
     emit_bytes(0x48, 0x0f, 0xba, 0xe2, 0x3f);
     // jc FP_ERROR_HANDLER
     emit_bytes(0x0f, 0x82);
-    fix_branch(emit_branch_target32(), fpe_handler);
+    fix_external_branch(emit_branch_target32(), fpe_handler);
   }
   void emit_i64_trunc_s_f64() {
     // cvttsd2si (%rsp), %rax
@@ -1496,7 +1611,7 @@ public:
     emit_bytes(0x48, 0x0f, 0xba, 0xe2, 0x3f);
     // jc FP_ERROR_HANDLER
     emit_bytes(0x0f, 0x82);
-    fix_branch(emit_branch_target32(), fpe_handler);
+    fix_external_branch(emit_branch_target32(), fpe_handler);
   }
 
   void emit_f32_convert_s_i32() {
@@ -1649,12 +1764,103 @@ public:
 
   using fn_type = native_value (*)(void *context, void *memory);
   void finalize(function_body &body) {
+    if (_out) {
+      // the body offset is only known in merge()
+      _out->size = code - _code_start;
+      if (auto shrunk = std::realloc(_out->code.get(), _out->size)) {
+        _out->code.release();
+        _out->code.reset(static_cast<unsigned char *>(shrunk));
+      }
+      return;
+    }
     _mod.allocator.reclaim(code, _code_end - code);
     body.jit_code_offset = _code_start - (unsigned char *)_code_segment_base;
   }
 
+  // Appends the code of @fc, compiled by a writer made from this one, to
+  // the code segment.  Functions must be merged in order.
+  void merge(const function_code &fc, function_body &body) {
+    assert(!_out);
+    _code_start = _mod.allocator.alloc<unsigned char>(fc.size);
+    std::memcpy(_code_start, fc.code.get(), fc.size);
+    code = _code_end = _code_start + fc.size;
+    start_function(_code_start, fc.funcnum + _mod.get_imported_functions_size());
+    for (const auto &[offset, target] : fc.branches)
+      fix_branch(_code_start + offset, target);
+    for (const auto &[offset, funcnum] : fc.calls)
+      register_call(_code_start + offset, funcnum);
+    const auto base_offset =
+        static_cast<uint32_t>(_code_start - (unsigned char *)_code_segment_base);
+    for (jit_relocation reloc : fc.relocations) {
+      reloc.offset += base_offset;
+      _mod.jit_relocations.push_back(reloc);
+    }
+    body.jit_code_offset = base_offset;
+  }
+
+  // Installs the code of @image, generated for the same module by this
+  // writer, instead of generating it.  The module sections preceding the
+  // code section must already be parsed.
+  static void load_code_image(growable_allocator &alloc, module &mod,
+                              const jit_code_image &image) {
+    EOS_VM_ASSERT(image.function_offsets.size() == mod.code.size(),
+                  wasm_parse_exception, "code image does not match module");
+    unsigned char *base = alloc.alloc_jit_code(image.code_size);
+    std::memcpy(base, image.code, image.code_size);
+    mod.jit_relocations.assign(image.relocations,
+                               image.relocations + image.relocation_count);
+    for (const jit_relocation &reloc : mod.jit_relocations) {
+      EOS_VM_ASSERT(reloc.offset + sizeof(void *) <= image.code_size,
+                    wasm_parse_exception, "code image relocation out of range");
+      void *target = symbol_address(mod, static_cast<jit_symbol>(reloc.symbol),
+                                    reloc.index);
+      std::memcpy(base + reloc.offset, &target, sizeof(target));
+    }
+    for (std::size_t i = 0; i < image.function_offsets.size(); ++i) {
+      EOS_VM_ASSERT(image.function_offsets[i] < image.code_size,
+                    wasm_parse_exception, "code image function out of range");
+      mod.code[i].jit_code_offset = image.function_offsets[i];
+    }
+    mod.maximum_stack = image.maximum_stack;
+    alloc.enable_code(true);
+  }
+
+  static void *symbol_address(module &mod, jit_symbol symbol, uint32_t index) {
+    switch (symbol) {
+    case jit_symbol::global_value:
+      EOS_VM_ASSERT(index < mod.globals.size(), wasm_parse_exception,
+                    "code image global out of range");
+      return &mod.globals[index].current.value;
+    case jit_symbol::current_memory:
+      return reinterpret_cast<void *>(&current_memory);
+    case jit_symbol::grow_memory:
+      return reinterpret_cast<void *>(&grow_memory);
+    case jit_symbol::call_host_function:
+      return reinterpret_cast<void *>(&call_host_function);
+    case jit_symbol::on_unreachable:
+      return reinterpret_cast<void *>(&on_unreachable);
+    case jit_symbol::on_fp_error:
+      return reinterpret_cast<void *>(&on_fp_error);
+    case jit_symbol::on_call_indirect_error:
+      return reinterpret_cast<void *>(&on_call_indirect_error);
+    case jit_symbol::on_type_error:
+      return reinterpret_cast<void *>(&on_type_error);
+    case jit_symbol::on_stack_overflow:
+      return reinterpret_cast<void *>(&on_stack_overflow);
+    case jit_symbol::on_out_of_gas:
+      return reinterpret_cast<void *>(&on_out_of_gas);
+    case jit_symbol::memory_copy:
+      return reinterpret_cast<void *>(&memory_copy);
+    case jit_symbol::memory_fill:
+      return reinterpret_cast<void *>(&memory_fill);
+    }
+    EOS_VM_ASSERT(false, wasm_parse_exception, "unknown code image symbol");
+    return nullptr;
+  }
+
 private:
   auto fixed_size_instr(std::size_t expected_bytes) {
+    flush_top();
     return scope_guard{[this, expected_code = code + expected_bytes]() {
 #ifdef EOS_VM_VALIDATE_JIT_SIZE
       assert(code == expected_code);
@@ -1663,6 +1869,7 @@ private:
     }};
   }
   auto variable_size_instr(std::size_t min, std::size_t max) {
+    flush_top();
     return scope_guard{[this, min_code = code + min, max_code = code + max]() {
 #ifdef EOS_VM_VALIDATE_JIT_SIZE
       assert(min_code <= code && code <= max_code);
@@ -1673,6 +1880,7 @@ private:
 
   module &_mod;
   void *_code_segment_base;
+  function_code *_out = nullptr;
   const func_type *_ft;
   unsigned char *_code_start;
   unsigned char *_code_end;
@@ -1682,11 +1890,197 @@ private:
   void *call_indirect_handler;
   void *type_error_handler;
   void *stack_overflow_handler;
+  void *out_of_gas_handler;
   void *jmp_table;
   uint32_t _local_count;
   uint32_t _table_element_size;
 
-  void emit_byte(uint8_t val) { *code++ = val; }
+  // The top of the stack, while it is not pushed.
+  enum class operand_kind : uint8_t { none, constant, local, rax, flags };
+  struct deferred_operand {
+    operand_kind kind = operand_kind::none;
+    // the SETcc opcode of a pending comparison
+    uint8_t cc = 0;
+    // of a local, from %rbp
+    int32_t offset = 0;
+    // i32 constants are zero extended
+    uint64_t value = 0;
+  };
+  deferred_operand _top;
+
+  static bool is_simm32(uint64_t value) {
+    return static_cast<int64_t>(value) == static_cast<int32_t>(value);
+  }
+  // The Jcc and CMOVcc opcodes of the same condition as a SETcc opcode.
+  static uint8_t jcc(uint8_t setcc) { return setcc - 0x10; }
+  static uint8_t cmovcc(uint8_t setcc) { return setcc - 0x50; }
+
+  int32_t local_offset(uint32_t local_idx) const {
+    if (local_idx < _ft->param_types.size())
+      return 8 * (_ft->param_types.size() - local_idx + 1);
+    return -8 * (local_idx - _ft->param_types.size() + 1);
+  }
+
+  deferred_operand take_top() {
+    return std::exchange(_top, deferred_operand{});
+  }
+  void defer_constant(uint64_t value) {
+    flush_top();
+    _top.kind = operand_kind::constant;
+    _top.value = value;
+  }
+  void defer_local(int32_t offset) {
+    flush_top();
+    _top.kind = operand_kind::local;
+    _top.offset = offset;
+  }
+  // The result of the last instruction is in %rax.
+  void defer_result() {
+    assert(_top.kind == operand_kind::none);
+    _top.kind = operand_kind::rax;
+  }
+  // The result of the last instruction is the SETcc @cc condition.
+  void defer_condition(uint8_t cc) {
+    assert(_top.kind == operand_kind::none);
+    _top.kind = operand_kind::flags;
+    _top.cc = cc;
+  }
+
+  // Pushes the top of the stack, if it is pending.
+  void flush_top() {
+    if (_top.kind == operand_kind::none)
+      return;
+    deferred_operand top = take_top();
+    if (top.kind == operand_kind::constant && is_simm32(top.value)) {
+      // pushq $value
+      emit_bytes(0x68);
+      emit_operand32(top.value);
+    } else if (top.kind == operand_kind::local) {
+      // pushq offset(%rbp)
+      emit_bytes(0xff, 0xb5);
+      emit_operand32(top.offset);
+    } else {
+      emit_load_operand(top, 0);
+      // pushq %rax
+      emit_bytes(0x50);
+    }
+  }
+
+  // Moves @top into %rax (@reg 0) or %rcx (@reg 1), popping it if it was
+  // pushed.  Clobbers the flags of a pending comparison.
+  void emit_load_operand(const deferred_operand &top, uint8_t reg) {
+    switch (top.kind) {
+    case operand_kind::none:
+      // popq %reg
+      emit_bytes(0x58 | reg);
+      break;
+    case operand_kind::constant:
+      if (top.value <= 0xffffffffu) {
+        // mov $value, %reg32
+        emit_bytes(0xb8 | reg);
+        emit_operand32(top.value);
+      } else if (is_simm32(top.value)) {
+        // movq $value, %reg
+        emit_bytes(0x48, 0xc7, 0xc0 | reg);
+        emit_operand32(top.value);
+      } else {
+        // movabsq $value, %reg
+        emit_bytes(0x48, 0xb8 | reg);
+        emit_operand64(top.value);
+      }
+      break;
+    case operand_kind::local:
+      // movq offset(%rbp), %reg
+      emit_bytes(0x48, 0x8b, 0x85 | reg << 3);
+      emit_operand32(top.offset);
+      break;
+    case operand_kind::rax:
+      if (reg != 0)
+        // movq %rax, %reg
+        emit_bytes(0x48, 0x89, 0xc0 | reg);
+      break;
+    case operand_kind::flags:
+      // SETcc %reg8
+      emit_bytes(0x0f, top.cc, 0xc0 | reg);
+      // movzbl %reg8, %reg32
+      emit_bytes(0x0f, 0xb6, 0xc0 | reg << 3 | reg);
+      break;
+    }
+  }
+  void pop_rax() { emit_load_operand(take_top(), 0); }
+  void pop_rcx() { emit_load_operand(take_top(), 1); }
+
+  // Pops a condition into the flags and returns the SETcc opcode that is
+  // true when it is not zero.  A pending comparison is used as is.
+  uint8_t emit_condition(bool is64 = false) {
+    deferred_operand top = take_top();
+    if (top.kind == operand_kind::flags)
+      return top.cc;
+    if (top.kind == operand_kind::local) {
+      // cmp $0, offset(%rbp)
+      if (is64)
+        emit_bytes(0x48);
+      emit_bytes(0x83, 0xbd);
+      emit_operand32(top.offset);
+      emit_bytes(0x00);
+    } else {
+      emit_load_operand(top, 0);
+      // test %eax, %eax
+      if (is64)
+        emit_bytes(0x48);
+      emit_bytes(0x85, 0xc0);
+    }
+    // setnz
+    return 0x95;
+  }
+
+  // Metered blocks still open, innermost last.
+  struct gas_block {
+    unsigned char *charge;
+    uint64_t cost;
+  };
+  std::vector<gas_block> _gas_blocks;
+
+  void start_gas_block() {
+    if (!_mod.gas_metering)
+      return;
+    // the charge clobbers %rax and the flags
+    flush_top();
+    auto icount = fixed_size_instr(gas_charge_size);
+    _gas_blocks.push_back({code, 0});
+    // movq (%rdi), %rax
+    emit_bytes(0x48, 0x8b, 0x07);
+    // subq $cost, (%rax)
+    emit_bytes(0x48, 0x81, 0x28);
+    emit_operand32(0);
+    // js OUT_OF_GAS
+    emit_bytes(0x0f, 0x88);
+    fix_external_branch(emit_branch_target32(), out_of_gas_handler);
+  }
+
+  void end_gas_block() {
+    if (!_mod.gas_metering)
+      return;
+    assert(!_gas_blocks.empty());
+    auto [charge, cost] = _gas_blocks.back();
+    _gas_blocks.pop_back();
+    EOS_VM_ASSERT(cost <= 0x7fffffffu, wasm_parse_exception,
+                  "metered block too long");
+    if (cost == 0) {
+      // jmp over the charge
+      charge[0] = 0xeb;
+      charge[1] = gas_charge_size - 2;
+    } else {
+      uint32_t imm = cost;
+      memcpy(charge + 6, &imm, sizeof(imm));
+    }
+  }
+
+  void emit_byte(uint8_t val) {
+    if (_top.kind != operand_kind::none)
+      flush_top();
+    *code++ = val;
+  }
   void emit_bytes() {}
   template <class... T> void emit_bytes(uint8_t val0, T... vals) {
     emit_byte(val0);
@@ -1712,6 +2106,27 @@ private:
     memcpy(code, &val, sizeof(val));
     code += sizeof(val);
   }
+  template <class T>
+  void emit_relocated_ptr(jit_symbol symbol, uint32_t index, T *val) {
+    if (_out)
+      _out->relocations.push_back({static_cast<uint32_t>(code - _code_start),
+                                   static_cast<uint32_t>(symbol), index});
+    else
+      _mod.jit_relocations.push_back(
+          {static_cast<uint32_t>(code - (unsigned char *)_code_segment_base),
+           static_cast<uint32_t>(symbol), index});
+    emit_operand_ptr(val);
+  }
+
+  // For branches from a function body to code out of it, that is the
+  // handlers and the function table.
+  void fix_external_branch(void *branch, void *target) {
+    if (_out)
+      _out->branches.emplace_back(
+          static_cast<unsigned char *>(branch) - _code_start, target);
+    else
+      fix_branch(branch, target);
+  }
 
   void *emit_branch_target32() {
     void *result = code;
@@ -1725,7 +2140,7 @@ private:
     emit_bytes(0xff, 0xcb);
     // jz stack_overflow
     emit_bytes(0x0f, 0x84);
-    fix_branch(emit_branch_target32(), stack_overflow_handler);
+    fix_external_branch(emit_branch_target32(), stack_overflow_handler);
   }
   void emit_check_call_depth_end() {
     // incl %ebx
@@ -1758,9 +2173,8 @@ private:
     }
   }
 
+  // The address is already in %rax.
   template <class... T> void emit_load_impl(uint32_t offset, T... loadop) {
-    // pop %rax
-    emit_bytes(0x58);
     if (offset & 0x80000000) {
       // mov $offset, %ecx
       emit_bytes(0xb9);
@@ -1776,15 +2190,11 @@ private:
     emit_bytes(0x48, 0x01, 0xf0);
     // from the caller
     emit_bytes(static_cast<uint8_t>(loadop)...);
-    // push RAX
-    emit_bytes(0x50);
+    defer_result();
   }
 
+  // The value is already in %rcx and the address in %rax.
   template <class... T> void emit_store_impl(uint32_t offset, T... storeop) {
-    // pop RCX
-    emit_bytes(0x59);
-    // pop RAX
-    emit_bytes(0x58);
     if (offset & 0x80000000) {
       // mov $offset, %ecx
       emit_bytes(0xb9);
@@ -1800,37 +2210,44 @@ private:
     emit_bytes(0x48, 0x01, 0xf0);
     // from the caller
     emit_bytes(static_cast<uint8_t>(storeop)...);
-    ;
   }
 
-  void emit_i32_relop(uint8_t opcod) {
-    // popq %rax
-    emit_bytes(0x58);
-    // popq %rcx
-    emit_bytes(0x59);
-    // xorq %rdx, %rdx
-    emit_bytes(0x48, 0x31, 0xd2);
-    // cmpl %eax, %ecx
-    emit_bytes(0x39, 0xc1);
-    // SETcc %dl
-    emit_bytes(0x0f, opcod, 0xc2);
-    // pushq %rdx
-    emit_bytes(0x52);
-  }
+  void emit_i32_relop(uint8_t opcod) { emit_int_relop(false, opcod); }
 
   template <class... T> void emit_i64_relop(uint8_t opcod) {
-    // popq %rax
-    emit_bytes(0x58);
-    // popq %rcx
-    emit_bytes(0x59);
-    // xorq %rdx, %rdx
-    emit_bytes(0x48, 0x31, 0xd2);
-    // cmpq %rax, %rcx
-    emit_bytes(0x48, 0x39, 0xc1);
-    // SETcc %dl
-    emit_bytes(0x0f, opcod, 0xc2);
-    // pushq %rdx
-    emit_bytes(0x52);
+    emit_int_relop(true, opcod);
+  }
+
+  // Compares and leaves the SETcc @opcod condition pending in the flags.
+  void emit_int_relop(bool is64, uint8_t opcod) {
+    deferred_operand rhs = take_top();
+    if (rhs.kind == operand_kind::constant && (!is64 || is_simm32(rhs.value))) {
+      // popq %rcx
+      emit_bytes(0x59);
+      // cmp $value, %ecx
+      if (is64)
+        emit_bytes(0x48);
+      emit_bytes(0x81, 0xf9);
+      emit_operand32(rhs.value);
+    } else if (rhs.kind == operand_kind::local) {
+      // popq %rcx
+      emit_bytes(0x59);
+      // cmp offset(%rbp), %ecx
+      if (is64)
+        emit_bytes(0x48);
+      emit_bytes(0x3b, 0x8d);
+      emit_operand32(rhs.offset);
+    } else {
+      // popq %rax
+      emit_load_operand(rhs, 0);
+      // popq %rcx
+      emit_bytes(0x59);
+      // cmp %eax, %ecx
+      if (is64)
+        emit_bytes(0x48);
+      emit_bytes(0x39, 0xc1);
+    }
+    defer_condition(opcod);
   }
 
   void emit_f32_relop(uint8_t opcod, bool switch_params, bool flip_result) {
@@ -1894,23 +2311,75 @@ private:
   }
 
   template <class... T> void emit_i32_binop(T... op) {
-    // popq %rcx
-    emit_bytes(0x59);
-    // popq %rax
-    emit_bytes(0x58);
-    // OP %eax, %ecx
-    emit_bytes(static_cast<uint8_t>(op)...);
-    // pushq %rax
-    // emit_bytes(0x50);
+    emit_int_binop(false, {static_cast<uint8_t>(op)...});
   }
 
   template <class... T> void emit_i64_binop(T... op) {
-    // popq %rcx
-    emit_bytes(0x59);
-    // popq %rax
-    emit_bytes(0x58);
-    // OP %eax, %ecx
-    emit_bytes(static_cast<uint8_t>(op)...);
+    emit_int_binop(true, {static_cast<uint8_t>(op)...});
+  }
+
+  // @op computes %rax OP %rcx.  If it ends with pushq %rax, the result is
+  // left pending in %rax instead.  A constant or local right operand is used
+  // in place by add, sub, and, or, xor, imul and the shifts.
+  void emit_int_binop(bool is64, std::initializer_list<uint8_t> op) {
+    const uint8_t *ops = op.begin();
+    std::size_t size = op.size();
+    std::size_t rex = is64 ? 1 : 0;
+    bool simple = size == rex + 3 && ops[size - 1] == 0x50;
+    uint8_t opcode = ops[rex];
+    bool alu = simple && ops[rex + 1] == 0xc8 &&
+               (opcode == 0x01 || opcode == 0x09 || opcode == 0x21 ||
+                opcode == 0x29 || opcode == 0x31);
+    bool imul = size == rex + 4 && opcode == 0x0f && ops[rex + 1] == 0xaf;
+    bool shift = simple && opcode == 0xd3;
+    if ((alu || imul || shift) && _top.kind == operand_kind::constant &&
+        (!is64 || is_simm32(_top.value))) {
+      uint64_t value = take_top().value;
+      // popq %rax
+      emit_bytes(0x58);
+      if (is64)
+        emit_bytes(0x48);
+      if (alu) {
+        // OP $value, %eax
+        emit_bytes(0x81, 0xc0 | (opcode & 0x38));
+        emit_operand32(value);
+      } else if (imul) {
+        // imul $value, %eax, %eax
+        emit_bytes(0x69, 0xc0);
+        emit_operand32(value);
+      } else {
+        // OP $value, %eax
+        emit_bytes(0xc1, ops[rex + 1], static_cast<uint8_t>(value));
+      }
+      defer_result();
+    } else if ((alu || imul) && _top.kind == operand_kind::local) {
+      int32_t offset = take_top().offset;
+      // popq %rax
+      emit_bytes(0x58);
+      if (is64)
+        emit_bytes(0x48);
+      // OP offset(%rbp), %eax
+      if (alu)
+        emit_bytes(opcode + 2, 0x85);
+      else
+        emit_bytes(0x0f, 0xaf, 0x85);
+      emit_operand32(offset);
+      defer_result();
+    } else {
+      // popq %rcx
+      pop_rcx();
+      // popq %rax
+      pop_rax();
+      // OP %eax, %ecx
+      if (ops[size - 1] == 0x50) {
+        for (std::size_t i = 0; i < size - 1; ++i)
+          emit_byte(ops[i]);
+        defer_result();
+      } else {
+        for (uint8_t byte : op)
+          emit_byte(byte);
+      }
+    }
   }
 
   void emit_f32_binop(uint8_t op) {
@@ -1955,16 +2424,16 @@ private:
     emit_bytes(0xf6, 0xc1, 0x01);
     // jnz FP_ERROR_HANDLER
     emit_bytes(0x0f, 0x85);
-    fix_branch(emit_branch_target32(), fpe_handler);
+    fix_external_branch(emit_branch_target32(), fpe_handler);
   }
 
-  void *emit_error_handler(void (*handler)()) {
+  void *emit_error_handler(jit_symbol handler) {
     void *result = code;
     // andq $-16, %rsp;
     emit_bytes(0x48, 0x83, 0xe4, 0xf0);
     // movabsq &on_unreachable, %rax
     emit_bytes(0x48, 0xb8);
-    emit_operand_ptr(handler);
+    emit_relocated_ptr(handler, 0, symbol_address(_mod, handler, 0));
     // callq *%rax
     emit_bytes(0xff, 0xd0);
     return result;
@@ -1983,6 +2452,39 @@ private:
     emit_bytes(0x48, 0x8b, 0x24, 0x24);
   }
 
+  // Calls @helper with the three i32 operands of memory.copy or memory.fill
+  // in esi, edx and ecx.
+  void emit_bulk_memory(jit_symbol helper) {
+    pop_rax();
+    // mov %eax, %ecx
+    emit_bytes(0x89, 0xc1);
+    // pop %rdx
+    emit_bytes(0x5a);
+    // pop %rax
+    emit_bytes(0x58);
+    // pushq %rdi
+    emit_bytes(0x57);
+    // pushq %rsi
+    emit_bytes(0x56);
+    // mov %eax, %esi
+    emit_bytes(0x89, 0xc6);
+    // mov %rsp, %rax; andq $-16, %rsp; push %rax; push %rax
+    emit_bytes(0x48, 0x89, 0xe0);
+    emit_bytes(0x48, 0x83, 0xe4, 0xf0);
+    emit_bytes(0x50);
+    emit_bytes(0x50);
+    // movabsq $helper, %rax
+    emit_bytes(0x48, 0xb8);
+    emit_relocated_ptr(helper, 0, symbol_address(_mod, helper, 0));
+    // call *%rax
+    emit_bytes(0xff, 0xd0);
+    emit_restore_stack();
+    // pop %rsi
+    emit_bytes(0x5e);
+    // pop %rdi
+    emit_bytes(0x5f);
+  }
+
   void emit_host_call(uint32_t funcnum) {
     // mov $funcnum, %edx
     emit_bytes(0xba);
@@ -1996,7 +2498,8 @@ private:
     emit_align_stack();
     // movabsq $call_host_function, %rax
     emit_bytes(0x48, 0xb8);
-    emit_operand_ptr(&call_host_function);
+    emit_relocated_ptr(jit_symbol::call_host_function, 0,
+                       &call_host_function);
     // callq *%rax
     emit_bytes(0xff, 0xd0);
     emit_restore_stack();
@@ -2020,6 +2523,9 @@ private:
     native_value result;
     vm::longjmp_on_exception(
         [&]() { result = context->call_host_function(stack, idx); });
+    // Leave the jit frames to the execute call without unwinding them.
+    if (context->exit_requested())
+      vm::longjmp_exit();
     return result;
   }
 
@@ -2031,6 +2537,19 @@ private:
     return context->grow_linear_memory(pages);
   }
 
+  static void memory_copy(Context *context /*rdi*/, uint32_t dest,
+                          uint32_t src, uint32_t count) {
+    vm::longjmp_on_exception(
+        [&]() { context->copy_linear_memory(dest, src, count); });
+  }
+
+  static void memory_fill(Context *context /*rdi*/, uint32_t dest,
+                          uint32_t value, uint32_t count) {
+    vm::longjmp_on_exception([&]() {
+      context->fill_linear_memory(dest, static_cast<uint8_t>(value), count);
+    });
+  }
+
   static void on_unreachable() {
     vm::throw_<wasm_interpreter_exception>("unreachable");
   }
@@ -2047,6 +2566,7 @@ private:
   static void on_stack_overflow() {
     vm::throw_<wasm_interpreter_exception>("stack overflow");
   }
+  static void on_out_of_gas() { vm::throw_<out_of_gas_exception>("out of gas"); }
 };
 
 } // namespace vm
@@ -26,6 +26,71 @@ extern "C" {
 
 EVMC_EXPORT evmc_vm *evmc_create_athena(void) noexcept;
 
+/// Timings of one execution phase in nanoseconds, collected process-wide
+/// while the "benchmark" option is set to "true".
+struct athena_phase_stats {
+  const char *phase;
+  uint64_t count;
+  uint64_t total_ns;
+  uint64_t min_ns;
+  uint64_t max_ns;
+  uint64_t p50_ns;
+  uint64_t p90_ns;
+  uint64_t p99_ns;
+};
+
+/// Copies the statistics of at most @capacity phases into @stats.
+/// @returns the number of phases, which may exceed @capacity.
+EVMC_EXPORT size_t athena_get_benchmark_stats(struct athena_phase_stats *stats,
+                                              size_t capacity) noexcept;
+
+/// One message of a batch, executed like evmc_vm::execute() with its own
+/// host context.
+struct athena_batch_message {
+  struct evmc_host_context *context;
+  const struct evmc_message *msg;
+  const uint8_t *code;
+  size_t code_size;
+};
+
+/// Executes @count independent messages on the worker threads of @vm and
+/// stores the result of @messages[i] in @results[i]. The host interface is
+/// called concurrently, each for a different host context. The number of
+/// threads is set with the "batch-threads" option.
+EVMC_EXPORT void
+athena_execute_batch(struct evmc_vm *vm, const struct evmc_host_interface *host,
+                     enum evmc_revision rev,
+                     const struct athena_batch_message *messages,
+                     struct evmc_result *results, size_t count) noexcept;
+
+/// Called with the storage @keys of @address which the execution of a
+/// message is expected to read, before the contract is instantiated. The
+/// host can start loading them then, it must not block on the loads nor
+/// call back into the VM.
+typedef void (*athena_storage_prefetch_fn)(void *user_data,
+                                           struct evmc_host_context *context,
+                                           const evmc_address *address,
+                                           const evmc_bytes32 *keys,
+                                           size_t count);
+
+/// Sets the storage prefetch callback of @vm, or clears it if @fn is NULL.
+/// Like set_option(), this must not run concurrently with executions.
+EVMC_EXPORT void athena_set_storage_prefetch(struct evmc_vm *vm,
+                                             athena_storage_prefetch_fn fn,
+                                             void *user_data) noexcept;
+
+/// Queues the Wasm @code with the code hash @code_hash to be validated and
+/// compiled (metered if so configured) on a background thread, so that its
+/// first execution finds it compiled. The code is copied. The number of
+/// threads is set with the "prepare-threads" option. Setting it, or an
+/// option the compilations depend on, waits for the running compilations
+/// and drops the queued ones.
+/// @returns false if the code is not WebAssembly, the module cache is
+/// disabled or the queue is full.
+EVMC_EXPORT bool athena_prepare(struct evmc_vm *vm,
+                                const evmc_bytes32 *code_hash,
+                                const uint8_t *code, size_t code_size) noexcept;
+
 #if __cplusplus
 }
 #endif
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+namespace athena {
+
+// Flat open addressing hash map keyed by account address, for the few
+// entries looked up on every execution. Entries cannot be removed, so the
+// references returned stay valid until the map grows.
+template <typename T> class AddressMap {
+public:
+  // @returns the value of @key or nullptr.
+  T *find(evmc::address const &key) noexcept {
+    if (m_size == 0)
+      return nullptr;
+    for (size_t i = index(key);; i = (i + 1) & mask()) {
+      Slot &slot = m_slots[i];
+      if (!slot.used)
+        return nullptr;
+      if (slot.key == key)
+        return &slot.value;
+    }
+  }
+
+  // @returns the value of @key, inserting a default constructed one.
+  T &operator[](evmc::address const &key) {
+    if (T *value = find(key))
+      return *value;
+    if (2 * (m_size + 1) > m_slots.size())
+      grow();
+    Slot &slot = emptySlot(key);
+    slot.used = true;
+    slot.key = key;
+    m_size++;
+    return slot.value;
+  }
+
+  size_t size() const noexcept { return m_size; }
+  bool empty() const noexcept { return m_size == 0; }
+
+private:
+  struct Slot {
+    bool used = false;
+    evmc::address key{};
+    T value{};
+  };
+
+  static constexpr size_t initialCapacity = 8;
+
+  size_t mask() const noexcept { return m_slots.size() - 1; }
+
+  size_t index(evmc::address const &key) const noexcept {
+    uint64_t words[3] = {};
+    memcpy(words, key.bytes, sizeof(key.bytes));
+    const uint64_t hash =
+        (words[0] ^ (words[1] * 0xff51afd7ed558ccd) ^ (words[2] << 17)) *
+        0x9e3779b97f4a7c15;
+    return size_t(hash >> 32) & mask();
+  }
+
+  Slot &emptySlot(evmc::address const &key) noexcept {
+    size_t i = index(key);
+    while (m_slots[i].used)
+      i = (i + 1) & mask();
+    return m_slots[i];
+  }
+
+  void grow() {
+    std::vector<Slot> slots(m_slots.empty() ? initialCapacity
+                                            : 2 * m_slots.size());
+    slots.swap(m_slots);
+    for (Slot &slot : slots)
+      if (slot.used)
+        emptySlot(slot.key) = std::move(slot);
+  }
+
+  std::vector<Slot> m_slots;
+  size_t m_size = 0;
+};
+
+} // namespace athena
@@ -16,21 +16,42 @@
 
 #include <athena/athena.h>
 
+#include <atomic>
+#include <cctype>
 #include <csignal>
+#include <cstdlib>
 #include <cstring>
+#include <deque>
+#include <fstream>
 //#include <execinfo.h>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
 
 #include <evmc/evmc.h>
+#include <evmc/helpers.h>
 
+#include "addressmap.h"
+#include "benchmark.h"
+#include "crypto.h"
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "hostprofile.h"
+#include "metering.h"
+#include "modulecache.h"
+#include "precompiles.h"
+#include "rejectioncache.h"
+#include "threadpool.h"
+#include "trace.h"
+#include "translationcache.h"
+#include "validation.h"
 #if H_EOS
 #include "eosvm.h"
 #endif
@@ -59,18 +80,37 @@ const map<string, athena_evm1mode> evm1mode_options{
     {"runevm", athena_evm1mode::runevm_contract},
 };
 
+enum class athena_metering {
+  disabled,
+  contract,
+  native,
+  // metered when compiled, by the engine where it supports it
+  jit,
+};
+
+const map<string, athena_metering> metering_options{
+    {"false", athena_metering::disabled},
+    {"true", athena_metering::contract},
+    {"contract", athena_metering::contract},
+    {"native", athena_metering::native},
+    {"jit", athena_metering::jit},
+};
+
 using WasmEngineCreateFn = unique_ptr<WasmEngine> (*)();
 
 const map<string, WasmEngineCreateFn> wasm_engine_map {
 #if H_EOS
   {"eosvm", EOSvmEngine::create},
+      {"eosvm-threaded", EOSvmEngine::createThreaded},
+      {"eosvm-interpreter", EOSvmEngine::createInterpreter},
+      {"eosvm-tiered", EOSvmEngine::createTiered},
 #endif
 #if H_WABT
       {"wabt", WabtEngine::create},
 #endif
 };
 
-WasmEngineCreateFn wasmEngineCreateFn =
+const WasmEngineCreateFn defaultEngineCreateFn =
 // This is the order of preference.
 #if H_WABT
     WabtEngine::create
@@ -81,16 +121,167 @@ WasmEngineCreateFn wasmEngineCreateFn =
 #endif
     ;
 
+// State reused by every execution at one call depth.
+struct ExecutionFrame {
+  static constexpr size_t reentrantCacheCapacity = 4;
+
+  ExecutionResult result;
+  // Executable code of the contract when it is not run as is: metered on
+  // deployment.
+  bytes code;
+  // evm2wasm translation of the contract, shared with the translation cache.
+  shared_ptr<bytes const> translation;
+  // Modules of contracts reentered at this depth, the shared cached module
+  // is in use by the outer call then.
+  ModuleCache reentrantModules{reentrantCacheCapacity};
+  // runevm executions nest when the interpreted contract calls another EVM
+  // contract, each depth gets its own runevm module then.
+  shared_ptr<WasmModule> runevmModule;
+  bool active = false;
+};
+
+// Execution state of one thread. Engines and compiled modules are not safe
+// to use from several threads at once, every thread executing on an
+// instance gets its own.
+struct ThreadState {
+  // Settings generation of the instance applied last.
+  uint64_t generation = 0;
+  uint64_t runevmGeneration = 0;
+  WasmEngineCreateFn engineCreateFn = nullptr;
+  unique_ptr<WasmEngine> engine;
+  // Contracts are compiled with gas metering.
+  bool meterOnLoad = false;
+  // Diagnostics of the instance, switched on for the executions of the
+  // thread by DiagnosticsScope.
+  bool benchmarkEnabled = false;
+  bool hostProfileEnabled = false;
+  bool traceEnabled = false;
+  ModuleCache moduleCache;
+  // The runevm interpreter does not depend on the contract, it is generated
+  // and compiled on first use.
+  bytes runevmCode;
+  shared_ptr<WasmModule> runevmModule;
+  // Keys handed to the storage prefetch callback.
+  vector<evmc::bytes32> prefetchKeys;
+  // Indexed by evmc_message::depth, a deque keeps the frames of outer calls
+  // in place while nested calls grow it.
+  deque<ExecutionFrame> frames;
+
+  bool executing() const noexcept {
+    for (auto const &frame : frames)
+      if (frame.active)
+        return true;
+    return false;
+  }
+};
+
+// A contract overridden with sys:, prepared when the option is set.
+struct SystemContract {
+  bytes code;
+  // Hash of the code, which keys its compiled modules instead of the code
+  // hash reported by the host.
+  evmc::bytes32 codeHash{};
+  // Compiled at settings generation preparedGeneration, the first thread
+  // executing the contract with those settings takes it.
+  shared_ptr<WasmModule> prepared;
+  uint64_t preparedGeneration = 0;
+  bool preparedMetered = false;
+};
+
+// A contract compiled ahead of its execution by athena_prepare().
+struct PreparedModule {
+  bytes code;
+  // null while the compilation is queued or running
+  shared_ptr<WasmModule> module;
+  uint64_t generation = 0;
+  bool metered = false;
+};
+
+atomic<uint64_t> nextInstanceId{1};
+
+// Settings are changed by set_option(), which must not run concurrently with
+// executions. Changes to the settings below the generation are picked up by
+// each thread on its next outermost execution.
 struct athena_instance : evmc_vm {
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
+  const uint64_t id = nextInstanceId++;
   athena_evm1mode evm1mode = athena_evm1mode::reject;
-  bool metering = false;
-  map<evmc::address, bytes> contract_preload_list;
+  athena_metering metering = athena_metering::disabled;
+  AddressMap<SystemContract> contract_preload_list;
+  TranslationCache translationCache;
+  // Code which failed to compile with the current settings.
+  RejectionCache rejectionCache;
+
+  atomic<uint64_t> generation{1};
+  WasmEngineCreateFn engineCreateFn = defaultEngineCreateFn;
+  size_t moduleCacheCapacity = ModuleCache::defaultCapacity;
+  // Bumped when the runevm system contract is replaced.
+  uint64_t runevmGeneration = 0;
+  bool benchmarkEnabled = false;
+  bool hostProfileEnabled = false;
+  bool traceEnabled = false;
+  bool storageCacheEnabled = false;
+  // eos-vm settings, kept across engine changes.
+  bool eosvmLazyZero = false;
+  string eosvmJitCacheDir;
+  uint64_t eosvmDeadlineUs = 0;
+  uint64_t eosvmTierUpThreshold = 2;
+  uint64_t eosvmSnapshotThreshold = 16384;
+  // the compile time maxima of eos-vm by default
+  uint32_t eosvmMaxPages = UINT32_MAX;
+  uint32_t eosvmMaxCallDepth = UINT32_MAX;
+  size_t eosvmMemoryPoolSize = 16;
+  bool eosvmHugePages = false;
+  bool eosvmPerfMap = false;
+  size_t eosvmCompileThreads = 1;
+  bool nativePrecompiles = false;
+  // where trace=dump writes the trace buffers
+  string traceFile = "athena.trace";
+  athena_storage_prefetch_fn storagePrefetch = nullptr;
+  void *storagePrefetchData = nullptr;
+
+  mutex threadsMutex;
+  unordered_map<thread::id, unique_ptr<ThreadState>> threads;
+
+  // Runs athena_execute_batch(), 0 threads means one per hardware thread.
+  size_t batchThreads = 0;
+  mutex poolMutex;
+  unique_ptr<ThreadPool> pool;
+
+  // Modules compiled by athena_prepare(), keyed by code hash. The first
+  // thread missing one in its module cache takes it.
+  static constexpr size_t maxPreparedModules = 1024;
+  size_t prepareThreads = 1;
+  mutex preparedMutex;
+  map<evmc::bytes32, PreparedModule> preparedModules;
+  // Declared last to stop before the state its jobs use goes.
+  unique_ptr<JobQueue> prepareQueue;
 
   athena_instance() noexcept
       : evmc_vm({EVMC_ABI_VERSION, "athena",
                  athena_get_buildinfo()->project_version, nullptr, nullptr,
                  nullptr, nullptr}) {}
+
+  // Waits for the compilations started by athena_prepare() and drops the
+  // queued ones, which use the settings.
+  void stopPreparing() {
+    prepareQueue.reset();
+    lock_guard<mutex> lock(preparedMutex);
+    for (auto it = preparedModules.begin(); it != preparedModules.end();)
+      it = it->second.module ? next(it) : preparedModules.erase(it);
+  }
+
+  // Applies @update to the settings below the generation. The compilations
+  // of athena_prepare() read them as well and are stopped first.
+  template <typename Update> void changeSettings(Update &&update) {
+    stopPreparing();
+    update();
+    rejectionCache.clear();
+    {
+      lock_guard<mutex> lock(preparedMutex);
+      preparedModules.clear();
+    }
+    generation.fetch_add(1, memory_order_release);
+  }
 };
 
 using namespace evmc::literals;
@@ -132,8 +323,9 @@ pair<evmc_status_code, bytes> callSystemContract(evmc::HostContext &context,
 }
 
 pair<evmc_status_code, bytes> locallyExecuteSystemContract(
-    evmc::HostContext &context, evmc_address const &address, int64_t &gas,
-    bytes_view input, bytes_view code, bytes_view state_code) {
+    evmc::HostContext &context, WasmEngineCreateFn engineCreateFn,
+    evmc_address const &address, int64_t &gas, bytes_view input,
+    WasmModule *module, bytes_view code, bytes_view state_code) {
   const evmc_message message = {
       .kind = EVMC_CALL,
       .flags = EVMC_STATIC,
@@ -147,10 +339,14 @@ pair<evmc_status_code, bytes> locallyExecuteSystemContract(
       .create2_salt = {},
   };
 
-  unique_ptr<WasmEngine> engine = wasmEngineCreateFn();
+  unique_ptr<WasmEngine> engine = engineCreateFn();
+  // system contracts run unmetered, any revision charges the same
+  const evmc_revision rev = EVMC_BYZANTIUM;
   // TODO: should we catch exceptions here?
   ExecutionResult result =
-      engine->execute(context, code, state_code, message, false);
+      module
+          ? engine->execute(context, *module, state_code, message, rev, false)
+          : engine->execute(context, code, state_code, message, rev, false);
 
   bytes ret;
   evmc_status_code status = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
@@ -210,9 +406,33 @@ bytes evm2wasm(evmc::HostContext &context, bytes_view input) {
   return ret;
 }
 
+// Translates the EVM @code of @address via evm2wasm, unless the translation
+// cache already has it.
+// @returns the translated code, shared with the translation cache.
+shared_ptr<bytes const> translateEvm(athena_instance *athena,
+                                     evmc::HostContext &context,
+                                     evmc_address const &address,
+                                     bytes_view code) {
+  const evmc::bytes32 key = context.get_code_hash(address);
+  if (!is_zero(key))
+    if (auto ret = athena->translationCache.find(key, code))
+      return ret;
+
+  shared_ptr<bytes const> ret;
+  {
+    benchmark::ScopedTimer timer(benchmark::Phase::Translation);
+    ret = make_shared<bytes const>(evm2wasm(context, code));
+  }
+
+  if (!is_zero(key) && hasWasmPreamble(*ret))
+    athena->translationCache.insert(key, code, ret);
+  return ret;
+}
+
 // Calls the runevm contract.
 // @returns a wasm-based evm interpreter.
-bytes runevm(evmc::HostContext &context, bytes code) {
+bytes runevm(evmc::HostContext &context, WasmEngineCreateFn engineCreateFn,
+             WasmModule *module, bytes_view code) {
   H_DEBUG << "Calling runevm (code " << code.size() << " bytes)...\n";
 
   int64_t gas = numeric_limits<int64_t>::max(); // do not charge for metering
@@ -220,8 +440,8 @@ bytes runevm(evmc::HostContext &context, bytes code) {
   evmc_status_code status;
   bytes ret;
 
-  tie(status, ret) =
-      locallyExecuteSystemContract(context, runevmAddress, gas, {}, code, code);
+  tie(status, ret) = locallyExecuteSystemContract(
+      context, engineCreateFn, runevmAddress, gas, {}, module, code, code);
 
   H_DEBUG << "runevm done (output " << ret.size()
           << " bytes) with status=" << status << "\n";
@@ -236,8 +456,378 @@ bytes runevm(evmc::HostContext &context, bytes code) {
   return ret;
 }
 
+// @returns the module prepared for @contract if it was compiled with the
+// settings of @state and no other thread took it yet.
+shared_ptr<WasmModule> takePrepared(ThreadState &state,
+                                    SystemContract &contract, bool metered) {
+  if (contract.preparedGeneration != state.generation ||
+      contract.preparedMetered != metered)
+    return nullptr;
+  return atomic_exchange(&contract.prepared, shared_ptr<WasmModule>{});
+}
+
+// Compiles the contract @code, metered if so configured. A module prepared
+// for the overriding @system contract is used instead when it fits.
+shared_ptr<WasmModule> compileContract(ThreadState &state, bytes_view code,
+                                       SystemContract *system = nullptr) {
+  if (system)
+    if (auto module = takePrepared(state, *system, state.meterOnLoad))
+      return module;
+  prevalidateContract(code);
+  if (state.meterOnLoad)
+    return state.engine->compileMetered(code);
+  return state.engine->compile(code);
+}
+
+// @returns the module compiled by athena_prepare() for @code with hash @key
+// if it was compiled with the settings of @state.
+shared_ptr<WasmModule> takePreparedModule(athena_instance *athena,
+                                          ThreadState &state,
+                                          evmc::bytes32 const &key,
+                                          bytes_view code) {
+  lock_guard<mutex> lock(athena->preparedMutex);
+  auto it = athena->preparedModules.find(key);
+  if (it == athena->preparedModules.end() || !it->second.module)
+    return nullptr;
+  shared_ptr<WasmModule> module;
+  if (it->second.code == code && it->second.generation == state.generation &&
+      it->second.metered == state.meterOnLoad)
+    module = move(it->second.module);
+  athena->preparedModules.erase(it);
+  return module;
+}
+
+// Compiles the contract @code with hash @key unless it was rejected before,
+// code failing to validate is remembered in the rejection cache.
+shared_ptr<WasmModule> compileUnlessRejected(athena_instance *athena,
+                                             ThreadState &state,
+                                             evmc::bytes32 const &key,
+                                             bytes_view code,
+                                             SystemContract *system) {
+  ensureCondition(!athena->rejectionCache.contains(key, code),
+                  ContractValidationFailure, "Contract was rejected before.");
+  try {
+    return compileContract(state, code, system);
+  } catch (ContractValidationFailure const &) {
+    athena->rejectionCache.insert(key, code);
+    throw;
+  }
+}
+
+// Looks up the compiled @code in the module cache of the thread, keyed by
+// the code hash of @address reported by the host, or by the hash of the
+// code of the overriding @system contract. Code the host reports no hash
+// for is keyed by its keccak256 hash, code without a usable module cache
+// still goes through the rejection cache. A cached module executing in an
+// outer call is never returned, reentrant calls get a module of their own
+// from @frame, as its linear memory and globals belong to the outer call.
+// @returns the cached module or a freshly compiled (and cached) one.
+shared_ptr<WasmModule> loadModule(athena_instance *athena, ThreadState &state,
+                                  ExecutionFrame &frame,
+                                  evmc::HostContext &context,
+                                  evmc_address const &address, bytes_view code,
+                                  SystemContract *system) {
+  benchmark::Timer timer;
+  evmc::bytes32 key =
+      system ? system->codeHash : context.get_code_hash(address);
+  // the host reports no code hash, key the code by its own hash
+  if (is_zero(key))
+    key = crypto::keccak256(code);
+
+  ModuleCache &cache = state.moduleCache;
+  if (cache.capacity() == 0)
+    return compileUnlessRejected(athena, state, key, code, system);
+
+  shared_ptr<WasmModule> module = cache.find(key, code);
+  timer.lap(benchmark::Phase::Load);
+  if (!module) {
+    if (!system)
+      module = takePreparedModule(athena, state, key, code);
+    if (!module)
+      module = compileUnlessRejected(athena, state, key, code, system);
+    cache.insert(key, code, module);
+  } else if (module->active) {
+    module = frame.reentrantModules.find(key, code);
+    if (!module) {
+      module = compileContract(state, code);
+      frame.reentrantModules.insert(key, code, module);
+    }
+  }
+  return module;
+}
+
+// @returns true if contracts are metered when deployed.
+bool meterOnDeployment(athena_instance *athena) noexcept {
+  return athena->metering == athena_metering::contract ||
+         athena->metering == athena_metering::native;
+}
+
+// Meters @code either natively or via the Sentinel contract.
+bytes meter(athena_instance *athena, evmc::HostContext &context,
+            bytes_view code) {
+  benchmark::ScopedTimer timer(benchmark::Phase::Metering);
+  if (athena->metering == athena_metering::native) {
+#if H_DEBUGGING
+    H_DEBUG << "Metering natively (input " << code.size() << " bytes)\n";
+#endif
+    return injectMetering(code);
+  }
+  return sentinel(context, code);
+}
+
+// @returns the runevm interpreter of the thread, generating it on first use.
+bytes const &runevmInterpreter(athena_instance *athena, ThreadState &state,
+                               evmc::HostContext &context) {
+  if (state.runevmCode.empty()) {
+    SystemContract *contract = athena->contract_preload_list.find(runevmAddress);
+    ensureCondition(contract, ContractValidationFailure,
+                    "runevm is not loaded.");
+    // runevm itself is executed unmetered
+    auto module = takePrepared(state, *contract, false);
+    bytes code =
+        runevm(context, state.engineCreateFn, module.get(), contract->code);
+    ensureCondition(code.size() > 8, ContractValidationFailure,
+                    "Interpreting via runevm failed");
+    state.runevmCode = move(code);
+  }
+  return state.runevmCode;
+}
+
+// @returns the compiled runevm interpreter, compiling it on first use.
+shared_ptr<WasmModule> runevmModule(ThreadState &state, ExecutionFrame &frame) {
+  WasmEngine &engine = *state.engine;
+  if (!state.runevmModule)
+    state.runevmModule = engine.compile(state.runevmCode);
+  if (!state.runevmModule->active)
+    return state.runevmModule;
+  if (!frame.runevmModule)
+    frame.runevmModule = engine.compile(state.runevmCode);
+  return frame.runevmModule;
+}
+
+// Hands the storage keys @module is expected to read when executing @msg to
+// the prefetch callback, whose host loads them while the module is
+// instantiated. The analysis is kept with the cached module.
+void prefetchStorage(athena_instance *athena, ThreadState &state,
+                     WasmModule &module, bytes_view code,
+                     evmc_host_context *context, evmc_message const &msg) {
+  if (!module.storageKeysAnalyzed) {
+    module.storageKeys = StorageKeyPlan::analyze(code);
+    module.storageKeysAnalyzed = true;
+  }
+  if (module.storageKeys.empty())
+    return;
+
+  vector<evmc::bytes32> &keys = state.prefetchKeys;
+  keys.clear();
+  module.storageKeys.evaluate({msg.input_data, msg.input_size}, keys);
+  if (!keys.empty())
+    athena->storagePrefetch(athena->storagePrefetchData, context,
+                            &msg.destination, keys.data(), keys.size());
+}
+
+// The EVM call depth limit.
+constexpr int32_t maxCallDepth = 1024;
+
+// @returns the frame of @depth, or nullptr if it is in use. System contracts
+// are called at depth 0 from within executions at any depth.
+ExecutionFrame *executionFrame(ThreadState &state, int32_t depth) {
+  if (depth < 0 || depth > maxCallDepth)
+    return nullptr;
+  while (state.frames.size() <= size_t(depth))
+    state.frames.emplace_back();
+  ExecutionFrame &frame = state.frames[depth];
+  return frame.active ? nullptr : &frame;
+}
+
+// Brings the engine and caches of @state up to date with the settings of
+// @athena.
+void configure(athena_instance *athena, ThreadState &state,
+               uint64_t generation) {
+  const bool meterOnLoad = athena->metering == athena_metering::jit;
+  if (state.engineCreateFn != athena->engineCreateFn || !state.engine) {
+    state.engineCreateFn = athena->engineCreateFn;
+    state.engine = state.engineCreateFn();
+    // compiled modules are engine specific
+    state.moduleCache.clear();
+    state.runevmModule.reset();
+    state.frames.clear();
+  } else if (state.meterOnLoad != meterOnLoad) {
+    state.moduleCache.clear();
+    state.frames.clear();
+  }
+  state.meterOnLoad = meterOnLoad;
+  state.benchmarkEnabled = athena->benchmarkEnabled;
+  state.hostProfileEnabled = athena->hostProfileEnabled;
+  state.traceEnabled = athena->traceEnabled;
+  state.engine->setStorageCache(athena->storageCacheEnabled);
+#if H_EOS
+  if (auto eosvm = dynamic_cast<EOSvmEngine *>(state.engine.get())) {
+    eosvm->setLazyZero(athena->eosvmLazyZero);
+    eosvm->setDeadline(chrono::microseconds(athena->eosvmDeadlineUs));
+    eosvm->setTierUpThreshold(athena->eosvmTierUpThreshold);
+    eosvm->setSnapshotThreshold(athena->eosvmSnapshotThreshold);
+    eosvm->setLimits(athena->eosvmMaxPages, athena->eosvmMaxCallDepth);
+    eosvm->setMemoryPoolSize(athena->eosvmMemoryPoolSize);
+    eosvm->setHugePages(athena->eosvmHugePages);
+    eosvm->setCompileThreads(athena->eosvmCompileThreads);
+    eosvm->setPerfMap(athena->eosvmPerfMap);
+    if (!athena->eosvmJitCacheDir.empty())
+      eosvm->setJitCacheDirectory(athena->eosvmJitCacheDir);
+  }
+#endif
+  state.moduleCache.setCapacity(athena->moduleCacheCapacity);
+  if (state.runevmGeneration != athena->runevmGeneration) {
+    state.runevmGeneration = athena->runevmGeneration;
+    state.runevmCode.clear();
+    state.runevmModule.reset();
+    for (auto &frame : state.frames)
+      frame.runevmModule.reset();
+  }
+  state.generation = generation;
+}
+
+// @returns the execution state of the calling thread on @athena.
+ThreadState &threadState(athena_instance *athena) {
+  // Saves the lookup for threads executing on a single instance.
+  thread_local uint64_t cachedInstance = 0;
+  thread_local ThreadState *cachedState = nullptr;
+  if (cachedInstance != athena->id) {
+    lock_guard<mutex> lock(athena->threadsMutex);
+    auto &state = athena->threads[this_thread::get_id()];
+    if (!state)
+      state = make_unique<ThreadState>();
+    cachedInstance = athena->id;
+    cachedState = state.get();
+  }
+
+  ThreadState &state = *cachedState;
+  // Nested calls keep the engine of the outermost one.
+  const uint64_t generation = athena->generation.load(memory_order_acquire);
+  if (state.generation != generation && !state.executing())
+    configure(athena, state, generation);
+  return state;
+}
+
+// Switches benchmarking, host profiling and tracing, which are switched per
+// thread, to the settings of @state for the lifetime of the scope. A nested
+// call may execute on another instance.
+class DiagnosticsScope {
+public:
+  explicit DiagnosticsScope(ThreadState const &state) noexcept
+      : m_benchmark(benchmark::enabled()),
+        m_hostProfile(hostprofile::enabled()), m_trace(trace::enabled()) {
+    benchmark::enable(state.benchmarkEnabled);
+    hostprofile::enable(state.hostProfileEnabled);
+    trace::enable(state.traceEnabled);
+  }
+  ~DiagnosticsScope() noexcept {
+    benchmark::enable(m_benchmark);
+    hostprofile::enable(m_hostProfile);
+    trace::enable(m_trace);
+  }
+
+  DiagnosticsScope(DiagnosticsScope const &) = delete;
+  DiagnosticsScope &operator=(DiagnosticsScope const &) = delete;
+
+private:
+  bool m_benchmark;
+  bool m_hostProfile;
+  bool m_trace;
+};
+
+// Marks a frame or a module as in use for the lifetime of the scope.
+class ActiveScope {
+public:
+  explicit ActiveScope(bool &active) noexcept : m_active(active) {
+    m_active = true;
+  }
+  ~ActiveScope() noexcept { m_active = false; }
+
+  ActiveScope(ActiveScope const &) = delete;
+  ActiveScope &operator=(ActiveScope const &) = delete;
+
+private:
+  bool &m_active;
+};
+
+// Output buffers of results. The buffer an execution produced its output
+// in is handed to the caller with the result, without a copy, and kept for
+// a later execution of the thread releasing the result. Results may be
+// released on any thread and after the instance is destroyed.
+class OutputPool {
+public:
+  static constexpr size_t maxFree = 16;
+  // larger buffers are freed when released
+  static constexpr size_t maxPooledCapacity = 64 * 1024;
+
+  // @returns a buffer holding the contents of @output, which takes over the
+  // storage of an earlier output in exchange.
+  static bytes *acquire(bytes &output) {
+    OutputPool &pool = local();
+    bytes *buffer;
+    if (pool.m_free.empty()) {
+      buffer = new bytes;
+    } else {
+      buffer = pool.m_free.back();
+      pool.m_free.pop_back();
+    }
+    buffer->swap(output);
+    output.clear();
+    return buffer;
+  }
+
+  static void release(bytes *buffer) noexcept {
+    OutputPool *pool = t_pool;
+    if (pool && buffer->capacity() <= maxPooledCapacity &&
+        pool->m_free.size() < maxFree) {
+      pool->m_free.push_back(buffer);
+      return;
+    }
+    delete buffer;
+  }
+
+  OutputPool(OutputPool const &) = delete;
+  OutputPool &operator=(OutputPool const &) = delete;
+
+private:
+  OutputPool() { m_free.reserve(maxFree); }
+  ~OutputPool() noexcept {
+    t_pool = nullptr;
+    for (bytes *buffer : m_free)
+      delete buffer;
+  }
+
+  static OutputPool &local() {
+    thread_local OutputPool pool;
+    t_pool = &pool;
+    return pool;
+  }
+
+  // the pool of the thread, null before its first acquire and once it is
+  // destroyed
+  static thread_local OutputPool *t_pool;
+
+  vector<bytes *> m_free;
+};
+
+thread_local OutputPool *OutputPool::t_pool = nullptr;
+
 void athena_destroy_result(evmc_result const *result) noexcept {
-  delete[] result->output_data;
+  OutputPool::release(
+      static_cast<bytes *>(evmc_get_const_optional_storage(result)->pointer));
+}
+
+// Hands @output to the caller with @ret, @output is left empty.
+void setOutput(evmc_result &ret, bytes &output) {
+  if (output.empty())
+    return;
+  bytes *buffer = OutputPool::acquire(output);
+
+  ret.output_size = buffer->size();
+  ret.output_data = buffer->data();
+  ret.release = athena_destroy_result;
+  evmc_get_optional_storage(&ret)->pointer = buffer;
 }
 
 evmc_result athena_execute(evmc_vm *instance,
@@ -247,6 +837,8 @@ evmc_result athena_execute(evmc_vm *instance,
                            size_t code_size) noexcept {
   athena_instance *athena = static_cast<athena_instance *>(instance);
   evmc::HostContext host{*host_interface, context};
+  ThreadState &state = threadState(athena);
+  DiagnosticsScope diagnostics(state);
 
 #if H_DEBUGGING
   H_DEBUG << "Executing message in Athena\n";
@@ -256,26 +848,43 @@ evmc_result athena_execute(evmc_vm *instance,
   memset(&ret, 0, sizeof(evmc_result));
 
   try {
-    athenaAssert(rev == EVMC_BYZANTIUM, "Only Byzantium supported.");
+    athenaAssert(GasSchedule::supports(rev),
+                 "Only Byzantium to Istanbul supported.");
     athenaAssert(msg->gas >= 0, "EVMC supplied negative startgas");
 
     bool meterInterfaceGas = true;
+    bool isRunevm = false;
 
     // the bytecode residing in the state - this will be used by interface
     // methods (i.e. codecopy)
     bytes_view state_code{code, code_size};
 
+    // Nested calls reuse the result buffers of earlier calls at their depth.
+    ExecutionFrame *frame = executionFrame(state, msg->depth);
+    ExecutionFrame localFrame;
+    if (!frame)
+      frame = &localFrame;
+    ActiveScope frameScope(frame->active);
+    ExecutionResult &result = frame->result;
+
     // the actual executable code - this can be modified (metered or evm2wasm
-    // compiled)
-    bytes run_code{state_code};
+    // compiled) into the code buffer of the frame
+    bytes_view run_code{state_code};
 
     // replace executable code if replacement is supplied
-    auto preload = athena->contract_preload_list.find(msg->destination);
-    if (preload != athena->contract_preload_list.end()) {
+    SystemContract *system = athena->contract_preload_list.find(msg->destination);
+    if (system) {
 #if H_DEBUGGING
       H_DEBUG << "Overriding contract.\n";
 #endif
-      run_code = preload->second;
+      run_code = system->code;
+    } else if (athena->nativePrecompiles && msg->kind != EVMC_CREATE &&
+               precompiles::isPrecompile(msg->destination)) {
+      precompiles::execute(*msg, result);
+      setOutput(ret, result.returnValue);
+      ret.status_code = EVMC_SUCCESS;
+      ret.gas_left = result.gasLeft;
+      return ret;
     }
 
     // ensure we can only handle WebAssembly version 1
@@ -284,7 +893,9 @@ evmc_result athena_execute(evmc_vm *instance,
     if (!isWasm) {
       switch (athena->evm1mode) {
       case athena_evm1mode::evm2wasm_contract:
-        run_code = evm2wasm(host, run_code);
+        frame->translation =
+            translateEvm(athena, host, msg->destination, run_code);
+        run_code = *frame->translation;
         ensureCondition(run_code.size() > 8, ContractValidationFailure,
                         "Transcompiling via evm2wasm failed");
         // TODO: enable this once evm2wasm does metering of interfaces
@@ -300,9 +911,8 @@ evmc_result athena_execute(evmc_vm *instance,
         ret.status_code = EVMC_FAILURE;
         return ret;
       case athena_evm1mode::runevm_contract:
-        run_code = runevm(host, athena->contract_preload_list[runevmAddress]);
-        ensureCondition(run_code.size() > 8, ContractValidationFailure,
-                        "Interpreting via runevm failed");
+        run_code = runevmInterpreter(athena, state, host);
+        isRunevm = true;
         // Runevm does interface metering on its own
         meterInterfaceGas = false;
         break;
@@ -314,34 +924,47 @@ evmc_result athena_execute(evmc_vm *instance,
 
     // Avoid this in case of evm2wasm translated code
     if (msg->kind == EVMC_CREATE && isWasm) {
+      // reject what could never be called before metering it
+      prevalidateContract(run_code);
       // Meter the deployment (constructor) code if it is WebAssembly
-      if (athena->metering)
-        run_code = sentinel(host, run_code);
+      if (meterOnDeployment(athena)) {
+        frame->code = meter(athena, host, run_code);
+        run_code = frame->code;
+      }
       ensureCondition(hasWasmPreamble(run_code) && hasWasmVersion(run_code, 1),
                       ContractValidationFailure,
                       "Invalid contract or metering failed.");
     }
 
-    athenaAssert(athena->engine, "Wasm engine not set.");
-    WasmEngine &engine = *athena->engine;
+    athenaAssert(state.engine, "Wasm engine not set.");
+    WasmEngine &engine = *state.engine;
 
-    ExecutionResult result;
     // should move after execution if want remember owner's address
     if (msg->kind == EVMC_CREATE) {
       ensureCondition(msg->input_size == 0, ContractValidationFailure,
                       "create must without input");
       result.gasLeft = msg->gas;
       result.isRevert = false;
-      result.returnValue = run_code;
+      result.returnValue.assign(run_code.data(), run_code.size());
     } else {
-      result =
-          engine.execute(host, run_code, state_code, *msg, meterInterfaceGas);
+      auto module =
+          isRunevm
+              ? runevmModule(state, *frame)
+              : loadModule(athena, state, *frame, host, msg->destination,
+                           run_code, system);
+      athenaAssert(!module->active, "Module in use by an outer call.");
+      ActiveScope moduleScope(module->active);
+      if (athena->storagePrefetch && !isRunevm)
+        prefetchStorage(athena, state, *module, run_code, context, *msg);
+      engine.execute(result, host, *module, state_code, *msg, rev,
+                     meterInterfaceGas);
       athenaAssert(result.gasLeft >= 0, "Negative gas left after execution.");
     }
 
     // copy call result
     if (result.returnValue.size() > 0) {
-      bytes returnValue;
+      bytes_view returnValue = result.returnValue;
+      bytes meteredCode;
 
       if (msg->kind == EVMC_CREATE && !result.isRevert &&
           hasWasmPreamble(result.returnValue)) {
@@ -349,24 +972,20 @@ evmc_result athena_execute(evmc_vm *instance,
                         ContractValidationFailure,
                         "Contract has an invalid WebAssembly version.");
 
-        // Meter the deployed code if it is WebAssembly
-        returnValue = athena->metering ? sentinel(host, result.returnValue)
-                                       : move(result.returnValue);
+        // Meter the deployed code if it is WebAssembly, the deployment code
+        // returned as is was metered already
+        if (meterOnDeployment(athena) && !isWasm) {
+          meteredCode = meter(athena, host, result.returnValue);
+          returnValue = meteredCode;
+        }
         ensureCondition(
             hasWasmPreamble(returnValue) && hasWasmVersion(returnValue, 1),
             ContractValidationFailure, "Invalid contract or metering failed.");
         // FIXME: this should be done by the sentinel
         // no verifyContract
-      } else {
-        returnValue = move(result.returnValue);
       }
 
-      uint8_t *output_data = new uint8_t[returnValue.size()];
-      copy(returnValue.begin(), returnValue.end(), output_data);
-
-      ret.output_size = returnValue.size();
-      ret.output_data = output_data;
-      ret.release = athena_destroy_result;
+      setOutput(ret, meteredCode.empty() ? result.returnValue : meteredCode);
     }
 
     ret.status_code = result.isRevert ? EVMC_REVERT : EVMC_SUCCESS;
@@ -410,6 +1029,22 @@ evmc_result athena_execute(evmc_vm *instance,
   return ret;
 }
 
+// Parses a decimal option value.
+bool parseUnsigned(char const *value, uint64_t &result) {
+  char *end = nullptr;
+  if (!isdigit(value[0]))
+    return false;
+  result = strtoull(value, &end, 10);
+  return *end == '\0';
+}
+
+// Writes the benchmark summary to standard error and athena_benchmarks.log.
+void dumpBenchmarks() {
+  const string log = benchmark::report();
+  cerr << log;
+  ofstream{"athena_benchmarks.log", ios::out | ios::app} << log;
+}
+
 bool athena_parse_sys_option(athena_instance *athena, string const &_name,
                              string const &value) {
   athenaAssert(_name.find("sys:") == 0, "");
@@ -451,10 +1086,40 @@ bool athena_parse_sys_option(athena_instance *athena, string const &_name,
     return false;
   }
 
+  if (!hasWasmPreamble(contents) || !hasWasmVersion(contents, 1)) {
+    H_DEBUG << "Contract is not a WebAssembly version 1 module: " << value
+            << "\n";
+    return false;
+  }
+
   H_DEBUG << "Loaded contract for " << name << " from " << value << " ("
           << contents.size() << " bytes)\n";
 
-  athena->contract_preload_list[address] = move(contents);
+  // Validate and compile now rather than on the first call. The module is
+  // prepared with the current settings on a scratch thread state.
+  const bool isRunevm = address == runevmAddress;
+  const uint64_t generation = athena->generation + (isRunevm ? 1 : 0);
+  ThreadState state;
+  configure(athena, state, generation);
+  shared_ptr<WasmModule> prepared;
+  try {
+    // runevm is executed unmetered
+    prepared = isRunevm ? state.engine->compile(contents)
+                        : compileContract(state, contents);
+  } catch (exception const &e) {
+    H_DEBUG << "Failed to compile contract for " << name << ": " << e.what()
+            << "\n";
+    return false;
+  }
+
+  SystemContract &contract = athena->contract_preload_list[address];
+  contract.codeHash = crypto::keccak256(contents);
+  contract.code = move(contents);
+  contract.prepared = move(prepared);
+  contract.preparedGeneration = generation;
+  contract.preparedMetered = !isRunevm && state.meterOnLoad;
+  if (isRunevm)
+    athena->changeSettings([&] { athena->runevmGeneration++; });
 
   return true;
 }
@@ -472,31 +1137,223 @@ evmc_set_option_result athena_set_option(evmc_vm *instance, char const *name,
   }
 
   if (strcmp(name, "metering") == 0) {
-    if (strcmp(value, "true") == 0)
-      athena->metering = true;
-    else if (strcmp(value, "false") != 0)
-      return EVMC_SET_OPTION_INVALID_VALUE;
-    return EVMC_SET_OPTION_SUCCESS;
+    if (metering_options.count(value)) {
+      athena->changeSettings(
+          [&] { athena->metering = metering_options.at(value); });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
   if (strcmp(name, "benchmark") == 0) {
-    if (strcmp(value, "true") == 0) {
-      WasmEngine::enableBenchmarking();
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->benchmarkEnabled = strcmp(value, "true") == 0; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    if (strcmp(value, "dump") == 0) {
+      dumpBenchmarks();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    if (strcmp(value, "reset") == 0) {
+      benchmark::reset();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "host-profile") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->hostProfileEnabled = strcmp(value, "true") == 0; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    if (strcmp(value, "dump") == 0) {
+      cerr << hostprofile::report();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    if (strcmp(value, "reset") == 0) {
+      hostprofile::reset();
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "trace") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->traceEnabled = strcmp(value, "true") == 0; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    if (strcmp(value, "dump") == 0) {
+      if (trace::dump(athena->traceFile))
+        return EVMC_SET_OPTION_SUCCESS;
+      H_DEBUG << "Failed to write trace file " << athena->traceFile << "\n";
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    }
+    if (strcmp(value, "reset") == 0) {
+      trace::reset();
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+  if (strcmp(name, "trace-file") == 0) {
+    if (value[0] == '\0')
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->traceFile = value;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
   if (strcmp(name, "engine") == 0) {
     auto it = wasm_engine_map.find(value);
     if (it != wasm_engine_map.end()) {
-      wasmEngineCreateFn = it->second;
-      athena->engine = wasmEngineCreateFn();
+      athena->changeSettings([&] { athena->engineCreateFn = it->second; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "evm2wasm-cache-dir") == 0) {
+    if (athena->translationCache.setDirectory(value))
+      return EVMC_SET_OPTION_SUCCESS;
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "storage-cache") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->storageCacheEnabled = strcmp(value, "true") == 0; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "native-precompiles") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->nativePrecompiles = strcmp(value, "true") == 0;
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "module-cache-size") == 0) {
+    uint64_t size;
+    if (!parseUnsigned(value, size))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->moduleCacheCapacity = size; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "batch-threads") == 0) {
+    uint64_t threads;
+    if (!parseUnsigned(value, threads))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    lock_guard<mutex> lock(athena->poolMutex);
+    athena->batchThreads = threads;
+    athena->pool.reset();
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "prepare-threads") == 0) {
+    uint64_t threads;
+    if (!parseUnsigned(value, threads) || threads == 0)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    // the queue starts again with the new count
+    athena->stopPreparing();
+    athena->prepareThreads = threads;
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+#if H_EOS
+  if (strcmp(name, "eosvm-memory-pool-size") == 0) {
+    uint64_t size;
+    if (!parseUnsigned(value, size))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmMemoryPoolSize = size; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-huge-pages") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->eosvmHugePages = strcmp(value, "true") == 0; });
+      return EVMC_SET_OPTION_SUCCESS;
+    }
+    return EVMC_SET_OPTION_INVALID_VALUE;
+  }
+
+  if (strcmp(name, "eosvm-perf-map") == 0) {
+    if (strcmp(value, "true") == 0 || strcmp(value, "false") == 0) {
+      athena->changeSettings(
+          [&] { athena->eosvmPerfMap = strcmp(value, "true") == 0; });
       return EVMC_SET_OPTION_SUCCESS;
     }
     return EVMC_SET_OPTION_INVALID_VALUE;
   }
 
+  if (strcmp(name, "eosvm-compile-threads") == 0) {
+    uint64_t threads;
+    if (!parseUnsigned(value, threads))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmCompileThreads = threads; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-memory-reset") == 0) {
+    if (strcmp(value, "memset") != 0 && strcmp(value, "madvise") != 0)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings(
+        [&] { athena->eosvmLazyZero = strcmp(value, "madvise") == 0; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-jit-cache-dir") == 0) {
+    if (!JitCache{""}.setDirectory(value))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmJitCacheDir = value; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-tier-up-threshold") == 0) {
+    uint64_t executions;
+    if (!parseUnsigned(value, executions))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmTierUpThreshold = executions; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-snapshot-threshold") == 0) {
+    uint64_t bytes;
+    if (!parseUnsigned(value, bytes))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmSnapshotThreshold = bytes; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "eosvm-max-memory-pages") == 0 ||
+      strcmp(name, "eosvm-max-call-depth") == 0) {
+    uint64_t limit;
+    if (!parseUnsigned(value, limit) || limit == 0 || limit > UINT32_MAX)
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] {
+      if (strcmp(name, "eosvm-max-memory-pages") == 0)
+        athena->eosvmMaxPages = uint32_t(limit);
+      else
+        athena->eosvmMaxCallDepth = uint32_t(limit);
+    });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+
+  if (strcmp(name, "deadline-us") == 0) {
+    uint64_t deadline;
+    if (!parseUnsigned(value, deadline))
+      return EVMC_SET_OPTION_INVALID_VALUE;
+    athena->changeSettings([&] { athena->eosvmDeadlineUs = deadline; });
+    return EVMC_SET_OPTION_SUCCESS;
+  }
+#endif
+
   if (strncmp(name, "sys:", 4) == 0) {
     if (athena_parse_sys_option(athena, string(name), string(value)))
       return EVMC_SET_OPTION_SUCCESS;
@@ -508,6 +1365,27 @@ evmc_set_option_result athena_set_option(evmc_vm *instance, char const *name,
 
 void athena_destroy(evmc_vm *instance) noexcept {
   athena_instance *athena = static_cast<athena_instance *>(instance);
+  // Stop the batch and prepare workers before their states go.
+  athena->pool.reset();
+  athena->prepareQueue.reset();
+  uint64_t hits = 0, misses = 0, evictions = 0;
+  for (auto const &thread : athena->threads) {
+    hits += thread.second->moduleCache.hits();
+    misses += thread.second->moduleCache.misses();
+    evictions += thread.second->moduleCache.evictions();
+  }
+  H_DEBUG << "Module cache: " << hits << " hits, " << misses << " misses, "
+          << evictions << " evictions\n";
+  H_DEBUG << "evm2wasm cache: " << athena->translationCache.hits()
+          << " hits, " << athena->translationCache.diskHits()
+          << " disk hits, " << athena->translationCache.misses()
+          << " misses\n";
+  if (athena->benchmarkEnabled)
+    dumpBenchmarks();
+  if (athena->hostProfileEnabled)
+    cerr << hostprofile::report();
+  if (athena->traceEnabled)
+    trace::dump(athena->traceFile);
   delete athena;
 }
 
@@ -562,6 +1440,126 @@ EVMC_EXPORT evmc_vm *evmc_create_athena() noexcept {
   return instance;
 }
 
+size_t athena_get_benchmark_stats(athena_phase_stats *stats,
+                                  size_t capacity) noexcept {
+  for (unsigned i = 0; i < benchmark::phaseCount && i < capacity; i++) {
+    const auto phase = benchmark::Phase(i);
+    const auto s = benchmark::stats(phase);
+    stats[i] = {benchmark::phaseName(phase), s.count, s.totalNs, s.minNs,
+                s.maxNs, s.p50Ns, s.p90Ns, s.p99Ns};
+  }
+  return benchmark::phaseCount;
+}
+
+void athena_execute_batch(evmc_vm *vm, const evmc_host_interface *host,
+                          enum evmc_revision rev,
+                          const athena_batch_message *messages,
+                          evmc_result *results, size_t count) noexcept {
+  athena_instance *athena = static_cast<athena_instance *>(vm);
+  auto body = [&](size_t i) {
+    athena_batch_message const &message = messages[i];
+    results[i] = athena_execute(vm, host, message.context, rev, message.msg,
+                                message.code, message.code_size);
+  };
+
+  ThreadPool *pool = nullptr;
+  try {
+    lock_guard<mutex> lock(athena->poolMutex);
+    if (!athena->pool) {
+      size_t threads = athena->batchThreads;
+      if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+      athena->pool = make_unique<ThreadPool>(threads);
+    }
+    pool = athena->pool.get();
+  } catch (exception const &e) {
+    H_DEBUG << "Failed to start the batch threads: " << e.what() << "\n";
+  }
+
+  if (pool) {
+    pool->parallelFor(count, body);
+  } else {
+    for (size_t i = 0; i < count; i++)
+      body(i);
+  }
+}
+
+void athena_set_storage_prefetch(evmc_vm *vm, athena_storage_prefetch_fn fn,
+                                 void *user_data) noexcept {
+  athena_instance *athena = static_cast<athena_instance *>(vm);
+  athena->storagePrefetch = fn;
+  athena->storagePrefetchData = user_data;
+}
+
+bool athena_prepare(evmc_vm *vm, const evmc_bytes32 *code_hash,
+                    const uint8_t *code, size_t code_size) noexcept {
+  athena_instance *athena = static_cast<athena_instance *>(vm);
+  const evmc::bytes32 key{*code_hash};
+  bytes_view codeView{code, code_size};
+  if (is_zero(key) || !hasWasmPreamble(codeView) ||
+      athena->moduleCacheCapacity == 0)
+    return false;
+
+  try {
+    {
+      lock_guard<mutex> lock(athena->preparedMutex);
+      auto &prepared = athena->preparedModules;
+      auto it = prepared.find(key);
+      if (it != prepared.end() && it->second.code == codeView)
+        return true; // queued or compiled already
+      if (it == prepared.end() && prepared.size() >= athena->maxPreparedModules)
+        prepared.erase(prepared.begin());
+      // the entry marks the compilation as queued
+      prepared[key] = PreparedModule{bytes{codeView}, nullptr, 0, false};
+
+      if (!athena->prepareQueue)
+        athena->prepareQueue = make_unique<JobQueue>(
+            athena->prepareThreads, athena_instance::maxPreparedModules);
+    }
+
+    const bool queued = athena->prepareQueue->push([athena, key]() {
+      bytes code;
+      {
+        lock_guard<mutex> lock(athena->preparedMutex);
+        auto it = athena->preparedModules.find(key);
+        if (it == athena->preparedModules.end())
+          return; // taken, evicted or the settings changed meanwhile
+        code = it->second.code;
+      }
+
+      // each worker thread compiles with a thread state of its own
+      ThreadState &state = threadState(athena);
+      DiagnosticsScope diagnostics(state);
+      shared_ptr<WasmModule> module;
+      try {
+        module = compileUnlessRejected(athena, state, key, code, nullptr);
+      } catch (exception const &e) {
+        H_DEBUG << "Failed to prepare contract: " << e.what() << "\n";
+      }
+
+      lock_guard<mutex> lock(athena->preparedMutex);
+      auto it = athena->preparedModules.find(key);
+      if (it == athena->preparedModules.end() || it->second.code != code)
+        return;
+      if (!module) {
+        athena->preparedModules.erase(it);
+        return;
+      }
+      it->second.module = move(module);
+      it->second.generation = state.generation;
+      it->second.metered = state.meterOnLoad;
+    });
+    if (!queued) {
+      lock_guard<mutex> lock(athena->preparedMutex);
+      athena->preparedModules.erase(key);
+    }
+    return queued;
+  } catch (exception const &e) {
+    H_DEBUG << "Failed to queue contract: " << e.what() << "\n";
+    return false;
+  }
+}
+
 #if athena_EXPORTS
 // If compiled as shared library, also export this symbol.
 EVMC_EXPORT evmc_vm *evmc_create() noexcept { return evmc_create_athena(); }
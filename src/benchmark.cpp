@@ -0,0 +1,205 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include "benchmark.h"
+
+using namespace std;
+
+namespace athena {
+namespace benchmark {
+
+thread_local bool enabledFlag = false;
+
+namespace {
+
+constexpr unsigned subBucketBits = 4;
+constexpr unsigned subBucketCount = 1u << subBucketBits;
+// Values below subBucketCount are exact, each further power of two is
+// split into subBucketCount buckets.
+constexpr unsigned bucketCount = subBucketCount * (64 - subBucketBits + 1);
+
+unsigned bucketIndex(uint64_t value) noexcept {
+  if (value < subBucketCount)
+    return unsigned(value);
+  const unsigned magnitude = 63 - unsigned(__builtin_clzll(value));
+  const unsigned shift = magnitude - subBucketBits;
+  return subBucketCount * shift + unsigned(value >> shift);
+}
+
+// @returns the middle of the bucket @index.
+uint64_t bucketValue(unsigned index) noexcept {
+  if (index < subBucketCount)
+    return index;
+  const unsigned shift = index / subBucketCount - 1;
+  const uint64_t lower = uint64_t(subBucketCount + index % subBucketCount)
+                         << shift;
+  return lower + ((uint64_t(1) << shift) >> 1);
+}
+
+using Counter = atomic<uint64_t>;
+
+// Counters are only written by their owning thread, a relaxed load and
+// store is enough and avoids locked instructions.
+inline void add(Counter &counter, uint64_t value) noexcept {
+  counter.store(counter.load(memory_order_relaxed) + value,
+                memory_order_relaxed);
+}
+
+struct Histogram {
+  Counter buckets[bucketCount];
+  Counter count;
+  Counter total;
+  Counter min;
+  Counter max;
+};
+
+struct ThreadMetrics {
+  Histogram phases[phaseCount];
+  ThreadMetrics *next = nullptr;
+};
+
+// Metrics of every thread that ever recorded a sample. Entries are never
+// removed, so samples of finished threads are still reported.
+atomic<ThreadMetrics *> threadList{nullptr};
+thread_local ThreadMetrics *threadMetrics = nullptr;
+
+ThreadMetrics *registerThread() noexcept {
+  auto metrics = new (nothrow) ThreadMetrics();
+  if (!metrics)
+    return nullptr;
+  metrics->next = threadList.load(memory_order_relaxed);
+  while (!threadList.compare_exchange_weak(metrics->next, metrics,
+                                           memory_order_release,
+                                           memory_order_relaxed))
+    ;
+  return metrics;
+}
+
+} // anonymous namespace
+
+char const *phaseName(Phase phase) noexcept {
+  switch (phase) {
+  case Phase::Load:
+    return "load";
+  case Phase::Translation:
+    return "translation";
+  case Phase::Metering:
+    return "metering";
+  case Phase::Compilation:
+    return "compilation";
+  case Phase::Instantiation:
+    return "instantiation";
+  case Phase::Execution:
+    return "execution";
+  case Phase::HostCall:
+    return "host call";
+  }
+  return "unknown";
+}
+
+void record(Phase phase, uint64_t nanoseconds) noexcept {
+  if (!threadMetrics && !(threadMetrics = registerThread()))
+    return;
+  Histogram &histogram = threadMetrics->phases[unsigned(phase)];
+  const uint64_t count = histogram.count.load(memory_order_relaxed);
+  if (count == 0 || nanoseconds < histogram.min.load(memory_order_relaxed))
+    histogram.min.store(nanoseconds, memory_order_relaxed);
+  if (nanoseconds > histogram.max.load(memory_order_relaxed))
+    histogram.max.store(nanoseconds, memory_order_relaxed);
+  add(histogram.buckets[bucketIndex(nanoseconds)], 1);
+  add(histogram.total, nanoseconds);
+  histogram.count.store(count + 1, memory_order_relaxed);
+}
+
+PhaseStats stats(Phase phase) noexcept {
+  PhaseStats ret;
+  uint64_t buckets[bucketCount] = {};
+  for (auto metrics = threadList.load(memory_order_acquire); metrics;
+       metrics = metrics->next) {
+    Histogram const &histogram = metrics->phases[unsigned(phase)];
+    const uint64_t count = histogram.count.load(memory_order_relaxed);
+    if (count == 0)
+      continue;
+    const uint64_t min = histogram.min.load(memory_order_relaxed);
+    if (ret.count == 0 || min < ret.minNs)
+      ret.minNs = min;
+    ret.maxNs = std::max(ret.maxNs, histogram.max.load(memory_order_relaxed));
+    ret.count += count;
+    ret.totalNs += histogram.total.load(memory_order_relaxed);
+    for (unsigned i = 0; i < bucketCount; i++)
+      buckets[i] += histogram.buckets[i].load(memory_order_relaxed);
+  }
+
+  uint64_t sampled = 0;
+  for (unsigned i = 0; i < bucketCount; i++)
+    sampled += buckets[i];
+  // ranks are 1-based, bucket values are clamped to the observed range
+  auto percentile = [&](unsigned percent) {
+    const uint64_t rank = (sampled * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < bucketCount; i++) {
+      seen += buckets[i];
+      if (seen >= rank && buckets[i])
+        return std::min(std::max(bucketValue(i), ret.minNs), ret.maxNs);
+    }
+    return ret.maxNs;
+  };
+  if (sampled) {
+    ret.p50Ns = percentile(50);
+    ret.p90Ns = percentile(90);
+    ret.p99Ns = percentile(99);
+  }
+  return ret;
+}
+
+void reset() noexcept {
+  for (auto metrics = threadList.load(memory_order_acquire); metrics;
+       metrics = metrics->next) {
+    for (auto &histogram : metrics->phases) {
+      for (auto &bucket : histogram.buckets)
+        bucket.store(0, memory_order_relaxed);
+      histogram.count.store(0, memory_order_relaxed);
+      histogram.total.store(0, memory_order_relaxed);
+      histogram.min.store(0, memory_order_relaxed);
+      histogram.max.store(0, memory_order_relaxed);
+    }
+  }
+}
+
+string report() {
+  auto us = [](uint64_t ns) { return double(ns) / 1000; };
+  ostringstream out;
+  out << fixed << setprecision(1) << "Time [us]:\n";
+  for (unsigned i = 0; i < phaseCount; i++) {
+    const auto phase = Phase(i);
+    const PhaseStats s = stats(phase);
+    if (s.count == 0)
+      continue;
+    out << "  " << phaseName(phase) << ": " << s.count
+        << " samples, total: " << us(s.totalNs) << ", min: " << us(s.minNs)
+        << ", p50: " << us(s.p50Ns) << ", p90: " << us(s.p90Ns)
+        << ", p99: " << us(s.p99Ns) << ", max: " << us(s.maxNs) << "\n";
+  }
+  return out.str();
+}
+
+} // namespace benchmark
+} // namespace athena
@@ -0,0 +1,115 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace athena {
+
+// Process-wide timing registry. Every thread records into its own
+// histograms, so recording is a handful of uncontended relaxed stores and
+// never takes a lock. Readers merge the histograms of all threads.
+namespace benchmark {
+
+enum class Phase : unsigned {
+  Load,          // module cache lookup
+  Translation,   // evm2wasm
+  Metering,      // gas metering injection
+  Compilation,   // parsing, validation and code generation
+  Instantiation, // memory and globals setup
+  Execution,     // includes the host calls below and nested calls
+  HostCall,      // calls and state access through the EVMC host
+};
+
+constexpr unsigned phaseCount = unsigned(Phase::HostCall) + 1;
+
+char const *phaseName(Phase phase) noexcept;
+
+// Durations are in nanoseconds. Percentiles come from log-linear buckets
+// with 16 sub-buckets per power of two, i.e. within about 6%.
+struct PhaseStats {
+  uint64_t count = 0;
+  uint64_t totalNs = 0;
+  uint64_t minNs = 0;
+  uint64_t maxNs = 0;
+  uint64_t p50Ns = 0;
+  uint64_t p90Ns = 0;
+  uint64_t p99Ns = 0;
+};
+
+// Switched per thread, Athena switches it to the setting of the instance a
+// thread executes on.
+extern thread_local bool enabledFlag;
+
+inline bool enabled() noexcept { return enabledFlag; }
+
+inline void enable(bool value) noexcept { enabledFlag = value; }
+
+inline uint64_t now() noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void record(Phase phase, uint64_t nanoseconds) noexcept;
+
+PhaseStats stats(Phase phase) noexcept;
+
+// Clears all histograms. Samples recorded concurrently may survive.
+void reset() noexcept;
+
+// @returns a human readable summary of all phases with samples.
+std::string report();
+
+// Measures consecutive phases, nothing is recorded if benchmarking was
+// disabled on construction.
+class Timer {
+public:
+  Timer() noexcept : m_start(enabled() ? now() : 0) {}
+
+  // Records the time since construction or the previous lap as @phase.
+  void lap(Phase phase) noexcept {
+    if (m_start) {
+      const uint64_t end = now();
+      record(phase, end - m_start);
+      m_start = end;
+    }
+  }
+
+private:
+  uint64_t m_start;
+};
+
+class ScopedTimer {
+public:
+  explicit ScopedTimer(Phase phase) noexcept : m_phase(phase) {}
+  ~ScopedTimer() noexcept { m_timer.lap(m_phase); }
+
+  ScopedTimer(ScopedTimer const &) = delete;
+  ScopedTimer &operator=(ScopedTimer const &) = delete;
+
+private:
+  Timer m_timer;
+  Phase m_phase;
+};
+
+} // namespace benchmark
+} // namespace athena
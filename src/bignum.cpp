@@ -0,0 +1,255 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "bignum.h"
+
+namespace athena {
+namespace bignum {
+
+namespace {
+
+using uint128 = unsigned __int128;
+
+constexpr unsigned maxDigits = 16;
+
+// @returns the number of significant entries of @x[0, n).
+template <typename T> unsigned significant(T const *x, unsigned n) noexcept {
+  while (n > 0 && x[n - 1] == 0)
+    n--;
+  return n;
+}
+
+bool isSmall(uint256 const &x) noexcept {
+  return (x.limbs[1] | x.limbs[2] | x.limbs[3]) == 0;
+}
+
+uint256 fromLimb(uint64_t x) noexcept { return uint256{{x, 0, 0, 0}}; }
+
+// Stores the 512-bit product of @a and @b in @out.
+void mulFull(uint256 const &a, uint256 const &b, uint64_t out[8]) noexcept {
+  for (unsigned i = 0; i < 8; i++)
+    out[i] = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t carry = 0;
+    for (unsigned j = 0; j < 4; j++) {
+      uint128 t = uint128(a.limbs[i]) * b.limbs[j] + out[i + j] + carry;
+      out[i + j] = uint64_t(t);
+      carry = uint64_t(t >> 64);
+    }
+    out[i + 4] = carry;
+  }
+}
+
+// Divides the @ulen limb number @u by @v, which must not be zero, using
+// Knuth's algorithm D on 32-bit digits. @quotient receives @ulen limbs and
+// may be null when only the remainder is needed.
+void divide(uint64_t const *u, unsigned ulen, uint256 const &v,
+            uint64_t *quotient, uint256 &remainder) noexcept {
+  uint32_t un[maxDigits + 1] = {};
+  uint32_t vn[8] = {};
+  uint32_t q[maxDigits] = {};
+  for (unsigned i = 0; i < ulen; i++) {
+    un[2 * i] = uint32_t(u[i]);
+    un[2 * i + 1] = uint32_t(u[i] >> 32);
+  }
+  for (unsigned i = 0; i < 4; i++) {
+    vn[2 * i] = uint32_t(v.limbs[i]);
+    vn[2 * i + 1] = uint32_t(v.limbs[i] >> 32);
+  }
+  const unsigned m = significant(un, 2 * ulen);
+  const unsigned n = significant(vn, 8);
+  constexpr uint64_t base = uint64_t(1) << 32;
+
+  if (m < n) {
+    // the dividend is smaller than the divisor
+  } else if (n == 1) {
+    uint64_t k = 0;
+    for (unsigned j = m; j-- > 0;) {
+      uint64_t t = (k << 32) | un[j];
+      q[j] = uint32_t(t / vn[0]);
+      k = t % vn[0];
+      un[j] = 0;
+    }
+    un[0] = uint32_t(k);
+  } else {
+    // normalize so that the top digit of the divisor has its high bit set
+    const unsigned s = __builtin_clz(vn[n - 1]);
+    for (unsigned i = n; i-- > 1;)
+      vn[i] = (vn[i] << s) | uint32_t(uint64_t(vn[i - 1]) >> (32 - s));
+    vn[0] <<= s;
+    un[m] = uint32_t(uint64_t(un[m - 1]) >> (32 - s));
+    for (unsigned i = m; i-- > 1;)
+      un[i] = (un[i] << s) | uint32_t(uint64_t(un[i - 1]) >> (32 - s));
+    un[0] <<= s;
+
+    for (unsigned j = m - n + 1; j-- > 0;) {
+      uint64_t numerator = (uint64_t(un[j + n]) << 32) | un[j + n - 1];
+      uint64_t qhat = numerator / vn[n - 1];
+      uint64_t rhat = numerator % vn[n - 1];
+      while (qhat >= base ||
+             qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2])) {
+        qhat--;
+        rhat += vn[n - 1];
+        if (rhat >= base)
+          break;
+      }
+
+      // multiply and subtract
+      int64_t t = 0;
+      uint64_t k = 0;
+      for (unsigned i = 0; i < n; i++) {
+        uint64_t p = qhat * vn[i];
+        t = int64_t(un[i + j]) - int64_t(k) - int64_t(p & 0xffffffff);
+        un[i + j] = uint32_t(t);
+        k = (p >> 32) - (t >> 32);
+      }
+      t = int64_t(un[j + n]) - int64_t(k);
+      un[j + n] = uint32_t(t);
+
+      q[j] = uint32_t(qhat);
+      if (t < 0) {
+        // subtracted too much, add the divisor back
+        q[j]--;
+        k = 0;
+        for (unsigned i = 0; i < n; i++) {
+          t = int64_t(uint64_t(un[i + j]) + vn[i] + k);
+          un[i + j] = uint32_t(t);
+          k = uint64_t(t) >> 32;
+        }
+        un[j + n] += uint32_t(k);
+      }
+    }
+
+    // denormalize the remainder
+    for (unsigned i = 0; i < n; i++)
+      un[i] = (un[i] >> s) | uint32_t(uint64_t(un[i + 1]) << (32 - s));
+    for (unsigned i = n; i <= m; i++)
+      un[i] = 0;
+  }
+
+  for (unsigned i = 0; i < 4; i++)
+    remainder.limbs[i] = uint64_t(un[2 * i]) | uint64_t(un[2 * i + 1]) << 32;
+  if (quotient)
+    for (unsigned i = 0; i < ulen; i++)
+      quotient[i] = uint64_t(q[2 * i]) | uint64_t(q[2 * i + 1]) << 32;
+}
+
+} // anonymous namespace
+
+uint256 load(uint8_t const *src) noexcept {
+  uint256 ret;
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (unsigned j = 8; j-- > 0;)
+      limb = (limb << 8) | src[8 * i + j];
+    ret.limbs[i] = limb;
+  }
+  return ret;
+}
+
+void store(uint256 const &value, uint8_t *dst) noexcept {
+  for (unsigned i = 0; i < 4; i++)
+    for (unsigned j = 0; j < 8; j++)
+      dst[8 * i + j] = uint8_t(value.limbs[i] >> (8 * j));
+}
+
+uint256 add(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret;
+  uint64_t carry = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    uint128 t = uint128(a.limbs[i]) + b.limbs[i] + carry;
+    ret.limbs[i] = uint64_t(t);
+    carry = uint64_t(t >> 64);
+  }
+  return ret;
+}
+
+uint256 sub(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret;
+  uint64_t borrow = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    uint128 t = uint128(a.limbs[i]) - b.limbs[i] - borrow;
+    ret.limbs[i] = uint64_t(t);
+    borrow = uint64_t(t >> 64) & 1;
+  }
+  return ret;
+}
+
+uint256 mul(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret = {};
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t carry = 0;
+    for (unsigned j = 0; i + j < 4; j++) {
+      uint128 t = uint128(a.limbs[i]) * b.limbs[j] + ret.limbs[i + j] + carry;
+      ret.limbs[i + j] = uint64_t(t);
+      carry = uint64_t(t >> 64);
+    }
+  }
+  return ret;
+}
+
+void divmod(uint256 const &a, uint256 const &b, uint256 &quotient,
+            uint256 &remainder) noexcept {
+  if (isSmall(b) && b.limbs[0] == 0) {
+    quotient = remainder = fromLimb(0);
+  } else if (isSmall(a) && isSmall(b)) {
+    quotient = fromLimb(a.limbs[0] / b.limbs[0]);
+    remainder = fromLimb(a.limbs[0] % b.limbs[0]);
+  } else {
+    uint256 q;
+    divide(a.limbs, 4, b, q.limbs, remainder);
+    quotient = q;
+  }
+}
+
+uint256 mulmod(uint256 const &a, uint256 const &b, uint256 const &m) noexcept {
+  if (isSmall(m) && m.limbs[0] == 0)
+    return fromLimb(0);
+  uint64_t product[8];
+  mulFull(a, b, product);
+  uint256 ret;
+  divide(product, 8, m, nullptr, ret);
+  return ret;
+}
+
+uint256 exp(uint256 const &base, uint256 const &exponent) noexcept {
+  uint256 ret = fromLimb(1);
+  uint256 power = base;
+  const unsigned limbs = significant(exponent.limbs, 4);
+  for (unsigned i = 0; i < limbs; i++) {
+    uint64_t bits = exponent.limbs[i];
+    for (unsigned j = 0; j < 64; j++) {
+      if (bits & 1)
+        ret = mul(ret, power);
+      bits >>= 1;
+      if (bits == 0 && i + 1 == limbs)
+        break;
+      power = mul(power, power);
+    }
+  }
+  return ret;
+}
+
+unsigned byteLength(uint256 const &value) noexcept {
+  const unsigned limbs = significant(value.limbs, 4);
+  if (limbs == 0)
+    return 0;
+  return 8 * (limbs - 1) + (71 - __builtin_clzll(value.limbs[limbs - 1])) / 8;
+}
+
+} // namespace bignum
+} // namespace athena
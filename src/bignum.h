@@ -0,0 +1,51 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+
+namespace athena {
+
+// 256-bit unsigned arithmetic behind the "bignum" host module. Values are
+// stored little endian in Wasm memory, results wrap modulo 2^256 and a zero
+// divisor or modulus yields zero, as the corresponding EVM instructions do.
+namespace bignum {
+
+struct uint256 {
+  // least significant limb first
+  uint64_t limbs[4];
+};
+
+uint256 load(uint8_t const *src) noexcept;
+void store(uint256 const &value, uint8_t *dst) noexcept;
+
+uint256 add(uint256 const &a, uint256 const &b) noexcept;
+uint256 sub(uint256 const &a, uint256 const &b) noexcept;
+uint256 mul(uint256 const &a, uint256 const &b) noexcept;
+void divmod(uint256 const &a, uint256 const &b, uint256 &quotient,
+            uint256 &remainder) noexcept;
+// a * b mod m, without truncating the 512-bit product
+uint256 mulmod(uint256 const &a, uint256 const &b, uint256 const &m) noexcept;
+uint256 exp(uint256 const &base, uint256 const &exponent) noexcept;
+
+// @returns the number of bytes up to the most significant non-zero byte,
+// which prices exp() like the EVM EXP instruction.
+unsigned byteLength(uint256 const &value) noexcept;
+
+} // namespace bignum
+} // namespace athena
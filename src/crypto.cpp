@@ -0,0 +1,686 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include "bignum.h"
+#include "crypto.h"
+
+using namespace std;
+
+namespace athena {
+namespace crypto {
+
+namespace {
+
+inline uint32_t rotl32(uint32_t x, unsigned n) noexcept {
+  return (x << n) | (x >> (32 - n));
+}
+
+inline uint32_t rotr32(uint32_t x, unsigned n) noexcept {
+  return (x >> n) | (x << (32 - n));
+}
+
+inline uint64_t rotl64(uint64_t x, unsigned n) noexcept {
+  return (x << n) | (x >> (64 - n));
+}
+
+inline uint32_t loadBE32(uint8_t const *p) noexcept {
+  return uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 |
+         p[3];
+}
+
+inline uint32_t loadLE32(uint8_t const *p) noexcept {
+  return uint32_t(p[3]) << 24 | uint32_t(p[2]) << 16 | uint32_t(p[1]) << 8 |
+         p[0];
+}
+
+// Feeds @data followed by the MD padding with the bit length in big or
+// little endian to @transform, which consumes whole 64 byte blocks.
+template <bool BigEndianLength, typename Transform>
+void mdHash(bytes_view data, Transform &&transform) {
+  const size_t blocks = data.size() / 64;
+  if (blocks)
+    transform(data.data(), blocks);
+
+  uint8_t tail[128] = {};
+  const size_t rest = data.size() % 64;
+  memcpy(tail, data.data() + blocks * 64, rest);
+  tail[rest] = 0x80;
+  const size_t tailSize = rest < 56 ? 64 : 128;
+  const uint64_t bits = uint64_t(data.size()) * 8;
+  for (unsigned i = 0; i < 8; i++)
+    tail[tailSize - 1 - (BigEndianLength ? i : 7 - i)] = uint8_t(bits >> (8 * i));
+  transform(tail, tailSize / 64);
+}
+
+/*
+ * Keccak
+ */
+
+constexpr uint64_t keccakRoundConstants[24] = {
+    0x0000000000000001, 0x0000000000008082, 0x800000000000808a,
+    0x8000000080008000, 0x000000000000808b, 0x0000000080000001,
+    0x8000000080008081, 0x8000000000008009, 0x000000000000008a,
+    0x0000000000000088, 0x0000000080008009, 0x000000008000000a,
+    0x000000008000808b, 0x800000000000008b, 0x8000000000008089,
+    0x8000000000008003, 0x8000000000008002, 0x8000000000000080,
+    0x000000000000800a, 0x800000008000000a, 0x8000000080008081,
+    0x8000000000008080, 0x0000000080000001, 0x8000000080008008};
+constexpr unsigned keccakRotations[24] = {1,  3,  6,  10, 15, 21, 28, 36,
+                                          45, 55, 2,  14, 27, 41, 56, 8,
+                                          25, 43, 62, 18, 39, 61, 20, 44};
+constexpr unsigned keccakLanes[24] = {10, 7,  11, 17, 18, 3,  5,  16,
+                                      8,  21, 24, 4,  15, 23, 19, 13,
+                                      12, 2,  20, 14, 22, 9,  6,  1};
+
+void keccakf(uint64_t (&state)[25]) noexcept {
+  for (unsigned round = 0; round < 24; round++) {
+    uint64_t c[5];
+    for (unsigned i = 0; i < 5; i++)
+      c[i] = state[i] ^ state[i + 5] ^ state[i + 10] ^ state[i + 15] ^
+             state[i + 20];
+    for (unsigned i = 0; i < 5; i++) {
+      const uint64_t d = c[(i + 4) % 5] ^ rotl64(c[(i + 1) % 5], 1);
+      for (unsigned j = 0; j < 25; j += 5)
+        state[j + i] ^= d;
+    }
+
+    uint64_t lane = state[1];
+    for (unsigned i = 0; i < 24; i++) {
+      const unsigned j = keccakLanes[i];
+      const uint64_t next = state[j];
+      state[j] = rotl64(lane, keccakRotations[i]);
+      lane = next;
+    }
+
+    for (unsigned j = 0; j < 25; j += 5) {
+      for (unsigned i = 0; i < 5; i++)
+        c[i] = state[j + i];
+      for (unsigned i = 0; i < 5; i++)
+        state[j + i] ^= ~c[(i + 1) % 5] & c[(i + 2) % 5];
+    }
+
+    state[0] ^= keccakRoundConstants[round];
+  }
+}
+
+/*
+ * SHA-256
+ */
+
+constexpr uint32_t sha256RoundConstants[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+void sha256Transform(uint32_t (&state)[8], uint8_t const *data,
+                     size_t blocks) noexcept {
+  for (; blocks > 0; blocks--, data += 64) {
+    uint32_t w[64];
+    for (unsigned i = 0; i < 16; i++)
+      w[i] = loadBE32(data + 4 * i);
+    for (unsigned i = 16; i < 64; i++) {
+      const uint32_t s0 =
+          rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+      const uint32_t s1 =
+          rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+      w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (unsigned i = 0; i < 64; i++) {
+      const uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+      const uint32_t t1 =
+          h + s1 + ((e & f) ^ (~e & g)) + sha256RoundConstants[i] + w[i];
+      const uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+      const uint32_t t2 = s0 + ((a & b) ^ (a & c) ^ (b & c));
+      h = g;
+      g = f;
+      f = e;
+      e = d + t1;
+      d = c;
+      c = b;
+      b = a;
+      a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+  }
+}
+
+#if defined(__x86_64__)
+bool hasShaExtensions() noexcept {
+  unsigned eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1))
+    return false;
+  return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+__attribute__((target("sha,sse4.1"))) void
+sha256TransformShani(uint32_t (&state)[8], uint8_t const *data,
+                     size_t blocks) noexcept {
+  const __m128i byteSwap =
+      _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+
+  // the rounds work on the ABEF and CDGH halves of the state
+  __m128i tmp = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(&state[0])), 0xb1);
+  __m128i state1 = _mm_shuffle_epi32(
+      _mm_loadu_si128(reinterpret_cast<__m128i const *>(&state[4])), 0x1b);
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);
+
+  for (; blocks > 0; blocks--, data += 64) {
+    const __m128i saved0 = state0;
+    const __m128i saved1 = state1;
+    __m128i w[4];
+    for (unsigned i = 0; i < 16; i++) {
+      __m128i &msg = w[i % 4];
+      if (i < 4) {
+        msg = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<__m128i const *>(data + 16 * i)),
+            byteSwap);
+      } else {
+        // w[i % 4] still holds the words of four rounds back
+        msg = _mm_sha256msg1_epu32(msg, w[(i + 1) % 4]);
+        msg = _mm_add_epi32(msg, _mm_alignr_epi8(w[(i + 3) % 4],
+                                                 w[(i + 2) % 4], 4));
+        msg = _mm_sha256msg2_epu32(msg, w[(i + 3) % 4]);
+      }
+      __m128i k = _mm_add_epi32(
+          msg, _mm_loadu_si128(reinterpret_cast<__m128i const *>(
+                   &sha256RoundConstants[4 * i])));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, k);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(k, 0x0e));
+    }
+    state0 = _mm_add_epi32(state0, saved0);
+    state1 = _mm_add_epi32(state1, saved1);
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);
+  state1 = _mm_shuffle_epi32(state1, 0xb1);
+  state0 = _mm_blend_epi16(tmp, state1, 0xf0);
+  state1 = _mm_alignr_epi8(state1, tmp, 8);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+
+const bool useShaExtensions = hasShaExtensions();
+#endif
+
+/*
+ * RIPEMD-160
+ */
+
+constexpr uint8_t ripemdWords[2][80] = {
+    {0,  1,  2,  3,  4,  5,  6,  7,  8,  9,  10, 11, 12, 13, 14, 15,
+     7,  4,  13, 1,  10, 6,  15, 3,  12, 0,  9,  5,  2,  14, 11, 8,
+     3,  10, 14, 4,  9,  15, 8,  1,  2,  7,  0,  6,  13, 11, 5,  12,
+     1,  9,  11, 10, 0,  8,  12, 4,  13, 3,  7,  15, 14, 5,  6,  2,
+     4,  0,  5,  9,  7,  12, 2,  10, 14, 1,  3,  8,  11, 6,  15, 13},
+    {5,  14, 7,  0,  9,  2,  11, 4,  13, 6,  15, 8,  1,  10, 3,  12,
+     6,  11, 3,  7,  0,  13, 5,  10, 14, 15, 8,  12, 4,  9,  1,  2,
+     15, 5,  1,  3,  7,  14, 6,  9,  11, 8,  12, 2,  10, 0,  4,  13,
+     8,  6,  4,  1,  3,  11, 15, 0,  5,  12, 2,  13, 9,  7,  10, 14,
+     12, 15, 10, 4,  1,  5,  8,  7,  6,  2,  13, 14, 0,  3,  9,  11}};
+constexpr uint8_t ripemdShifts[2][80] = {
+    {11, 14, 15, 12, 5,  8,  7,  9,  11, 13, 14, 15, 6,  7,  9,  8,
+     7,  6,  8,  13, 11, 9,  7,  15, 7,  12, 15, 9,  11, 7,  13, 12,
+     11, 13, 6,  7,  14, 9,  13, 15, 14, 8,  13, 6,  5,  12, 7,  5,
+     11, 12, 14, 15, 14, 15, 9,  8,  9,  14, 5,  6,  8,  6,  5,  12,
+     9,  15, 5,  11, 6,  8,  13, 12, 5,  12, 13, 14, 11, 8,  5,  6},
+    {8,  9,  9,  11, 13, 15, 15, 5,  7,  7,  8,  11, 14, 14, 12, 6,
+     9,  13, 15, 7,  12, 8,  9,  11, 7,  7,  12, 7,  6,  15, 13, 11,
+     9,  7,  15, 11, 8,  6,  6,  14, 12, 13, 5,  14, 13, 13, 7,  5,
+     15, 5,  8,  11, 14, 14, 6,  14, 6,  9,  12, 9,  12, 5,  15, 8,
+     8,  5,  12, 9,  12, 5,  14, 6,  8,  13, 6,  5,  15, 13, 11, 11}};
+constexpr uint32_t ripemdConstants[2][5] = {
+    {0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e},
+    {0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000}};
+
+inline uint32_t ripemdF(unsigned j, uint32_t x, uint32_t y,
+                        uint32_t z) noexcept {
+  switch (j / 16) {
+  case 0:
+    return x ^ y ^ z;
+  case 1:
+    return (x & y) | (~x & z);
+  case 2:
+    return (x | ~y) ^ z;
+  case 3:
+    return (x & z) | (y & ~z);
+  default:
+    return x ^ (y | ~z);
+  }
+}
+
+void ripemd160Transform(uint32_t (&state)[5], uint8_t const *data,
+                        size_t blocks) noexcept {
+  for (; blocks > 0; blocks--, data += 64) {
+    uint32_t x[16];
+    for (unsigned i = 0; i < 16; i++)
+      x[i] = loadLE32(data + 4 * i);
+
+    uint32_t line[2][5];
+    for (unsigned l = 0; l < 2; l++) {
+      uint32_t a = state[0], b = state[1], c = state[2], d = state[3],
+               e = state[4];
+      for (unsigned j = 0; j < 80; j++) {
+        // the right line runs the functions in reverse order
+        const uint32_t f = l == 0 ? ripemdF(j, b, c, d) : ripemdF(79 - j, b, c, d);
+        const uint32_t t =
+            rotl32(a + f + x[ripemdWords[l][j]] + ripemdConstants[l][j / 16],
+                   ripemdShifts[l][j]) +
+            e;
+        a = e;
+        e = d;
+        d = rotl32(c, 10);
+        c = b;
+        b = t;
+      }
+      line[l][0] = a;
+      line[l][1] = b;
+      line[l][2] = c;
+      line[l][3] = d;
+      line[l][4] = e;
+    }
+
+    const uint32_t t = state[1] + line[0][2] + line[1][3];
+    state[1] = state[2] + line[0][3] + line[1][4];
+    state[2] = state[3] + line[0][4] + line[1][0];
+    state[3] = state[4] + line[0][0] + line[1][1];
+    state[4] = state[0] + line[0][1] + line[1][2];
+    state[0] = t;
+  }
+}
+
+/*
+ * secp256k1
+ */
+
+using bignum::uint256;
+using uint128 = unsigned __int128;
+
+constexpr uint256 fieldPrime = {{0xfffffffefffffc2f, 0xffffffffffffffff,
+                                 0xffffffffffffffff, 0xffffffffffffffff}};
+// 2^256 - fieldPrime
+constexpr uint64_t fieldFold = 0x1000003d1;
+constexpr uint256 groupOrder = {{0xbfd25e8cd0364141, 0xbaaedce6af48a03b,
+                                 0xfffffffffffffffe, 0xffffffffffffffff}};
+constexpr uint256 generatorX = {{0x59f2815b16f81798, 0x029bfcdb2dce28d9,
+                                 0x55a06295ce870b07, 0x79be667ef9dcbbac}};
+constexpr uint256 generatorY = {{0x9c47d08ffb10d4b8, 0xfd17b448a6855419,
+                                 0x5da4fbfc0e1108a8, 0x483ada7726a3c465}};
+// fieldPrime - 2, for inverses by Fermat's little theorem
+constexpr uint256 fieldInverseExponent = {
+    {0xfffffffefffffc2d, 0xffffffffffffffff, 0xffffffffffffffff,
+     0xffffffffffffffff}};
+// (fieldPrime + 1) / 4, for square roots
+constexpr uint256 fieldSqrtExponent = {{0xffffffffbfffff0c, 0xffffffffffffffff,
+                                        0xffffffffffffffff, 0x3fffffffffffffff}};
+
+bool isZero(uint256 const &a) noexcept {
+  return (a.limbs[0] | a.limbs[1] | a.limbs[2] | a.limbs[3]) == 0;
+}
+
+bool equal(uint256 const &a, uint256 const &b) noexcept {
+  return memcmp(a.limbs, b.limbs, sizeof(a.limbs)) == 0;
+}
+
+bool less(uint256 const &a, uint256 const &b) noexcept {
+  for (unsigned i = 4; i-- > 0;)
+    if (a.limbs[i] != b.limbs[i])
+      return a.limbs[i] < b.limbs[i];
+  return false;
+}
+
+bool testBit(uint256 const &a, unsigned bit) noexcept {
+  return (a.limbs[bit / 64] >> (bit % 64)) & 1;
+}
+
+uint256 loadBE(evmc::bytes32 const &src) noexcept {
+  uint256 ret;
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t limb = 0;
+    for (unsigned j = 0; j < 8; j++)
+      limb = (limb << 8) | src.bytes[32 - 8 * (i + 1) + j];
+    ret.limbs[i] = limb;
+  }
+  return ret;
+}
+
+void storeBE(uint256 const &src, uint8_t *dst) noexcept {
+  for (unsigned i = 0; i < 32; i++)
+    dst[31 - i] = uint8_t(src.limbs[i / 8] >> (8 * (i % 8)));
+}
+
+// Arithmetic modulo fieldPrime on fully reduced values.
+
+uint256 feAdd(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret = bignum::add(a, b);
+  // a carry out of 256 bits or a sum at or above the prime
+  if (less(ret, a) || !less(ret, fieldPrime))
+    ret = bignum::sub(ret, fieldPrime);
+  return ret;
+}
+
+uint256 feSub(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret = bignum::sub(a, b);
+  if (less(a, b))
+    ret = bignum::add(ret, fieldPrime);
+  return ret;
+}
+
+uint256 feMul(uint256 const &a, uint256 const &b) noexcept {
+  uint64_t product[8] = {};
+  for (unsigned i = 0; i < 4; i++) {
+    uint64_t carry = 0;
+    for (unsigned j = 0; j < 4; j++) {
+      uint128 t = uint128(a.limbs[i]) * b.limbs[j] + product[i + j] + carry;
+      product[i + j] = uint64_t(t);
+      carry = uint64_t(t >> 64);
+    }
+    product[i + 4] = carry;
+  }
+
+  // 2^256 is congruent to fieldFold, fold the high half in twice
+  uint256 ret;
+  uint128 t = 0;
+  for (unsigned i = 0; i < 4; i++) {
+    t += uint128(product[i + 4]) * fieldFold + product[i];
+    ret.limbs[i] = uint64_t(t);
+    t >>= 64;
+  }
+  t = uint128(uint64_t(t)) * fieldFold;
+  for (unsigned i = 0; i < 4; i++) {
+    t += ret.limbs[i];
+    ret.limbs[i] = uint64_t(t);
+    t >>= 64;
+  }
+  if (t) {
+    // the result wrapped, it is small now and the addition cannot carry
+    t = uint128(ret.limbs[0]) + fieldFold;
+    ret.limbs[0] = uint64_t(t);
+    for (unsigned i = 1; i < 4 && (t >> 64); i++) {
+      t = uint128(ret.limbs[i]) + 1;
+      ret.limbs[i] = uint64_t(t);
+    }
+  }
+  if (!less(ret, fieldPrime))
+    ret = bignum::sub(ret, fieldPrime);
+  return ret;
+}
+
+uint256 fePow(uint256 const &base, uint256 const &exponent) noexcept {
+  uint256 ret = {{1, 0, 0, 0}};
+  for (unsigned bit = 256; bit-- > 0;) {
+    ret = feMul(ret, ret);
+    if (testBit(exponent, bit))
+      ret = feMul(ret, base);
+  }
+  return ret;
+}
+
+// Arithmetic modulo groupOrder, rare enough to use the generic reduction.
+
+uint256 scalarMul(uint256 const &a, uint256 const &b) noexcept {
+  return bignum::mulmod(a, b, groupOrder);
+}
+
+// @returns (@top * 2^256 + @x) / 2 for a @top bit of zero or one.
+uint256 shiftRight(uint256 const &x, uint64_t top) noexcept {
+  uint256 ret;
+  for (unsigned i = 0; i < 4; i++)
+    ret.limbs[i] = (x.limbs[i] >> 1) | ((i < 3 ? x.limbs[i + 1] : top) << 63);
+  return ret;
+}
+
+// @returns x / 2 modulo the odd groupOrder.
+uint256 scalarHalve(uint256 const &x) noexcept {
+  if (!(x.limbs[0] & 1))
+    return shiftRight(x, 0);
+  const uint256 sum = bignum::add(x, groupOrder);
+  return shiftRight(sum, less(sum, x));
+}
+
+uint256 scalarSub(uint256 const &a, uint256 const &b) noexcept {
+  uint256 ret = bignum::sub(a, b);
+  if (less(a, b))
+    ret = bignum::add(ret, groupOrder);
+  return ret;
+}
+
+// Binary extended Euclid, the signature values are public so it need not
+// run in constant time.
+uint256 scalarInverse(uint256 const &a) noexcept {
+  const uint256 one = {{1, 0, 0, 0}};
+  uint256 u = a, v = groupOrder, x1 = one, x2 = {};
+  while (!equal(u, one) && !equal(v, one)) {
+    while (!(u.limbs[0] & 1)) {
+      u = shiftRight(u, 0);
+      x1 = scalarHalve(x1);
+    }
+    while (!(v.limbs[0] & 1)) {
+      v = shiftRight(v, 0);
+      x2 = scalarHalve(x2);
+    }
+    if (!less(u, v)) {
+      u = bignum::sub(u, v);
+      x1 = scalarSub(x1, x2);
+    } else {
+      v = bignum::sub(v, u);
+      x2 = scalarSub(x2, x1);
+    }
+  }
+  return equal(u, one) ? x1 : x2;
+}
+
+// A point in Jacobian coordinates, (x / z^2, y / z^3); z is zero for the
+// point at infinity.
+struct Point {
+  uint256 x, y, z;
+};
+
+Point pointDouble(Point const &p) noexcept {
+  if (isZero(p.z) || isZero(p.y))
+    return Point{};
+  const uint256 a = feMul(p.x, p.x);
+  const uint256 b = feMul(p.y, p.y);
+  const uint256 c = feMul(b, b);
+  uint256 d = feAdd(p.x, b);
+  d = feSub(feSub(feMul(d, d), a), c);
+  d = feAdd(d, d);
+  const uint256 e = feAdd(feAdd(a, a), a);
+  const uint256 f = feMul(e, e);
+  Point ret;
+  ret.x = feSub(f, feAdd(d, d));
+  uint256 c8 = feAdd(c, c);
+  c8 = feAdd(c8, c8);
+  c8 = feAdd(c8, c8);
+  ret.y = feSub(feMul(e, feSub(d, ret.x)), c8);
+  ret.z = feMul(p.y, p.z);
+  ret.z = feAdd(ret.z, ret.z);
+  return ret;
+}
+
+Point pointAdd(Point const &p, Point const &q) noexcept {
+  if (isZero(p.z))
+    return q;
+  if (isZero(q.z))
+    return p;
+  const uint256 pz2 = feMul(p.z, p.z);
+  const uint256 qz2 = feMul(q.z, q.z);
+  const uint256 u1 = feMul(p.x, qz2);
+  const uint256 u2 = feMul(q.x, pz2);
+  const uint256 s1 = feMul(p.y, feMul(q.z, qz2));
+  const uint256 s2 = feMul(q.y, feMul(p.z, pz2));
+  const uint256 h = feSub(u2, u1);
+  const uint256 r = feSub(s2, s1);
+  if (isZero(h))
+    return isZero(r) ? pointDouble(p) : Point{};
+  const uint256 h2 = feMul(h, h);
+  const uint256 h3 = feMul(h2, h);
+  const uint256 v = feMul(u1, h2);
+  Point ret;
+  ret.x = feSub(feSub(feMul(r, r), h3), feAdd(v, v));
+  ret.y = feSub(feMul(r, feSub(v, ret.x)), feMul(s1, h3));
+  ret.z = feMul(feMul(p.z, q.z), h);
+  return ret;
+}
+
+// @returns a * p + b * q by interleaving the two double-and-add chains.
+Point pointMulAdd(uint256 const &a, Point const &p, uint256 const &b,
+                  Point const &q) noexcept {
+  const Point pq = pointAdd(p, q);
+  Point ret{};
+  for (unsigned bit = 256; bit-- > 0;) {
+    ret = pointDouble(ret);
+    const bool useP = testBit(a, bit);
+    const bool useQ = testBit(b, bit);
+    if (useP && useQ)
+      ret = pointAdd(ret, pq);
+    else if (useP)
+      ret = pointAdd(ret, p);
+    else if (useQ)
+      ret = pointAdd(ret, q);
+  }
+  return ret;
+}
+
+} // anonymous namespace
+
+evmc::bytes32 keccak256(bytes_view data) noexcept {
+  constexpr size_t rate = 136;
+  uint64_t state[25] = {};
+  auto absorb = [&state](uint8_t const *block) {
+    for (unsigned i = 0; i < rate / 8; i++) {
+      uint64_t lane;
+      memcpy(&lane, block + 8 * i, sizeof(lane));
+      state[i] ^= lane;
+    }
+    keccakf(state);
+  };
+
+  size_t pos = 0;
+  for (; data.size() - pos >= rate; pos += rate)
+    absorb(data.data() + pos);
+  uint8_t last[rate] = {};
+  memcpy(last, data.data() + pos, data.size() - pos);
+  last[data.size() - pos] ^= 0x01;
+  last[rate - 1] ^= 0x80;
+  absorb(last);
+
+  evmc::bytes32 ret;
+  memcpy(ret.bytes, state, sizeof(ret.bytes));
+  return ret;
+}
+
+evmc::bytes32 sha256(bytes_view data) noexcept {
+  uint32_t state[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                       0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+  mdHash<true>(data, [&state](uint8_t const *blocks, size_t count) {
+#if defined(__x86_64__)
+    if (useShaExtensions) {
+      sha256TransformShani(state, blocks, count);
+      return;
+    }
+#endif
+    sha256Transform(state, blocks, count);
+  });
+
+  evmc::bytes32 ret;
+  for (unsigned i = 0; i < 32; i++)
+    ret.bytes[i] = uint8_t(state[i / 4] >> (24 - 8 * (i % 4)));
+  return ret;
+}
+
+void ripemd160(bytes_view data, uint8_t (&digest)[20]) noexcept {
+  uint32_t state[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476,
+                       0xc3d2e1f0};
+  mdHash<false>(data, [&state](uint8_t const *blocks, size_t count) {
+    ripemd160Transform(state, blocks, count);
+  });
+  for (unsigned i = 0; i < 20; i++)
+    digest[i] = uint8_t(state[i / 4] >> (8 * (i % 4)));
+}
+
+bool ecrecover(evmc::bytes32 const &hash, unsigned recid,
+               evmc::bytes32 const &r, evmc::bytes32 const &s,
+               evmc::address &signer) noexcept {
+  const uint256 rValue = loadBE(r);
+  const uint256 sValue = loadBE(s);
+  if (recid > 1 || isZero(rValue) || !less(rValue, groupOrder) ||
+      isZero(sValue) || !less(sValue, groupOrder))
+    return false;
+
+  // the point R with x = r, y^2 = x^3 + 7 and the parity of y from recid
+  Point point{rValue, {}, {{1, 0, 0, 0}}};
+  const uint256 y2 = feAdd(feMul(feMul(rValue, rValue), rValue),
+                           uint256{{7, 0, 0, 0}});
+  point.y = fePow(y2, fieldSqrtExponent);
+  if (!equal(feMul(point.y, point.y), y2))
+    return false;
+  if ((point.y.limbs[0] & 1) != recid)
+    point.y = feSub(uint256{}, point.y);
+
+  // Q = r^-1 (s R - e G)
+  uint256 e, quotient;
+  bignum::divmod(loadBE(hash), groupOrder, quotient, e);
+  const uint256 rInverse = scalarInverse(rValue);
+  const uint256 u1 = bignum::sub(groupOrder, scalarMul(e, rInverse));
+  const uint256 u2 = scalarMul(sValue, rInverse);
+  const Point generator{generatorX, generatorY, {{1, 0, 0, 0}}};
+  // u1 is groupOrder for e = 0, which is the same as zero
+  const Point q = pointMulAdd(isZero(e) ? uint256{} : u1, generator, u2, point);
+  if (isZero(q.z))
+    return false;
+
+  const uint256 zInverse = fePow(q.z, fieldInverseExponent);
+  const uint256 zInverse2 = feMul(zInverse, zInverse);
+  uint8_t publicKey[64];
+  storeBE(feMul(q.x, zInverse2), publicKey);
+  storeBE(feMul(q.y, feMul(zInverse2, zInverse)), publicKey + 32);
+
+  const evmc::bytes32 publicKeyHash =
+      keccak256(bytes_view{publicKey, sizeof(publicKey)});
+  memcpy(signer.bytes, publicKeyHash.bytes + 12, sizeof(signer.bytes));
+  return true;
+}
+
+} // namespace crypto
+} // namespace athena
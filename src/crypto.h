@@ -0,0 +1,44 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+
+namespace athena {
+
+// Native hash functions and signature recovery behind the precompiles.
+namespace crypto {
+
+evmc::bytes32 keccak256(bytes_view data) noexcept;
+// Uses the SHA extensions when the processor has them.
+evmc::bytes32 sha256(bytes_view data) noexcept;
+void ripemd160(bytes_view data, uint8_t (&digest)[20]) noexcept;
+
+// Recovers the address which signed @hash on secp256k1 with the recovery
+// id @recid (0 or 1) and the big endian @r and @s.
+// @returns false if the signature is invalid.
+bool ecrecover(evmc::bytes32 const &hash, unsigned recid,
+               evmc::bytes32 const &r, evmc::bytes32 const &s,
+               evmc::address &signer) noexcept;
+
+} // namespace crypto
+} // namespace athena
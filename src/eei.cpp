@@ -15,13 +15,14 @@
  */
 
 #include <array>
-#include <fstream>
+#include <cstring>
 #include <iostream>
 
 #include "debugging.h"
 #include "eei.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "metering.h"
 
 #include <evmc/instructions.h>
 
@@ -37,28 +38,79 @@ bool exceedsUint128(evmc_uint256be const &value) noexcept {
   }
   return false;
 }
-} // namespace
 
-bool WasmEngine::benchmarkingEnabled = false;
+/* Copies @length bytes of @src into @dst in reverse order, eight bytes at a
+ * time. The buffers must not overlap. */
+void copyReversed(uint8_t *dst, uint8_t const *src, size_t length) noexcept {
+  while (length >= 8) {
+    uint64_t word;
+    length -= 8;
+    memcpy(&word, src, 8);
+    word = __builtin_bswap64(word);
+    memcpy(dst + length, &word, 8);
+    src += 8;
+  }
+  while (length)
+    dst[--length] = *src++;
+}
 
-void WasmEngine::collectBenchmarkingData() {
-  // Convert duration to string with microsecond units.
-  constexpr auto to_us_str = [](clock::duration d) {
-    return std::to_string(
-        std::chrono::duration_cast<std::chrono::microseconds>(d).count());
-  };
+constexpr GasSchedule byzantiumGas{};
+
+// EIP-1283 net gas metering of storage stores.
+constexpr GasSchedule constantinopleGas = [] {
+  GasSchedule gas;
+  gas.netStorageMetering = true;
+  gas.storageStoreNoop = 200;
+  return gas;
+}();
+
+// Petersburg reverted EIP-1283 again.
+constexpr GasSchedule petersburgGas{};
+
+// EIP-1884 repricing and EIP-2200 net gas metering of storage stores.
+constexpr GasSchedule istanbulGas = [] {
+  GasSchedule gas;
+  gas.storageLoad = 800;
+  gas.balance = 700;
+  gas.netStorageMetering = true;
+  gas.storageStoreNoop = 800;
+  gas.storageStoreSentry = 2300;
+  return gas;
+}();
+
+// The host functions rely on these bounds to compute their costs without
+// overflowing.
+constexpr bool isSafe(GasSchedule const &gas) {
+  return gas.log <= 65536 && gas.logTopic <= 65536 && gas.logData <= 65536 &&
+         gas.copy <= 65536 &&
+         gas.storageStoreCreate >= gas.storageStoreChange &&
+         gas.storageStoreChange >= gas.storageStoreNoop;
+}
+static_assert(isSafe(byzantiumGas) && isSafe(constantinopleGas) &&
+                  isSafe(petersburgGas) && isSafe(istanbulGas),
+              "Gas schedule could lead to overflow");
+} // namespace
 
-  const auto now = clock::now();
-  const auto instantiationDuration =
-      executionStartTime - instantiationStartTime;
-  const auto executionDuration = now - executionStartTime;
+GasSchedule const &GasSchedule::of(evmc_revision rev) noexcept {
+  switch (rev) {
+  case EVMC_CONSTANTINOPLE:
+    return constantinopleGas;
+  case EVMC_PETERSBURG:
+    return petersburgGas;
+  case EVMC_ISTANBUL:
+    return istanbulGas;
+  default:
+    return byzantiumGas;
+  }
+}
 
-  const auto log =
-      "Time [us]: " + to_us_str(instantiationDuration + executionDuration) +
-      " (instantiation: " + to_us_str(instantiationDuration) +
-      ", execution: " + to_us_str(executionDuration) + ")\n";
-  std::cerr << log;
-  std::ofstream{"athena_benchmarks.log", std::ios::out | std::ios::app} << log;
+shared_ptr<WasmModule> WasmEngine::compileMetered(bytes_view code) {
+  bytes metered;
+  {
+    benchmark::ScopedTimer timer(benchmark::Phase::Metering);
+    metered = injectMetering(code);
+  }
+  return compile(metered);
 }
 
 #if H_DEBUGGING
@@ -164,9 +216,7 @@ void EthereumInterface::debugEvmTrace(uint32_t pc, int32_t opcode,
 #endif
 
 void EthereumInterface::eeiUseGas(int64_t gas) {
-#if H_DEBUGGING
-  H_DEBUG << depthToString() << " useGas " << gas << "\n";
-#endif
+  ProfileScope profile(*this, HostFunction::UseGas, uint64_t(gas));
 
   ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
 
@@ -174,31 +224,30 @@ void EthereumInterface::eeiUseGas(int64_t gas) {
 }
 
 int64_t EthereumInterface::eeiGetGasLeft() {
-  H_DEBUG << depthToString() << " getGasLeft\n";
+  ProfileScope profile(*this, HostFunction::GetGasLeft);
 
   static_assert(is_same<decltype(m_result.gasLeft), int64_t>::value,
                 "int64_t type expected");
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   return m_result.gasLeft;
 }
 
 void EthereumInterface::eeiGetAddress(uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getAddress " << hex << resultOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetAddress, resultOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeAddress(m_msg.destination, resultOffset);
 }
 
 void EthereumInterface::eeiGetExternalBalance(uint32_t addressOffset,
                                               uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getExternalBalance " << hex << addressOffset
-          << " " << resultOffset << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetExternalBalance, addressOffset,
+                       resultOffset);
 
-  takeInterfaceGas(GasSchedule::balance);
+  takeInterfaceGas(m_gas.balance);
 
   evmc_address address = loadAddress(addressOffset);
   evmc_uint256be balance = m_host.get_balance(address);
@@ -207,10 +256,9 @@ void EthereumInterface::eeiGetExternalBalance(uint32_t addressOffset,
 
 uint32_t EthereumInterface::eeiGetBlockHash(uint64_t number,
                                             uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getBlockHash " << hex << number << " "
-          << resultOffset << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetBlockHash, number, resultOffset);
 
-  takeInterfaceGas(GasSchedule::blockhash);
+  takeInterfaceGas(m_gas.blockhash);
 
   const auto blockhash = m_host.get_block_hash(static_cast<int64_t>(number));
 
@@ -223,60 +271,54 @@ uint32_t EthereumInterface::eeiGetBlockHash(uint64_t number,
 }
 
 uint32_t EthereumInterface::eeiGetCallDataSize() {
-#if H_DEBUGGING
-  H_DEBUG << depthToString() << " getCallDataSize\n";
-#endif
+  ProfileScope profile(*this, HostFunction::GetCallDataSize);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   return static_cast<uint32_t>(m_msg.input_size);
 }
 
 void EthereumInterface::eeiCallDataCopy(uint32_t resultOffset,
                                         uint32_t dataOffset, uint32_t length) {
-#if H_DEBUGGING
-  H_DEBUG << depthToString() << " callDataCopy " << hex << resultOffset << " "
-          << dataOffset << " " << length << dec << "\n";
-#endif
+  ProfileScope profile(*this, HostFunction::CallDataCopy, resultOffset,
+                       dataOffset, length);
 
-  safeChargeDataCopy(length, GasSchedule::verylow);
+  safeChargeDataCopy(length, m_gas.verylow);
 
   storeMemory({m_msg.input_data, m_msg.input_size}, dataOffset, resultOffset,
               length);
 }
 
 void EthereumInterface::eeiGetCaller(uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getCaller " << hex << resultOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetCaller, resultOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeAddress(m_msg.sender, resultOffset);
 }
 
 void EthereumInterface::eeiGetCallValue(uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getCallValue " << hex << resultOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetCallValue, resultOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeUint128(m_msg.value, resultOffset);
 }
 
 void EthereumInterface::eeiCodeCopy(uint32_t resultOffset, uint32_t codeOffset,
                                     uint32_t length) {
-  H_DEBUG << depthToString() << " codeCopy " << hex << resultOffset << " "
-          << codeOffset << " " << length << dec << "\n";
+  ProfileScope profile(*this, HostFunction::CodeCopy, resultOffset, codeOffset,
+                       length);
 
-  safeChargeDataCopy(length, GasSchedule::verylow);
+  safeChargeDataCopy(length, m_gas.verylow);
 
   storeMemory(m_code, codeOffset, resultOffset, length);
 }
 
 uint32_t EthereumInterface::eeiGetCodeSize() {
-  H_DEBUG << depthToString() << " getCodeSize\n";
+  ProfileScope profile(*this, HostFunction::GetCodeSize);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   return static_cast<uint32_t>(m_code.size());
 }
@@ -285,11 +327,10 @@ void EthereumInterface::eeiExternalCodeCopy(uint32_t addressOffset,
                                             uint32_t resultOffset,
                                             uint32_t codeOffset,
                                             uint32_t length) {
-  H_DEBUG << depthToString() << " externalCodeCopy " << hex << addressOffset
-          << " " << resultOffset << " " << codeOffset << " " << length << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::ExternalCodeCopy, addressOffset,
+                       resultOffset, codeOffset, length);
 
-  safeChargeDataCopy(length, GasSchedule::extcode);
+  safeChargeDataCopy(length, m_gas.extcode);
 
   evmc_address address = loadAddress(addressOffset);
   // TODO: optimise this so no copy needs to be created
@@ -303,10 +344,9 @@ void EthereumInterface::eeiExternalCodeCopy(uint32_t addressOffset,
 }
 
 uint32_t EthereumInterface::eeiGetExternalCodeSize(uint32_t addressOffset) {
-  H_DEBUG << depthToString() << " getExternalCodeSize " << hex << addressOffset
-          << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetExternalCodeSize, addressOffset);
 
-  takeInterfaceGas(GasSchedule::extcode);
+  takeInterfaceGas(m_gas.extcode);
 
   evmc_address address = loadAddress(addressOffset);
   size_t code_size = m_host.get_code_size(address);
@@ -315,27 +355,25 @@ uint32_t EthereumInterface::eeiGetExternalCodeSize(uint32_t addressOffset) {
 }
 
 void EthereumInterface::eeiGetBlockCoinbase(uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getBlockCoinbase " << hex << resultOffset
-          << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetBlockCoinbase, resultOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeAddress(m_host.get_tx_context().block_coinbase, resultOffset);
 }
 
 void EthereumInterface::eeiGetBlockDifficulty(uint32_t offset) {
-  H_DEBUG << depthToString() << " getBlockDifficulty " << hex << offset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetBlockDifficulty, offset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeUint256(m_host.get_tx_context().block_difficulty, offset);
 }
 
 int64_t EthereumInterface::eeiGetBlockGasLimit() {
-  H_DEBUG << depthToString() << " getBlockGasLimit\n";
+  ProfileScope profile(*this, HostFunction::GetBlockGasLimit);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   static_assert(is_same<decltype(m_host.get_tx_context().block_gas_limit),
                         int64_t>::value,
@@ -345,10 +383,9 @@ int64_t EthereumInterface::eeiGetBlockGasLimit() {
 }
 
 void EthereumInterface::eeiGetTxGasPrice(uint32_t valueOffset) {
-  H_DEBUG << depthToString() << " getTxGasPrice " << hex << valueOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetTxGasPrice, valueOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeUint128(m_host.get_tx_context().tx_gas_price, valueOffset);
 }
@@ -357,18 +394,13 @@ void EthereumInterface::eeiLog(uint32_t dataOffset, uint32_t length,
                                uint32_t numberOfTopics, uint32_t topic1,
                                uint32_t topic2, uint32_t topic3,
                                uint32_t topic4) {
-  H_DEBUG << depthToString() << " log " << hex << dataOffset << " " << length
-          << " " << numberOfTopics << dec << "\n";
-
-  static_assert(GasSchedule::log <= 65536,
-                "Gas cost of log could lead to overflow");
-  static_assert(GasSchedule::logTopic <= 65536,
-                "Gas cost of logTopic could lead to overflow");
-  static_assert(GasSchedule::logData <= 65536,
-                "Gas cost of logData could lead to overflow");
+  ProfileScope profile(*this, HostFunction::Log, dataOffset, length,
+                       numberOfTopics);
+
+  // The schedules keep these costs at most 65536, which can not overflow.
   // Using uint64_t to force a type issue if the underlying API changes.
-  takeInterfaceGas(GasSchedule::log + (GasSchedule::logTopic * numberOfTopics) +
-                   (GasSchedule::logData * int64_t(length)));
+  takeInterfaceGas(m_gas.log + (m_gas.logTopic * numberOfTopics) +
+                   (m_gas.logData * int64_t(length)));
 
   ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "log");
 
@@ -391,9 +423,9 @@ void EthereumInterface::eeiLog(uint32_t dataOffset, uint32_t length,
 }
 
 int64_t EthereumInterface::eeiGetBlockNumber() {
-  H_DEBUG << depthToString() << " getBlockNumber\n";
+  ProfileScope profile(*this, HostFunction::GetBlockNumber);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   static_assert(
       is_same<decltype(m_host.get_tx_context().block_number), int64_t>::value,
@@ -403,9 +435,9 @@ int64_t EthereumInterface::eeiGetBlockNumber() {
 }
 
 int64_t EthereumInterface::eeiGetBlockTimestamp() {
-  H_DEBUG << depthToString() << " getBlockTimestamp\n";
+  ProfileScope profile(*this, HostFunction::GetBlockTimestamp);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   static_assert(is_same<decltype(m_host.get_tx_context().block_timestamp),
                         int64_t>::value,
@@ -415,95 +447,82 @@ int64_t EthereumInterface::eeiGetBlockTimestamp() {
 }
 
 void EthereumInterface::eeiGetTxOrigin(uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " getTxOrigin " << hex << resultOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::GetTxOrigin, resultOffset);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
   storeAddress(m_host.get_tx_context().tx_origin, resultOffset);
 }
 
 void EthereumInterface::eeiStorageStore(uint32_t pathOffset,
                                         uint32_t valueOffset) {
-  H_DEBUG << depthToString() << " storageStore " << hex << pathOffset << " "
-          << valueOffset << dec << "\n";
-
-  static_assert(GasSchedule::storageStoreCreate >=
-                    GasSchedule::storageStoreChange,
-                "storageStoreChange costs more than storageStoreCreate");
+  ProfileScope profile(*this, HostFunction::StorageStore, pathOffset,
+                       valueOffset);
 
   // Charge this here as it is the minimum cost.
-  takeInterfaceGas(GasSchedule::storageStoreChange);
+  takeStorageStoreGas();
 
   ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation,
                   "storageStore");
 
   const auto path = loadBytes32(pathOffset);
   const auto value = loadBytes32(valueOffset);
-  const auto current = m_host.get_storage(m_msg.destination, path);
-
-  // Charge the right amount in case of the create case.
-  if (is_zero(current) && !is_zero(value))
-    takeInterfaceGas(GasSchedule::storageStoreCreate -
-                     GasSchedule::storageStoreChange);
-
-  // We do not need to take care about the delete case (gas refund), the client
-  // does it.
-
-  m_host.set_storage(m_msg.destination, path, value);
+  chargeAndSetStorage(path, value);
 }
 
 void EthereumInterface::eeiStorageLoad(uint32_t pathOffset,
                                        uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " storageLoad " << hex << pathOffset << " "
-          << resultOffset << dec << "\n";
+  ProfileScope profile(*this, HostFunction::StorageLoad, pathOffset,
+                       resultOffset);
 
-  takeInterfaceGas(GasSchedule::storageLoad);
+  takeInterfaceGas(m_gas.storageLoad);
 
   evmc_bytes32 path = loadBytes32(pathOffset);
-  evmc_bytes32 result = m_host.get_storage(m_msg.destination, path);
+  evmc_bytes32 result = getStorage(path);
 
   storeBytes32(result, resultOffset);
 }
 
 void EthereumInterface::eeiRevertOrFinish(bool revert, uint32_t offset,
                                           uint32_t size) {
-#if H_DEBUGGING
-  H_DEBUG << depthToString() << " " << (revert ? "revert " : "finish ") << hex
-          << offset << " " << size << dec << "\n";
-#endif
+  ProfileScope profile(*this,
+                       revert ? HostFunction::Revert : HostFunction::Finish,
+                       offset, size);
 
   ensureSourceMemoryBounds(offset, size);
-  m_result.returnValue = bytes(size, '\0');
+  m_result.returnValue.assign(size, '\0');
   loadMemory(offset, m_result.returnValue, size);
 
   m_result.isRevert = revert;
 
-  throw EndExecution{};
+  endExecution();
 }
 
 uint32_t EthereumInterface::eeiGetReturnDataSize() {
-  H_DEBUG << depthToString() << " getReturnDataSize\n";
+  ProfileScope profile(*this, HostFunction::GetReturnDataSize);
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
 
-  return static_cast<uint32_t>(m_lastReturnData.size());
+  return static_cast<uint32_t>(m_lastReturn.output_size);
 }
 
 void EthereumInterface::eeiReturnDataCopy(uint32_t dataOffset, uint32_t offset,
                                           uint32_t size) {
-  H_DEBUG << depthToString() << " returnDataCopy " << hex << dataOffset << " "
-          << offset << " " << size << dec << "\n";
+  ProfileScope profile(*this, HostFunction::ReturnDataCopy, dataOffset, offset,
+                       size);
 
-  safeChargeDataCopy(size, GasSchedule::verylow);
+  safeChargeDataCopy(size, m_gas.verylow);
 
-  storeMemory(m_lastReturnData, offset, dataOffset, size);
+  storeMemory(lastReturnData(), offset, dataOffset, size);
 }
 
 uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
                                     uint32_t addressOffset,
                                     uint32_t valueOffset, uint32_t dataOffset,
                                     uint32_t dataLength) {
+  ProfileScope profile(
+      *this, HostFunction(unsigned(HostFunction::Call) + unsigned(kind)),
+      uint64_t(gas), addressOffset, dataOffset, dataLength);
   ensureCondition(gas >= 0, ArgumentOutOfRange, "Negative gas supplied.");
 
   evmc_message call_message;
@@ -537,36 +556,11 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
     break;
   }
 
-#if H_DEBUGGING
-  string methodName;
-  switch (kind) {
-  case EEICallKind::Call:
-    methodName = "call";
-    break;
-  case EEICallKind::CallCode:
-    methodName = "callCode";
-    break;
-  case EEICallKind::CallDelegate:
-    methodName = "callDelegate";
-    break;
-  case EEICallKind::CallStatic:
-    methodName = "callStatic";
-    break;
-  }
-
-  H_DEBUG << depthToString() << " " << methodName << " " << hex << gas << " "
-          << addressOffset << " " << valueOffset << " " << dataOffset << " "
-          << dataLength << dec << "\n";
-#endif
-
-  // NOTE: this must be declared outside the condition to ensure the memory
-  // doesn't go out of scope
-  bytes input_data;
+  // The input is passed in place, the memory of the caller does not change
+  // while the callee runs.
   if (dataLength) {
     ensureSourceMemoryBounds(dataOffset, dataLength);
-    input_data.resize(dataLength);
-    loadMemory(dataOffset, input_data, dataLength);
-    call_message.input_data = input_data.data();
+    call_message.input_data = memoryPointer(dataOffset, dataLength);
     call_message.input_size = dataLength;
   } else {
     call_message.input_data = nullptr;
@@ -574,7 +568,7 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
   }
 
   // Start with base call gas
-  takeInterfaceGas(GasSchedule::call);
+  takeInterfaceGas(m_gas.call);
 
   if (m_msg.depth >= 1024)
     return 1;
@@ -583,7 +577,7 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
   // Charge valuetransfer gas if value is being transferred.
   if ((kind == EEICallKind::Call || kind == EEICallKind::CallCode) &&
       !evmc::is_zero(call_message.value)) {
-    takeInterfaceGas(GasSchedule::valuetransfer);
+    takeInterfaceGas(m_gas.valuetransfer);
 
     if (!enoughSenderBalanceFor(call_message.value))
       return 1;
@@ -592,7 +586,7 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
     // is being transferred per EIP161.
     if ((kind == EEICallKind::Call) &&
         !m_host.account_exists(call_message.destination))
-      takeInterfaceGas(GasSchedule::callNewAccount);
+      takeInterfaceGas(m_gas.callNewAccount);
   }
 
   // This is the gas we are forwarding to the callee.
@@ -603,24 +597,27 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
 
   // Add gas stipend for value transfers
   if (!evmc::is_zero(call_message.value))
-    gas += GasSchedule::valueStipend;
+    gas += m_gas.valueStipend;
 
   call_message.gas = gas;
 
-  auto call_result = m_host.call(call_message);
-
-  if (call_result.output_data) {
-    m_lastReturnData.assign(call_result.output_data,
-                            call_result.output_data + call_result.output_size);
-  } else {
-    m_lastReturnData.clear();
-  }
+  evmc::result call_result = [&] {
+    benchmark::ScopedTimer timer(benchmark::Phase::HostCall);
+    return m_host.call(call_message);
+  }();
+  // the callee may have reentered and changed our storage
+  m_storageCache.clear();
 
   /* Return unspent gas */
   athenaAssert(call_result.gas_left >= 0, "EVMC returned negative gas left");
   m_result.gasLeft += call_result.gas_left;
+  profileGas(-call_result.gas_left);
+
+  const evmc_status_code status = call_result.status_code;
+  // keeps the output of the callee instead of copying it
+  m_lastReturn = move(call_result);
 
-  switch (call_result.status_code) {
+  switch (status) {
   case EVMC_SUCCESS:
     return 0;
   case EVMC_REVERT:
@@ -632,11 +629,10 @@ uint32_t EthereumInterface::eeiCall(EEICallKind kind, int64_t gas,
 
 uint32_t EthereumInterface::eeiCreate(uint32_t valueOffset, uint32_t dataOffset,
                                       uint32_t length, uint32_t resultOffset) {
-  H_DEBUG << depthToString() << " create " << hex << valueOffset << " "
-          << dataOffset << " " << length << dec << " " << resultOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::Create, valueOffset, dataOffset,
+                       length, resultOffset);
 
-  takeInterfaceGas(GasSchedule::create);
+  takeInterfaceGas(m_gas.create);
 
   ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation, "create");
 
@@ -651,14 +647,9 @@ uint32_t EthereumInterface::eeiCreate(uint32_t valueOffset, uint32_t dataOffset,
   if (!enoughSenderBalanceFor(create_message.value))
     return 1;
 
-  // NOTE: this must be declared outside the condition to ensure the memory
-  // doesn't go out of scope
-  bytes contract_code;
   if (length) {
     ensureSourceMemoryBounds(dataOffset, length);
-    contract_code.resize(length);
-    loadMemory(dataOffset, contract_code, length);
-    create_message.input_data = contract_code.data();
+    create_message.input_data = memoryPointer(dataOffset, length);
     create_message.input_size = length;
   } else {
     create_message.input_data = nullptr;
@@ -673,24 +664,27 @@ uint32_t EthereumInterface::eeiCreate(uint32_t valueOffset, uint32_t dataOffset,
   create_message.gas = gas;
   takeInterfaceGas(gas);
 
-  auto create_result = m_host.call(create_message);
+  evmc::result create_result = [&] {
+    benchmark::ScopedTimer timer(benchmark::Phase::HostCall);
+    return m_host.call(create_message);
+  }();
+  m_storageCache.clear();
 
   /* Return unspent gas */
   athenaAssert(create_result.gas_left >= 0, "EVMC returned negative gas left");
   m_result.gasLeft += create_result.gas_left;
+  profileGas(-create_result.gas_left);
 
-  if (create_result.status_code == EVMC_SUCCESS) {
+  const evmc_status_code status = create_result.status_code;
+  if (status == EVMC_SUCCESS) {
     storeAddress(create_result.create_address, resultOffset);
-    m_lastReturnData.clear();
-  } else if (create_result.output_data) {
-    m_lastReturnData.assign(create_result.output_data,
-                            create_result.output_data +
-                                create_result.output_size);
+    // a successful create has no return data
+    m_lastReturn = evmc::result{EVMC_SUCCESS, 0, nullptr, 0};
   } else {
-    m_lastReturnData.clear();
+    m_lastReturn = move(create_result);
   }
 
-  switch (create_result.status_code) {
+  switch (status) {
   case EVMC_SUCCESS:
     return 0;
   case EVMC_REVERT:
@@ -701,10 +695,9 @@ uint32_t EthereumInterface::eeiCreate(uint32_t valueOffset, uint32_t dataOffset,
 }
 
 void EthereumInterface::eeiSelfDestruct(uint32_t addressOffset) {
-  H_DEBUG << depthToString() << " selfDestruct " << hex << addressOffset << dec
-          << "\n";
+  ProfileScope profile(*this, HostFunction::SelfDestruct, addressOffset);
 
-  takeInterfaceGas(GasSchedule::selfdestruct);
+  takeInterfaceGas(m_gas.selfdestruct);
 
   ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation,
                   "selfDestruct");
@@ -712,17 +705,152 @@ void EthereumInterface::eeiSelfDestruct(uint32_t addressOffset) {
   evmc_address address = loadAddress(addressOffset);
 
   if (!m_host.account_exists(address))
-    takeInterfaceGas(GasSchedule::callNewAccount);
+    takeInterfaceGas(m_gas.callNewAccount);
 
   m_host.selfdestruct(m_msg.destination, address);
 
-  throw EndExecution{};
+  endExecution();
+}
+
+/*
+ * ethereum_batch Methods
+ */
+
+void EthereumInterface::batchStorageLoadMany(uint32_t pathsOffset,
+                                             uint32_t resultsOffset,
+                                             uint32_t count) {
+  ProfileScope profile(*this, HostFunction::StorageLoadMany, pathsOffset,
+                       resultsOffset, count);
+
+  takeInterfaceGas(int64_t(m_gas.storageLoad) * count);
+
+  ensureArrayMemoryBounds(pathsOffset, count, 32);
+  ensureArrayMemoryBounds(resultsOffset, count, 32);
+  for (uint32_t i = 0; i < count; i++) {
+    const evmc::bytes32 path = loadBytes32(pathsOffset + i * 32);
+    storeBytes32(getStorage(path), resultsOffset + i * 32);
+  }
+}
+
+void EthereumInterface::batchStorageStoreMany(uint32_t pathsOffset,
+                                              uint32_t valuesOffset,
+                                              uint32_t count) {
+  ProfileScope profile(*this, HostFunction::StorageStoreMany, pathsOffset,
+                       valuesOffset, count);
+
+  ensureCondition(count == 0 || !(m_msg.flags & EVMC_STATIC),
+                  StaticModeViolation, "storageStoreMany");
+
+  ensureArrayMemoryBounds(pathsOffset, count, 32);
+  ensureArrayMemoryBounds(valuesOffset, count, 32);
+  for (uint32_t i = 0; i < count; i++) {
+    // the minimum cost of each store, as in eeiStorageStore(), the sentry
+    // applies to every store of the batch
+    takeStorageStoreGas();
+    const auto path = loadBytes32(pathsOffset + i * 32);
+    const auto value = loadBytes32(valuesOffset + i * 32);
+    chargeAndSetStorage(path, value);
+  }
+}
+
+void EthereumInterface::batchCallDataCopyMany(uint32_t segmentsOffset,
+                                              uint32_t count) {
+  ProfileScope profile(*this, HostFunction::CallDataCopyMany, segmentsOffset,
+                       count);
+
+  ensureArrayMemoryBounds(segmentsOffset, count, 12);
+  for (uint32_t i = 0; i < count; i++) {
+    uint8_t segment[12];
+    loadMemory(segmentsOffset + i * 12, segment, sizeof(segment));
+    uint32_t resultOffset, dataOffset, length;
+    memcpy(&resultOffset, segment, 4);
+    memcpy(&dataOffset, segment + 4, 4);
+    memcpy(&length, segment + 8, 4);
+
+    safeChargeDataCopy(length, m_gas.verylow);
+
+    storeMemory({m_msg.input_data, m_msg.input_size}, dataOffset,
+                resultOffset, length);
+  }
+}
+
+/*
+ * bignum Methods
+ */
+
+void EthereumInterface::bignumAdd256(uint32_t aOffset, uint32_t bOffset,
+                                     uint32_t resultOffset) {
+  ProfileScope profile(*this, HostFunction::BignumAdd256, aOffset, bOffset,
+                       resultOffset);
+
+  takeInterfaceGas(m_gas.bignumAdd);
+  storeBignum(bignum::add(loadBignum(aOffset), loadBignum(bOffset)),
+              resultOffset);
+}
+
+void EthereumInterface::bignumSub256(uint32_t aOffset, uint32_t bOffset,
+                                     uint32_t resultOffset) {
+  ProfileScope profile(*this, HostFunction::BignumSub256, aOffset, bOffset,
+                       resultOffset);
+
+  takeInterfaceGas(m_gas.bignumAdd);
+  storeBignum(bignum::sub(loadBignum(aOffset), loadBignum(bOffset)),
+              resultOffset);
+}
+
+void EthereumInterface::bignumMul256(uint32_t aOffset, uint32_t bOffset,
+                                     uint32_t resultOffset) {
+  ProfileScope profile(*this, HostFunction::BignumMul256, aOffset, bOffset,
+                       resultOffset);
+
+  takeInterfaceGas(m_gas.bignumMul);
+  storeBignum(bignum::mul(loadBignum(aOffset), loadBignum(bOffset)),
+              resultOffset);
+}
+
+void EthereumInterface::bignumDivMod256(uint32_t aOffset, uint32_t bOffset,
+                                        uint32_t quotientOffset,
+                                        uint32_t remainderOffset) {
+  ProfileScope profile(*this, HostFunction::BignumDivMod256, aOffset,
+                       bOffset, quotientOffset, remainderOffset);
+
+  takeInterfaceGas(m_gas.bignumDivMod);
+  bignum::uint256 quotient, remainder;
+  bignum::divmod(loadBignum(aOffset), loadBignum(bOffset), quotient,
+                 remainder);
+  storeBignum(quotient, quotientOffset);
+  storeBignum(remainder, remainderOffset);
+}
+
+void EthereumInterface::bignumMulMod(uint32_t aOffset, uint32_t bOffset,
+                                     uint32_t modOffset,
+                                     uint32_t resultOffset) {
+  ProfileScope profile(*this, HostFunction::BignumMulMod, aOffset, bOffset,
+                       modOffset, resultOffset);
+
+  takeInterfaceGas(m_gas.bignumMulMod);
+  storeBignum(bignum::mulmod(loadBignum(aOffset), loadBignum(bOffset),
+                             loadBignum(modOffset)),
+              resultOffset);
+}
+
+void EthereumInterface::bignumExp(uint32_t baseOffset, uint32_t exponentOffset,
+                                  uint32_t resultOffset) {
+  ProfileScope profile(*this, HostFunction::BignumExp, baseOffset,
+                       exponentOffset, resultOffset);
+
+  const bignum::uint256 exponent = loadBignum(exponentOffset);
+  takeInterfaceGas(m_gas.bignumExp +
+                   int64_t(m_gas.bignumExpByte) *
+                       bignum::byteLength(exponent));
+  storeBignum(bignum::exp(loadBignum(baseOffset), exponent), resultOffset);
 }
 
 void EthereumInterface::takeGas(int64_t gas) {
   // NOTE: gas >= 0 is validated by the callers of this method
   ensureCondition(gas <= m_result.gasLeft, OutOfGas, "Out of gas.");
   m_result.gasLeft -= gas;
+  profileGas(gas);
 }
 
 void EthereumInterface::takeInterfaceGas(int64_t gas) {
@@ -744,6 +872,16 @@ void EthereumInterface::ensureSourceMemoryBounds(uint32_t offset,
                   "Out of bounds (source) memory copy.");
 }
 
+// Checks that @count items of @itemSize bytes at @offset are in memory,
+// without overflowing 32 bits.
+void EthereumInterface::ensureArrayMemoryBounds(uint32_t offset,
+                                                uint32_t count,
+                                                uint32_t itemSize) {
+  const uint64_t end = uint64_t(offset) + uint64_t(count) * itemSize;
+  ensureCondition(end <= memorySize(), InvalidMemoryAccess,
+                  "Out of bounds memory array.");
+}
+
 void EthereumInterface::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst,
                                           size_t length) {
   // NOTE: the source bound check is not needed as the caller already ensures it
@@ -756,9 +894,9 @@ void EthereumInterface::loadMemoryReverse(uint32_t srcOffset, uint8_t *dst,
     H_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; ++i) {
-    dst[length - (i + 1)] = memoryGet(srcOffset + i);
-  }
+  if (length)
+    copyReversed(dst, memoryPointer(srcOffset, length), length);
+  profileBytes(length);
 }
 
 void EthereumInterface::loadMemory(uint32_t srcOffset, uint8_t *dst,
@@ -773,9 +911,9 @@ void EthereumInterface::loadMemory(uint32_t srcOffset, uint8_t *dst,
     H_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; ++i) {
-    dst[i] = memoryGet(srcOffset + i);
-  }
+  if (length)
+    memcpy(dst, memoryPointer(srcOffset, length), length);
+  profileBytes(length);
 }
 
 void EthereumInterface::loadMemory(uint32_t srcOffset, bytes &dst,
@@ -792,9 +930,9 @@ void EthereumInterface::loadMemory(uint32_t srcOffset, bytes &dst,
     H_DEBUG << "Zero-length memory load from offset 0x" << hex << srcOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; ++i) {
-    dst[i] = memoryGet(srcOffset + i);
-  }
+  if (length)
+    memcpy(&dst[0], memoryPointer(srcOffset, length), length);
+  profileBytes(length);
 }
 
 void EthereumInterface::storeMemoryReverse(const uint8_t *src,
@@ -809,9 +947,9 @@ void EthereumInterface::storeMemoryReverse(const uint8_t *src,
     H_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; ++i) {
-    memorySet(dstOffset + length - (i + 1), src[i]);
-  }
+  if (length)
+    copyReversed(memoryPointer(dstOffset, length), src, length);
+  profileBytes(length);
 }
 
 void EthereumInterface::storeMemory(const uint8_t *src, uint32_t dstOffset,
@@ -825,9 +963,9 @@ void EthereumInterface::storeMemory(const uint8_t *src, uint32_t dstOffset,
     H_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; ++i) {
-    memorySet(dstOffset + i, src[i]);
-  }
+  if (length)
+    memcpy(memoryPointer(dstOffset, length), src, length);
+  profileBytes(length);
 }
 
 void EthereumInterface::storeMemory(bytes_view src, uint32_t srcOffset,
@@ -845,9 +983,9 @@ void EthereumInterface::storeMemory(bytes_view src, uint32_t srcOffset,
     H_DEBUG << "Zero-length memory store to offset 0x" << hex << dstOffset
             << dec << "\n";
 
-  for (uint32_t i = 0; i < length; i++) {
-    memorySet(dstOffset + i, src[srcOffset + i]);
-  }
+  if (length)
+    memcpy(memoryPointer(dstOffset, length), src.data() + srcOffset, length);
+  profileBytes(length);
 }
 
 /*
@@ -900,9 +1038,86 @@ void EthereumInterface::storeUint128(evmc::uint256be const &src,
   storeMemoryReverse(src.bytes + 16, dstOffset, 16);
 }
 
+bignum::uint256 EthereumInterface::loadBignum(uint32_t srcOffset) {
+  uint8_t dst[32];
+  loadMemory(srcOffset, dst, 32);
+  return bignum::load(dst);
+}
+
+void EthereumInterface::storeBignum(bignum::uint256 const &src,
+                                    uint32_t dstOffset) {
+  uint8_t value[32];
+  bignum::store(src, value);
+  storeMemory(value, dstOffset, 32);
+}
+
 /*
  * Utilities
  */
+evmc::bytes32 EthereumInterface::getStorage(evmc::bytes32 const &path) {
+  evmc::bytes32 value;
+  if (storageCacheActive() && m_storageCache.find(path, value))
+    return value;
+  {
+    benchmark::ScopedTimer timer(benchmark::Phase::HostCall);
+    value = m_host.get_storage(m_msg.destination, path);
+  }
+  if (storageCacheActive())
+    m_storageCache.insert(path, value);
+  return value;
+}
+
+evmc_storage_status EthereumInterface::setStorage(evmc::bytes32 const &path,
+                                                  evmc::bytes32 const &value) {
+  evmc_storage_status status;
+  {
+    benchmark::ScopedTimer timer(benchmark::Phase::HostCall);
+    status = m_host.set_storage(m_msg.destination, path, value);
+  }
+  if (storageCacheActive())
+    m_storageCache.insert(path, value);
+  return status;
+}
+
+void EthereumInterface::takeStorageStoreGas() {
+  if (!m_gas.netStorageMetering) {
+    takeInterfaceGas(m_gas.storageStoreChange);
+    return;
+  }
+  ensureCondition(!m_meterGas || m_result.gasLeft > m_gas.storageStoreSentry,
+                  OutOfGas, "Out of gas.");
+  takeInterfaceGas(m_gas.storageStoreNoop);
+}
+
+void EthereumInterface::chargeAndSetStorage(evmc::bytes32 const &path,
+                                            evmc::bytes32 const &value) {
+  if (!m_gas.netStorageMetering) {
+    // Charge the right amount in case of the create case.
+    if (is_zero(getStorage(path)) && !is_zero(value))
+      takeInterfaceGas(m_gas.storageStoreCreate - m_gas.storageStoreChange);
+
+    // We do not need to take care about the delete case (gas refund), the
+    // client does it.
+    setStorage(path, value);
+    return;
+  }
+
+  // The host knows the value of the slot before the transaction, it tells
+  // how the store changed the slot.
+  switch (setStorage(path, value)) {
+  case EVMC_STORAGE_ADDED:
+    takeInterfaceGas(m_gas.storageStoreCreate - m_gas.storageStoreNoop);
+    break;
+  case EVMC_STORAGE_MODIFIED:
+  case EVMC_STORAGE_DELETED:
+    takeInterfaceGas(m_gas.storageStoreChange - m_gas.storageStoreNoop);
+    break;
+  default:
+    // unchanged or modified again, refunds are up to the client
+    break;
+  }
+}
+
 void EthereumInterface::safeChargeDataCopy(uint32_t length, unsigned baseCost) {
   takeInterfaceGas(baseCost);
 
@@ -912,11 +1127,9 @@ void EthereumInterface::safeChargeDataCopy(uint32_t length, unsigned baseCost) {
   // Since `gas` is 63 bits wide, that means we have an extra 36 bits of
   // headroom.
   //
-  // Allow 16 bits here.
-  static_assert(GasSchedule::copy <= 65536,
-                "Gas cost of copy could lead to overflow");
+  // Allow 16 bits here, which the schedules are checked for.
   // Using uint64_t to force a type issue if the underlying API changes.
-  takeInterfaceGas(GasSchedule::copy * ((int64_t(length) + 31) / 32));
+  takeInterfaceGas(m_gas.copy * ((int64_t(length) + 31) / 32));
 }
 
 bool EthereumInterface::enoughSenderBalanceFor(evmc_uint256be const &value) {
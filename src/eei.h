@@ -16,15 +16,22 @@
 
 #pragma once
 
-#include <chrono>
+#include <atomic>
 #include <cstdint>
+#include <memory>
 #include <string>
 
 #include <evmc/evmc.h>
 #include <evmc/evmc.hpp>
 
+#include "benchmark.h"
+#include "bignum.h"
 #include "exceptions.h"
 #include "helpers.h"
+#include "hostprofile.h"
+#include "storagecache.h"
+#include "storagekeys.h"
+#include "trace.h"
 
 namespace athena {
 
@@ -34,6 +41,22 @@ struct ExecutionResult {
   bool isRevert = false;
 };
 
+// A parsed, validated and (where the engine supports it) compiled module.
+// Engines return their own subclass from compile(); a module must be
+// reusable for any number of subsequent executions, but not concurrently by
+// nested calls: engines keep the instance state inside the module.
+class WasmModule {
+public:
+  virtual ~WasmModule() noexcept = default;
+
+  // Set while the module is executing, a reentrant call into the same
+  // contract must use another module.
+  bool active = false;
+  // Analyzed on the first execution with a storage prefetch callback set.
+  StorageKeyPlan storageKeys;
+  bool storageKeysAnalyzed = false;
+};
+
 // There is a single engine instance in each VM instance and
 // likely execute() is called multiple times. As a result
 // an engine implementation cannot have instance variables with
@@ -42,54 +65,118 @@ class WasmEngine {
 public:
   virtual ~WasmEngine() noexcept = default;
 
-  virtual ExecutionResult execute(evmc::HostContext &context, bytes_view code,
-                                  bytes_view state_code,
-                                  evmc_message const &msg,
-                                  bool meterInterfaceGas) = 0;
+  virtual std::shared_ptr<WasmModule> compile(bytes_view code) = 0;
 
-  static void enableBenchmarking() noexcept { benchmarkingEnabled = true; }
+  // Compiles @code to charge gas like the output of injectMetering() does.
+  // Engines able to meter in their generated code override this.
+  virtual std::shared_ptr<WasmModule> compileMetered(bytes_view code);
 
-protected:
-  void instantiationStarted() noexcept {
-    if (benchmarkingEnabled)
-      instantiationStartTime = clock::now();
-  }
+  // Executes @module and stores the outcome in @result, whose buffers are
+  // reused so callers may keep one result per call depth.
+  virtual void execute(ExecutionResult &result, evmc::HostContext &context,
+                       WasmModule &module, bytes_view state_code,
+                       evmc_message const &msg, evmc_revision rev,
+                       bool meterInterfaceGas) = 0;
 
-  void executionStarted() noexcept {
-    if (benchmarkingEnabled)
-      executionStartTime = clock::now();
+  ExecutionResult execute(evmc::HostContext &context, WasmModule &module,
+                          bytes_view state_code, evmc_message const &msg,
+                          evmc_revision rev, bool meterInterfaceGas) {
+    ExecutionResult result;
+    execute(result, context, module, state_code, msg, rev, meterInterfaceGas);
+    return result;
   }
 
-  void executionFinished() {
-    if (benchmarkingEnabled)
-      collectBenchmarkingData();
+  // Compiles @code and executes it once.
+  ExecutionResult execute(evmc::HostContext &context, bytes_view code,
+                          bytes_view state_code, evmc_message const &msg,
+                          evmc_revision rev, bool meterInterfaceGas) {
+    auto module = compile(code);
+    return execute(context, *module, state_code, msg, rev, meterInterfaceGas);
   }
 
+  // Executions serve repeated storage reads from a cache of their own, see
+  // EthereumInterface::enableStorageCache().
+  void setStorageCache(bool enable) noexcept { m_storageCache = enable; }
+  bool storageCache() const noexcept { return m_storageCache; }
+
 private:
-  void collectBenchmarkingData();
+  bool m_storageCache = false;
+};
+
+// Gas charged by the host functions, the prices of the EVM instructions
+// they replace in one revision.
+struct GasSchedule {
+  unsigned storageLoad = 200;
+  unsigned storageStoreCreate = 20000;
+  unsigned storageStoreChange = 5000;
+  // Net gas metering of storage stores (EIP-1283, EIP-2200): stores which
+  // leave the value unchanged or change it again in the same transaction
+  // cost storageStoreNoop. Stores fail with less than storageStoreSentry gas
+  // left.
+  bool netStorageMetering = false;
+  unsigned storageStoreNoop = 0;
+  unsigned storageStoreSentry = 0;
+  unsigned log = 375;
+  unsigned logData = 8;
+  unsigned logTopic = 375;
+  unsigned create = 32000;
+  unsigned call = 700;
+  unsigned copy = 3;
+  unsigned blockhash = 800;
+  unsigned balance = 400;
+  unsigned base = 2;
+  unsigned verylow = 3;
+  unsigned extcode = 700;
+  unsigned selfdestruct = 5000;
+  unsigned valuetransfer = 9000;
+  unsigned valueStipend = 2300;
+  unsigned callNewAccount = 25000;
+  // bignum host functions, priced like the EVM instructions they replace
+  unsigned bignumAdd = 3;
+  unsigned bignumMul = 5;
+  unsigned bignumDivMod = 5;
+  unsigned bignumMulMod = 8;
+  unsigned bignumExp = 10;
+  unsigned bignumExpByte = 50;
 
-  using clock = std::chrono::high_resolution_clock;
-  static bool benchmarkingEnabled;
-  clock::time_point instantiationStartTime;
-  clock::time_point executionStartTime;
+  // @returns true if contracts can be executed in revision @rev.
+  static bool supports(evmc_revision rev) noexcept {
+    return rev >= EVMC_BYZANTIUM && rev <= EVMC_ISTANBUL;
+  }
+  // @returns the schedule of the supported revision @rev.
+  static GasSchedule const &of(evmc_revision rev) noexcept;
 };
 
 class EthereumInterface {
 public:
   explicit EthereumInterface(evmc::HostContext &_context, bytes_view _code,
                              evmc_message const &_msg, ExecutionResult &_result,
-                             bool _meterGas)
+                             evmc_revision _rev, bool _meterGas)
       : m_host(_context), m_code{_code}, m_msg(_msg), m_result(_result),
-        m_meterGas(_meterGas) {
+        m_gas(GasSchedule::of(_rev)), m_meterGas(_meterGas) {
     athenaAssert((m_msg.flags & ~uint32_t(EVMC_STATIC)) == 0,
                  "Unknown flags not supported.");
 
     // set starting gas
     m_result.gasLeft = m_msg.gas;
     // set sane defaults
-    m_result.returnValue = {};
+    m_result.returnValue.clear();
     m_result.isRevert = false;
+
+    if (hostprofile::enabled())
+      m_profile = hostprofile::contract(m_msg.destination);
+  }
+
+  // Serve repeated storage reads of the execution from a local cache, every
+  // storage write still reaches the host.
+  void enableStorageCache(bool enable) noexcept {
+    m_storageCacheEnabled = enable;
   }
+  bool storageCacheActive() const noexcept { return m_storageCacheEnabled; }
+
+  // finish, revert and selfDestruct set @flag instead of throwing
+  // EndExecution, the engine stops the execution once they return.
+  void setExitFlag(bool &flag) noexcept { m_exitFlag = &flag; }
 
   // WAVM/WABT host functions access this interface through an instance,
   // which requires public methods.
@@ -155,12 +242,41 @@ public:
                      uint32_t resultOffset);
   void eeiSelfDestruct(uint32_t addressOffset);
 
+  // ethereum_batch methods, vector forms of EEI methods charged like the
+  // sequence of calls they replace
+
+  // Loads the values of @count 32 byte keys at @pathsOffset to
+  // @resultsOffset.
+  void batchStorageLoadMany(uint32_t pathsOffset, uint32_t resultsOffset,
+                            uint32_t count);
+  // Stores @count 32 byte values at @valuesOffset under the keys at
+  // @pathsOffset, in order.
+  void batchStorageStoreMany(uint32_t pathsOffset, uint32_t valuesOffset,
+                             uint32_t count);
+  // Copies @count segments of the call data, each described at
+  // @segmentsOffset by the little endian i32 resultOffset, dataOffset and
+  // length of a callDataCopy.
+  void batchCallDataCopyMany(uint32_t segmentsOffset, uint32_t count);
+
+  // bignum methods, the operands are 256-bit little endian values
+
+  void bignumAdd256(uint32_t aOffset, uint32_t bOffset, uint32_t resultOffset);
+  void bignumSub256(uint32_t aOffset, uint32_t bOffset, uint32_t resultOffset);
+  void bignumMul256(uint32_t aOffset, uint32_t bOffset, uint32_t resultOffset);
+  void bignumDivMod256(uint32_t aOffset, uint32_t bOffset,
+                       uint32_t quotientOffset, uint32_t remainderOffset);
+  void bignumMulMod(uint32_t aOffset, uint32_t bOffset, uint32_t modOffset,
+                    uint32_t resultOffset);
+  void bignumExp(uint32_t baseOffset, uint32_t exponentOffset,
+                 uint32_t resultOffset);
+
 private:
   void eeiRevertOrFinish(bool revert, uint32_t offset, uint32_t size);
 
   void takeGas(int64_t gas);
 
-  void ensureSourceMemoryBounds(uint32_t offset, uint32_t length);
+  void ensureArrayMemoryBounds(uint32_t offset, uint32_t count,
+                               uint32_t itemSize);
   void loadMemoryReverse(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, uint8_t *dst, size_t length);
   void loadMemory(uint32_t srcOffset, bytes &dst, size_t length);
@@ -178,6 +294,8 @@ private:
   void storeAddress(evmc::address const &src, uint32_t dstOffset);
   evmc::uint256be loadUint128(uint32_t srcOffset);
   void storeUint128(evmc::uint256be const &src, uint32_t dstOffset);
+  bignum::uint256 loadBignum(uint32_t srcOffset);
+  void storeBignum(bignum::uint256 const &src, uint32_t dstOffset);
 
   inline int64_t maxCallGas(int64_t gas) { return gas - (gas / 64); }
 
@@ -186,6 +304,60 @@ private:
   static unsigned __int128 safeLoadUint128(evmc_uint256be const &value);
 
 protected:
+  using HostFunction = hostprofile::HostFunction;
+
+  void ensureSourceMemoryBounds(uint32_t offset, uint32_t length);
+
+  // Accounts the enclosing host function call when host profiling is on,
+  // and records it with its arguments when tracing is on. Only the outermost
+  // scope is profiled, so functions may call each other.
+  class ProfileScope {
+  public:
+    ProfileScope(EthereumInterface &interface, HostFunction function,
+                 uint64_t arg0 = 0, uint32_t arg1 = 0, uint32_t arg2 = 0,
+                 uint32_t arg3 = 0) noexcept
+        : m_interface(interface.m_profile && !interface.m_profiling
+                          ? &interface
+                          : nullptr) {
+      if (trace::enabled())
+        trace::record(unsigned(function), interface.m_msg.depth,
+                      interface.m_result.gasLeft, arg0, arg1, arg2, arg3);
+      if (m_interface) {
+        m_interface->m_profiling = true;
+        m_interface->m_profiledFunction = function;
+        m_start = hostprofile::cycles();
+      }
+    }
+    ~ProfileScope() noexcept {
+      if (m_interface) {
+        m_interface->profiledCounters().calls.fetch_add(
+            1, std::memory_order_relaxed);
+        m_interface->profiledCounters().cycles.fetch_add(
+            hostprofile::cycles() - m_start, std::memory_order_relaxed);
+        m_interface->m_profiling = false;
+      }
+    }
+
+    ProfileScope(ProfileScope const &) = delete;
+    ProfileScope &operator=(ProfileScope const &) = delete;
+
+  private:
+    EthereumInterface *m_interface;
+    uint64_t m_start = 0;
+  };
+
+  hostprofile::FunctionCounters &profiledCounters() noexcept {
+    return m_profile->functions[unsigned(m_profiledFunction)];
+  }
+  void profileBytes(size_t length) noexcept {
+    if (m_profiling)
+      profiledCounters().bytes.fetch_add(length, std::memory_order_relaxed);
+  }
+  void profileGas(int64_t gas) noexcept {
+    if (m_profiling)
+      profiledCounters().gas.fetch_add(gas, std::memory_order_relaxed);
+  }
+
   // Helpers methods
   inline std::string depthToString() const {
     return "[" + std::to_string(m_msg.depth) + "]";
@@ -194,33 +366,46 @@ protected:
   /* Checks for overflow and safely charges gas for variable length data copies
    */
   void safeChargeDataCopy(uint32_t length, unsigned baseCost);
+  // Storage access of m_msg.destination, through the storage cache.
+  evmc::bytes32 getStorage(evmc::bytes32 const &path);
+  evmc_storage_status setStorage(evmc::bytes32 const &path,
+                                 evmc::bytes32 const &value);
+  // Charges the least a storage store costs, chargeAndSetStorage() charges
+  // the rest once the store is done.
+  void takeStorageStoreGas();
+  void chargeAndSetStorage(evmc::bytes32 const &path,
+                           evmc::bytes32 const &value);
+  // Ends the execution with the result recorded so far.
+  void endExecution() {
+    if (!m_exitFlag)
+      throw EndExecution{};
+    *m_exitFlag = true;
+  }
   evmc::HostContext &m_host;
   bytes_view m_code;
   evmc_message const &m_msg;
-  bytes m_lastReturnData;
+  // Result of the last call or create, its output is released with the
+  // next one or with the interface.
+  evmc::result m_lastReturn{EVMC_SUCCESS, 0, nullptr, 0};
+  bytes_view lastReturnData() const noexcept {
+    return {m_lastReturn.output_data, m_lastReturn.output_size};
+  }
   ExecutionResult &m_result;
+  // The schedule and whether to meter are chosen per execution rather than
+  // made template parameters, which would instantiate the host functions of
+  // every engine once per revision. Reading them is not measurable next to
+  // the host calls which do it.
+  GasSchedule const &m_gas;
   bool m_meterGas = true;
-};
 
-struct GasSchedule {
-  static constexpr unsigned storageLoad = 200;
-  static constexpr unsigned storageStoreCreate = 20000;
-  static constexpr unsigned storageStoreChange = 5000;
-  static constexpr unsigned log = 375;
-  static constexpr unsigned logData = 8;
-  static constexpr unsigned logTopic = 375;
-  static constexpr unsigned create = 32000;
-  static constexpr unsigned call = 700;
-  static constexpr unsigned copy = 3;
-  static constexpr unsigned blockhash = 800;
-  static constexpr unsigned balance = 400;
-  static constexpr unsigned base = 2;
-  static constexpr unsigned verylow = 3;
-  static constexpr unsigned extcode = 700;
-  static constexpr unsigned selfdestruct = 5000;
-  static constexpr unsigned valuetransfer = 9000;
-  static constexpr unsigned valueStipend = 2300;
-  static constexpr unsigned callNewAccount = 25000;
+private:
+  bool *m_exitFlag = nullptr;
+  bool m_storageCacheEnabled = false;
+  hostprofile::ContractProfile *m_profile = nullptr;
+  HostFunction m_profiledFunction = HostFunction::UseGas;
+  bool m_profiling = false;
+  // Storage of m_msg.destination, cleared whenever the host may change it.
+  StorageCache m_storageCache;
 };
 
 } // namespace athena
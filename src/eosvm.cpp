@@ -19,11 +19,29 @@
 #include <eosio/vm/host_function.hpp>
 #include <eosio/vm/watchdog.hpp>
 
+#include <athena/buildinfo.h>
+
+#include "crypto.h"
 #include "debugging.h"
 #include "eosvm.h"
+#include "metering.h"
+#include "perfmap.h"
+#include "threadpool.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
 #include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 using namespace eosio;
 using namespace eosio::vm;
@@ -41,6 +59,14 @@ template <typename T> struct wasm_type_converter<T &> {
   static T &from_wasm(T *val) { return *val; }
   static T *to_wasm(T &val) { return std::addressof(val); }
 };
+
+// Host functions are members of the interface itself, call them on the
+// instance given to backend::call instead of on a copy made for each call,
+// which would lose any state kept between host calls.
+template <typename T> struct construct_derived<T, T> {
+  static T &value(T &base) { return base; }
+  typedef T type;
+};
 } // namespace eosio::vm
 
 using namespace std;
@@ -50,17 +76,22 @@ namespace athena {
 
 const string ethMod = "ethereum";
 const string dbgMod = "debug";
+const string bignumMod = "bignum";
+const string batchMod = "ethereum_batch";
 
 class EOSvmEthereumInterface;
-using backend_t = eosio::vm::backend<EOSvmEthereumInterface, eosio::vm::jit>;
-// using backend_t = eosio::vm::backend<EOSvmEthereumInterface>;
+// Impl is eosio::vm::jit, or eosio::vm::threaded or eosio::vm::interpreter
+// for the interpreters.
+template <typename Impl>
+using backend_t = eosio::vm::backend<EOSvmEthereumInterface, Impl>;
 
 class EOSvmEthereumInterface : public EthereumInterface {
 public:
   explicit EOSvmEthereumInterface(evmc::HostContext &_context, bytes_view _code,
                                   evmc_message const &_msg,
-                                  ExecutionResult &_result, bool _meterGas)
-      : EthereumInterface(_context, _code, _msg, _result, _meterGas) {}
+                                  ExecutionResult &_result,
+                                  evmc_revision _rev, bool _meterGas)
+      : EthereumInterface(_context, _code, _msg, _result, _rev, _meterGas) {}
 
 #if H_DEBUGGING
   void dbgPrint(char *, uint32_t length);
@@ -81,6 +112,28 @@ public:
   void eCallDataCopy(uint8_t *result, uint32_t dataOffset, uint32_t length);
   void eFinish(void *dp, uint32_t siz) { eRevertOrFinish(false, dp, siz); }
   void eRevert(void *dp, uint32_t siz) { eRevertOrFinish(true, dp, siz); }
+  uint32_t eCall(int64_t gas, uint32_t addressOffset, uint32_t valueOffset,
+                 uint32_t dataOffset, uint32_t dataLength) {
+    return eeiCall(EEICallKind::Call, gas, addressOffset, valueOffset,
+                   dataOffset, dataLength);
+  }
+  uint32_t eCallCode(int64_t gas, uint32_t addressOffset, uint32_t valueOffset,
+                     uint32_t dataOffset, uint32_t dataLength) {
+    return eeiCall(EEICallKind::CallCode, gas, addressOffset, valueOffset,
+                   dataOffset, dataLength);
+  }
+  uint32_t eCallDelegate(int64_t gas, uint32_t addressOffset,
+                         uint32_t dataOffset, uint32_t dataLength) {
+    return eeiCall(EEICallKind::CallDelegate, gas, addressOffset, 0,
+                   dataOffset, dataLength);
+  }
+  uint32_t eCallStatic(int64_t gas, uint32_t addressOffset,
+                       uint32_t dataOffset, uint32_t dataLength) {
+    return eeiCall(EEICallKind::CallStatic, gas, addressOffset, 0, dataOffset,
+                   dataLength);
+  }
+
+  void setWasmAllocator(wasm_allocator *walloc) { m_walloc = walloc; }
 
 private:
 #if H_DEBUGGING
@@ -88,12 +141,29 @@ private:
   void debugPrintStorageImpl(bool, uint8_t *);
 #endif
   void eRevertOrFinish(bool revert, void *dp, uint32_t size);
-  size_t memorySize() const override { return 0; }
-  void memorySet(size_t offset, uint8_t value) override {}
-  uint8_t memoryGet(size_t offset) override { return 0; }
+  // of a pointer into the linear memory, as traced
+  uint32_t wasmOffset(void const *p) const {
+    return uint32_t(static_cast<char const *>(p) -
+                    m_walloc->get_base_ptr<char>());
+  }
+  // These assume that m_walloc was set prior to execution.
+  size_t memorySize() const override {
+    int32_t pages = m_walloc->get_current_page();
+    return pages > 0 ? size_t(pages) * page_size : 0;
+  }
+  void memorySet(size_t offset, uint8_t value) override {
+    m_walloc->get_base_ptr<uint8_t>()[offset] = value;
+  }
+  uint8_t memoryGet(size_t offset) override {
+    return m_walloc->get_base_ptr<uint8_t>()[offset];
+  }
   uint8_t *memoryPointer(size_t offset, size_t length) override {
-    return nullptr;
+    ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess,
+                    "Memory is shorter than requested segment");
+    return m_walloc->get_base_ptr<uint8_t>() + offset;
   }
+
+  wasm_allocator *m_walloc = nullptr;
 };
 
 #if H_DEBUGGING
@@ -155,200 +225,794 @@ void EOSvmEthereumInterface::debugPrintStorageImpl(bool useHex, uint8_t *dp) {
 
 void EOSvmEthereumInterface::eCallDataCopy(uint8_t *result, uint32_t dataOffset,
                                            uint32_t length) {
-#if H_DEBUGGING
-  H_DEBUG << depthToString() << " callDataCopy " << hex
-          << (uint32_t)((uint64_t)result) << " " << dataOffset << " " << length
-          << dec << "\n";
-#endif
+  ProfileScope profile(*this, HostFunction::CallDataCopy, wasmOffset(result),
+                       dataOffset, length);
   if (dataOffset >= m_msg.input_size)
     return; // no copy
 
-  safeChargeDataCopy(length, GasSchedule::verylow);
+  safeChargeDataCopy(length, m_gas.verylow);
 
   if (dataOffset + length > m_msg.input_size)
     length = m_msg.input_size - dataOffset;
   memcpy(result, m_msg.input_data + dataOffset, length);
+  profileBytes(length);
 }
 
 void EOSvmEthereumInterface::eGetCaller(uint8_t *result) {
-  H_DEBUG << depthToString() << " getCaller " << hex
-          << (uint32_t)((uint64_t)result) << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetCaller, wasmOffset(result));
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
   memcpy(result, &m_msg.sender, sizeof(m_msg.sender));
+  profileBytes(sizeof(m_msg.sender));
 }
 
 void EOSvmEthereumInterface::eGetAddress(uint8_t *result) {
-  H_DEBUG << depthToString() << " getAddress " << hex
-          << (uint32_t)((uint64_t)result) << dec << "\n";
+  ProfileScope profile(*this, HostFunction::GetAddress, wasmOffset(result));
 
-  takeInterfaceGas(GasSchedule::base);
+  takeInterfaceGas(m_gas.base);
   memcpy(result, &m_msg.destination, sizeof(m_msg.destination));
+  profileBytes(sizeof(m_msg.destination));
 }
 
 void EOSvmEthereumInterface::eSelfDestruct(address *result) {
-  H_DEBUG << depthToString() << " selfDestruct " << hex
-          << (uint32_t)((uint64_t)result) << dec << "\n";
+  ProfileScope profile(*this, HostFunction::SelfDestruct, wasmOffset(result));
 
-  takeInterfaceGas(GasSchedule::balance);
+  takeInterfaceGas(m_gas.balance);
   m_host.selfdestruct(m_msg.destination, *result);
-  throw EndExecution{};
+  endExecution();
 }
 
 void EOSvmEthereumInterface::eStorageStore(bytes32 *path, bytes32 *valuePtr) {
-  H_DEBUG << depthToString() << " storageStore " << hex
-          << (uint32_t)((uint64_t)path) << " " << (uint32_t)((uint64_t)valuePtr)
-          << dec << "\n";
+  ProfileScope profile(*this, HostFunction::StorageStore, wasmOffset(path),
+                       wasmOffset(valuePtr));
 
   // Charge this here as it is the minimum cost.
-  takeInterfaceGas(GasSchedule::storageStoreChange);
+  takeStorageStoreGas();
 
   ensureCondition(!(m_msg.flags & EVMC_STATIC), StaticModeViolation,
                   "storageStore");
 
-  const auto current = m_host.get_storage(m_msg.destination, *path);
-
-  // Charge the right amount in case of the create case.
-  if (is_zero(current) && !is_zero(*valuePtr))
-    takeInterfaceGas(GasSchedule::storageStoreCreate -
-                     GasSchedule::storageStoreChange);
-
-  // We do not need to take care about the delete case (gas refund), the client
-  // does it.
-
-  m_host.set_storage(m_msg.destination, *path, *valuePtr);
+  chargeAndSetStorage(*path, *valuePtr);
+  profileBytes(sizeof(*path) + sizeof(*valuePtr));
 }
 
 void EOSvmEthereumInterface::eStorageLoad(bytes32 *path, bytes32 *result) {
-  H_DEBUG << depthToString() << " storageLoad " << hex
-          << (uint32_t)((uint64_t)path) << " " << (uint32_t)((uint64_t)result)
-          << dec << "\n";
+  ProfileScope profile(*this, HostFunction::StorageLoad, wasmOffset(path),
+                       wasmOffset(result));
 
-  takeInterfaceGas(GasSchedule::storageLoad);
+  takeInterfaceGas(m_gas.storageLoad);
 
-  *result = m_host.get_storage(m_msg.destination, *path);
+  *result = getStorage(*path);
+  profileBytes(sizeof(*path) + sizeof(*result));
 }
 
 void EOSvmEthereumInterface::eRevertOrFinish(bool revert, void *dp,
                                              uint32_t size) {
+  ProfileScope profile(*this,
+                       revert ? HostFunction::Revert : HostFunction::Finish,
+                       wasmOffset(dp), size);
+
+  // eos-vm only translates the offset, the length is checked here before
+  // anything is allocated for it
+  ensureSourceMemoryBounds(wasmOffset(dp), size);
+  m_result.returnValue.assign(size, '\0');
+  memcpy(m_result.returnValue.data(), dp, size);
+  profileBytes(size);
+
+  m_result.isRevert = revert;
+
+  endExecution();
+}
+
+
+namespace {
+
+using rhf_t = eosio::vm::registered_host_functions<EOSvmEthereumInterface>;
+
+// Binds the complete ethereum, bignum (and debug) modules. The host
+// function table of eos-vm is process wide, so this is done only once.
+void registerHostFunctions() {
+  using I = EOSvmEthereumInterface;
+  rhf_t::add<I, &I::eeiUseGas, wasm_allocator>(ethMod, "useGas");
+  rhf_t::add<I, &I::eGetAddress, wasm_allocator>(ethMod, "getAddress");
+  rhf_t::add<I, &I::eeiGetExternalBalance, wasm_allocator>(
+      ethMod, "getExternalBalance");
+  rhf_t::add<I, &I::eeiGetBlockHash, wasm_allocator>(ethMod, "getBlockHash");
+  rhf_t::add<I, &I::eCall, wasm_allocator>(ethMod, "call");
+  rhf_t::add<I, &I::eCallDataCopy, wasm_allocator>(ethMod, "callDataCopy");
+  rhf_t::add<I, &I::eeiGetCallDataSize, wasm_allocator>(ethMod,
+                                                         "getCallDataSize");
+  rhf_t::add<I, &I::eCallCode, wasm_allocator>(ethMod, "callCode");
+  rhf_t::add<I, &I::eCallDelegate, wasm_allocator>(ethMod, "callDelegate");
+  rhf_t::add<I, &I::eCallStatic, wasm_allocator>(ethMod, "callStatic");
+  rhf_t::add<I, &I::eStorageStore, wasm_allocator>(ethMod, "storageStore");
+  rhf_t::add<I, &I::eStorageLoad, wasm_allocator>(ethMod, "storageLoad");
+  rhf_t::add<I, &I::eGetCaller, wasm_allocator>(ethMod, "getCaller");
+  rhf_t::add<I, &I::eeiGetCallValue, wasm_allocator>(ethMod, "getCallValue");
+  rhf_t::add<I, &I::eeiCodeCopy, wasm_allocator>(ethMod, "codeCopy");
+  rhf_t::add<I, &I::eeiGetCodeSize, wasm_allocator>(ethMod, "getCodeSize");
+  rhf_t::add<I, &I::eeiGetBlockCoinbase, wasm_allocator>(ethMod,
+                                                          "getBlockCoinbase");
+  rhf_t::add<I, &I::eeiCreate, wasm_allocator>(ethMod, "create");
+  rhf_t::add<I, &I::eeiGetBlockDifficulty, wasm_allocator>(
+      ethMod, "getBlockDifficulty");
+  rhf_t::add<I, &I::eeiExternalCodeCopy, wasm_allocator>(ethMod,
+                                                          "externalCodeCopy");
+  rhf_t::add<I, &I::eeiGetExternalCodeSize, wasm_allocator>(
+      ethMod, "getExternalCodeSize");
+  rhf_t::add<I, &I::eeiGetGasLeft, wasm_allocator>(ethMod, "getGasLeft");
+  rhf_t::add<I, &I::eeiGetBlockGasLimit, wasm_allocator>(ethMod,
+                                                          "getBlockGasLimit");
+  rhf_t::add<I, &I::eeiGetTxGasPrice, wasm_allocator>(ethMod, "getTxGasPrice");
+  rhf_t::add<I, &I::eeiLog, wasm_allocator>(ethMod, "log");
+  rhf_t::add<I, &I::eeiGetBlockNumber, wasm_allocator>(ethMod,
+                                                        "getBlockNumber");
+  rhf_t::add<I, &I::eeiGetTxOrigin, wasm_allocator>(ethMod, "getTxOrigin");
+  rhf_t::add<I, &I::eFinish, wasm_allocator>(ethMod, "finish");
+  rhf_t::add<I, &I::eRevert, wasm_allocator>(ethMod, "revert");
+  rhf_t::add<I, &I::eeiGetReturnDataSize, wasm_allocator>(ethMod,
+                                                           "getReturnDataSize");
+  rhf_t::add<I, &I::eeiReturnDataCopy, wasm_allocator>(ethMod,
+                                                        "returnDataCopy");
+  rhf_t::add<I, &I::eSelfDestruct, wasm_allocator>(ethMod, "selfDestruct");
+  rhf_t::add<I, &I::eeiGetBlockTimestamp, wasm_allocator>(ethMod,
+                                                           "getBlockTimestamp");
+  rhf_t::add<I, &I::bignumAdd256, wasm_allocator>(bignumMod, "add256");
+  rhf_t::add<I, &I::bignumSub256, wasm_allocator>(bignumMod, "sub256");
+  rhf_t::add<I, &I::bignumMul256, wasm_allocator>(bignumMod, "mul256");
+  rhf_t::add<I, &I::bignumDivMod256, wasm_allocator>(bignumMod, "divmod256");
+  rhf_t::add<I, &I::bignumMulMod, wasm_allocator>(bignumMod, "mulmod");
+  rhf_t::add<I, &I::bignumExp, wasm_allocator>(bignumMod, "exp");
+  rhf_t::add<I, &I::batchStorageLoadMany, wasm_allocator>(batchMod,
+                                                          "storageLoadMany");
+  rhf_t::add<I, &I::batchStorageStoreMany, wasm_allocator>(batchMod,
+                                                           "storageStoreMany");
+  rhf_t::add<I, &I::batchCallDataCopyMany, wasm_allocator>(batchMod,
+                                                           "callDataCopyMany");
 #if H_DEBUGGING
-  H_DEBUG << depthToString() << " " << (revert ? "revert " : "finish ") << hex
-          << (uint32_t)((uint64_t)dp) << " " << size << dec << "\n";
+  rhf_t::add<I, &I::dbgPrint, wasm_allocator>(dbgMod, "print");
+  rhf_t::add<I, &I::debugPrint32, wasm_allocator>(dbgMod, "print32");
+  rhf_t::add<I, &I::debugPrint64, wasm_allocator>(dbgMod, "print64");
+  rhf_t::add<I, &I::dbgPrintMem, wasm_allocator>(dbgMod, "printMem");
+  rhf_t::add<I, &I::dbgPrintMemHex, wasm_allocator>(dbgMod, "printMemHex");
+  rhf_t::add<I, &I::dbgPrintStorage, wasm_allocator>(dbgMod, "printStorage");
+  rhf_t::add<I, &I::dbgPrintStorageHex, wasm_allocator>(dbgMod,
+                                                         "printStorageHex");
 #endif
+}
 
-  m_result.returnValue = bytes(size, '\0');
-  memcpy(m_result.returnValue.data(), dp, size);
+} // anonymous namespace
 
-  m_result.isRevert = revert;
+// Linear memory reservations of one engine. Each wasm_allocator reserves
+// max_memory of address space, reusing them avoids the mmap and munmap on
+// every execution. Allocators beyond the capacity are released.
+class WasmAllocatorPool {
+public:
+  static constexpr size_t defaultCapacity = 16;
 
-  throw EndExecution{};
+  ~WasmAllocatorPool() { clear(); }
+
+  unique_ptr<wasm_allocator> acquire() {
+    if (m_free.empty())
+      return make_unique<wasm_allocator>();
+    auto walloc = move(m_free.back());
+    m_free.pop_back();
+    return walloc;
+  }
+
+  void release(unique_ptr<wasm_allocator> walloc) {
+    if (m_free.size() < m_capacity)
+      m_free.push_back(move(walloc));
+    else
+      walloc->free();
+  }
+
+  void setCapacity(size_t capacity) {
+    m_capacity = capacity;
+    while (m_free.size() > m_capacity) {
+      m_free.back()->free();
+      m_free.pop_back();
+    }
+  }
+
+  void clear() {
+    for (auto &walloc : m_free)
+      walloc->free();
+    m_free.clear();
+  }
+
+private:
+  vector<unique_ptr<wasm_allocator>> m_free;
+  size_t m_capacity = defaultCapacity;
+};
+
+namespace {
+
+// Checks out an allocator of @pool for the scope of one execution, the
+// zeroing done meanwhile (including the reset on initialization) is added
+// to @stats.
+class PooledWasmAllocator {
+public:
+  PooledWasmAllocator(WasmAllocatorPool &pool, bool lazyZero,
+                      EOSvmEngine::MemoryStats &stats)
+      : m_pool(pool), m_walloc(pool.acquire()), m_stats(stats) {
+    m_walloc->set_lazy_zero(lazyZero);
+    m_walloc->clear_stats();
+  }
+  ~PooledWasmAllocator() {
+    m_stats.bytesZeroed += m_walloc->get_bytes_zeroed();
+    m_stats.bytesDiscarded += m_walloc->get_bytes_discarded();
+    m_pool.release(move(m_walloc));
+  }
+  PooledWasmAllocator(PooledWasmAllocator const &) = delete;
+  PooledWasmAllocator &operator=(PooledWasmAllocator const &) = delete;
+
+  wasm_allocator *get() const noexcept { return m_walloc.get(); }
+
+private:
+  WasmAllocatorPool &m_pool;
+  unique_ptr<wasm_allocator> m_walloc;
+  EOSvmEngine::MemoryStats &m_stats;
+};
+
+// Selects huge pages for the reservations made by the calling thread for
+// the lifetime of the scope.
+class HugePagesScope {
+public:
+  explicit HugePagesScope(bool enable) noexcept
+      : m_previous(huge_pages_enabled()) {
+    set_huge_pages(enable);
+  }
+  ~HugePagesScope() noexcept { set_huge_pages(m_previous); }
+
+  HugePagesScope(HugePagesScope const &) = delete;
+  HugePagesScope &operator=(HugePagesScope const &) = delete;
+
+private:
+  bool m_previous;
+};
+
+// Process wide workers compiling function bodies in parallel, one pool per
+// thread count engines asked for. A pool is started on first use and kept
+// until exit.
+class CompilePool {
+public:
+  static CompilePool &instance() {
+    static CompilePool pool;
+    return pool;
+  }
+
+  // @returns an empty function if functions are to be compiled in order.
+  // The workers make their reservations with the huge pages setting of the
+  // calling thread.
+  parallel_for_t parallelFor(size_t threads) {
+    if (threads == 0)
+      threads = max(1u, thread::hardware_concurrency());
+    if (threads <= 1)
+      return {};
+    shared_ptr<ThreadPool> pool;
+    try {
+      lock_guard<mutex> lock(m_mutex);
+      auto &slot = m_pools[threads];
+      if (!slot)
+        slot = make_shared<ThreadPool>(threads);
+      pool = slot;
+    } catch (std::exception const &e) {
+      H_DEBUG << "Failed to start the compile threads: " << e.what() << "\n";
+      return {};
+    }
+    const bool hugePages = huge_pages_enabled();
+    return [pool, hugePages](size_t count,
+                             function<void(size_t)> const &body) {
+      pool->parallelFor(count, [&body, hugePages](size_t i) {
+        HugePagesScope scope(hugePages);
+        body(i);
+      });
+    };
+  }
+
+private:
+  mutex m_mutex;
+  map<size_t, shared_ptr<ThreadPool>> m_pools;
+};
+
+template <typename Impl> struct EOSvmModule : WasmModule {
+  EOSvmModule(wasm_code_ptr &wcodePtr, size_t size,
+              jit_code_image const *image, bool gasMetering,
+              parallel_for_t const &parallelFor)
+      : bkend(wcodePtr, size, image, gasMetering, parallelFor),
+        gasMetered(gasMetering) {}
+
+  backend_t<Impl> bkend;
+  uint32_t main_idx = 0;
+  // the JIT code charges result.gasLeft directly
+  bool gasMetered;
+  // set once the first instantiation decided on taking a snapshot
+  bool snapshotChecked = false;
+  // modules still cached after this many executions are compacted
+  static constexpr uint32_t compactAfterExecutions = 8;
+  uint32_t executions = 0;
+};
+
+using code_writer_t =
+    machine_code_writer<jit_execution_context<EOSvmEthereumInterface>>;
+
+string jitCacheVersion(bool gasMetering) {
+  return "eos-vm-jit-" + to_string(code_writer_t::code_image_version) + "-" +
+         athena_get_buildinfo()->project_version + (gasMetering ? "-gas" : "");
 }
 
-unique_ptr<WasmEngine> EOSvmEngine::create() {
-  return unique_ptr<WasmEngine>{new EOSvmEngine};
+// Payload of a JIT cache file: a CodeImageHeader followed by the function
+// offsets, the relocations and the code.
+struct CodeImageHeader {
+  uint64_t maximumStack;
+  uint64_t codeSize;
+  uint32_t functionCount;
+  uint32_t relocationCount;
+};
+
+bytes serializeCodeImage(jit_code_image const &image) {
+  CodeImageHeader header{image.maximum_stack, image.code_size,
+                         uint32_t(image.function_offsets.size()),
+                         uint32_t(image.relocation_count)};
+  bytes out;
+  auto append = [&out](void const *data, size_t size) {
+    out.append(static_cast<uint8_t const *>(data), size);
+  };
+  append(&header, sizeof(header));
+  append(image.function_offsets.data(),
+         image.function_offsets.size() * sizeof(uint64_t));
+  append(image.relocations, image.relocation_count * sizeof(jit_relocation));
+  append(image.code, image.code_size);
+  return out;
 }
 
-ExecutionResult EOSvmEngine::execute(evmc::HostContext &context,
-                                     bytes_view code, bytes_view state_code,
-                                     evmc_message const &msg,
-                                     bool meterInterfaceGas) {
+// @returns false if @payload is truncated, @image then views @payload.
+bool parseCodeImage(bytes_view payload, jit_code_image &image) {
+  CodeImageHeader header;
+  if (payload.size() < sizeof(header))
+    return false;
+  memcpy(&header, payload.data(), sizeof(header));
+  const size_t offsetsSize = header.functionCount * sizeof(uint64_t);
+  const size_t relocationsSize =
+      header.relocationCount * sizeof(jit_relocation);
+  if (payload.size() - sizeof(header) !=
+      offsetsSize + relocationsSize + header.codeSize)
+    return false;
+
+  uint8_t const *pos = payload.data() + sizeof(header);
+  image.function_offsets.resize(header.functionCount);
+  memcpy(image.function_offsets.data(), pos, offsetsSize);
+  pos += offsetsSize;
+  // the payload is 8 byte aligned in the file
+  image.relocations = reinterpret_cast<jit_relocation const *>(pos);
+  image.relocation_count = header.relocationCount;
+  pos += relocationsSize;
+  image.code = pos;
+  image.code_size = header.codeSize;
+  image.maximum_stack = header.maximumStack;
+  return true;
+}
 
-  wasm_allocator wa;
-  using rhf_t = eosio::vm::registered_host_functions<EOSvmEthereumInterface>;
-#if H_DEBUGGING
-  H_DEBUG << "Executing with eosvm...\n";
-#endif
-  instantiationStarted();
-
-  // register eth_finish
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eFinish,
-             wasm_allocator>(ethMod, "finish");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eRevert,
-             wasm_allocator>(ethMod, "revert");
-  // register eth_getCallDataSize
-  rhf_t::add<EOSvmEthereumInterface,
-             &EOSvmEthereumInterface::eeiGetCallDataSize, wasm_allocator>(
-      ethMod, "getCallDataSize");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eCallDataCopy,
-             wasm_allocator>(ethMod, "callDataCopy");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eGetAddress,
-             wasm_allocator>(ethMod, "getAddress");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eStorageStore,
-             wasm_allocator>(ethMod, "storageStore");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eStorageLoad,
-             wasm_allocator>(ethMod, "storageLoad");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eGetCaller,
-             wasm_allocator>(ethMod, "getCaller");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eSelfDestruct,
-             wasm_allocator>(ethMod, "selfDestruct");
+// Lists the machine code of @mod, compiled from @code, in the perf map as
+// wasm:<code hash>:<function name or index>. The error handlers, host call
+// stubs and call_indirect table in front of the functions are one symbol.
+// Every function keeps a frame pointer, so perf --call-graph=fp walks the
+// JIT frames.
+void recordPerfMap(bytes_view code, eosio::vm::module &mod) {
+  const string contract =
+      "wasm:" + toHex(crypto::keccak256(code)).substr(2, 16) + ":";
+  const uint32_t imported = mod.get_imported_functions_size();
+  vector<string> names =
+      perfmap::functionNames(code, imported + mod.code.size());
+  // function bodies by code offset
+  vector<pair<uint64_t, uint32_t>> bodies;
+  for (uint32_t i = 0; i < mod.code.size(); i++)
+    bodies.emplace_back(mod.code[i].jit_code_offset, imported + i);
+  sort(bodies.begin(), bodies.end());
+
+  const auto base = reinterpret_cast<uintptr_t>(mod.allocator._code_base);
+  vector<perfmap::Symbol> symbols;
+  if (!bodies.empty() && bodies[0].first > 0)
+    symbols.push_back({base, size_t(bodies[0].first), contract + "stubs"});
+  for (size_t i = 0; i < bodies.size(); i++) {
+    const uint64_t end = i + 1 < bodies.size() ? bodies[i + 1].first
+                                               : mod.allocator._code_size;
+    const uint32_t index = bodies[i].second;
+    symbols.push_back(
+        {base + bodies[i].first, size_t(end - bodies[i].first),
+         contract + (names[index].empty() ? to_string(index) : names[index])});
+  }
+  perfmap::record(symbols);
+}
+
+// Parses @code, with the machine code of @image if not null, and links it
+// to the host functions. The JIT compiles on @compileThreads threads, see
+// EOSvmEngine::setCompileThreads(). Throws eosio::vm::exception.
+template <typename Impl>
+shared_ptr<EOSvmModule<Impl>>
+loadModule(bytes_view code, jit_code_image const *image, bool gasMetering,
+           size_t compileThreads, bool perfMap) {
+  wasm_code_ptr wcodePtr((uint8_t *)code.data(), code.size());
+  auto module = make_shared<EOSvmModule<Impl>>(
+      wcodePtr, code.size(), image, gasMetering,
+      image ? parallel_for_t{}
+            : CompilePool::instance().parallelFor(compileThreads));
 #if H_DEBUGGING
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::dbgPrint,
-             wasm_allocator>(dbgMod, "print");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::debugPrint32,
-             wasm_allocator>(dbgMod, "print32");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::debugPrint64,
-             wasm_allocator>(dbgMod, "print64");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::dbgPrintMem,
-             wasm_allocator>(dbgMod, "printMem");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::dbgPrintMemHex,
-             wasm_allocator>(dbgMod, "printMemHex");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::dbgPrintStorage,
-             wasm_allocator>(dbgMod, "printStorage");
-  rhf_t::add<EOSvmEthereumInterface,
-             &EOSvmEthereumInterface::dbgPrintStorageHex, wasm_allocator>(
-      dbgMod, "printStorageHex");
+  H_DEBUG << "Resolving ewasm with eosvm...\n";
 #endif
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eeiUseGas,
-             wasm_allocator>(ethMod, "useGas");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eeiGetGasLeft,
-             wasm_allocator>(ethMod, "getGasLeft");
-  rhf_t::add<EOSvmEthereumInterface, &EOSvmEthereumInterface::eeiGetBlockNumber,
-             wasm_allocator>(ethMod, "getBlockNumber");
+  rhf_t::resolve(module->bkend.get_module());
+  module->bkend.get_module().finalize();
+  module->main_idx = module->bkend.get_module().get_exported_function("main");
+  if constexpr (Impl::is_jit) {
+    if (perfMap)
+      recordPerfMap(code, module->bkend.get_module());
+  }
+  return module;
+}
+
+// @returns the module built from the machine code cached for @code, or null.
+shared_ptr<EOSvmModule<eosio::vm::jit>>
+loadCachedModule(JitCache &jitCache, bytes_view code, bool gasMetering,
+                 bool perfMap) {
+  JitCache::MappedFile file;
+  bytes_view payload;
+  jit_code_image image;
+  if (!jitCache.find(code, file, payload) || !parseCodeImage(payload, image))
+    return nullptr;
+  try {
+    return loadModule<eosio::vm::jit>(code, &image, gasMetering, 1, perfMap);
+  } catch (const eosio::vm::exception &ex) {
+    // fall back to generating the code
+    H_DEBUG << "eos-vm: invalid JIT cache entry: " << ex.detail() << "\n";
+    return nullptr;
+  }
+}
+
+// A module of engine=eosvm-tiered. It runs on the threaded code interpreter
+// until it has been executed often enough, then the JIT compiles it on the
+// tier-up thread and executions starting after that run the machine code.
+// A call always completes on the tier it started on, as the two keep their
+// frames on different stacks.
+struct EOSvmTieredModule : WasmModule,
+                           enable_shared_from_this<EOSvmTieredModule> {
+  explicit EOSvmTieredModule(bytes_view _code) : code(_code) {}
+
+  shared_ptr<EOSvmModule<eosio::vm::jit>> jitModule() const {
+    return atomic_load(&optimized);
+  }
+
+  // kept for the JIT
+  const bytes code;
+  shared_ptr<EOSvmModule<eosio::vm::threaded>> baseline;
+  // set by the tier-up thread, use atomic_load()
+  shared_ptr<EOSvmModule<eosio::vm::jit>> optimized;
+  // only used by the executing thread
+  uint64_t executions = 0;
+  bool tierUpQueued = false;
+};
+
+// Process wide thread compiling tiered modules, in the order they were
+// queued. Jobs still queued on exit are dropped.
+class TierUpQueue {
+public:
+  static TierUpQueue &instance() {
+    static TierUpQueue queue;
+    return queue;
+  }
+
+  void push(function<void()> job) {
+    {
+      lock_guard<mutex> lock(m_mutex);
+      if (!m_thread.joinable())
+        m_thread = thread(&TierUpQueue::run, this);
+      m_jobs.push_back(move(job));
+    }
+    m_cond.notify_one();
+  }
+
+private:
+  TierUpQueue() = default;
+  ~TierUpQueue() {
+    {
+      lock_guard<mutex> lock(m_mutex);
+      m_stopping = true;
+    }
+    m_cond.notify_one();
+    if (m_thread.joinable())
+      m_thread.join();
+  }
+
+  void run() {
+    unique_lock<mutex> lock(m_mutex);
+    for (;;) {
+      m_cond.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+      if (m_stopping)
+        return;
+      function<void()> job = move(m_jobs.front());
+      m_jobs.pop_front();
+      lock.unlock();
+      job();
+      lock.lock();
+    }
+  }
+
+  mutex m_mutex;
+  condition_variable m_cond;
+  deque<function<void()>> m_jobs;
+  thread m_thread;
+  bool m_stopping = false;
+};
+
+} // anonymous namespace
+
+EOSvmEngine::EOSvmEngine(Mode mode)
+    : m_mode(mode), m_allocatorPool(make_unique<WasmAllocatorPool>()),
+      m_jitCache(jitCacheVersion(false)),
+      m_meteredJitCache(jitCacheVersion(true)) {}
+
+void EOSvmEngine::setMemoryPoolSize(size_t size) {
+  m_allocatorPool->setCapacity(size);
+}
+
+void EOSvmEngine::setHugePages(bool enable) {
+  if (enable == m_hugePages)
+    return;
+  m_hugePages = enable;
+  // reserved again on demand with the new backing
+  m_allocatorPool->clear();
+}
+
+EOSvmEngine::~EOSvmEngine() noexcept {
+  H_DEBUG << "eos-vm memory: " << m_memoryStats.bytesZeroed
+          << " bytes zeroed, " << m_memoryStats.bytesDiscarded
+          << " bytes discarded\n";
+  if (m_jitCache.enabled())
+    H_DEBUG << "JIT cache: " << m_jitCache.hits() << " hits, "
+            << m_jitCache.misses() << " misses\n";
+}
+
+unique_ptr<WasmEngine> EOSvmEngine::create() {
+  static once_flag registered;
+  call_once(registered, registerHostFunctions);
+  return unique_ptr<WasmEngine>{new EOSvmEngine};
+}
+
+unique_ptr<WasmEngine> EOSvmEngine::createThreaded() {
+  static once_flag registered;
+  call_once(registered, registerHostFunctions);
+  return unique_ptr<WasmEngine>{new EOSvmEngine(Mode::Threaded)};
+}
+
+unique_ptr<WasmEngine> EOSvmEngine::createTiered() {
+  static once_flag registered;
+  call_once(registered, registerHostFunctions);
+  return unique_ptr<WasmEngine>{new EOSvmEngine(Mode::Tiered)};
+}
+
+unique_ptr<WasmEngine> EOSvmEngine::createInterpreter() {
+  static once_flag registered;
+  call_once(registered, registerHostFunctions);
+  return unique_ptr<WasmEngine>{new EOSvmEngine(Mode::Interpreter)};
+}
+
+shared_ptr<WasmModule> EOSvmEngine::compileMetered(bytes_view code) {
+  if (m_mode != Mode::Jit)
+    return WasmEngine::compileMetered(code);
+  {
+    // The JIT charges the gas itself, the injector only runs to reject the
+    // code it rejects in the other modes.
+    benchmark::ScopedTimer timer(benchmark::Phase::Metering);
+    injectMetering(code);
+  }
+  return compile(code, true);
+}
+
+shared_ptr<WasmModule> EOSvmEngine::compile(bytes_view code,
+                                            bool gasMetering) {
+  HugePagesScope hugePages(m_hugePages);
+  switch (m_mode) {
+  case Mode::Threaded:
+    return compileWith<eosio::vm::threaded>(code, gasMetering);
+  case Mode::Interpreter:
+    return compileWith<eosio::vm::interpreter>(code, gasMetering);
+  case Mode::Tiered:
+    // metered code goes through WasmEngine::compileMetered()
+    assert(!gasMetering);
+    return compileTiered(code);
+  default:
+    return compileWith<eosio::vm::jit>(code, gasMetering);
+  }
+}
+
+template <typename Impl>
+shared_ptr<WasmModule> EOSvmEngine::compileWith(bytes_view code,
+                                                bool gasMetering) {
+  benchmark::ScopedTimer timer(benchmark::Phase::Compilation);
 #if H_DEBUGGING
   H_DEBUG << "Reading ewasm with eosvm...\n";
 #endif
-  wasm_code_ptr wcodePtr((uint8_t *)code.data(), code.size());
-  // wasm_code wcode(code.begin(), code.end());
-  backend_t bkend(wcodePtr, code.size());
-  bkend.set_wasm_allocator(&wa);
+  // only machine code is cached
+  JitCache &jitCache = gasMetering ? m_meteredJitCache : m_jitCache;
+  const bool cached = Impl::is_jit && jitCache.enabled();
+  shared_ptr<EOSvmModule<Impl>> module;
+  if constexpr (Impl::is_jit) {
+    if (cached)
+      module = loadCachedModule(jitCache, code, gasMetering, m_perfMap);
+  }
 
+  const bool generated = !module;
+  try {
+    if (generated)
+      module = loadModule<Impl>(code, nullptr, gasMetering, m_compileThreads,
+                                m_perfMap);
+  } catch (const eosio::vm::exception &ex) {
+    H_DEBUG << "eos-vm: " << ex.what() << " : " << ex.detail() << "\n";
+    ensureCondition(false, ContractValidationFailure,
+                    "Module failed to load.");
+  }
+  if constexpr (Impl::is_jit) {
+    if (generated && cached)
+      module->bkend.visit_code_image([&](jit_code_image const &image) {
+        jitCache.store(code, serializeCodeImage(image));
+      });
+  }
 #if H_DEBUGGING
-  H_DEBUG << "Resolving ewasm with eosvm...\n";
+  H_DEBUG << "Resolved with eosvm...\n";
 #endif
-  rhf_t::resolve(bkend.get_module());
-  bkend.get_module().finalize();
-  bkend.initialize();
+  return module;
+}
+
+shared_ptr<WasmModule> EOSvmEngine::compileTiered(bytes_view code) {
+  auto module = make_shared<EOSvmTieredModule>(code);
+  // cached machine code is ready right away
+  if (m_jitCache.enabled()) {
+    benchmark::ScopedTimer timer(benchmark::Phase::Compilation);
+    module->optimized = loadCachedModule(m_jitCache, code, false, m_perfMap);
+  }
+  if (!module->optimized)
+    module->baseline = static_pointer_cast<EOSvmModule<eosio::vm::threaded>>(
+        compileWith<eosio::vm::threaded>(code, false));
+  return module;
+}
+
+void EOSvmEngine::execute(ExecutionResult &result,
+                          evmc::HostContext &context, WasmModule &wasmModule,
+                          bytes_view state_code, evmc_message const &msg,
+                          evmc_revision rev, bool meterInterfaceGas) {
+  HugePagesScope hugePages(m_hugePages);
+  switch (m_mode) {
+  case Mode::Threaded:
+    executeWith<eosio::vm::threaded>(result, context, wasmModule, state_code,
+                                     msg, rev, meterInterfaceGas);
+    break;
+  case Mode::Interpreter:
+    executeWith<eosio::vm::interpreter>(result, context, wasmModule,
+                                        state_code, msg, rev,
+                                        meterInterfaceGas);
+    break;
+  case Mode::Tiered:
+    executeTiered(result, context, wasmModule, state_code, msg, rev,
+                  meterInterfaceGas);
+    break;
+  default:
+    executeWith<eosio::vm::jit>(result, context, wasmModule, state_code, msg,
+                                rev, meterInterfaceGas);
+  }
+}
+
+void EOSvmEngine::executeTiered(ExecutionResult &result,
+                                evmc::HostContext &context,
+                                WasmModule &wasmModule, bytes_view state_code,
+                                evmc_message const &msg, evmc_revision rev,
+                                bool meterInterfaceGas) {
+  auto &module = static_cast<EOSvmTieredModule &>(wasmModule);
+  if (auto optimized = module.jitModule()) {
+    executeWith<eosio::vm::jit>(result, context, *optimized, state_code, msg,
+                                rev, meterInterfaceGas);
+    return;
+  }
+
+  if (!module.tierUpQueued && ++module.executions >= m_tierUpThreshold) {
+    module.tierUpQueued = true;
+    // the job must not refer to the engine, it may be gone by then
+    weak_ptr<EOSvmTieredModule> weak = module.weak_from_this();
+    JitCache jitCache = m_jitCache;
+    const size_t compileThreads = m_compileThreads;
+    const bool hugePages = m_hugePages;
+    const bool perfMap = m_perfMap;
+    TierUpQueue::instance().push([weak, jitCache, compileThreads, hugePages,
+                                  perfMap]() mutable {
+      auto tiered = weak.lock();
+      if (!tiered)
+        return; // evicted meanwhile
+      HugePagesScope scope(hugePages);
+      try {
+        auto optimized = loadModule<eosio::vm::jit>(
+            tiered->code, nullptr, false, compileThreads, perfMap);
+        if (jitCache.enabled())
+          optimized->bkend.visit_code_image([&](jit_code_image const &image) {
+            jitCache.store(tiered->code, serializeCodeImage(image));
+          });
+        atomic_store(&tiered->optimized, optimized);
+      } catch (const eosio::vm::exception &ex) {
+        // stays on the interpreter
+        H_DEBUG << "eos-vm: tier-up failed: " << ex.what() << " : "
+                << ex.detail() << "\n";
+      }
+    });
+  }
+  executeWith<eosio::vm::threaded>(result, context, *module.baseline,
+                                   state_code, msg, rev, meterInterfaceGas);
+}
+
+template <typename Impl>
+void EOSvmEngine::executeWith(ExecutionResult &result,
+                              evmc::HostContext &context,
+                              WasmModule &wasmModule, bytes_view state_code,
+                              evmc_message const &msg, evmc_revision rev,
+                              bool meterInterfaceGas) {
 #if H_DEBUGGING
-  H_DEBUG << "Resolved with eosvm...\n";
+  H_DEBUG << "Executing with eosvm...\n";
 #endif
-  ExecutionResult result; // = internalExecute(context, code, state_code, msg,
-                          // meterInterfaceGas);
-  EOSvmEthereumInterface interface{context, state_code, msg, result,
+  benchmark::Timer instantiationTimer;
+  auto &module = static_cast<EOSvmModule<Impl> &>(wasmModule);
+  backend_t<Impl> &bkend = module.bkend;
+
+  PooledWasmAllocator wa(*m_allocatorPool, m_lazyZero, m_memoryStats);
+  // sets the starting gas, which metered code charges from the start
+  EOSvmEthereumInterface interface{context, state_code, msg, result, rev,
                                    meterInterfaceGas};
-  executionStarted();
+  interface.setWasmAllocator(wa.get());
+  interface.setExitFlag(bkend.get_context().exit_requested());
+  interface.enableStorageCache(storageCache());
+  bkend.set_wasm_allocator(wa.get());
+  bkend.get_context().set_gas_counter(module.gasMetered ? &result.gasLeft
+                                                        : nullptr);
+  bkend.get_context().set_max_pages(m_maxPages);
+  bkend.get_context().set_max_call_depth(m_maxCallDepth);
+  if (++module.executions == module.compactAfterExecutions)
+    bkend.compact();
+  bkend.initialize();
+  if (!module.snapshotChecked) {
+    module.snapshotChecked = true;
+    auto const &data = bkend.get_module().data;
+    uint64_t dataSize = 0;
+    for (uint32_t i = 0; i < data.size(); i++)
+      dataSize += data[i].data.size();
+    if (m_snapshotThreshold > 0 && dataSize >= m_snapshotThreshold)
+      bkend.take_snapshot();
+  }
+  instantiationTimer.lap(benchmark::Phase::Instantiation);
+  benchmark::ScopedTimer executionTimer(benchmark::Phase::Execution);
   try {
-    uint32_t main_idx = bkend.get_module().get_exported_function("main");
-    // bkend.execute_all(null_watchdog());
-    // bkend.call(&interface, "test", "main");
-    auto res = bkend.call(&interface, main_idx);
+    bool res = false;
+    if (m_deadline.count() > 0)
+      bkend.timed_run(shared_watchdog(m_deadline), [&]() {
+        res = bkend.call(&interface, module.main_idx);
+      });
+    else
+      res = bkend.call(&interface, module.main_idx);
     // Wrap any non-EEI exception under VMTrap.
     ensureCondition(res, VMTrap, "The VM invocation had a trap.");
+  } catch (timeout_exception const &) {
+    ensureCondition(false, VMTrap, "Execution deadline exceeded.");
+  } catch (out_of_gas_exception const &) {
+    ensureCondition(false, OutOfGas, "Out of gas.");
   } catch (wasm_exit_exception const &) {
     // This exception is ignored here because we consider it to be a success.
     // It is only a clutch for POSIX style exit()
     ensureCondition(bkend.get_context().get_error_code().value() == 0, VMTrap,
                     "The VM exit code not zero.");
   } catch (EndExecution const &) {
-    // This exception is ignored here because we consider it to be a success.
-    // It is only a clutch for eth_finish() and eth_revert()
+    // finish, revert and selfDestruct return through the exit flag, this
+    // is only left for host functions ending the execution otherwise.
   } catch (const eosio::vm::exception &ex) {
     std::cerr << "eos-vm interpreter error\n";
     std::cerr << ex.what() << " : " << ex.detail() << "\n";
     result.isRevert = true;
     // result.gasLeft = 0;
   }
-  executionFinished();
-  return result;
 }
 
 } // namespace athena
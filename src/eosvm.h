@@ -16,18 +16,142 @@
 
 #pragma once
 
+#include <chrono>
+
 #include "eei.h"
+#include "jitcache.h"
 
 namespace athena {
 
+class WasmAllocatorPool;
+
 class EOSvmEngine : public WasmEngine {
 public:
   /// Factory method to create the WAVM Wasm Engine.
   static std::unique_ptr<WasmEngine> create();
+  /// Creates an engine running the eos-vm threaded code interpreter, for
+  /// hosts which do not allow generating machine code.
+  static std::unique_ptr<WasmEngine> createThreaded();
+  /// Creates an engine starting modules on the threaded code interpreter
+  /// and switching them to machine code compiled in the background once
+  /// they are executed repeatedly.
+  static std::unique_ptr<WasmEngine> createTiered();
+  /// Creates an engine running the eos-vm tree interpreter, the slowest
+  /// mode, to check the other ones against.
+  static std::unique_ptr<WasmEngine> createInterpreter();
+
+  enum class Mode { Jit, Threaded, Tiered, Interpreter };
+
+  explicit EOSvmEngine(Mode mode = Mode::Jit);
+
+  struct MemoryStats {
+    uint64_t bytesZeroed = 0;
+    uint64_t bytesDiscarded = 0;
+  };
+
+  ~EOSvmEngine() noexcept override;
+
+  /// Selects whether linear memory is cleared with memset() on reset, or
+  /// handed back to the kernel with madvise() and zero filled on first touch.
+  void setLazyZero(bool enable) noexcept { m_lazyZero = enable; }
+  MemoryStats const &memoryStats() const noexcept { return m_memoryStats; }
+
+  /// Sets how many linear memory reservations the engine keeps for reuse.
+  void setMemoryPoolSize(size_t size);
+  /// Selects whether linear memory, module and machine code reservations
+  /// made by the engine from now on are backed with transparent huge pages.
+  /// Pooled reservations are released on a change.
+  void setHugePages(bool enable);
+  /// Sets how many threads, including the calling one, the JIT uses to
+  /// compile the functions of a module. One, the default, compiles them in
+  /// order and zero uses one per hardware thread.
+  void setCompileThreads(size_t threads) noexcept {
+    m_compileThreads = threads;
+  }
+  /// Selects whether the machine code of modules compiled from now on is
+  /// listed in /tmp/perf-<pid>.map for sampling profilers.
+  void setPerfMap(bool enable) noexcept { m_perfMap = enable; }
+
+  /// Aborts executions running longer than @deadline with a VMTrap, zero
+  /// disables the limit. All engines share one timer thread.
+  void setDeadline(std::chrono::microseconds deadline) noexcept {
+    m_deadline = deadline;
+  }
+
+  /// Sets after how many executions a tiered module is queued for
+  /// compilation by the JIT.
+  void setTierUpThreshold(uint64_t executions) noexcept {
+    m_tierUpThreshold = executions;
+  }
+
+  /// Sets from how many bytes of data segments the initialized linear
+  /// memory of a module is snapshotted on its first execution and mapped
+  /// copy-on-write by later ones, zero disables snapshots.
+  void setSnapshotThreshold(uint64_t bytes) noexcept {
+    m_snapshotThreshold = bytes;
+  }
+
+  /// Limits the linear memory of a contract to @pages pages and the depth
+  /// of its nested calls to @depth, both at most the compile time maxima of
+  /// eos-vm (528 pages, 250 calls). Modules with more initial pages fail to
+  /// instantiate, deeper calls trap.
+  void setLimits(uint32_t pages, uint32_t depth) noexcept {
+    m_maxPages = pages;
+    m_maxCallDepth = depth;
+  }
+
+  /// Persists generated machine code in @path and reuses it on later
+  /// compilations of the same code. @returns false if @path is unusable.
+  bool setJitCacheDirectory(std::string const &path) {
+    return m_jitCache.setDirectory(path) &&
+           m_meteredJitCache.setDirectory(path);
+  }
+
+  std::shared_ptr<WasmModule> compile(bytes_view code) override {
+    return compile(code, false);
+  }
+  /// The JIT charges the gas of every block inline, no useGas import is
+  /// called. The interpreter runs the code metered in-process, and so do
+  /// both tiers of a tiered module, to charge the same gas. The JIT rejects
+  /// the code the injector rejects, so that a contract is accepted the same
+  /// way by every mode.
+  std::shared_ptr<WasmModule> compileMetered(bytes_view code) override;
+
+  using WasmEngine::execute;
+  void execute(ExecutionResult &result, evmc::HostContext &context,
+               WasmModule &module, bytes_view state_code,
+               evmc_message const &msg, evmc_revision rev,
+               bool meterInterfaceGas) override;
+
+private:
+  std::shared_ptr<WasmModule> compile(bytes_view code, bool gasMetering);
+  template <typename Impl>
+  std::shared_ptr<WasmModule> compileWith(bytes_view code, bool gasMetering);
+  template <typename Impl>
+  void executeWith(ExecutionResult &result, evmc::HostContext &context,
+                   WasmModule &module, bytes_view state_code,
+                   evmc_message const &msg, evmc_revision rev,
+                   bool meterInterfaceGas);
+  std::shared_ptr<WasmModule> compileTiered(bytes_view code);
+  void executeTiered(ExecutionResult &result, evmc::HostContext &context,
+                     WasmModule &module, bytes_view state_code,
+                     evmc_message const &msg, evmc_revision rev,
+                     bool meterInterfaceGas);
 
-  ExecutionResult execute(evmc::HostContext &context, bytes_view code,
-                          bytes_view state_code, evmc_message const &msg,
-                          bool meterInterfaceGas) override;
+  Mode m_mode;
+  bool m_lazyZero = false;
+  std::chrono::microseconds m_deadline{0};
+  uint64_t m_tierUpThreshold = 2;
+  uint64_t m_snapshotThreshold = 16384;
+  uint32_t m_maxPages = UINT32_MAX;
+  uint32_t m_maxCallDepth = UINT32_MAX;
+  bool m_hugePages = false;
+  size_t m_compileThreads = 1;
+  bool m_perfMap = false;
+  MemoryStats m_memoryStats;
+  std::unique_ptr<WasmAllocatorPool> m_allocatorPool;
+  JitCache m_jitCache;
+  JitCache m_meteredJitCache;
 };
 
 } // namespace athena
@@ -14,9 +14,12 @@
  * limitations under the License.
  */
 
-#include <fstream>
+#include <fcntl.h>
 #include <iomanip>
 #include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <evmc/evmc.h>
 
@@ -27,9 +30,21 @@ using namespace std;
 namespace athena {
 
 bytes loadFileContents(string const &path) {
-  using iterator = istreambuf_iterator<ifstream::char_type>;
-  ifstream is{path};
-  return {iterator{is}, iterator{}};
+  bytes ret;
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return ret;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      ret.assign(static_cast<uint8_t const *>(addr), size);
+      munmap(addr, size);
+    }
+  }
+  close(fd);
+  return ret;
 }
 
 string toHex(evmc_uint256be const &value) {
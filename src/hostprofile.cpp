@@ -0,0 +1,142 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+#include "helpers.h"
+#include "hostprofile.h"
+
+using namespace std;
+
+namespace athena {
+namespace hostprofile {
+
+thread_local bool enabledFlag = false;
+
+namespace {
+
+mutex profilesMutex;
+map<evmc::address, unique_ptr<ContractProfile>> profiles;
+
+} // anonymous namespace
+
+char const *functionName(HostFunction function) noexcept {
+  static char const *const names[functionCount] = {
+      "useGas",
+      "getGasLeft",
+      "getAddress",
+      "getExternalBalance",
+      "getBlockHash",
+      "getCallDataSize",
+      "callDataCopy",
+      "getCaller",
+      "getCallValue",
+      "codeCopy",
+      "getCodeSize",
+      "externalCodeCopy",
+      "getExternalCodeSize",
+      "getBlockCoinbase",
+      "getBlockDifficulty",
+      "getBlockGasLimit",
+      "getTxGasPrice",
+      "log",
+      "getBlockNumber",
+      "getBlockTimestamp",
+      "getTxOrigin",
+      "storageStore",
+      "storageLoad",
+      "finish",
+      "revert",
+      "getReturnDataSize",
+      "returnDataCopy",
+      "call",
+      "callCode",
+      "callDelegate",
+      "callStatic",
+      "create",
+      "selfDestruct",
+      "storageLoadMany",
+      "storageStoreMany",
+      "callDataCopyMany",
+      "add256",
+      "sub256",
+      "mul256",
+      "divmod256",
+      "mulmod",
+      "exp",
+  };
+  return names[unsigned(function)];
+}
+
+ContractProfile *contract(evmc::address const &address) {
+  lock_guard<mutex> lock(profilesMutex);
+  auto it = profiles.find(address);
+  if (it == profiles.end()) {
+    const evmc::address key =
+        profiles.size() < maxContracts ? address : evmc::address{};
+    auto &profile = profiles[key];
+    if (!profile)
+      profile.reset(new ContractProfile);
+    return profile.get();
+  }
+  return it->second.get();
+}
+
+void reset() noexcept {
+  lock_guard<mutex> lock(profilesMutex);
+  // running executions keep pointers to their profiles
+  for (auto &entry : profiles)
+    for (FunctionCounters &counters : entry.second->functions) {
+      counters.calls.store(0, memory_order_relaxed);
+      counters.cycles.store(0, memory_order_relaxed);
+      counters.bytes.store(0, memory_order_relaxed);
+      counters.gas.store(0, memory_order_relaxed);
+    }
+}
+
+string report() {
+  lock_guard<mutex> lock(profilesMutex);
+  ostringstream out;
+  out << "Host functions:\n";
+  for (auto const &entry : profiles) {
+    evmc::address const &address = entry.first;
+    bool header = false;
+    for (unsigned i = 0; i < functionCount; i++) {
+      FunctionCounters const &counters = entry.second->functions[i];
+      const uint64_t calls = counters.calls.load(memory_order_relaxed);
+      if (calls == 0)
+        continue;
+      if (!header) {
+        out << "  " << bytesAsHexStr({address.bytes, sizeof(address.bytes)})
+            << ":\n";
+        header = true;
+      }
+      out << "    " << functionName(HostFunction(i)) << ": " << calls
+          << " calls, " << counters.cycles.load(memory_order_relaxed)
+          << " cycles, " << counters.bytes.load(memory_order_relaxed)
+          << " bytes, " << counters.gas.load(memory_order_relaxed)
+          << " gas\n";
+    }
+  }
+  return out.str();
+}
+
+} // namespace hostprofile
+} // namespace athena
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <evmc/evmc.hpp>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "benchmark.h"
+
+namespace athena {
+
+// Optional per contract accounting of the EEI host functions: calls, time
+// stamp counter cycles, bytes copied between the Wasm memory and the host
+// and gas charged. Cycles of calls and creates include the nested
+// execution.
+namespace hostprofile {
+
+// Host functions under their import names in the "ethereum" and
+// "ethereum_batch" modules.
+enum class HostFunction : unsigned {
+  UseGas,
+  GetGasLeft,
+  GetAddress,
+  GetExternalBalance,
+  GetBlockHash,
+  GetCallDataSize,
+  CallDataCopy,
+  GetCaller,
+  GetCallValue,
+  CodeCopy,
+  GetCodeSize,
+  ExternalCodeCopy,
+  GetExternalCodeSize,
+  GetBlockCoinbase,
+  GetBlockDifficulty,
+  GetBlockGasLimit,
+  GetTxGasPrice,
+  Log,
+  GetBlockNumber,
+  GetBlockTimestamp,
+  GetTxOrigin,
+  StorageStore,
+  StorageLoad,
+  Finish,
+  Revert,
+  GetReturnDataSize,
+  ReturnDataCopy,
+  // the order of the calls follows EthereumInterface::EEICallKind
+  Call,
+  CallCode,
+  CallDelegate,
+  CallStatic,
+  Create,
+  SelfDestruct,
+  StorageLoadMany,
+  StorageStoreMany,
+  CallDataCopyMany,
+  BignumAdd256,
+  BignumSub256,
+  BignumMul256,
+  BignumDivMod256,
+  BignumMulMod,
+  BignumExp,
+};
+
+constexpr unsigned functionCount = unsigned(HostFunction::BignumExp) + 1;
+
+char const *functionName(HostFunction function) noexcept;
+
+struct FunctionCounters {
+  std::atomic<uint64_t> calls{0};
+  std::atomic<uint64_t> cycles{0};
+  std::atomic<uint64_t> bytes{0};
+  // net of the gas returned by calls and creates
+  std::atomic<int64_t> gas{0};
+};
+
+struct ContractProfile {
+  FunctionCounters functions[functionCount];
+};
+
+// Switched per thread, Athena switches it to the setting of the instance a
+// thread executes on.
+extern thread_local bool enabledFlag;
+
+inline bool enabled() noexcept { return enabledFlag; }
+
+inline void enable(bool value) noexcept { enabledFlag = value; }
+
+inline uint64_t cycles() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  return benchmark::now();
+#endif
+}
+
+// At most this many contracts are tracked, the rest is accounted under
+// the zero address.
+constexpr size_t maxContracts = 4096;
+
+// @returns the profile of @address, which stays valid for the lifetime of
+// the process.
+ContractProfile *contract(evmc::address const &address);
+
+// Clears the counters of all profiles, executions may be running.
+void reset() noexcept;
+
+// @returns a human readable summary of the functions called by each
+// contract.
+std::string report();
+
+} // namespace hostprofile
+} // namespace athena
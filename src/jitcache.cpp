@@ -0,0 +1,164 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugging.h"
+#include "jitcache.h"
+
+using namespace std;
+
+namespace athena {
+
+namespace {
+
+// On-disk layout: header (host endian), the Wasm code, padding to 8 bytes
+// and the payload.
+constexpr uint32_t fileMagic = 0x6374696a; // "jitc"
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t versionHash;
+  uint64_t wasmSize;
+  uint64_t payloadSize;
+};
+
+constexpr size_t payloadOffset(uint64_t wasmSize) {
+  return (sizeof(FileHeader) + wasmSize + 7) & ~size_t(7);
+}
+
+// 64-bit FNV-1a, only used to name files and to tag versions.
+uint64_t fnv1a(uint64_t hash, uint8_t const *data, size_t size) {
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ data[i]) * 0x100000001b3;
+  return hash;
+}
+
+constexpr uint64_t fnvOffsetBasis = 0xcbf29ce484222325;
+
+uint64_t versionHash(string const &version) {
+  auto data = reinterpret_cast<uint8_t const *>(version.data());
+  return fnv1a(fnvOffsetBasis, data, version.size());
+}
+
+} // anonymous namespace
+
+void JitCache::MappedFile::reset() noexcept {
+  if (m_addr)
+    munmap(m_addr, m_size);
+  m_addr = nullptr;
+  m_size = 0;
+}
+
+bool JitCache::setDirectory(string const &path) {
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      access(path.c_str(), R_OK | W_OK | X_OK) != 0)
+    return false;
+  m_directory = path;
+  return true;
+}
+
+string JitCache::filePath(bytes_view wasmCode) const {
+  uint64_t hash =
+      fnv1a(versionHash(m_version), wasmCode.data(), wasmCode.size());
+  ostringstream path;
+  path << m_directory << "/" << hex << setw(16) << setfill('0') << hash
+       << ".jit";
+  return path.str();
+}
+
+bool JitCache::find(bytes_view wasmCode, MappedFile &file,
+                    bytes_view &payload) {
+  file.reset();
+  int fd = open(filePath(wasmCode).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    ++m_misses;
+    return false;
+  }
+
+  bool found = false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(FileHeader)) {
+    size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      file.m_addr = addr;
+      file.m_size = size;
+      auto base = static_cast<uint8_t const *>(addr);
+      FileHeader header;
+      memcpy(&header, base, sizeof(header));
+      if (header.magic == fileMagic &&
+          header.versionHash == versionHash(m_version) &&
+          header.wasmSize == wasmCode.size() &&
+          payloadOffset(header.wasmSize) <= size &&
+          header.payloadSize == size - payloadOffset(header.wasmSize) &&
+          memcmp(base + sizeof(header), wasmCode.data(), wasmCode.size()) ==
+              0) {
+        payload = bytes_view{base + payloadOffset(header.wasmSize),
+                             header.payloadSize};
+        found = true;
+      } else {
+        file.reset();
+      }
+    }
+  }
+  close(fd);
+  if (found)
+    ++m_hits;
+  else
+    ++m_misses;
+  return found;
+}
+
+void JitCache::store(bytes_view wasmCode, bytes_view payload) {
+  const string path = filePath(wasmCode);
+  const string tmpPath = path + "." + to_string(getpid()) + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (!file) {
+    H_DEBUG << "Failed to create JIT cache file " << tmpPath << "\n";
+    return;
+  }
+
+  FileHeader header{fileMagic, 0, versionHash(m_version), wasmCode.size(),
+                    payload.size()};
+  const uint8_t padding[8] = {};
+  const size_t paddingSize =
+      payloadOffset(wasmCode.size()) - sizeof(header) - wasmCode.size();
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(wasmCode.data(), 1, wasmCode.size(), file) ==
+                wasmCode.size() &&
+            fwrite(padding, 1, paddingSize, file) == paddingSize &&
+            fwrite(payload.data(), 1, payload.size(), file) == payload.size();
+  ok = (fclose(file) == 0) && ok;
+
+  // rename() is atomic, concurrent readers never see a partial file
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    H_DEBUG << "Failed to write JIT cache file " << path << "\n";
+    unlink(tmpPath.c_str());
+  }
+}
+
+} // namespace athena
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "helpers.h"
+
+namespace athena {
+
+// Directory backed store of machine code generated for Wasm modules.
+// Files are keyed by a hash of the code generator version and the Wasm
+// code. Like TranslationCache, the Wasm code is kept in each file and
+// compared on lookup. The payload format is up to the engine.
+class JitCache {
+public:
+  // A read-only memory mapping of a cache file.
+  class MappedFile {
+  public:
+    MappedFile() noexcept = default;
+    ~MappedFile() { reset(); }
+    MappedFile(MappedFile const &) = delete;
+    MappedFile &operator=(MappedFile const &) = delete;
+
+    void reset() noexcept;
+
+  private:
+    friend class JitCache;
+    void *m_addr = nullptr;
+    size_t m_size = 0;
+  };
+
+  explicit JitCache(std::string version) : m_version(std::move(version)) {}
+
+  // @returns false if @path is not an accessible directory.
+  bool setDirectory(std::string const &path);
+  bool enabled() const noexcept { return !m_directory.empty(); }
+
+  // @returns true if a payload for @wasmCode was found, @payload then points
+  // into @file and stays valid as long as @file is not reset.
+  bool find(bytes_view wasmCode, MappedFile &file, bytes_view &payload);
+  void store(bytes_view wasmCode, bytes_view payload);
+
+  uint64_t hits() const noexcept { return m_hits; }
+  uint64_t misses() const noexcept { return m_misses; }
+
+private:
+  std::string filePath(bytes_view wasmCode) const;
+
+  std::string m_version;
+  std::string m_directory;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+};
+
+} // namespace athena
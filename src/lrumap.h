@@ -0,0 +1,95 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <map>
+#include <utility>
+
+#include <evmc/evmc.hpp>
+
+namespace athena {
+
+// Map keyed by code hash holding at most a capacity of entries, the least
+// recently found or inserted one is evicted first. The caches keyed by code
+// hash are built on it. Not safe to use from several threads.
+template <typename Value> class LruMap {
+public:
+  explicit LruMap(size_t capacity) noexcept : m_capacity(capacity) {}
+
+  // @returns the value of @key, now the most recently used, or nullptr.
+  Value *find(evmc::bytes32 const &key) {
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+      return nullptr;
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return &it->second->second;
+  }
+
+  // Sets the value of @key, the most recently used entry then. With a zero
+  // capacity nothing is kept.
+  // @returns the number of entries evicted.
+  size_t insert(evmc::bytes32 const &key, Value value) {
+    auto it = m_index.find(key);
+    if (it != m_index.end()) {
+      it->second->second = std::move(value);
+      m_entries.splice(m_entries.begin(), m_entries, it->second);
+      return 0;
+    }
+    if (m_capacity == 0)
+      return 0;
+    const size_t evicted = evictTo(m_capacity - 1);
+    m_entries.emplace_front(key, std::move(value));
+    m_index[key] = m_entries.begin();
+    return evicted;
+  }
+
+  // @returns the number of entries evicted.
+  size_t setCapacity(size_t capacity) {
+    m_capacity = capacity;
+    return evictTo(m_capacity);
+  }
+
+  void clear() noexcept {
+    m_index.clear();
+    m_entries.clear();
+  }
+
+  size_t capacity() const noexcept { return m_capacity; }
+  size_t size() const noexcept { return m_entries.size(); }
+
+private:
+  using EntryList = std::list<std::pair<evmc::bytes32, Value>>;
+
+  size_t evictTo(size_t count) {
+    size_t evicted = 0;
+    while (m_entries.size() > count) {
+      m_index.erase(m_entries.back().first);
+      m_entries.pop_back();
+      evicted++;
+    }
+    return evicted;
+  }
+
+  // Most recently used entries are at the front.
+  EntryList m_entries;
+  std::map<evmc::bytes32, typename EntryList::iterator> m_index;
+  size_t m_capacity;
+};
+
+} // namespace athena
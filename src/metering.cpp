@@ -0,0 +1,412 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "exceptions.h"
+#include "metering.h"
+#include "wasmbinary.h"
+
+using namespace std;
+
+namespace athena {
+
+using namespace wasm;
+
+namespace {
+
+struct Section {
+  uint8_t id;
+  bytes_view payload;
+};
+
+// memory.copy and memory.fill cost this many bytes per unit of gas on top of
+// the instruction itself, like the eos-vm jit.
+constexpr uint8_t bulkMemoryBytesPerGasShift = 3;
+
+// An edit of a function body: inserts a useGas call of @value before @pos,
+// replaces the call target encoded in [pos, end) with @value, or charges the
+// length on top of the stack before @pos, keeping it in local @value.
+struct BodyEdit {
+  enum Kind { Charge, CallTarget, LengthCharge };
+  size_t pos;
+  size_t end;
+  uint64_t value;
+  Kind kind;
+};
+
+class Injector {
+public:
+  uint32_t typeCount = 0;
+  uint32_t importedFunctionCount = 0;
+  vector<uint64_t> typeParamCounts;
+  vector<uint64_t> functionTypes;
+
+  uint32_t useGasIndex() const noexcept { return importedFunctionCount; }
+
+  uint64_t remap(uint64_t funcIndex) const noexcept {
+    return funcIndex >= useGasIndex() ? funcIndex + 1 : funcIndex;
+  }
+
+  void countImports(bytes_view payload) {
+    Reader r(payload);
+    uint64_t count = r.readULEB();
+    for (uint64_t i = 0; i < count; i++) {
+      r.readBytes(r.readULEB()); // module
+      r.readBytes(r.readULEB()); // field
+      uint8_t kind = r.readByte();
+      switch (kind) {
+      case FunctionKind:
+        r.readULEB();
+        importedFunctionCount++;
+        break;
+      case TableKind:
+        r.readByte();
+        skipLimits(r);
+        break;
+      case MemoryKind:
+        skipLimits(r);
+        break;
+      case GlobalKind:
+        r.readByte();
+        r.readByte();
+        break;
+      default:
+        ensureCondition(false, ContractValidationFailure,
+                        "Invalid import kind.");
+      }
+    }
+  }
+
+  bytes rewriteTypes(bytes_view payload) {
+    Reader r(payload);
+    typeCount = r.readULEB();
+    size_t start = r.pos();
+    for (uint32_t i = 0; i < typeCount; i++) {
+      ensureCondition(r.readByte() == FuncTypeForm, ContractValidationFailure,
+                      "Invalid function type.");
+      uint64_t params = r.readULEB();
+      r.readBytes(params);
+      typeParamCounts.push_back(params);
+      r.readBytes(r.readULEB()); // results
+    }
+    bytes out;
+    writeULEB(out, typeCount + 1);
+    out.append(payload.substr(start));
+    // (i64) -> ()
+    out.append({FuncTypeForm, 0x01, ValueTypeI64, 0x00});
+    return out;
+  }
+
+  bytes rewriteImports(bytes_view payload) {
+    bytes out;
+    size_t pos = 0;
+    uint64_t count = 0;
+    if (!payload.empty()) {
+      Reader r(payload);
+      count = r.readULEB();
+      pos = r.pos();
+    }
+    writeULEB(out, count + 1);
+    out.append(payload.substr(pos));
+    appendName(out, "ethereum");
+    appendName(out, "useGas");
+    out.push_back(FunctionKind);
+    writeULEB(out, typeCount);
+    return out;
+  }
+
+  void readFunctions(bytes_view payload) {
+    Reader r(payload);
+    uint64_t count = r.readULEB();
+    for (uint64_t i = 0; i < count; i++)
+      functionTypes.push_back(r.readULEB());
+  }
+
+  bytes rewriteExports(bytes_view payload) {
+    Reader r(payload);
+    bytes out;
+    uint64_t count = r.readULEB();
+    writeULEB(out, count);
+    for (uint64_t i = 0; i < count; i++) {
+      size_t start = r.pos();
+      r.readBytes(r.readULEB());
+      uint8_t kind = r.readByte();
+      out.append(payload.substr(start, r.pos() - start));
+      uint64_t index = r.readULEB();
+      writeULEB(out, kind == FunctionKind ? remap(index) : index);
+    }
+    return out;
+  }
+
+  bytes rewriteStart(bytes_view payload) {
+    Reader r(payload);
+    bytes out;
+    writeULEB(out, remap(r.readULEB()));
+    return out;
+  }
+
+  bytes rewriteElements(bytes_view payload) {
+    Reader r(payload);
+    bytes out;
+    uint64_t count = r.readULEB();
+    writeULEB(out, count);
+    for (uint64_t i = 0; i < count; i++) {
+      size_t start = r.pos();
+      r.readULEB(); // table index
+      skipInitExpr(r);
+      out.append(payload.substr(start, r.pos() - start));
+      uint64_t n = r.readULEB();
+      writeULEB(out, n);
+      for (uint64_t j = 0; j < n; j++)
+        writeULEB(out, remap(r.readULEB()));
+    }
+    return out;
+  }
+
+  bytes rewriteCode(bytes_view payload) {
+    Reader r(payload);
+    bytes out;
+    uint64_t count = r.readULEB();
+    writeULEB(out, count);
+    ensureCondition(count == functionTypes.size(), ContractValidationFailure,
+                    "Function and code section sizes differ.");
+    for (uint64_t i = 0; i < count; i++) {
+      ensureCondition(functionTypes[i] < typeParamCounts.size(),
+                      ContractValidationFailure, "Invalid function type.");
+      bytes body = rewriteBody(r.readBytes(r.readULEB()),
+                               typeParamCounts[functionTypes[i]]);
+      writeULEB(out, body.size());
+      out.append(body);
+    }
+    return out;
+  }
+
+private:
+  struct MeteredBlock {
+    size_t start;
+    uint64_t cost;
+  };
+
+  // @params is the number of parameters of the function, the scratch local
+  // holding the length of memory.copy and memory.fill is added after them
+  // and the declared locals.
+  bytes rewriteBody(bytes_view body, uint64_t params) {
+    Reader r(body);
+    uint64_t localGroups = r.readULEB();
+    size_t groupsStart = r.pos();
+    uint64_t scratchLocal = params;
+    for (uint64_t i = 0; i < localGroups; i++) {
+      scratchLocal += r.readULEB();
+      r.readByte();
+    }
+    size_t codeStart = r.pos();
+    bool needsScratch = false;
+
+    vector<BodyEdit> edits;
+    vector<MeteredBlock> stack{{r.pos(), 0}};
+    auto finalize = [&]() {
+      edits.push_back({stack.back().start, stack.back().start,
+                       stack.back().cost, BodyEdit::Charge});
+      stack.pop_back();
+    };
+
+    while (!stack.empty()) {
+      uint8_t opcode = r.readByte();
+      switch (opcode) {
+      case Block:
+      case Loop:
+      case If:
+        stack.back().cost++;
+        r.skipImmediates(opcode);
+        stack.push_back({r.pos(), 0});
+        break;
+      case Else:
+        ensureCondition(stack.size() > 1, ContractValidationFailure,
+                        "Unexpected else.");
+        finalize();
+        stack.push_back({r.pos(), 0});
+        break;
+      case End:
+        finalize();
+        break;
+      case Call: {
+        stack.back().cost++;
+        size_t start = r.pos();
+        uint64_t target = r.readULEB();
+        edits.push_back({start, r.pos(), remap(target), BodyEdit::CallTarget});
+        break;
+      }
+      case MiscPrefix: {
+        stack.back().cost++;
+        size_t start = r.pos() - 1;
+        uint64_t subOpcode = r.readULEB();
+        r.skipMiscImmediates(subOpcode);
+        edits.push_back({start, start, scratchLocal, BodyEdit::LengthCharge});
+        needsScratch = true;
+        break;
+      }
+      default:
+        stack.back().cost++;
+        r.skipImmediates(opcode);
+      }
+    }
+    ensureCondition(r.eof(), ContractValidationFailure,
+                    "Trailing bytes after function body.");
+
+    // Blocks are finalized innermost first, apply them in code order.
+    stable_sort(edits.begin(), edits.end(),
+                [](BodyEdit const &a, BodyEdit const &b) {
+                  return a.pos < b.pos;
+                });
+
+    bytes out;
+    size_t pos = 0;
+    if (needsScratch) {
+      writeULEB(out, localGroups + 1);
+      out.append(body.substr(groupsStart, codeStart - groupsStart));
+      out.append({0x01, ValueTypeI32});
+      pos = codeStart;
+    }
+    for (auto const &edit : edits) {
+      out.append(body.substr(pos, edit.pos - pos));
+      switch (edit.kind) {
+      case BodyEdit::Charge:
+        out.push_back(I64Const);
+        writeSLEB(out, static_cast<int64_t>(edit.value));
+        out.push_back(Call);
+        writeULEB(out, useGasIndex());
+        break;
+      case BodyEdit::CallTarget:
+        writeULEB(out, edit.value);
+        break;
+      case BodyEdit::LengthCharge:
+        // local.tee; local.get; i64.extend_i32_u; i64.const; i64.shr_u
+        out.push_back(LocalTee);
+        writeULEB(out, edit.value);
+        out.push_back(LocalGet);
+        writeULEB(out, edit.value);
+        out.append({I64ExtendI32U, I64Const, bulkMemoryBytesPerGasShift,
+                    I64ShrU, Call});
+        writeULEB(out, useGasIndex());
+        break;
+      }
+      pos = edit.end;
+    }
+    out.append(body.substr(pos));
+    return out;
+  }
+
+  static void appendName(bytes &out, char const *name) {
+    bytes_view str{reinterpret_cast<uint8_t const *>(name),
+                   char_traits<char>::length(name)};
+    writeULEB(out, str.size());
+    out.append(str);
+  }
+
+  static void skipLimits(Reader &r) {
+    if (r.readByte() & 1) {
+      r.readULEB();
+      r.readULEB();
+    } else {
+      r.readULEB();
+    }
+  }
+
+  static void skipInitExpr(Reader &r) {
+    uint8_t opcode;
+    while ((opcode = r.readByte()) != End)
+      r.skipImmediates(opcode);
+  }
+};
+
+} // anonymous namespace
+
+bytes injectMetering(bytes_view code) {
+  ensureCondition(hasWasmPreamble(code) && hasWasmVersion(code, 1),
+                  ContractValidationFailure,
+                  "Metering requires a WebAssembly version 1 module.");
+
+  vector<Section> sections;
+  Reader r(code.substr(8));
+  while (!r.eof()) {
+    uint8_t id = r.readByte();
+    ensureCondition(id <= DataSection, ContractValidationFailure,
+                    "Unknown section.");
+    sections.push_back({id, r.readBytes(r.readULEB())});
+  }
+
+  Injector injector;
+  bool hasTypes = false;
+  bool hasImports = false;
+  for (auto const &section : sections) {
+    if (section.id == TypeSection)
+      hasTypes = true;
+    else if (section.id == ImportSection) {
+      hasImports = true;
+      injector.countImports(section.payload);
+    }
+  }
+
+  bytes out{code.substr(0, 8)};
+  auto emitMissing = [&](uint8_t nextId) {
+    if (!hasTypes && nextId > TypeSection) {
+      writeSection(out, TypeSection, injector.rewriteTypes(bytes{0x00}));
+      hasTypes = true;
+    }
+    if (!hasImports && nextId > ImportSection) {
+      writeSection(out, ImportSection, injector.rewriteImports({}));
+      hasImports = true;
+    }
+  };
+
+  for (auto const &section : sections) {
+    if (section.id != CustomSection)
+      emitMissing(section.id);
+    switch (section.id) {
+    case TypeSection:
+      writeSection(out, section.id, injector.rewriteTypes(section.payload));
+      break;
+    case ImportSection:
+      writeSection(out, section.id, injector.rewriteImports(section.payload));
+      break;
+    case FunctionSection:
+      injector.readFunctions(section.payload);
+      writeSection(out, section.id, section.payload);
+      break;
+    case ExportSection:
+      writeSection(out, section.id, injector.rewriteExports(section.payload));
+      break;
+    case StartSection:
+      writeSection(out, section.id, injector.rewriteStart(section.payload));
+      break;
+    case ElementSection:
+      writeSection(out, section.id, injector.rewriteElements(section.payload));
+      break;
+    case CodeSection:
+      writeSection(out, section.id, injector.rewriteCode(section.payload));
+      break;
+    default:
+      writeSection(out, section.id, section.payload);
+    }
+  }
+  emitMissing(DataSection + 1);
+
+  return out;
+}
+
+} // namespace athena
@@ -0,0 +1,35 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "helpers.h"
+
+namespace athena {
+
+// Native replacement of the Sentinel system contract.
+// Imports ethereum::useGas(i64) and charges the cost of every metered block
+// (function body, block, loop, if and else arms) at its start, using a cost
+// of one per instruction as the reference Sentinel does. memory.copy and
+// memory.fill are additionally charged one per 8 bytes of their length.
+// Unlike Sentinel, which ends a metered block at every branch, a block is
+// charged as a whole, so branching out of it early costs the instructions
+// skipped as well.
+// @returns the metered module; throws ContractValidationFailure on
+// malformed input.
+bytes injectMetering(bytes_view code);
+
+} // namespace athena
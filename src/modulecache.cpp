@@ -0,0 +1,73 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "modulecache.h"
+
+using namespace std;
+
+namespace athena {
+
+shared_ptr<WasmModule> ModuleCache::find(evmc::bytes32 const &key,
+                                         bytes_view code) {
+  auto it = m_index.find(key);
+  if (it == m_index.end() || it->second->code != code) {
+    ++m_misses;
+    return nullptr;
+  }
+  ++m_hits;
+  // move to front
+  m_entries.splice(m_entries.begin(), m_entries, it->second);
+  return it->second->module;
+}
+
+void ModuleCache::insert(evmc::bytes32 const &key, bytes_view code,
+                         shared_ptr<WasmModule> module) {
+  if (m_capacity == 0)
+    return;
+
+  auto it = m_index.find(key);
+  if (it != m_index.end()) {
+    // same hash with different code, replace the stale entry
+    it->second->code = bytes{code};
+    it->second->module = move(module);
+    m_entries.splice(m_entries.begin(), m_entries, it->second);
+    return;
+  }
+
+  evictTo(m_capacity - 1);
+  m_entries.push_front(Entry{key, bytes{code}, move(module)});
+  m_index[key] = m_entries.begin();
+}
+
+void ModuleCache::setCapacity(size_t capacity) {
+  m_capacity = capacity;
+  evictTo(m_capacity);
+}
+
+void ModuleCache::clear() noexcept {
+  m_index.clear();
+  m_entries.clear();
+}
+
+void ModuleCache::evictTo(size_t count) {
+  while (m_entries.size() > count) {
+    m_index.erase(m_entries.back().key);
+    m_entries.pop_back();
+    ++m_evictions;
+  }
+}
+
+} // namespace athena
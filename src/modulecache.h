@@ -0,0 +1,75 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+
+#include <evmc/evmc.hpp>
+
+#include "eei.h"
+#include "helpers.h"
+
+namespace athena {
+
+// Bounded LRU cache of compiled modules, keyed by code hash.
+// The code itself is kept alongside each entry and compared on lookup, so a
+// host returning an unexpected hash can only cause a miss, never a wrong hit.
+class ModuleCache {
+public:
+  static constexpr size_t defaultCapacity = 256;
+
+  explicit ModuleCache(size_t capacity = defaultCapacity) noexcept
+      : m_capacity(capacity) {}
+
+  // @returns the cached module or nullptr on miss.
+  std::shared_ptr<WasmModule> find(evmc::bytes32 const &key, bytes_view code);
+  void insert(evmc::bytes32 const &key, bytes_view code,
+              std::shared_ptr<WasmModule> module);
+
+  // Setting the capacity to 0 disables the cache.
+  void setCapacity(size_t capacity);
+  void clear() noexcept;
+
+  size_t capacity() const noexcept { return m_capacity; }
+  size_t size() const noexcept { return m_entries.size(); }
+  uint64_t hits() const noexcept { return m_hits; }
+  uint64_t misses() const noexcept { return m_misses; }
+  uint64_t evictions() const noexcept { return m_evictions; }
+
+private:
+  struct Entry {
+    evmc::bytes32 key;
+    bytes code;
+    std::shared_ptr<WasmModule> module;
+  };
+  using EntryList = std::list<Entry>;
+
+  void evictTo(size_t count);
+
+  // Most recently used entries are at the front.
+  EntryList m_entries;
+  std::map<evmc::bytes32, EntryList::iterator> m_index;
+  size_t m_capacity;
+  uint64_t m_hits = 0;
+  uint64_t m_misses = 0;
+  uint64_t m_evictions = 0;
+};
+
+} // namespace athena
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include <unistd.h>
+
+#include "exceptions.h"
+#include "perfmap.h"
+#include "wasmbinary.h"
+
+using namespace std;
+
+namespace athena {
+namespace perfmap {
+
+namespace {
+
+constexpr uint8_t functionNamesSubsection = 1;
+
+void readFunctionNames(wasm::Reader &r, vector<string> &names) {
+  uint64_t count = r.readULEB();
+  for (uint64_t i = 0; i < count; i++) {
+    uint64_t index = r.readULEB();
+    bytes_view name = r.readBytes(r.readULEB());
+    if (index < names.size())
+      names[index].assign(name.begin(), name.end());
+  }
+}
+
+} // anonymous namespace
+
+vector<string> functionNames(bytes_view wasm, size_t functionCount) {
+  vector<string> names(functionCount);
+  try {
+    wasm::Reader r(wasm);
+    r.readBytes(8); // magic and version
+    while (!r.eof()) {
+      uint8_t id = r.readByte();
+      wasm::Reader section(r.readBytes(r.readULEB()));
+      if (id != wasm::CustomSection)
+        continue;
+      bytes_view sectionName = section.readBytes(section.readULEB());
+      if (sectionName.size() != 4 || memcmp(sectionName.data(), "name", 4))
+        continue;
+      while (!section.eof()) {
+        uint8_t subsection = section.readByte();
+        wasm::Reader payload(section.readBytes(section.readULEB()));
+        if (subsection == functionNamesSubsection)
+          readFunctionNames(payload, names);
+      }
+      break;
+    }
+  } catch (ContractValidationFailure const &) {
+    // keep the names read so far
+  }
+  return names;
+}
+
+void record(vector<Symbol> const &symbols) {
+  static mutex fileMutex;
+  static FILE *file = nullptr;
+  lock_guard<mutex> lock(fileMutex);
+  if (!file) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%d.map", int(getpid()));
+    file = fopen(path, "a");
+    if (!file)
+      return;
+  }
+  for (Symbol const &symbol : symbols)
+    fprintf(file, "%" PRIxPTR " %zx %s\n", symbol.start, symbol.size,
+            symbol.name.c_str());
+  fflush(file);
+}
+
+} // namespace perfmap
+} // namespace athena
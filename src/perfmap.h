@@ -0,0 +1,49 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "helpers.h"
+
+namespace athena {
+
+// Optional /tmp/perf-<pid>.map listing the machine code generated for
+// contracts, which perf and other sampling profilers read to name the
+// samples taken in JIT code.
+namespace perfmap {
+
+struct Symbol {
+  uintptr_t start;
+  size_t size;
+  std::string name;
+};
+
+// @returns the names of the @functionCount functions of @wasm by function
+// index, imports included, from its "name" section. Functions without one
+// get an empty name, a malformed section is ignored from where it goes wrong.
+std::vector<std::string> functionNames(bytes_view wasm, size_t functionCount);
+
+// Appends @symbols to the map. Code that is freed keeps its entries, later
+// entries for the same addresses take precedence in perf.
+void record(std::vector<Symbol> const &symbols);
+
+} // namespace perfmap
+} // namespace athena
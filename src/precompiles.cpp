@@ -0,0 +1,139 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstring>
+
+#include "crypto.h"
+#include "exceptions.h"
+#include "precompiles.h"
+
+using namespace std;
+
+namespace athena {
+namespace precompiles {
+
+namespace {
+
+enum Precompile : uint8_t {
+  Ecrecover = 1,
+  Sha256 = 2,
+  Ripemd160 = 3,
+  Identity = 4,
+  Keccak256 = 9,
+};
+
+uint64_t wordCost(size_t size, uint64_t base, uint64_t perWord) noexcept {
+  return base + perWord * ((uint64_t(size) + 31) / 32);
+}
+
+// Copies 32 bytes of @input at @offset, zero padded like call data.
+evmc::bytes32 inputWord(bytes_view input, size_t offset) noexcept {
+  evmc::bytes32 ret{};
+  if (offset < input.size())
+    memcpy(ret.bytes, input.data() + offset,
+           min(input.size() - offset, sizeof(ret.bytes)));
+  return ret;
+}
+
+} // anonymous namespace
+
+bool isPrecompile(evmc::address const &address) noexcept {
+  for (unsigned i = 0; i + 1 < sizeof(address.bytes); i++)
+    if (address.bytes[i])
+      return false;
+  switch (address.bytes[sizeof(address.bytes) - 1]) {
+  case Ecrecover:
+  case Sha256:
+  case Ripemd160:
+  case Identity:
+  case Keccak256:
+    return true;
+  default:
+    return false;
+  }
+}
+
+void execute(evmc_message const &msg, ExecutionResult &result) {
+  const auto precompile =
+      Precompile(msg.destination.bytes[sizeof(msg.destination.bytes) - 1]);
+  bytes_view input{msg.input_data, msg.input_size};
+
+  uint64_t cost = 0;
+  switch (precompile) {
+  case Ecrecover:
+    cost = 3000;
+    break;
+  case Sha256:
+    cost = wordCost(input.size(), 60, 12);
+    break;
+  case Ripemd160:
+    cost = wordCost(input.size(), 600, 120);
+    break;
+  case Identity:
+    cost = wordCost(input.size(), 15, 3);
+    break;
+  case Keccak256:
+    cost = wordCost(input.size(), 30, 6);
+    break;
+  }
+  ensureCondition(cost <= uint64_t(msg.gas), OutOfGas, "Out of gas.");
+  result.gasLeft = msg.gas - int64_t(cost);
+  result.isRevert = false;
+  result.returnValue.clear();
+
+  switch (precompile) {
+  case Ecrecover: {
+    // an invalid signature is no failure, there is just no output
+    const evmc::bytes32 v = inputWord(input, 32);
+    bool validV = v.bytes[31] == 27 || v.bytes[31] == 28;
+    for (unsigned i = 0; i < 31; i++)
+      validV = validV && v.bytes[i] == 0;
+    evmc::address signer;
+    if (validV &&
+        crypto::ecrecover(inputWord(input, 0), v.bytes[31] - 27u,
+                          inputWord(input, 64), inputWord(input, 96),
+                          signer)) {
+      result.returnValue.assign(12, 0);
+      result.returnValue.append(signer.bytes, sizeof(signer.bytes));
+    }
+    break;
+  }
+  case Sha256: {
+    const evmc::bytes32 hash = crypto::sha256(input);
+    result.returnValue.assign(hash.bytes, sizeof(hash.bytes));
+    break;
+  }
+  case Ripemd160: {
+    uint8_t digest[20];
+    crypto::ripemd160(input, digest);
+    result.returnValue.assign(12, 0);
+    result.returnValue.append(digest, sizeof(digest));
+    break;
+  }
+  case Identity:
+    result.returnValue.assign(input.data(), input.size());
+    break;
+  case Keccak256: {
+    const evmc::bytes32 hash = crypto::keccak256(input);
+    result.returnValue.assign(hash.bytes, sizeof(hash.bytes));
+    break;
+  }
+  }
+}
+
+} // namespace precompiles
+} // namespace athena
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <evmc/evmc.hpp>
+
+#include "eei.h"
+
+namespace athena {
+
+// Native implementations of the Ewasm precompiles: ecrecover (address 1),
+// sha256 (2), ripemd160 (3), identity (4) and keccak256 (9). They charge
+// the gas of the precompile contracts and save the client call and the
+// nested Wasm execution.
+namespace precompiles {
+
+// @returns true if @address has a native implementation.
+bool isPrecompile(evmc::address const &address) noexcept;
+
+// Runs the precompile at the destination of @msg, which must satisfy
+// isPrecompile(), and stores its output in @result. Throws OutOfGas.
+void execute(evmc_message const &msg, ExecutionResult &result);
+
+} // namespace precompiles
+} // namespace athena
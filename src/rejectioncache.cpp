@@ -0,0 +1,42 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rejectioncache.h"
+
+using namespace std;
+
+namespace athena {
+
+bool RejectionCache::contains(evmc::bytes32 const &key, bytes_view code) {
+  lock_guard<mutex> lock(m_mutex);
+  bytes *entry = m_entries.find(key);
+  if (!entry || *entry != code)
+    return false;
+  ++m_hits;
+  return true;
+}
+
+void RejectionCache::insert(evmc::bytes32 const &key, bytes_view code) {
+  lock_guard<mutex> lock(m_mutex);
+  m_entries.insert(key, bytes{code});
+}
+
+void RejectionCache::clear() noexcept {
+  lock_guard<mutex> lock(m_mutex);
+  m_entries.clear();
+}
+
+} // namespace athena
@@ -0,0 +1,50 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+#include "lrumap.h"
+
+namespace athena {
+
+// Contracts which failed to validate or compile, keyed by code hash, so
+// that the same invalid code is rejected without parsing it again. At most
+// maxEntries are remembered, the least recently rejected ones are forgotten
+// first. The code is kept with each entry and compared on lookup so that a
+// hash collision never rejects valid code. Safe to use from several threads.
+class RejectionCache {
+public:
+  static constexpr size_t maxEntries = 1024;
+
+  bool contains(evmc::bytes32 const &key, bytes_view code);
+  void insert(evmc::bytes32 const &key, bytes_view code);
+  void clear() noexcept;
+
+  uint64_t hits() const noexcept { return m_hits; }
+
+private:
+  std::mutex m_mutex;
+  LruMap<bytes> m_entries{maxEntries};
+  std::atomic<uint64_t> m_hits{0};
+};
+
+} // namespace athena
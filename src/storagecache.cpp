@@ -0,0 +1,96 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#include "storagecache.h"
+
+using namespace std;
+
+namespace athena {
+
+size_t StorageCache::slotIndex(evmc::bytes32 const &key) const noexcept {
+  // Keys are either small slot numbers or hashes, fold all the words with a
+  // multiplicative mix so both spread over the table.
+  uint64_t words[4];
+  memcpy(words, key.bytes, sizeof(words));
+  uint64_t h = words[0] ^ (words[1] * 0x9e3779b97f4a7c15) ^
+               (words[2] * 0xc2b2ae3d27d4eb4f) ^ words[3];
+  h ^= h >> 32;
+  h *= 0x9e3779b97f4a7c15;
+  return (h >> 32) & (m_slots.size() - 1);
+}
+
+bool StorageCache::find(evmc::bytes32 const &key,
+                        evmc::bytes32 &value) const noexcept {
+  if (m_size == 0)
+    return false;
+  const size_t mask = m_slots.size() - 1;
+  for (size_t i = slotIndex(key);; i = (i + 1) & mask) {
+    Slot const &slot = m_slots[i];
+    if (!slot.used)
+      return false;
+    if (slot.key == key) {
+      value = slot.value;
+      return true;
+    }
+  }
+}
+
+void StorageCache::insert(evmc::bytes32 const &key,
+                          evmc::bytes32 const &value) {
+  // keep the load factor at or below 3/4
+  if ((m_size + 1) * 4 > m_slots.size() * 3) {
+    if (m_slots.size() * 3 / 4 >= maxEntries)
+      clear();
+    else
+      rehash(m_slots.empty() ? initialCapacity : m_slots.size() * 2);
+  }
+
+  const size_t mask = m_slots.size() - 1;
+  for (size_t i = slotIndex(key);; i = (i + 1) & mask) {
+    Slot &slot = m_slots[i];
+    if (!slot.used) {
+      slot = Slot{key, value, true};
+      ++m_size;
+      return;
+    }
+    if (slot.key == key) {
+      slot.value = value;
+      return;
+    }
+  }
+}
+
+void StorageCache::clear() noexcept {
+  if (m_size == 0)
+    return;
+  for (auto &slot : m_slots)
+    slot.used = false;
+  m_size = 0;
+}
+
+void StorageCache::rehash(size_t capacity) {
+  vector<Slot> slots(capacity);
+  swap(slots, m_slots);
+  m_size = 0;
+  for (auto const &slot : slots) {
+    if (slot.used)
+      insert(slot.key, slot.value);
+  }
+}
+
+} // namespace athena
@@ -0,0 +1,58 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+namespace athena {
+
+// Small open addressing map of storage keys to values, with linear probing.
+// It holds the storage of one account as last read from or written to the
+// host, so that one execution does not ask the host again for the same key.
+class StorageCache {
+public:
+  // The table is cleared rather than grown beyond this.
+  static constexpr size_t maxEntries = 4096;
+
+  // @returns true if @key is cached, its value is then copied to @value.
+  bool find(evmc::bytes32 const &key, evmc::bytes32 &value) const noexcept;
+  void insert(evmc::bytes32 const &key, evmc::bytes32 const &value);
+  void clear() noexcept;
+
+  size_t size() const noexcept { return m_size; }
+
+private:
+  struct Slot {
+    evmc::bytes32 key;
+    evmc::bytes32 value;
+    bool used;
+  };
+
+  static constexpr size_t initialCapacity = 16;
+
+  size_t slotIndex(evmc::bytes32 const &key) const noexcept;
+  void rehash(size_t capacity);
+
+  // Capacity is zero or a power of two.
+  std::vector<Slot> m_slots;
+  size_t m_size = 0;
+};
+
+} // namespace athena
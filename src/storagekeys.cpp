@@ -0,0 +1,238 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include "exceptions.h"
+#include "storagekeys.h"
+#include "wasmbinary.h"
+
+using namespace std;
+
+namespace athena {
+
+using namespace wasm;
+
+namespace {
+
+constexpr uint32_t noFunction = ~uint32_t(0);
+
+struct DataSegment {
+  uint32_t offset;
+  bytes_view data;
+};
+
+// A callDataCopy to @resultOffset.
+struct InputCopy {
+  uint32_t resultOffset;
+  uint32_t dataOffset;
+  uint32_t length;
+};
+
+bool covers(uint64_t start, uint64_t length, uint32_t offset) noexcept {
+  return start <= offset && uint64_t(offset) + 32 <= start + length;
+}
+
+bool isName(bytes_view name, char const *expected) noexcept {
+  return name.size() == strlen(expected) &&
+         memcmp(name.data(), expected, name.size()) == 0;
+}
+
+void skipLimits(Reader &r) {
+  if (r.readByte() & 1)
+    r.readULEB();
+  r.readULEB();
+}
+
+// @returns false if the offset of a data segment is not an i32.const.
+bool readOffset(Reader &r, uint32_t &offset) {
+  uint8_t opcode = r.readByte();
+  if (opcode == I32Const) {
+    offset = uint32_t(r.readSLEB(35));
+    opcode = r.readByte();
+    if (opcode == End)
+      return true;
+  }
+  while (opcode != End) {
+    r.skipImmediates(opcode);
+    opcode = r.readByte();
+  }
+  return false;
+}
+
+} // anonymous namespace
+
+StorageKeyPlan StorageKeyPlan::analyze(bytes_view code) {
+  StorageKeyPlan plan;
+  try {
+    plan.scan(code);
+  } catch (ContractValidationFailure const &) {
+    // the engine reports the module as invalid when compiling it
+  }
+  return plan;
+}
+
+void StorageKeyPlan::evaluate(bytes_view input,
+                              vector<evmc::bytes32> &keys) const {
+  keys.insert(keys.end(), m_constantKeys.begin(), m_constantKeys.end());
+  for (uint32_t offset : m_inputOffsets) {
+    if (uint64_t(offset) + 32 > input.size())
+      continue;
+    evmc::bytes32 key;
+    memcpy(key.bytes, input.data() + offset, 32);
+    keys.push_back(key);
+  }
+}
+
+void StorageKeyPlan::scan(bytes_view code) {
+  if (!hasWasmPreamble(code) || !hasWasmVersion(code, 1))
+    return;
+
+  uint32_t storageLoad = noFunction;
+  uint32_t storageLoadMany = noFunction;
+  uint32_t callDataCopy = noFunction;
+  bytes_view codeSection;
+  vector<DataSegment> segments;
+
+  Reader sections(code.substr(8));
+  while (!sections.eof()) {
+    uint8_t id = sections.readByte();
+    Reader r(sections.readBytes(sections.readULEB()));
+    if (id == ImportSection) {
+      uint32_t functions = 0;
+      uint64_t count = r.readULEB();
+      for (uint64_t i = 0; i < count; i++) {
+        bytes_view module = r.readBytes(r.readULEB());
+        bytes_view field = r.readBytes(r.readULEB());
+        uint8_t kind = r.readByte();
+        if (kind == FunctionKind) {
+          r.readULEB();
+          if (isName(module, "ethereum") && isName(field, "storageLoad"))
+            storageLoad = functions;
+          else if (isName(module, "ethereum") && isName(field, "callDataCopy"))
+            callDataCopy = functions;
+          else if (isName(module, "ethereum_batch") &&
+                   isName(field, "storageLoadMany"))
+            storageLoadMany = functions;
+          functions++;
+        } else if (kind == TableKind) {
+          r.readByte();
+          skipLimits(r);
+        } else if (kind == MemoryKind) {
+          skipLimits(r);
+        } else {
+          r.readByte();
+          r.readByte();
+        }
+      }
+    } else if (id == CodeSection) {
+      codeSection = r.readBytes(r.remaining());
+    } else if (id == DataSection) {
+      uint64_t count = r.readULEB();
+      for (uint64_t i = 0; i < count; i++) {
+        uint64_t memory = r.readULEB();
+        uint32_t offset = 0;
+        bool constant = readOffset(r, offset);
+        bytes_view data = r.readBytes(r.readULEB());
+        if (memory == 0 && constant)
+          segments.push_back({offset, data});
+      }
+    }
+  }
+
+  if (storageLoad == noFunction && storageLoadMany == noFunction)
+    return;
+
+  vector<InputCopy> copies;
+  // The key at @offset, taken from the latest write known to cover it.
+  auto addKeyAt = [&](uint32_t offset) {
+    for (auto it = copies.rbegin(); it != copies.rend(); ++it)
+      if (covers(it->resultOffset, it->length, offset)) {
+        uint64_t dataOffset = uint64_t(it->dataOffset) + offset -
+                              it->resultOffset;
+        if (dataOffset <= ~uint32_t(0))
+          addInputOffset(uint32_t(dataOffset));
+        return;
+      }
+    for (auto it = segments.rbegin(); it != segments.rend(); ++it)
+      if (covers(it->offset, it->data.size(), offset)) {
+        evmc::bytes32 key;
+        memcpy(key.bytes, it->data.data() + (offset - it->offset), 32);
+        addKey(key);
+        return;
+      }
+  };
+
+  Reader bodies(codeSection);
+  uint64_t count = codeSection.empty() ? 0 : bodies.readULEB();
+  for (uint64_t i = 0; i < count; i++) {
+    Reader r(bodies.readBytes(bodies.readULEB()));
+    uint64_t localGroups = r.readULEB();
+    for (uint64_t j = 0; j < localGroups; j++) {
+      r.readULEB();
+      r.readByte();
+    }
+
+    // Copies are only tracked within a function, and constants only
+    // between consecutive instructions.
+    copies.clear();
+    vector<uint32_t> constants;
+    while (!r.eof()) {
+      uint8_t opcode = r.readByte();
+      if (opcode == I32Const) {
+        constants.push_back(uint32_t(r.readSLEB(35)));
+        continue;
+      }
+      if (opcode == Call) {
+        uint64_t target = r.readULEB();
+        size_t n = constants.size();
+        if (target == callDataCopy && n >= 3) {
+          copies.push_back({constants[n - 3], constants[n - 2],
+                            constants[n - 1]});
+        } else if (target == storageLoad && n >= 2) {
+          addKeyAt(constants[n - 2]);
+        } else if (target == storageLoadMany && n >= 3) {
+          uint32_t keys = min<uint32_t>(constants[n - 1], maxKeys);
+          for (uint32_t k = 0; k < keys; k++)
+            if (uint64_t(constants[n - 3]) + 32 * k <= ~uint32_t(0))
+              addKeyAt(constants[n - 3] + 32 * k);
+        }
+      } else {
+        r.skipImmediates(opcode);
+      }
+      constants.clear();
+    }
+  }
+}
+
+void StorageKeyPlan::addKey(evmc::bytes32 const &key) {
+  if (m_constantKeys.size() + m_inputOffsets.size() >= maxKeys ||
+      find(m_constantKeys.begin(), m_constantKeys.end(), key) !=
+          m_constantKeys.end())
+    return;
+  m_constantKeys.push_back(key);
+}
+
+void StorageKeyPlan::addInputOffset(uint32_t offset) {
+  if (m_constantKeys.size() + m_inputOffsets.size() >= maxKeys ||
+      find(m_inputOffsets.begin(), m_inputOffsets.end(), offset) !=
+          m_inputOffsets.end())
+    return;
+  m_inputOffsets.push_back(offset);
+}
+
+} // namespace athena
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+
+namespace athena {
+
+// Storage keys a contract is expected to read, found by a static pass over
+// its Wasm code. Keys are recognized where storageLoad or storageLoadMany is
+// called with a constant key offset, and the memory there either holds a
+// data segment or was filled by a preceding callDataCopy with constant
+// arguments in the same function. The plan is a hint for prefetching only:
+// it ignores control flow and stores, so it may miss or mispredict keys.
+class StorageKeyPlan {
+public:
+  // Larger plans are truncated.
+  static constexpr size_t maxKeys = 64;
+
+  // Analyzes the Wasm @code, which may be malformed, then the plan is empty.
+  static StorageKeyPlan analyze(bytes_view code);
+
+  // Appends the keys for the call data @input to @keys. Keys reading beyond
+  // the end of @input are skipped, as that callDataCopy would trap.
+  void evaluate(bytes_view input, std::vector<evmc::bytes32> &keys) const;
+
+  bool empty() const noexcept {
+    return m_constantKeys.empty() && m_inputOffsets.empty();
+  }
+
+private:
+  // Throws ContractValidationFailure on malformed code, keeping the keys
+  // found up to there.
+  void scan(bytes_view code);
+  void addKey(evmc::bytes32 const &key);
+  void addInputOffset(uint32_t offset);
+
+  std::vector<evmc::bytes32> m_constantKeys;
+  // Offsets into the call data of keys copied from it.
+  std::vector<uint32_t> m_inputOffsets;
+};
+
+} // namespace athena
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "threadpool.h"
+
+using namespace std;
+
+namespace athena {
+
+namespace {
+
+thread_local bool workerThread = false;
+
+} // anonymous namespace
+
+ThreadPool::ThreadPool(size_t size) {
+  if (size == 0)
+    size = 1;
+  for (size_t i = 0; i < size; i++)
+    m_ranges.push_back(make_unique<Range>());
+  for (size_t i = 1; i < size; i++)
+    m_workers.emplace_back(&ThreadPool::workerMain, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_start.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+}
+
+bool ThreadPool::isWorkerThread() noexcept { return workerThread; }
+
+void ThreadPool::parallelFor(size_t count, function<void(size_t)> const &body) {
+  if (count == 0)
+    return;
+  if (workerThread || count == 1 || m_workers.empty()) {
+    for (size_t i = 0; i < count; i++)
+      body(i);
+    return;
+  }
+
+  lock_guard<mutex> loopLock(m_loopMutex);
+  const size_t participants = size();
+  for (size_t i = 0; i < participants; i++) {
+    Range &range = *m_ranges[i];
+    lock_guard<mutex> lock(range.mutex);
+    range.begin = count * i / participants;
+    range.end = count * (i + 1) / participants;
+  }
+
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_body = &body;
+    m_running = m_workers.size();
+    ++m_generation;
+  }
+  m_start.notify_all();
+
+  runLoop(0);
+
+  unique_lock<mutex> lock(m_mutex);
+  m_done.wait(lock, [this]() { return m_running == 0; });
+  m_body = nullptr;
+}
+
+void ThreadPool::workerMain(size_t index) {
+  workerThread = true;
+  uint64_t generation = 0;
+  for (;;) {
+    {
+      unique_lock<mutex> lock(m_mutex);
+      m_start.wait(lock, [&]() {
+        return m_stopping || m_generation != generation;
+      });
+      if (m_stopping)
+        return;
+      generation = m_generation;
+    }
+
+    runLoop(index);
+
+    bool last;
+    {
+      lock_guard<mutex> lock(m_mutex);
+      last = --m_running == 0;
+    }
+    if (last)
+      m_done.notify_one();
+  }
+}
+
+void ThreadPool::runLoop(size_t index) {
+  size_t item;
+  while (next(index, item))
+    (*m_body)(item);
+}
+
+bool ThreadPool::next(size_t index, size_t &item) {
+  Range &own = *m_ranges[index];
+  do {
+    lock_guard<mutex> lock(own.mutex);
+    if (own.begin < own.end) {
+      item = own.begin++;
+      return true;
+    }
+  } while (steal(index));
+  return false;
+}
+
+bool ThreadPool::steal(size_t index) {
+  // Pick the victim with most work left. The choice may be stale by the
+  // time its range is locked, which costs at most another round.
+  size_t victim = index;
+  size_t most = 0;
+  for (size_t i = 0; i < m_ranges.size(); i++) {
+    if (i == index)
+      continue;
+    Range &range = *m_ranges[i];
+    lock_guard<mutex> lock(range.mutex);
+    if (range.end - range.begin > most) {
+      most = range.end - range.begin;
+      victim = i;
+    }
+  }
+  if (victim == index)
+    return false;
+
+  size_t begin, end;
+  {
+    Range &range = *m_ranges[victim];
+    lock_guard<mutex> lock(range.mutex);
+    if (range.begin >= range.end)
+      return true; // emptied meanwhile, look again
+    end = range.end;
+    begin = range.begin + (range.end - range.begin) / 2;
+    range.end = begin;
+  }
+  Range &own = *m_ranges[index];
+  lock_guard<mutex> lock(own.mutex);
+  own.begin = begin;
+  own.end = end;
+  return true;
+}
+
+JobQueue::JobQueue(size_t threads, size_t capacity) : m_capacity(capacity) {
+  if (threads == 0)
+    threads = 1;
+  for (size_t i = 0; i < threads; i++)
+    m_workers.emplace_back(&JobQueue::workerMain, this);
+}
+
+JobQueue::~JobQueue() {
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_stopping = true;
+    m_jobs.clear();
+  }
+  m_cond.notify_all();
+  for (auto &worker : m_workers)
+    worker.join();
+}
+
+bool JobQueue::push(function<void()> job) {
+  {
+    lock_guard<mutex> lock(m_mutex);
+    if (m_jobs.size() >= m_capacity)
+      return false;
+    m_jobs.push_back(move(job));
+  }
+  m_cond.notify_one();
+  return true;
+}
+
+void JobQueue::workerMain() {
+  unique_lock<mutex> lock(m_mutex);
+  for (;;) {
+    m_cond.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+    if (m_stopping)
+      return;
+    function<void()> job = move(m_jobs.front());
+    m_jobs.pop_front();
+    lock.unlock();
+    job();
+    lock.lock();
+  }
+}
+
+} // namespace athena
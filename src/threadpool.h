@@ -0,0 +1,104 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace athena {
+
+// Fixed set of worker threads running parallel loops. The indices of a loop
+// are split into one contiguous range per participant; a participant that
+// runs out of work steals the upper half of the largest remaining range.
+// The calling thread takes part, a pool of size n starts n - 1 threads.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t size);
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const &) = delete;
+  ThreadPool &operator=(ThreadPool const &) = delete;
+
+  size_t size() const noexcept { return m_ranges.size(); }
+
+  // Calls @body for every index in [0, @count) and returns when all calls
+  // are done. @body must not throw. Loops are run one at a time, a loop
+  // started from within @body runs on the calling thread only.
+  void parallelFor(size_t count, std::function<void(size_t)> const &body);
+
+  // @returns true on the worker threads of any pool.
+  static bool isWorkerThread() noexcept;
+
+private:
+  // Indices [begin, end) left to a participant.
+  struct alignas(64) Range {
+    std::mutex mutex;
+    size_t begin = 0;
+    size_t end = 0;
+  };
+
+  void workerMain(size_t index);
+  void runLoop(size_t index);
+  bool next(size_t index, size_t &item);
+  bool steal(size_t index);
+
+  std::vector<std::unique_ptr<Range>> m_ranges;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_loopMutex; // serializes parallelFor()
+  std::mutex m_mutex;
+  std::condition_variable m_start;
+  std::condition_variable m_done;
+  std::function<void(size_t)> const *m_body = nullptr;
+  uint64_t m_generation = 0;
+  size_t m_running = 0;
+  bool m_stopping = false;
+};
+
+// Worker threads running queued jobs, each job on one of them in the order
+// they were queued. Jobs still queued when the queue is destroyed are
+// dropped, running ones are waited for.
+class JobQueue {
+public:
+  JobQueue(size_t threads, size_t capacity);
+  ~JobQueue();
+
+  JobQueue(JobQueue const &) = delete;
+  JobQueue &operator=(JobQueue const &) = delete;
+
+  // @returns false if @capacity jobs are queued already.
+  bool push(std::function<void()> job);
+
+private:
+  void workerMain();
+
+  const size_t m_capacity;
+  std::vector<std::thread> m_workers;
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  std::deque<std::function<void()>> m_jobs;
+  bool m_stopping = false;
+};
+
+} // namespace athena
@@ -0,0 +1,189 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "hostprofile.h"
+#include "trace.h"
+
+using namespace std;
+
+namespace athena {
+namespace trace {
+
+thread_local bool enabledFlag = false;
+
+namespace {
+
+using hostprofile::HostFunction;
+
+// The recorded arguments of each host function, in the order of
+// hostprofile::HostFunction. Calls leave out the value offset.
+char const *const argumentNames[hostprofile::functionCount] = {
+    "gas",
+    "",
+    "resultOffset",
+    "addressOffset resultOffset",
+    "number resultOffset",
+    "",
+    "resultOffset dataOffset length",
+    "resultOffset",
+    "resultOffset",
+    "resultOffset codeOffset length",
+    "",
+    "addressOffset resultOffset codeOffset length",
+    "addressOffset",
+    "resultOffset",
+    "resultOffset",
+    "",
+    "valueOffset",
+    "dataOffset length numberOfTopics",
+    "",
+    "",
+    "resultOffset",
+    "pathOffset valueOffset",
+    "pathOffset resultOffset",
+    "dataOffset length",
+    "dataOffset length",
+    "",
+    "resultOffset dataOffset length",
+    "gas addressOffset dataOffset dataLength",
+    "gas addressOffset dataOffset dataLength",
+    "gas addressOffset dataOffset dataLength",
+    "gas addressOffset dataOffset dataLength",
+    "valueOffset dataOffset length resultOffset",
+    "addressOffset",
+    "pathsOffset resultsOffset count",
+    "pathsOffset valuesOffset count",
+    "segmentsOffset count",
+    "aOffset bOffset resultOffset",
+    "aOffset bOffset resultOffset",
+    "aOffset bOffset resultOffset",
+    "aOffset bOffset quotientOffset remainderOffset",
+    "aOffset bOffset modOffset resultOffset",
+    "baseOffset exponentOffset resultOffset",
+};
+
+// Written by its thread only, the release store of head publishes the
+// events before it to dump().
+struct Buffer {
+  explicit Buffer(uint32_t _index) : index(_index) {}
+
+  uint32_t const index;
+  atomic<uint64_t> head{0};
+  Event events[bufferSize];
+};
+
+mutex buffersMutex;
+vector<unique_ptr<Buffer>> buffers;
+// of threads which ended, taken over by new threads
+vector<Buffer *> freeBuffers;
+
+Buffer *acquireBuffer() {
+  lock_guard<mutex> lock(buffersMutex);
+  if (!freeBuffers.empty()) {
+    Buffer *buffer = freeBuffers.back();
+    freeBuffers.pop_back();
+    return buffer;
+  }
+  buffers.emplace_back(new Buffer(uint32_t(buffers.size())));
+  return buffers.back().get();
+}
+
+// Attaches a buffer to a thread on its first event.
+struct ThreadBuffer {
+  Buffer *buffer = nullptr;
+
+  ~ThreadBuffer() {
+    if (buffer) {
+      lock_guard<mutex> lock(buffersMutex);
+      freeBuffers.push_back(buffer);
+    }
+  }
+};
+
+thread_local ThreadBuffer threadBuffer;
+
+} // anonymous namespace
+
+void record(unsigned function, int32_t depth, int64_t gasLeft, uint64_t arg0,
+            uint32_t arg1, uint32_t arg2, uint32_t arg3) noexcept {
+  Buffer *buffer = threadBuffer.buffer;
+  if (!buffer) {
+    try {
+      buffer = threadBuffer.buffer = acquireBuffer();
+    } catch (...) {
+      return;
+    }
+  }
+  const uint64_t head = buffer->head.load(memory_order_relaxed);
+  Event &event = buffer->events[head & (bufferSize - 1)];
+  event.cycles = hostprofile::cycles();
+  event.gasLeft = gasLeft;
+  event.arg0 = arg0;
+  event.args[0] = arg1;
+  event.args[1] = arg2;
+  event.args[2] = arg3;
+  event.function = uint16_t(function);
+  event.depth = uint16_t(depth);
+  buffer->head.store(head + 1, memory_order_release);
+}
+
+bool dump(string const &path) {
+  lock_guard<mutex> lock(buffersMutex);
+  FILE *file = fopen(path.c_str(), "wb");
+  if (!file)
+    return false;
+
+  FileHeader header{fileMagic, fileVersion, sizeof(Event),
+                    hostprofile::functionCount, uint32_t(buffers.size())};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+  for (unsigned i = 0; ok && i < hostprofile::functionCount; i++) {
+    string description = hostprofile::functionName(HostFunction(i));
+    if (argumentNames[i][0])
+      description += string(" ") + argumentNames[i];
+    ok = fwrite(description.c_str(), description.size() + 1, 1, file) == 1;
+  }
+  for (auto const &buffer : buffers) {
+    if (!ok)
+      break;
+    const uint64_t head = buffer->head.load(memory_order_acquire);
+    const uint64_t count = head < bufferSize ? head : bufferSize;
+    BufferHeader bufferHeader{buffer->index, 0, count, head - count};
+    ok = fwrite(&bufferHeader, sizeof(bufferHeader), 1, file) == 1;
+    // the oldest events may be at the end of the ring
+    for (uint64_t j = head - count; ok && j < head;) {
+      const uint64_t begin = j & (bufferSize - 1);
+      const uint64_t n = min(head - j, bufferSize - begin);
+      ok = fwrite(&buffer->events[begin], sizeof(Event), n, file) == n;
+      j += n;
+    }
+  }
+  return (fclose(file) == 0) && ok;
+}
+
+void reset() noexcept {
+  lock_guard<mutex> lock(buffersMutex);
+  for (auto &buffer : buffers)
+    buffer->head.store(0, memory_order_relaxed);
+}
+
+} // namespace trace
+} // namespace athena
@@ -0,0 +1,94 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace athena {
+
+// Binary tracing of the EEI host function calls. Every thread records
+// fixed size events into a ring buffer of its own, the buffers are written
+// to a file on request and decoded offline with athena-trace. Tracing is
+// always compiled in and costs a single branch while it is off.
+namespace trace {
+
+// File layout, host endian: a FileHeader, FileHeader::functionCount zero
+// terminated function descriptions, then for every buffer a BufferHeader
+// followed by its events, oldest first. A description is the name of the
+// function followed by the names of its recorded arguments, separated by
+// spaces and matching Event::args in order.
+constexpr uint64_t fileMagic = 0x6563617274687461; // "athtrace"
+constexpr uint32_t fileVersion = 1;
+
+struct FileHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t eventSize;
+  uint32_t functionCount;
+  uint32_t bufferCount;
+};
+
+struct BufferHeader {
+  uint32_t buffer;
+  uint32_t reserved;
+  uint64_t events;
+  // overwritten since the last reset
+  uint64_t dropped;
+};
+
+struct Event {
+  // time stamp counter when the call started
+  uint64_t cycles;
+  // before the call charged anything
+  int64_t gasLeft;
+  // args[0] is the only argument wider than 32 bits, like an amount of gas
+  uint64_t arg0;
+  uint32_t args[3];
+  // hostprofile::HostFunction
+  uint16_t function;
+  uint16_t depth;
+};
+static_assert(sizeof(Event) == 40, "the file layout depends on it");
+
+// Events kept per thread, a power of two.
+constexpr size_t bufferSize = 1 << 15;
+
+// Switched per thread, Athena switches it to the setting of the instance a
+// thread executes on.
+extern thread_local bool enabledFlag;
+
+inline bool enabled() noexcept { return enabledFlag; }
+
+inline void enable(bool value) noexcept { enabledFlag = value; }
+
+// Appends an event to the buffer of the calling thread, overwriting the
+// oldest once it is full. Never blocks on other threads.
+void record(unsigned function, int32_t depth, int64_t gasLeft, uint64_t arg0,
+            uint32_t arg1, uint32_t arg2, uint32_t arg3) noexcept;
+
+// Writes the buffers of all threads to @path, which should be done while
+// no execution is running. @returns false if the file cannot be written.
+bool dump(std::string const &path);
+
+// Drops all events, must not be called while executing.
+void reset() noexcept;
+
+} // namespace trace
+} // namespace athena
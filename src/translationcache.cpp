@@ -0,0 +1,158 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "debugging.h"
+#include "translationcache.h"
+
+using namespace std;
+
+namespace athena {
+
+namespace {
+
+// On-disk layout: magic, EVM code size, Wasm code size (host endian),
+// followed by the EVM code and the Wasm code.
+constexpr uint32_t fileMagic = 0x63773265; // "e2wc"
+
+struct FileHeader {
+  uint32_t magic;
+  uint32_t reserved;
+  uint64_t evmSize;
+  uint64_t wasmSize;
+};
+
+atomic<uint64_t> tmpFileCounter{0};
+
+} // anonymous namespace
+
+shared_ptr<bytes const> TranslationCache::find(evmc::bytes32 const &key,
+                                               bytes_view evmCode) {
+  string directory;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    Entry *entry = m_entries.find(key);
+    if (entry && entry->evmCode == evmCode) {
+      ++m_hits;
+      return entry->wasmCode;
+    }
+    directory = m_directory;
+  }
+  bytes wasmCode;
+  if (!directory.empty() &&
+      load(filePath(directory, key), evmCode, wasmCode)) {
+    ++m_diskHits;
+    auto shared = make_shared<bytes const>(move(wasmCode));
+    lock_guard<mutex> lock(m_mutex);
+    m_entries.insert(key, Entry{bytes{evmCode}, shared});
+    return shared;
+  }
+  ++m_misses;
+  return nullptr;
+}
+
+void TranslationCache::insert(evmc::bytes32 const &key, bytes_view evmCode,
+                              shared_ptr<bytes const> wasmCode) {
+  string directory;
+  {
+    lock_guard<mutex> lock(m_mutex);
+    m_entries.insert(key, Entry{bytes{evmCode}, wasmCode});
+    directory = m_directory;
+  }
+  if (!directory.empty())
+    store(filePath(directory, key), evmCode, *wasmCode);
+}
+
+bool TranslationCache::setDirectory(string const &path) {
+  struct stat st;
+  if (path.empty() || stat(path.c_str(), &st) != 0 || !S_ISDIR(st.st_mode) ||
+      access(path.c_str(), R_OK | W_OK | X_OK) != 0)
+    return false;
+  lock_guard<mutex> lock(m_mutex);
+  m_directory = path;
+  return true;
+}
+
+string TranslationCache::filePath(string const &directory,
+                                  evmc::bytes32 const &key) {
+  // toHex() has a leading "0x"
+  return directory + "/" + toHex(key).substr(2) + ".e2w";
+}
+
+bool TranslationCache::load(string const &path, bytes_view evmCode,
+                            bytes &wasmCode) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return false;
+
+  bool found = false;
+  struct stat st;
+  if (fstat(fd, &st) == 0 && size_t(st.st_size) >= sizeof(FileHeader)) {
+    size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr != MAP_FAILED) {
+      auto base = static_cast<uint8_t const *>(addr);
+      FileHeader header;
+      memcpy(&header, base, sizeof(header));
+      if (header.magic == fileMagic && header.evmSize == evmCode.size() &&
+          header.evmSize <= size - sizeof(header) &&
+          header.wasmSize == size - sizeof(header) - header.evmSize &&
+          memcmp(base + sizeof(header), evmCode.data(), evmCode.size()) == 0) {
+        wasmCode.assign(base + sizeof(header) + header.evmSize,
+                        header.wasmSize);
+        found = true;
+      }
+      munmap(addr, size);
+    }
+  }
+  close(fd);
+  return found;
+}
+
+void TranslationCache::store(string const &path, bytes_view evmCode,
+                             bytes_view wasmCode) {
+  // unique among processes and threads storing the same translation
+  const string tmpPath = path + "." + to_string(getpid()) + "." +
+                         to_string(tmpFileCounter++) + ".tmp";
+  FILE *file = fopen(tmpPath.c_str(), "wb");
+  if (!file) {
+    H_DEBUG << "Failed to create translation cache file " << tmpPath << "\n";
+    return;
+  }
+
+  FileHeader header{fileMagic, 0, evmCode.size(), wasmCode.size()};
+  bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+            fwrite(evmCode.data(), 1, evmCode.size(), file) == evmCode.size() &&
+            fwrite(wasmCode.data(), 1, wasmCode.size(), file) ==
+                wasmCode.size();
+  ok = (fclose(file) == 0) && ok;
+
+  // rename() is atomic, concurrent readers never see a partial file
+  if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+    H_DEBUG << "Failed to write translation cache file " << path << "\n";
+    unlink(tmpPath.c_str());
+  }
+}
+
+} // namespace athena
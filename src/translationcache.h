@@ -0,0 +1,75 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include <evmc/evmc.hpp>
+
+#include "helpers.h"
+#include "lrumap.h"
+
+namespace athena {
+
+// Cache of evm2wasm translations keyed by EVM code hash.
+// The most recently used maxMemoryEntries translations live in memory and,
+// when a directory is set, all are also persisted to one file per code hash
+// which is memory mapped on lookup. Like ModuleCache, the EVM code is kept
+// with each entry and compared on lookup. Safe to use from several threads.
+class TranslationCache {
+public:
+  static constexpr size_t maxMemoryEntries = 1024;
+
+  // @returns the translation of @evmCode, shared with the cache, or nullptr.
+  std::shared_ptr<bytes const> find(evmc::bytes32 const &key,
+                                    bytes_view evmCode);
+  void insert(evmc::bytes32 const &key, bytes_view evmCode,
+              std::shared_ptr<bytes const> wasmCode);
+
+  // @returns false if @path is not an accessible directory.
+  bool setDirectory(std::string const &path);
+
+  uint64_t hits() const noexcept { return m_hits; }
+  uint64_t diskHits() const noexcept { return m_diskHits; }
+  uint64_t misses() const noexcept { return m_misses; }
+
+private:
+  struct Entry {
+    bytes evmCode;
+    std::shared_ptr<bytes const> wasmCode;
+  };
+
+  static std::string filePath(std::string const &directory,
+                              evmc::bytes32 const &key);
+  static bool load(std::string const &path, bytes_view evmCode,
+                   bytes &wasmCode);
+  static void store(std::string const &path, bytes_view evmCode,
+                    bytes_view wasmCode);
+
+  // Guards the entries and the directory, file I/O is done without it.
+  std::mutex m_mutex;
+  LruMap<Entry> m_entries{maxMemoryEntries};
+  std::string m_directory;
+  std::atomic<uint64_t> m_hits{0};
+  std::atomic<uint64_t> m_diskHits{0};
+  std::atomic<uint64_t> m_misses{0};
+};
+
+} // namespace athena
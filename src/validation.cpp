@@ -0,0 +1,148 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cstring>
+
+#include "exceptions.h"
+#include "hostprofile.h"
+#include "validation.h"
+#include "wasmbinary.h"
+
+using namespace std;
+
+namespace athena {
+
+using namespace wasm;
+using hostprofile::HostFunction;
+
+namespace {
+
+bool isName(bytes_view name, char const *expected) noexcept {
+  return name.size() == strlen(expected) &&
+         memcmp(name.data(), expected, name.size()) == 0;
+}
+
+// @returns true if the host functions [@first, @last] include @field.
+bool isHostFunction(bytes_view field, HostFunction first, HostFunction last) {
+  for (unsigned i = unsigned(first); i <= unsigned(last); i++)
+    if (isName(field, hostprofile::functionName(HostFunction(i))))
+      return true;
+  return false;
+}
+
+bool isImportable(bytes_view module, bytes_view field) {
+  if (isName(module, "ethereum"))
+    return isHostFunction(field, HostFunction::UseGas,
+                          HostFunction::SelfDestruct);
+  if (isName(module, "ethereum_batch"))
+    return isHostFunction(field, HostFunction::StorageLoadMany,
+                          HostFunction::CallDataCopyMany);
+  if (isName(module, "bignum"))
+    return isHostFunction(field, HostFunction::BignumAdd256,
+                          HostFunction::BignumExp);
+#if H_DEBUGGING
+  if (isName(module, "debug"))
+    return true;
+#endif
+  return false;
+}
+
+void checkImports(Reader &r) {
+  uint64_t count = r.readULEB();
+  for (uint64_t i = 0; i < count; i++) {
+    bytes_view module = r.readBytes(r.readULEB());
+    bytes_view field = r.readBytes(r.readULEB());
+    ensureCondition(r.readByte() == FunctionKind, ContractValidationFailure,
+                    "Contract imports something else than a function.");
+    ensureCondition(isImportable(module, field), ContractValidationFailure,
+                    "Contract imports an unknown host function.");
+    r.readULEB();
+  }
+}
+
+void checkExports(Reader &r, bool &hasMain, bool &hasMemory) {
+  uint64_t count = r.readULEB();
+  for (uint64_t i = 0; i < count; i++) {
+    bytes_view name = r.readBytes(r.readULEB());
+    uint8_t kind = r.readByte();
+    r.readULEB();
+    if (isName(name, "main")) {
+      ensureCondition(kind == FunctionKind, ContractValidationFailure,
+                      "\"main\" is not a function");
+      hasMain = true;
+    } else if (isName(name, "memory")) {
+      ensureCondition(kind == MemoryKind, ContractValidationFailure,
+                      "\"memory\" is not a memory");
+      hasMemory = true;
+    }
+  }
+}
+
+} // anonymous namespace
+
+void prevalidateContract(bytes_view code) {
+  ensureCondition(hasWasmPreamble(code) && hasWasmVersion(code, 1),
+                  ContractValidationFailure,
+                  "Contract is not a WebAssembly version 1 module.");
+
+  uint8_t lastId = CustomSection;
+  uint64_t functionCount = 0;
+  uint64_t bodyCount = 0;
+  uint64_t memoryCount = 0;
+  bool hasMain = false;
+  bool hasMemory = false;
+  Reader sections(code.substr(8));
+  while (!sections.eof()) {
+    uint8_t id = sections.readByte();
+    Reader r(sections.readBytes(sections.readULEB()));
+    if (id == CustomSection)
+      continue;
+    ensureCondition(id > lastId && id <= DataSection,
+                    ContractValidationFailure,
+                    "Unknown or misplaced section.");
+    lastId = id;
+    switch (id) {
+    case ImportSection:
+      checkImports(r);
+      break;
+    case FunctionSection:
+      functionCount = r.readULEB();
+      break;
+    case MemorySection:
+      memoryCount = r.readULEB();
+      break;
+    case ExportSection:
+      checkExports(r, hasMain, hasMemory);
+      break;
+    case StartSection:
+      ensureCondition(false, ContractValidationFailure,
+                      "Contract contains start function.");
+      break;
+    case CodeSection:
+      bodyCount = r.readULEB();
+      break;
+    }
+  }
+
+  ensureCondition(memoryCount == 1, ContractValidationFailure,
+                  "Contract must have exactly one memory.");
+  ensureCondition(hasMemory, ContractValidationFailure, "\"memory\" not found");
+  ensureCondition(hasMain, ContractValidationFailure, "\"main\" not found");
+  ensureCondition(functionCount == bodyCount, ContractValidationFailure,
+                  "Function and code section sizes differ.");
+}
+
+} // namespace athena
@@ -0,0 +1,31 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include "helpers.h"
+
+namespace athena {
+
+// Checks the outline of a contract before an engine parses it: sections in
+// order and within bounds, function imports from the host modules only,
+// one memory, a "memory" and a "main" export and no start function.
+// Function bodies are not looked at, so this touches little more than the
+// section headers, imports and exports.
+// Throws ContractValidationFailure if @code can not be a valid contract.
+void prevalidateContract(bytes_view code);
+
+} // namespace athena
@@ -46,58 +46,157 @@ public:
     bytes_view _code,
     evmc_message const& _msg,
     ExecutionResult & _result,
+    evmc_revision _rev,
     bool _meterGas
   ):
-    EthereumInterface(_context, _code, _msg, _result, _meterGas)
-  {}
-  void setEnv(interp::Environment *evP) {
+    EthereumInterface(_context, _code, _msg, _result, _rev, _meterGas)
+  {
+    setExitFlag(m_exited);
+  }
+  // The memory is looked up on every access, loading a module into the
+  // environment may move it.
+  void setEnv(interp::Environment *evP, Index memoryIndex) {
 	envPtr = evP;
+	memIndex = memoryIndex;
+  }
+  bool exited() const { return m_exited; }
+  // Host functions that may end the execution trap the executor, which
+  // unwinds its own stacks.
+  interp::Result hostResult() const {
+    return interp::Result(m_exited ? interp::ResultType::TrapHostTrapped
+                                   : interp::ResultType::Ok);
   }
 
 private:
   // These assume that m_wasmMemory was set prior to execution.
   size_t memorySize() const override {
-	auto memPtr = envPtr->GetMemory(0);
+	auto memPtr = envPtr->GetMemory(memIndex);
 	return memPtr->data.size();
   }
   void memorySet(size_t offset, uint8_t value) override {
-	auto memPtr = envPtr->GetMemory(0);
+	auto memPtr = envPtr->GetMemory(memIndex);
 	memPtr->data[offset] = static_cast<char>(value);
   }
   uint8_t memoryGet(size_t offset) override {
-	auto memPtr = envPtr->GetMemory(0);
+	auto memPtr = envPtr->GetMemory(memIndex);
 	return static_cast<uint8_t>(memPtr->data[offset]);
   }
   uint8_t* memoryPointer(size_t offset, size_t length) override {
-	auto memPtr = envPtr->GetMemory(0);
+	auto memPtr = envPtr->GetMemory(memIndex);
     ensureCondition(memorySize() >= (offset + length), InvalidMemoryAccess, "Memory is shorter than requested segment");
     return reinterpret_cast<uint8_t*>(& memPtr->data[offset]);
   }
 
   interp::Environment *envPtr;
+  Index memIndex = 0;
+  bool m_exited = false;
+};
+
+namespace {
+// The proposals accepted on top of the MVP, the same for the environment and
+// the binary reader: bulk memory for memory.copy and memory.fill.
+Features contractFeatures() {
+  Features features;
+  features.enable_bulk_memory();
+  return features;
+}
+} // anonymous namespace
+
+// A wabt Environment, which includes the Wasm store and the list of modules
+// used for importing/exporting between modules. The host modules are built
+// once, the contracts compiled by an engine are loaded next to them and keep
+// the runtime alive.
+struct WabtRuntime {
+  // Contracts loaded before the runtime is retired. The code of evicted
+  // modules is only released with the runtime.
+  static constexpr size_t maxModules = 256;
+
+  WabtRuntime();
+
+  // @returns the executor for the next nesting level of executions.
+  interp::Executor &enter() {
+    if (depth == executors.size())
+      executors.emplace_back(new interp::Executor(
+          &env,
+          nullptr,                  // null for no tracing
+          interp::Thread::Options{} // empty for no threads
+          ));
+    return *executors[depth++];
+  }
+
+  interp::Environment env{contractFeatures()};
+  // The host functions dispatch to the interface of the innermost execution.
+  WabtEthereumInterface *interface = nullptr;
+  // One per nesting level, the stacks of outer executions stay in place.
+  vector<unique_ptr<interp::Executor>> executors;
+  size_t depth = 0;
+  size_t loadedModules = 0;
 };
 
 unique_ptr<WasmEngine> WabtEngine::create() {
   return unique_ptr<WasmEngine>{new WabtEngine};
 }
 
-ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
-                                    bytes_view state_code,
-                                    evmc_message const &msg,
-                                    bool meterInterfaceGas) {
-  instantiationStarted();
-#if H_DEBUGGING
-  H_DEBUG << "Executing with wabt...\n";
-#endif
+namespace {
 
-  // Set up the wabt Environment, which includes the Wasm store
-  // and the list of modules used for importing/exporting between modules
-  interp::Environment env(Features{});
+struct WabtModule : WasmModule {
+  shared_ptr<WabtRuntime> runtime;
+  interp::DefinedModule *module = nullptr;
+  interp::Export *mainFunction = nullptr;
+  Index memoryIndex = 0;
+  Index globalsBegin = 0;
+  Index globalsEnd = 0;
+
+  // State right after loading, restored before every execution.
+  Limits initialPageLimits;
+  vector<interp::TypedValue> initialGlobals;
+
+  void snapshot() {
+    interp::Environment &env = runtime->env;
+    initialPageLimits = env.GetMemory(memoryIndex)->page_limits;
+    initialGlobals.clear();
+    for (Index i = globalsBegin; i < globalsEnd; i++)
+      initialGlobals.push_back(env.GetGlobal(i)->typed_value);
+  }
 
-  // Set up interface to eei host functions
-  ExecutionResult result;
-  WabtEthereumInterface interface{context, state_code, msg, result,
-                                  meterInterfaceGas};
+  void restore() {
+    interp::Environment &env = runtime->env;
+    interp::Memory *memory = env.GetMemory(memoryIndex);
+    memory->page_limits = initialPageLimits;
+    memory->data.assign(initialPageLimits.initial * WABT_PAGE_SIZE, 0);
+    for (Index i = 0; i < initialGlobals.size(); i++)
+      env.GetGlobal(globalsBegin + i)->typed_value = initialGlobals[i];
+  }
+};
+
+// Makes @interface the one the host functions of @runtime dispatch to and
+// takes an executor for the scope of one execution.
+class RuntimeScope {
+public:
+  RuntimeScope(WabtRuntime &runtime, WabtEthereumInterface &interface)
+      : m_runtime(runtime), m_outer(runtime.interface),
+        m_executor(runtime.enter()) {
+    runtime.interface = &interface;
+  }
+  ~RuntimeScope() {
+    m_runtime.depth--;
+    m_runtime.interface = m_outer;
+  }
+  RuntimeScope(RuntimeScope const &) = delete;
+  RuntimeScope &operator=(RuntimeScope const &) = delete;
+
+  interp::Executor &executor() const noexcept { return m_executor; }
+
+private:
+  WabtRuntime &m_runtime;
+  WabtEthereumInterface *m_outer;
+  interp::Executor &m_executor;
+};
+
+} // anonymous namespace
+
+WabtRuntime::WabtRuntime() {
+  WabtEthereumInterface *&interface = this->interface;
 
   // Create EEI host module
   // The lifecycle of this pointer is handled by `env`.
@@ -113,7 +212,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiUseGas(static_cast<int64_t>(args[0].value.i64));
+      interface->eeiUseGas(static_cast<int64_t>(args[0].value.i64));
       return interp::ResultType::Ok;
     }
   );
@@ -127,7 +226,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetAddress(args[0].value.i32);
+      interface->eeiGetAddress(args[0].value.i32);
       return interp::ResultType::Ok;
     }
   );
@@ -141,7 +240,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetExternalBalance(args[0].value.i32, args[1].value.i32);
+      interface->eeiGetExternalBalance(args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -155,7 +254,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetBlockHash(args[0].value.i64, args[1].value.i32));
+      results[0].set_i32(interface->eeiGetBlockHash(args[0].value.i64, args[1].value.i32));
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -169,7 +268,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
+      results[0].set_i32(interface->eeiCall(
         EthereumInterface::EEICallKind::Call,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
         args[2].value.i32, args[3].value.i32, args[4].value.i32
@@ -187,7 +286,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiCallDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiCallDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -201,7 +300,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetCallDataSize());
+      results[0].set_i32(interface->eeiGetCallDataSize());
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -215,7 +314,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
+      results[0].set_i32(interface->eeiCall(
         EthereumInterface::EEICallKind::CallCode,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32,
         args[2].value.i32, args[3].value.i32, args[4].value.i32
@@ -233,7 +332,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
+      results[0].set_i32(interface->eeiCall(
         EthereumInterface::EEICallKind::CallDelegate,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
         args[2].value.i32, args[3].value.i32
@@ -251,7 +350,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCall(
+      results[0].set_i32(interface->eeiCall(
         EthereumInterface::EEICallKind::CallStatic,
         static_cast<int64_t>(args[0].value.i64), args[1].value.i32, 0,
         args[2].value.i32, args[3].value.i32
@@ -269,7 +368,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiStorageStore(args[0].value.i32, args[1].value.i32);
+      interface->eeiStorageStore(args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -283,7 +382,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiStorageLoad(args[0].value.i32, args[1].value.i32);
+      interface->eeiStorageLoad(args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -297,7 +396,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetCaller(args[0].value.i32);
+      interface->eeiGetCaller(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -311,7 +410,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetCallValue(args[0].value.i32);
+      interface->eeiGetCallValue(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -325,7 +424,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiCodeCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiCodeCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -339,7 +438,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetCodeSize());
+      results[0].set_i32(interface->eeiGetCodeSize());
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -353,7 +452,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetBlockCoinbase(args[0].value.i32);
+      interface->eeiGetBlockCoinbase(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -367,7 +466,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiCreate(
+      results[0].set_i32(interface->eeiCreate(
         args[0].value.i32, args[1].value.i32,
         args[2].value.i32, args[3].value.i32
       ));
@@ -384,7 +483,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetBlockDifficulty(args[0].value.i32);
+      interface->eeiGetBlockDifficulty(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -398,7 +497,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiExternalCodeCopy(
+      interface->eeiExternalCodeCopy(
         args[0].value.i32, args[1].value.i32,
         args[2].value.i32, args[3].value.i32
       );
@@ -415,7 +514,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetExternalCodeSize(args[0].value.i32));
+      results[0].set_i32(interface->eeiGetExternalCodeSize(args[0].value.i32));
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -429,7 +528,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetGasLeft()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetGasLeft()));
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -443,7 +542,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockGasLimit()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockGasLimit()));
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -457,7 +556,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetTxGasPrice(args[0].value.i32);
+      interface->eeiGetTxGasPrice(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -471,7 +570,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiLog(
+      interface->eeiLog(
         args[0].value.i32, args[1].value.i32, args[2].value.i32, args[3].value.i32,
         args[4].value.i32, args[5].value.i32, args[6].value.i32
       );
@@ -488,7 +587,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockNumber()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockNumber()));
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -502,7 +601,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiGetTxOrigin(args[0].value.i32);
+      interface->eeiGetTxOrigin(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -516,11 +615,8 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-#if H_DEBUGGING
-      interface.debugPrintMem(true, args[0].value.i32, args[1].value.i32);
-#endif
-      interface.eeiFinish(args[0].value.i32, args[1].value.i32);
-      return interp::Result(interp::ResultType::Ok);
+      interface->eeiFinish(args[0].value.i32, args[1].value.i32);
+      return interface->hostResult();
     }
   );
 
@@ -533,8 +629,8 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiRevert(args[0].value.i32, args[1].value.i32);
-      return interp::Result(interp::ResultType::Ok);
+      interface->eeiRevert(args[0].value.i32, args[1].value.i32);
+      return interface->hostResult();
     }
   );
 
@@ -547,7 +643,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i32(interface.eeiGetReturnDataSize());
+      results[0].set_i32(interface->eeiGetReturnDataSize());
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -561,7 +657,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiReturnDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      interface->eeiReturnDataCopy(args[0].value.i32, args[1].value.i32, args[2].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -575,8 +671,8 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.eeiSelfDestruct(args[0].value.i32);
-      return interp::Result(interp::ResultType::Ok);
+      interface->eeiSelfDestruct(args[0].value.i32);
+      return interface->hostResult();
     }
   );
 
@@ -589,7 +685,143 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues&,
       interp::TypedValues& results
     ) {
-      results[0].set_i64(static_cast<uint64_t>(interface.eeiGetBlockTimestamp()));
+      results[0].set_i64(static_cast<uint64_t>(interface->eeiGetBlockTimestamp()));
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  // Create bignum host module
+  // The lifecycle of this pointer is handled by `env`.
+  hostModule = env.AppendHostModule("bignum");
+  athenaAssert(hostModule, "Failed to create host module.");
+
+  hostModule->AppendFuncExport(
+    "add256",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumAdd256(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "sub256",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumSub256(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "mul256",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumMul256(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "divmod256",
+    {{Type::I32, Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumDivMod256(args[0].value.i32, args[1].value.i32, args[2].value.i32, args[3].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "mulmod",
+    {{Type::I32, Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumMulMod(args[0].value.i32, args[1].value.i32, args[2].value.i32, args[3].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "exp",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->bignumExp(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  // Create ethereum_batch host module
+  // The lifecycle of this pointer is handled by `env`.
+  hostModule = env.AppendHostModule("ethereum_batch");
+  athenaAssert(hostModule, "Failed to create host module.");
+
+  hostModule->AppendFuncExport(
+    "storageLoadMany",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->batchStorageLoadMany(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "storageStoreMany",
+    {{Type::I32, Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->batchStorageStoreMany(args[0].value.i32, args[1].value.i32, args[2].value.i32);
+      return interp::Result(interp::ResultType::Ok);
+    }
+  );
+
+  hostModule->AppendFuncExport(
+    "callDataCopyMany",
+    {{Type::I32, Type::I32}, {}},
+    [&interface](
+      const interp::HostFunc*,
+      const interp::FuncSignature*,
+      const interp::TypedValues& args,
+      interp::TypedValues&
+    ) {
+      interface->batchCallDataCopyMany(args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -609,7 +841,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrint(args[0].value.i32, args[1].value.i32);
+      interface->debugPrint(args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -623,7 +855,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrint32(args[0].value.i32);
+      interface->debugPrint32(args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -637,7 +869,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrint64(args[0].value.i64);
+      interface->debugPrint64(args[0].value.i64);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -651,7 +883,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintMem(false, args[0].value.i32, args[1].value.i32);
+      interface->debugPrintMem(false, args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -665,7 +897,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintMem(true, args[0].value.i32, args[1].value.i32);
+      interface->debugPrintMem(true, args[0].value.i32, args[1].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -679,7 +911,7 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintStorage(false, args[0].value.i32);
+      interface->debugPrintStorage(false, args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
@@ -693,14 +925,31 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
       const interp::TypedValues& args,
       interp::TypedValues&
     ) {
-      interface.debugPrintStorage(true, args[0].value.i32);
+      interface->debugPrintStorage(true, args[0].value.i32);
       return interp::Result(interp::ResultType::Ok);
     }
   );
 #endif
+}
+
+shared_ptr<WasmModule> WabtEngine::compile(bytes_view code) {
+  benchmark::ScopedTimer timer(benchmark::Phase::Compilation);
+#if H_DEBUGGING
+  H_DEBUG << "Compiling with wabt...\n";
+#endif
+
+  // Loading moves the code of the environment, which must not happen under
+  // a running execution.
+  if (!m_runtime || m_runtime->depth > 0 ||
+      m_runtime->loadedModules >= WabtRuntime::maxModules)
+    m_runtime = make_shared<WabtRuntime>();
+  interp::Environment &env = m_runtime->env;
+  const Index memoriesBefore = env.GetMemoryCount();
+  const Index globalsBefore = env.GetGlobalCount();
+  const interp::Environment::MarkPoint mark = env.Mark();
 
   // Parse module
-  ReadBinaryOptions options(Features{},
+  ReadBinaryOptions options(contractFeatures(),
                             nullptr, // debugging stream for loading
                             false,   // ReadDebugNames
                             true,    // StopOnFirstError
@@ -718,48 +967,86 @@ ExecutionResult WabtEngine::execute(evmc::HostContext &context, bytes_view code,
   }
 #endif
 
-  ensureCondition(Succeeded(loadResult) && module, ContractValidationFailure,
-                  "Module failed to load.");
-  ensureCondition(env.GetMemoryCount() == 1, ContractValidationFailure,
-                  "Multiple memory sections exported.");
-  ensureCondition(module->GetExport("memory"), ContractValidationFailure,
-                  "\"memory\" not found");
-  ensureCondition(module->start_func_index == kInvalidIndex,
-                  ContractValidationFailure,
-                  "Contract contains start function.");
+  interp::Export *mainFunction = nullptr;
+  try {
+    ensureCondition(Succeeded(loadResult) && module, ContractValidationFailure,
+                    "Module failed to load.");
+    ensureCondition(env.GetMemoryCount() == memoriesBefore + 1 &&
+                        module->memory_index == memoriesBefore,
+                    ContractValidationFailure,
+                    "Multiple memory sections exported.");
+    ensureCondition(module->GetExport("memory"), ContractValidationFailure,
+                    "\"memory\" not found");
+    ensureCondition(module->start_func_index == kInvalidIndex,
+                    ContractValidationFailure,
+                    "Contract contains start function.");
+
+    // Prepare to execute
+    mainFunction = module->GetExport("main");
+    ensureCondition(mainFunction, ContractValidationFailure,
+                    "\"main\" not found");
+    ensureCondition(mainFunction->kind == ExternalKind::Func,
+                    ContractValidationFailure, "\"main\" is not a function");
+  } catch (...) {
+    // drop what was loaded of the rejected module
+    env.ResetToMarkPoint(mark);
+    throw;
+  }
+
+  auto wabtModule = make_shared<WabtModule>();
+  wabtModule->runtime = m_runtime;
+  wabtModule->module = module;
+  wabtModule->mainFunction = mainFunction;
+  wabtModule->memoryIndex = memoriesBefore;
+  wabtModule->globalsBegin = globalsBefore;
+  wabtModule->globalsEnd = env.GetGlobalCount();
+  wabtModule->snapshot();
+  m_runtime->loadedModules++;
+  return wabtModule;
+}
 
-  // Prepare to execute
-  interp::Export *mainFunction = module->GetExport("main");
-  ensureCondition(mainFunction, ContractValidationFailure,
-                  "\"main\" not found");
-  ensureCondition(mainFunction->kind == ExternalKind::Func,
-                  ContractValidationFailure, "\"main\" is not a function");
+void WabtEngine::execute(ExecutionResult &result, evmc::HostContext &context,
+                         WasmModule &wasmModule, bytes_view state_code,
+                         evmc_message const &msg, evmc_revision rev,
+                         bool meterInterfaceGas) {
+  benchmark::Timer instantiationTimer;
+#if H_DEBUGGING
+  H_DEBUG << "Executing with wabt...\n";
+#endif
+  auto &module = static_cast<WabtModule &>(wasmModule);
+  module.restore();
 
-  interp::Executor executor(&env,
-                            nullptr,                  // null for no tracing
-                            interp::Thread::Options{} // empty for no threads
-  );
+  // Set up interface to eei host functions
+  WabtEthereumInterface interface{context, state_code, msg, result, rev,
+                                  meterInterfaceGas};
+  interface.enableStorageCache(storageCache());
+  // the executor resets its stacks on every run
+  RuntimeScope scope(*module.runtime, interface);
+  interp::Executor &executor = scope.executor();
 
   // better set env other than setMemory
-  interface.setEnv(&env);
-  executionStarted();
+  interface.setEnv(&module.runtime->env, module.memoryIndex);
+  instantiationTimer.lap(benchmark::Phase::Instantiation);
+  benchmark::ScopedTimer executionTimer(benchmark::Phase::Execution);
 
   // Execute main
   try {
-    interp::ExecResult wabtResult = executor.Initialize(module);
+    interp::ExecResult wabtResult = executor.Initialize(module.module);
+    if (interface.exited())
+      return;
     ensureCondition(wabtResult.result.ok(), VMTrap, "VM initialize failed.");
     wabtResult = executor.RunExport(
-        mainFunction,
+        module.mainFunction,
         interp::TypedValues{}); // second arg is empty since no args
+    // finish, revert and selfDestruct stop the executor with a trap.
+    if (interface.exited())
+      return;
     // Wrap any non-EEI exception under VMTrap.
     ensureCondition(wabtResult.result.ok(), VMTrap, "The VM invocation had a trap.");
   } catch (EndExecution const&) {
     // This exception is ignored here because we consider it to be a success.
     // It is only a clutch for POSIX style exit()
   }
-
-  executionFinished();
-  return result;
 }
 
 } // namespace athena
@@ -20,14 +20,25 @@
 
 namespace athena {
 
+struct WabtRuntime;
+
 class WabtEngine : public WasmEngine {
 public:
   /// Factory method to create the WABT Wasm Engine.
   static std::unique_ptr<WasmEngine> create();
 
-  ExecutionResult execute(evmc::HostContext &context, bytes_view code,
-                          bytes_view state_code, evmc_message const &msg,
-                          bool meterInterfaceGas) override;
+  std::shared_ptr<WasmModule> compile(bytes_view code) override;
+
+  using WasmEngine::execute;
+  void execute(ExecutionResult &result, evmc::HostContext &context,
+               WasmModule &module, bytes_view state_code,
+               evmc_message const &msg, evmc_revision rev,
+               bool meterInterfaceGas) override;
+
+private:
+  // Where modules are compiled into, replaced once it was loaded with
+  // enough of them.
+  std::shared_ptr<WabtRuntime> m_runtime;
 };
 
 } // namespace athena
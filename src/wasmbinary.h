@@ -0,0 +1,249 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "exceptions.h"
+#include "helpers.h"
+
+namespace athena {
+
+// Minimal helpers to walk and re-emit a Wasm MVP binary, plus memory.copy
+// and memory.fill, without involving a full engine. Malformed input throws ContractValidationFailure.
+namespace wasm {
+
+enum SectionId : uint8_t {
+  CustomSection = 0,
+  TypeSection = 1,
+  ImportSection = 2,
+  FunctionSection = 3,
+  TableSection = 4,
+  MemorySection = 5,
+  GlobalSection = 6,
+  ExportSection = 7,
+  StartSection = 8,
+  ElementSection = 9,
+  CodeSection = 10,
+  DataSection = 11,
+};
+
+enum ExternalKind : uint8_t {
+  FunctionKind = 0,
+  TableKind = 1,
+  MemoryKind = 2,
+  GlobalKind = 3,
+};
+
+enum Opcode : uint8_t {
+  Unreachable = 0x00,
+  Block = 0x02,
+  Loop = 0x03,
+  If = 0x04,
+  Else = 0x05,
+  End = 0x0b,
+  Br = 0x0c,
+  BrIf = 0x0d,
+  BrTable = 0x0e,
+  Return = 0x0f,
+  Call = 0x10,
+  CallIndirect = 0x11,
+  LocalGet = 0x20,
+  LocalTee = 0x22,
+  GlobalSet = 0x24,
+  I32Load = 0x28,
+  I64Store32 = 0x3e,
+  MemorySize = 0x3f,
+  MemoryGrow = 0x40,
+  I32Const = 0x41,
+  I64Const = 0x42,
+  F32Const = 0x43,
+  F64Const = 0x44,
+  I32Eqz = 0x45,
+  I64ShrU = 0x88,
+  I64ExtendI32U = 0xad,
+  F64ReinterpretI64 = 0xbf,
+  MiscPrefix = 0xfc,
+};
+
+// Sub-opcodes following MiscPrefix.
+enum MiscOpcode : uint8_t {
+  MemoryCopy = 0x0a,
+  MemoryFill = 0x0b,
+};
+
+constexpr uint8_t ValueTypeI32 = 0x7f;
+constexpr uint8_t ValueTypeI64 = 0x7e;
+constexpr uint8_t FuncTypeForm = 0x60;
+
+class Reader {
+public:
+  explicit Reader(bytes_view input) noexcept : m_input(input) {}
+
+  bool eof() const noexcept { return m_pos >= m_input.size(); }
+  size_t pos() const noexcept { return m_pos; }
+  size_t remaining() const noexcept { return m_input.size() - m_pos; }
+
+  uint8_t readByte() {
+    ensureCondition(m_pos < m_input.size(), ContractValidationFailure,
+                    "Unexpected end of Wasm binary.");
+    return m_input[m_pos++];
+  }
+
+  bytes_view readBytes(size_t length) {
+    ensureCondition(length <= remaining(), ContractValidationFailure,
+                    "Unexpected end of Wasm binary.");
+    bytes_view ret = m_input.substr(m_pos, length);
+    m_pos += length;
+    return ret;
+  }
+
+  uint64_t readULEB(unsigned maxBits = 32) {
+    uint64_t result = 0;
+    for (unsigned shift = 0;; shift += 7) {
+      ensureCondition(shift < maxBits, ContractValidationFailure,
+                      "Invalid LEB128 encoding.");
+      uint8_t b = readByte();
+      result |= uint64_t(b & 0x7f) << shift;
+      if ((b & 0x80) == 0)
+        return result;
+    }
+  }
+
+  int64_t readSLEB(unsigned maxBits = 32) {
+    int64_t result = 0;
+    unsigned shift = 0;
+    uint8_t b;
+    do {
+      ensureCondition(shift < maxBits, ContractValidationFailure,
+                      "Invalid LEB128 encoding.");
+      b = readByte();
+      result |= int64_t(b & 0x7f) << shift;
+      shift += 7;
+    } while (b & 0x80);
+    if (shift < 64 && (b & 0x40))
+      result |= -(int64_t(1) << shift);
+    return result;
+  }
+
+  // Skips the immediates of an MVP instruction @opcode.
+  void skipImmediates(uint8_t opcode) {
+    switch (opcode) {
+    case Block:
+    case Loop:
+    case If:
+      readByte(); // block type
+      break;
+    case Br:
+    case BrIf:
+    case Call:
+      readULEB();
+      break;
+    case BrTable: {
+      uint64_t count = readULEB();
+      for (uint64_t i = 0; i <= count; i++)
+        readULEB();
+      break;
+    }
+    case CallIndirect:
+      readULEB();
+      readByte(); // reserved
+      break;
+    case MemorySize:
+    case MemoryGrow:
+      readByte(); // reserved
+      break;
+    case I32Const:
+      readSLEB(35);
+      break;
+    case I64Const:
+      readSLEB(70);
+      break;
+    case F32Const:
+      readBytes(4);
+      break;
+    case F64Const:
+      readBytes(8);
+      break;
+    case MiscPrefix:
+      skipMiscImmediates(readULEB());
+      break;
+    default:
+      if (opcode >= LocalGet && opcode <= GlobalSet) {
+        readULEB();
+      } else if (opcode >= I32Load && opcode <= I64Store32) {
+        readULEB(); // alignment
+        readULEB(); // offset
+      } else {
+        ensureCondition(opcode <= 0x01 || opcode == Else || opcode == End ||
+                            opcode == Return || opcode == 0x1a ||
+                            opcode == 0x1b ||
+                            (opcode >= I32Eqz && opcode <= F64ReinterpretI64),
+                        ContractValidationFailure, "Unknown Wasm opcode.");
+      }
+    }
+  }
+
+  // Skips the immediates of the MiscPrefix instruction @subOpcode.
+  void skipMiscImmediates(uint64_t subOpcode) {
+    switch (subOpcode) {
+    case MemoryCopy:
+      readBytes(2); // reserved
+      break;
+    case MemoryFill:
+      readByte(); // reserved
+      break;
+    default:
+      ensureCondition(false, ContractValidationFailure, "Unknown Wasm opcode.");
+    }
+  }
+
+private:
+  bytes_view m_input;
+  size_t m_pos = 0;
+};
+
+inline void writeULEB(bytes &out, uint64_t value) {
+  do {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    if (value)
+      b |= 0x80;
+    out.push_back(b);
+  } while (value);
+}
+
+inline void writeSLEB(bytes &out, int64_t value) {
+  bool more = true;
+  while (more) {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    more = !((value == 0 && !(b & 0x40)) || (value == -1 && (b & 0x40)));
+    if (more)
+      b |= 0x80;
+    out.push_back(b);
+  }
+}
+
+inline void writeSection(bytes &out, uint8_t id, bytes_view payload) {
+  out.push_back(id);
+  writeULEB(out, payload.size());
+  out.append(payload);
+}
+
+} // namespace wasm
+} // namespace athena
@@ -0,0 +1,416 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// athena-bench runs the built-in contract corpus against a mock host on
+// every available engine and reports cold and warm latencies, throughput
+// and resident memory, as a table or as JSON lines.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <athena/athena.h>
+#include <evmc/evmc.hpp>
+
+#include "corpus.h"
+
+using namespace std;
+using namespace athena::bench;
+
+namespace {
+
+// In-memory state for the corpus. Calls are executed by the VM under test
+// with the code registered for the destination.
+class MockHost {
+public:
+  evmc_vm *vm = nullptr;
+  map<evmc::address, bytes const *> code;
+  map<pair<evmc::address, evmc::bytes32>, evmc::bytes32> storage;
+
+  MockHost() {
+    m_interface.account_exists = [](evmc_host_context *,
+                                    evmc_address const *) { return true; };
+    m_interface.get_storage =
+        [](evmc_host_context *context, evmc_address const *address,
+           evmc_bytes32 const *key) -> evmc_bytes32 {
+      auto &storage = self(context).storage;
+      auto it = storage.find({*address, *key});
+      return it != storage.end() ? it->second : evmc::bytes32{};
+    };
+    m_interface.set_storage =
+        [](evmc_host_context *context, evmc_address const *address,
+           evmc_bytes32 const *key, evmc_bytes32 const *value) {
+          self(context).storage[{*address, *key}] = *value;
+          return EVMC_STORAGE_MODIFIED;
+        };
+    m_interface.get_balance = [](evmc_host_context *,
+                                 evmc_address const *) -> evmc_uint256be {
+      return {};
+    };
+    m_interface.get_code_size = [](evmc_host_context *context,
+                                   evmc_address const *address) -> size_t {
+      auto const *code = self(context).find(*address);
+      return code ? code->size() : 0;
+    };
+    m_interface.get_code_hash = [](evmc_host_context *,
+                                   evmc_address const *address) {
+      // unique per contract, enough for the module cache
+      evmc::bytes32 hash{};
+      memcpy(hash.bytes, address->bytes, sizeof(address->bytes));
+      hash.bytes[31] = 1;
+      return evmc_bytes32(hash);
+    };
+    m_interface.copy_code = [](evmc_host_context *context,
+                               evmc_address const *address, size_t offset,
+                               uint8_t *buffer, size_t size) -> size_t {
+      auto const *code = self(context).find(*address);
+      if (!code || offset >= code->size())
+        return 0;
+      const size_t n = min(size, code->size() - offset);
+      memcpy(buffer, code->data() + offset, n);
+      return n;
+    };
+    m_interface.selfdestruct = [](evmc_host_context *, evmc_address const *,
+                                  evmc_address const *) {};
+    m_interface.call = [](evmc_host_context *context,
+                          evmc_message const *msg) -> evmc_result {
+      return self(context).call(*msg);
+    };
+    m_interface.get_tx_context = [](evmc_host_context *) -> evmc_tx_context {
+      return {};
+    };
+    m_interface.get_block_hash = [](evmc_host_context *,
+                                    int64_t) -> evmc_bytes32 { return {}; };
+    m_interface.emit_log = [](evmc_host_context *, evmc_address const *,
+                              uint8_t const *, size_t, evmc_bytes32 const[],
+                              size_t) {};
+  }
+
+  evmc_result call(evmc_message const &msg) {
+    auto const *code = find(msg.destination);
+    if (!code) {
+      evmc_result ret{};
+      ret.status_code = EVMC_SUCCESS;
+      ret.gas_left = msg.gas;
+      return ret;
+    }
+    return vm->execute(vm, &m_interface, context(), EVMC_BYZANTIUM, &msg,
+                       code->data(), code->size());
+  }
+
+  evmc_host_context *context() noexcept {
+    return reinterpret_cast<evmc_host_context *>(this);
+  }
+
+private:
+  static MockHost &self(evmc_host_context *context) noexcept {
+    return *reinterpret_cast<MockHost *>(context);
+  }
+
+  bytes const *find(evmc::address const &address) const {
+    auto it = code.find(address);
+    return it != code.end() ? it->second : nullptr;
+  }
+
+  evmc_host_interface m_interface{};
+};
+
+struct Options {
+  unsigned iterations = 200;
+  unsigned coldRuns = 10;
+  unsigned scale = 1;
+  bool json = false;
+  bool hugePages = false;
+  vector<string> engines{"wabt", "eosvm", "eosvm-threaded", "eosvm-tiered"};
+  string filter;
+  vector<string> corpusDirs;
+  // forwarded to the VM with set_option
+  vector<pair<string, string>> vmOptions;
+};
+
+struct Latencies {
+  vector<double> samples; // microseconds
+
+  double percentile(unsigned percent) {
+    if (samples.empty())
+      return 0;
+    sort(samples.begin(), samples.end());
+    size_t rank = (samples.size() * percent + 99) / 100;
+    return samples[max<size_t>(rank, 1) - 1];
+  }
+  double total() const {
+    double sum = 0;
+    for (double sample : samples)
+      sum += sample;
+    return sum;
+  }
+};
+
+struct CaseResult {
+  string name;
+  string engine;
+  bool ok = true;
+  string error;
+  Latencies cold;
+  Latencies warm;
+  long rssKb = 0;
+  long peakRssKb = 0;
+};
+
+// @returns the VmRSS or VmHWM value of /proc/self/status in kB.
+long procStatusKb(char const *field) {
+  ifstream status("/proc/self/status");
+  string line;
+  const size_t length = strlen(field);
+  while (getline(status, line))
+    if (line.compare(0, length, field) == 0 && line[length] == ':')
+      return atol(line.c_str() + length + 1);
+  return 0;
+}
+
+evmc_vm *createVm(Options const &options, string const &engine) {
+  evmc_vm *vm = evmc_create_athena();
+  if (vm->set_option(vm, "engine", engine.c_str()) !=
+      EVMC_SET_OPTION_SUCCESS) {
+    vm->destroy(vm);
+    return nullptr;
+  }
+  for (auto const &option : options.vmOptions)
+    if (vm->set_option(vm, option.first.c_str(), option.second.c_str()) !=
+        EVMC_SET_OPTION_SUCCESS)
+      cerr << "warning: option " << option.first << "=" << option.second
+           << " rejected\n";
+  return vm;
+}
+
+// Executes @benchCase once, @returns the latency in microseconds or a
+// negative value on failure.
+double runOnce(MockHost &host, BenchCase const &benchCase, string &error) {
+  evmc_message msg{};
+  msg.kind = EVMC_CALL;
+  msg.gas = 1000000000;
+  msg.destination = benchCase.address;
+  msg.input_data = benchCase.input.data();
+  msg.input_size = benchCase.input.size();
+
+  const auto start = chrono::steady_clock::now();
+  evmc_result result = host.call(msg);
+  const auto end = chrono::steady_clock::now();
+  const bool ok = result.status_code == EVMC_SUCCESS || !benchCase.mustSucceed;
+  if (!ok)
+    error = "status " + to_string(result.status_code);
+  if (result.release)
+    result.release(&result);
+  if (!ok)
+    return -1;
+  return chrono::duration<double, micro>(end - start).count();
+}
+
+bool runCase(Options const &options, BenchCase const &benchCase,
+             string const &engine, CaseResult &result) {
+  result.name = benchCase.name;
+  result.engine = engine;
+
+  MockHost host;
+  host.code[benchCase.address] = &benchCase.code;
+
+  // Cold: a new VM instance each time, so nothing is cached in memory.
+  for (unsigned i = 0; i < options.coldRuns; i++) {
+    host.vm = createVm(options, engine);
+    if (!host.vm)
+      return false;
+    const double us = runOnce(host, benchCase, result.error);
+    host.vm->destroy(host.vm);
+    if (us < 0) {
+      result.ok = false;
+      return true;
+    }
+    result.cold.samples.push_back(us);
+  }
+
+  host.vm = createVm(options, engine);
+  if (!host.vm)
+    return false;
+  string error;
+  if (runOnce(host, benchCase, error) >= 0) {
+    for (unsigned i = 0; i < options.iterations; i++) {
+      const double us = runOnce(host, benchCase, error);
+      if (us < 0)
+        break;
+      result.warm.samples.push_back(us);
+    }
+  }
+  if (!error.empty()) {
+    result.ok = false;
+    result.error = error;
+  }
+  result.rssKb = procStatusKb("VmRSS");
+  result.peakRssKb = procStatusKb("VmHWM");
+  host.vm->destroy(host.vm);
+  return true;
+}
+
+void printJson(Options const &options, CaseResult &r) {
+  const double warmTotal = r.warm.total();
+  printf("{\"case\":\"%s\",\"engine\":\"%s\",\"ok\":%s", r.name.c_str(),
+         r.engine.c_str(), r.ok ? "true" : "false");
+  printf(",\"huge_pages\":%s", options.hugePages ? "true" : "false");
+  if (!r.ok)
+    printf(",\"error\":\"%s\"", r.error.c_str());
+  printf(",\"cold_runs\":%zu,\"cold_p50_us\":%.2f,\"cold_p90_us\":%.2f,"
+         "\"cold_p99_us\":%.2f",
+         r.cold.samples.size(), r.cold.percentile(50), r.cold.percentile(90),
+         r.cold.percentile(99));
+  printf(",\"warm_runs\":%zu,\"warm_p50_us\":%.2f,\"warm_p90_us\":%.2f,"
+         "\"warm_p99_us\":%.2f,\"throughput_per_s\":%.1f",
+         r.warm.samples.size(), r.warm.percentile(50), r.warm.percentile(90),
+         r.warm.percentile(99),
+         warmTotal > 0 ? r.warm.samples.size() * 1e6 / warmTotal : 0.0);
+  printf(",\"rss_kb\":%ld,\"peak_rss_kb\":%ld}\n", r.rssKb, r.peakRssKb);
+}
+
+void printTableHeader() {
+  printf("%-16s %-7s %10s %10s %10s %10s %10s %10s %10s\n", "case", "engine",
+         "cold p50", "cold p99", "warm p50", "warm p90", "warm p99",
+         "exec/s", "rss kB");
+}
+
+void printTableRow(CaseResult &r) {
+  if (!r.ok) {
+    printf("%-16s %-7s failed: %s\n", r.name.c_str(), r.engine.c_str(),
+           r.error.c_str());
+    return;
+  }
+  const double warmTotal = r.warm.total();
+  printf("%-16s %-7s %10.1f %10.1f %10.1f %10.1f %10.1f %10.0f %10ld\n",
+         r.name.c_str(), r.engine.c_str(), r.cold.percentile(50),
+         r.cold.percentile(99), r.warm.percentile(50), r.warm.percentile(90),
+         r.warm.percentile(99),
+         warmTotal > 0 ? r.warm.samples.size() * 1e6 / warmTotal : 0.0,
+         r.rssKb);
+}
+
+void usage(char const *argv0) {
+  cerr << "Usage: " << argv0 << " [options]\n"
+       << "  --engine <name>    engine to run, may be repeated "
+          "(default: wabt and the eosvm engines)\n"
+       << "  --case <name>      only run cases whose name contains <name>\n"
+       << "  --iterations <n>   warm executions per case (default: 200)\n"
+       << "  --cold <n>         cold executions per case (default: 10)\n"
+       << "  --scale <n>        workload size multiplier (default: 1)\n"
+       << "  --option <k>=<v>   VM option, may be repeated\n"
+       << "  --huge-pages       back eosvm memory and code with huge pages\n"
+       << "  --corpus-dir <dir> also run the .wasm modules in <dir>, may be "
+          "repeated\n"
+       << "  --json             print one JSON object per case and engine\n"
+       << "  --list             list the cases and exit\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  Options options;
+  bool list = false;
+  bool engineGiven = false;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    auto value = [&]() -> char const * {
+      if (i + 1 >= argc) {
+        usage(argv[0]);
+        exit(2);
+      }
+      return argv[++i];
+    };
+    if (arg == "--engine") {
+      if (!engineGiven)
+        options.engines.clear();
+      engineGiven = true;
+      options.engines.push_back(value());
+    } else if (arg == "--case") {
+      options.filter = value();
+    } else if (arg == "--iterations") {
+      options.iterations = unsigned(atoi(value()));
+    } else if (arg == "--cold") {
+      options.coldRuns = unsigned(atoi(value()));
+    } else if (arg == "--scale") {
+      options.scale = max(1, atoi(value()));
+    } else if (arg == "--option") {
+      const string option = value();
+      const size_t eq = option.find('=');
+      if (eq == string::npos) {
+        usage(argv[0]);
+        return 2;
+      }
+      options.vmOptions.emplace_back(option.substr(0, eq),
+                                     option.substr(eq + 1));
+    } else if (arg == "--huge-pages") {
+      options.hugePages = true;
+      options.vmOptions.emplace_back("eosvm-huge-pages", "true");
+    } else if (arg == "--corpus-dir") {
+      options.corpusDirs.push_back(value());
+    } else if (arg == "--json") {
+      options.json = true;
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  vector<BenchCase> cases = corpus(options.scale);
+  for (auto const &directory : options.corpusDirs)
+    loadCorpus(directory, cases);
+  if (list) {
+    for (auto const &benchCase : cases)
+      printf("%-16s %s\n", benchCase.name.c_str(),
+             benchCase.description.c_str());
+    return 0;
+  }
+
+  if (!options.json)
+    printTableHeader();
+  int status = 0;
+  for (auto const &benchCase : cases) {
+    if (benchCase.name.find(options.filter) == string::npos)
+      continue;
+    for (auto const &engine : options.engines) {
+      CaseResult result;
+      if (!runCase(options, benchCase, engine, result)) {
+        if (engineGiven) {
+          cerr << "engine " << engine << " is not available\n";
+          status = 1;
+        }
+        continue;
+      }
+      if (!result.ok)
+        status = 1;
+      if (options.json)
+        printJson(options, result);
+      else
+        printTableRow(result);
+    }
+  }
+  return status;
+}
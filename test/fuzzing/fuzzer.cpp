@@ -14,54 +14,247 @@
  * limitations under the License.
  */
 
-#include <evmc/helpers.h>
-#include <hera/hera.h>
-#include <initializer_list>
-#include <utility>
+// Differential fuzzer: every input is executed as a contract on each
+// engine compiled into Athena, which must agree on the status, the gas left
+// and the output. Code is metered with metering=jit so that every engine
+// charges the same gas and loops end.
+//
+// Executions exceeding the time or memory budget of their engine are
+// reported, and saved to the directory in ATHENA_FUZZ_OUTLIERS if it is
+// set, as <engine>-<time|memory>-<hash>.wasm. athena-bench --corpus-dir
+// runs such files as regression cases.
+//
+// The corpus directory next to this file holds inputs on which the engines
+// disagreed once, single byte mutations of the athena-bench contracts. They
+// are replayed by the athena-fuzzer-regressions test.
 
-class Hera {
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <athena/athena.h>
+#include <evmc/evmc.hpp>
+
+using namespace std;
+
+namespace {
+
+using bytes = vector<uint8_t>;
+
+// In-memory state of one execution. Calls to other contracts succeed
+// without executing anything.
+class FuzzHost {
 public:
-  ~Hera() noexcept { m_instance->destroy(m_instance); }
+  map<pair<evmc::address, evmc::bytes32>, evmc::bytes32> storage;
 
-  Hera(std::initializer_list<std::pair<const char *, const char *>> options)
-      : m_instance{evmc_create_hera()} {
-    for (auto option : options)
-      evmc_set_option(m_instance, option.first, option.second);
+  FuzzHost() {
+    m_interface.account_exists = [](evmc_host_context *,
+                                    evmc_address const *) { return true; };
+    m_interface.get_storage =
+        [](evmc_host_context *context, evmc_address const *address,
+           evmc_bytes32 const *key) -> evmc_bytes32 {
+      auto &storage = self(context).storage;
+      auto it = storage.find({*address, *key});
+      return it != storage.end() ? it->second : evmc::bytes32{};
+    };
+    m_interface.set_storage =
+        [](evmc_host_context *context, evmc_address const *address,
+           evmc_bytes32 const *key, evmc_bytes32 const *value) {
+          self(context).storage[{*address, *key}] = *value;
+          return EVMC_STORAGE_MODIFIED;
+        };
+    m_interface.get_balance = [](evmc_host_context *,
+                                 evmc_address const *) -> evmc_uint256be {
+      return {};
+    };
+    m_interface.get_code_size = [](evmc_host_context *,
+                                   evmc_address const *) -> size_t {
+      return 0;
+    };
+    // not cached by code hash, every input is compiled afresh
+    m_interface.get_code_hash = [](evmc_host_context *,
+                                   evmc_address const *) -> evmc_bytes32 {
+      return {};
+    };
+    m_interface.copy_code = [](evmc_host_context *, evmc_address const *,
+                               size_t, uint8_t *, size_t) -> size_t {
+      return 0;
+    };
+    m_interface.selfdestruct = [](evmc_host_context *, evmc_address const *,
+                                  evmc_address const *) {};
+    m_interface.call = [](evmc_host_context *,
+                          evmc_message const *msg) -> evmc_result {
+      evmc_result result{};
+      result.status_code = EVMC_SUCCESS;
+      result.gas_left = msg->gas;
+      return result;
+    };
+    m_interface.get_tx_context = [](evmc_host_context *) -> evmc_tx_context {
+      return {};
+    };
+    m_interface.get_block_hash = [](evmc_host_context *,
+                                    int64_t) -> evmc_bytes32 { return {}; };
+    m_interface.emit_log = [](evmc_host_context *, evmc_address const *,
+                              uint8_t const *, size_t, evmc_bytes32 const[],
+                              size_t) {};
   }
 
-  evmc_result execute(evmc_revision rev, const evmc_message &msg,
-                      const uint8_t *code, size_t code_size) noexcept {
-    return m_instance->execute(m_instance, nullptr, rev, &msg, code, code_size);
+  evmc_host_interface const *interface() const noexcept {
+    return &m_interface;
+  }
+  evmc_host_context *context() noexcept {
+    return reinterpret_cast<evmc_host_context *>(this);
   }
 
 private:
-  evmc_instance *const m_instance = nullptr;
+  static FuzzHost &self(evmc_host_context *context) noexcept {
+    return *reinterpret_cast<FuzzHost *>(context);
+  }
+
+  evmc_host_interface m_interface{};
 };
 
-inline void expect(bool test) noexcept {
-  if (!test)
-    __builtin_trap();
+struct Engine {
+  char const *name;
+  // of an execution, including compilation
+  chrono::milliseconds timeBudget;
+  // growth of the peak resident memory during an execution
+  long memoryBudgetKb;
+  evmc_vm *vm = nullptr;
+};
+
+struct Outcome {
+  evmc_status_code status;
+  int64_t gasLeft;
+  bytes output;
+};
+
+// The interpreters get more time than the JIT.
+vector<Engine> createEngines() {
+  vector<Engine> engines = {
+      {"wabt", chrono::milliseconds{500}, 64 * 1024},
+      {"eosvm", chrono::milliseconds{100}, 64 * 1024},
+      {"eosvm-threaded", chrono::milliseconds{250}, 64 * 1024},
+      {"eosvm-tiered", chrono::milliseconds{250}, 64 * 1024},
+      {"eosvm-interpreter", chrono::milliseconds{500}, 64 * 1024},
+  };
+  vector<Engine> available;
+  for (auto &engine : engines) {
+    engine.vm = evmc_create_athena();
+    if (engine.vm->set_option(engine.vm, "engine", engine.name) !=
+        EVMC_SET_OPTION_SUCCESS) {
+      engine.vm->destroy(engine.vm);
+      continue;
+    }
+    engine.vm->set_option(engine.vm, "metering", "jit");
+    engine.vm->set_option(engine.vm, "module-cache-size", "0");
+    available.push_back(engine);
+  }
+  return available;
 }
 
-extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size) {
-  Hera heraBinaryen{{"engine", "binaryen"}};
-  Hera heraWabt{{"engine", "wabt"}};
+// Limits the peak resident memory to the current one, so that the VmHWM
+// read after an execution is its own peak.
+void resetPeakRss() noexcept {
+  FILE *file = fopen("/proc/self/clear_refs", "w");
+  if (file) {
+    fputs("5", file);
+    fclose(file);
+  }
+}
 
+// @returns the VmRSS or VmHWM value of /proc/self/status in kB.
+long procStatusKb(char const *field) {
+  ifstream status("/proc/self/status");
+  string line;
+  const size_t length = strlen(field);
+  while (getline(status, line))
+    if (line.compare(0, length, field) == 0 && line[length] == ':')
+      return atol(line.c_str() + length + 1);
+  return 0;
+}
+
+void saveOutlier(Engine const &engine, char const *kind, uint8_t const *input,
+                 size_t size) {
+  char const *directory = getenv("ATHENA_FUZZ_OUTLIERS");
+  if (!directory)
+    return;
+  char hash[17];
+  snprintf(hash, sizeof(hash), "%016zx",
+           std::hash<string>{}(string(reinterpret_cast<char const *>(input),
+                                      size)));
+  const string path = string(directory) + "/" + engine.name + "-" + kind +
+                      "-" + hash + ".wasm";
+  ofstream{path, ios::binary}.write(reinterpret_cast<char const *>(input),
+                                    streamsize(size));
+}
+
+Outcome execute(Engine const &engine, uint8_t const *input, size_t size) {
   evmc_message msg{};
-  msg.kind = EVMC_CREATE;
-  msg.gas = 100000;
+  msg.kind = EVMC_CALL;
+  msg.gas = 1000000;
+
+  FuzzHost host;
+  resetPeakRss();
+  const long rssKb = procStatusKb("VmRSS");
+  const auto start = chrono::steady_clock::now();
+  evmc_result result =
+      engine.vm->execute(engine.vm, host.interface(), host.context(),
+                         EVMC_BYZANTIUM, &msg, input, size);
+  const auto elapsed = chrono::steady_clock::now() - start;
+  const long memoryKb = procStatusKb("VmHWM") - rssKb;
+
+  if (elapsed > engine.timeBudget) {
+    fprintf(stderr, "%s: %lld ms over the time budget\n", engine.name,
+            (long long)chrono::duration_cast<chrono::milliseconds>(elapsed)
+                .count());
+    saveOutlier(engine, "time", input, size);
+  }
+  if (memoryKb > engine.memoryBudgetKb) {
+    fprintf(stderr, "%s: %ld kB over the memory budget\n", engine.name,
+            memoryKb);
+    saveOutlier(engine, "memory", input, size);
+  }
 
-  auto resBinaryen = heraBinaryen.execute(EVMC_BYZANTIUM, msg, input, size);
-  auto resWabt = heraBinaryen.execute(EVMC_BYZANTIUM, msg, input, size);
+  Outcome outcome{result.status_code, result.gas_left,
+                  bytes(result.output_data,
+                        result.output_data + result.output_size)};
+  if (result.release)
+    result.release(&result);
+  return outcome;
+}
 
-  expect(resBinaryen.gas_left == resWabt.gas_left);
-  expect(resBinaryen.output_size == resWabt.output_size);
-  expect(resBinaryen.status_code == resWabt.status_code);
+inline void expect(bool test) noexcept {
+  if (!test)
+    __builtin_trap();
+}
+
+} // anonymous namespace
 
-  if (resBinaryen.release)
-    resBinaryen.release(&resBinaryen);
-  if (resWabt.release)
-    resWabt.release(&resWabt);
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *input, size_t size) {
+  static const vector<Engine> engines = createEngines();
+  expect(!engines.empty());
 
+  const Outcome reference = execute(engines[0], input, size);
+  for (size_t i = 1; i < engines.size(); i++) {
+    const Outcome outcome = execute(engines[i], input, size);
+    if (outcome.status != reference.status ||
+        outcome.gasLeft != reference.gasLeft ||
+        outcome.output != reference.output) {
+      fprintf(stderr,
+              "%s: status %d, gas left %lld, %zu bytes of output\n"
+              "%s: status %d, gas left %lld, %zu bytes of output\n",
+              engines[0].name, reference.status, (long long)reference.gasLeft,
+              reference.output.size(), engines[i].name, outcome.status,
+              (long long)outcome.gasLeft, outcome.output.size());
+      expect(false);
+    }
+  }
   return 0;
 }
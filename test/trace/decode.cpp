@@ -0,0 +1,164 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// athena-trace prints the host function calls recorded in a file written by
+// the trace=dump option, one line per call with the cycles elapsed since the
+// first call of its buffer, the call depth, the gas left before the call and
+// the arguments.
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "trace.h"
+
+using namespace std;
+using namespace athena::trace;
+
+namespace {
+
+struct Function {
+  string name;
+  vector<string> arguments;
+};
+
+void usage(char const *argv0) {
+  cerr << "Usage: " << argv0 << " [options] <trace file>\n"
+       << "  --function <name>  only print calls of <name>\n"
+       << "  --buffer <n>       only print the calls recorded in buffer <n>\n";
+}
+
+bool readFunctions(FILE *file, uint32_t count, vector<Function> &functions) {
+  for (uint32_t i = 0; i < count; i++) {
+    string description;
+    int c;
+    while ((c = fgetc(file)) != EOF && c != '\0')
+      description += char(c);
+    if (c == EOF)
+      return false;
+    istringstream words(description);
+    Function function;
+    words >> function.name;
+    for (string argument; words >> argument;)
+      function.arguments.push_back(argument);
+    functions.push_back(function);
+  }
+  return true;
+}
+
+void print(Event const &event, uint64_t start,
+           vector<Function> const &functions) {
+  cout << "  " << event.cycles - start << " [" << event.depth << "] ";
+  if (event.function >= functions.size()) {
+    cout << "function" << event.function << "\n";
+    return;
+  }
+  Function const &function = functions[event.function];
+  cout << function.name << " gasLeft=" << event.gasLeft;
+  for (size_t i = 0; i < function.arguments.size() && i < 4; i++) {
+    string const &argument = function.arguments[i];
+    const uint64_t value = i == 0 ? event.arg0 : event.args[i - 1];
+    const size_t suffix = argument.rfind("Offset");
+    cout << " " << argument << "=";
+    if (suffix != string::npos && suffix + 6 == argument.size())
+      cout << "0x" << hex << value << dec;
+    else if (argument == "gas")
+      cout << int64_t(value);
+    else
+      cout << value;
+  }
+  cout << "\n";
+}
+
+} // anonymous namespace
+
+int main(int argc, char **argv) {
+  string path;
+  string functionFilter;
+  long bufferFilter = -1;
+  for (int i = 1; i < argc; i++) {
+    const string arg = argv[i];
+    if ((arg == "--function" || arg == "--buffer") && i + 1 < argc) {
+      if (arg == "--function")
+        functionFilter = argv[++i];
+      else
+        bufferFilter = atol(argv[++i]);
+    } else if (path.empty() && arg[0] != '-') {
+      path = arg;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (path.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) {
+    cerr << "Cannot open " << path << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+
+  FileHeader header;
+  vector<Function> functions;
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      header.magic != fileMagic || header.version != fileVersion ||
+      header.eventSize != sizeof(Event) ||
+      !readFunctions(file, header.functionCount, functions)) {
+    cerr << path << " is not a trace file of this version\n";
+    fclose(file);
+    return 1;
+  }
+
+  for (uint32_t i = 0; i < header.bufferCount; i++) {
+    BufferHeader buffer;
+    if (fread(&buffer, sizeof(buffer), 1, file) != 1) {
+      cerr << path << " is truncated\n";
+      fclose(file);
+      return 1;
+    }
+    const bool selected = bufferFilter < 0 || buffer.buffer == bufferFilter;
+    if (selected)
+      cout << "buffer " << buffer.buffer << ": " << buffer.events
+           << " events, " << buffer.dropped << " dropped\n";
+    uint64_t start = 0;
+    for (uint64_t j = 0; j < buffer.events; j++) {
+      Event event;
+      if (fread(&event, sizeof(event), 1, file) != 1) {
+        cerr << path << " is truncated\n";
+        fclose(file);
+        return 1;
+      }
+      if (j == 0)
+        start = event.cycles;
+      if (!selected || (!functionFilter.empty() &&
+                        (event.function >= functions.size() ||
+                         functions[event.function].name != functionFilter)))
+        continue;
+      print(event, start, functions);
+    }
+  }
+  fclose(file);
+  return 0;
+}
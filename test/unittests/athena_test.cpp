@@ -0,0 +1,363 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Executes small generated contracts through the EVMC interface of Athena,
+// on every engine that is built.
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include <athena/athena.h>
+#include <gtest/gtest.h>
+
+#include "corpus.h"
+#include "mockhost.h"
+
+using namespace athena::test;
+
+namespace {
+
+bytes fromHex(std::string const &hex) {
+  bytes out;
+  for (size_t i = 0; i + 1 < hex.size(); i += 2)
+    out.push_back(uint8_t(std::stoul(hex.substr(i, 2), nullptr, 16)));
+  return out;
+}
+
+bytes output(evmc::result const &result) {
+  return bytes(result.output_data, result.output_data + result.output_size);
+}
+
+// @returns the number of compilations recorded by the benchmark option.
+uint64_t compilations() {
+  athena_phase_stats stats[16];
+  const size_t count = athena_get_benchmark_stats(stats, 16);
+  for (size_t i = 0; i < count && i < 16; i++)
+    if (strcmp(stats[i].phase, "compilation") == 0)
+      return stats[i].count;
+  return 0;
+}
+
+class AthenaTest : public testing::TestWithParam<std::string> {
+protected:
+  VmPtr vm(std::vector<std::pair<char const *, char const *>> options = {}) {
+    // tier-ups would compile in the background
+    if (GetParam() == "eosvm-tiered")
+      options.push_back({"eosvm-tier-up-threshold", "1000000"});
+    return createVm(GetParam(), options);
+  }
+};
+
+// Fills and copies memory, then runs a loop of four entries. Metered at one
+// gas per instruction, charged when its block is entered, and one per 8
+// bytes filled or copied:
+//   function body        9 (three constants and the instruction, twice,
+//                           and the block)
+//   block                1 (the loop)
+//   loop             4 * 9 (the exit test and the increment, the exit
+//                           charges the whole loop as well)
+//   fill and copy 100 / 8 + 64 / 8
+constexpr int64_t meteredGas = 9 + 1 + 4 * 9 + 12 + 8;
+
+bytes meteredContract() {
+  Contract contract;
+  contract.locals = {I32};
+  Code c;
+  c.i32(0).i32(7).i32(100).memoryFill();
+  c.i32(200).i32(0).i32(64).memoryCopy();
+  c.block().loop();
+  c.get(0).i32(3).op(0x4f).brIf(1);
+  c.get(0).i32(1).op(0x6a).set(0).br(0);
+  c.end().end();
+  return buildModule(contract, c);
+}
+
+TEST_P(AthenaTest, injectedMeteringCharges) {
+  auto meteringVm = vm({{"metering", "native"}});
+  if (!meteringVm)
+    GTEST_SKIP() << GetParam() << " is not built";
+  MockHost host(meteringVm.get());
+
+  const bytes contract = meteredContract();
+  auto deployed = host.create(contract);
+  ASSERT_EQ(deployed.status_code, EVMC_SUCCESS);
+  EXPECT_NE(output(deployed), contract);
+
+  const auto address = makeAddress(1);
+  host.code[address] = output(deployed);
+  constexpr int64_t gas = 1000000;
+  auto result = host.execute(address, {}, gas);
+  ASSERT_EQ(result.status_code, EVMC_SUCCESS);
+  EXPECT_EQ(gas - result.gas_left, meteredGas);
+
+  result = host.execute(address, {}, meteredGas - 1);
+  EXPECT_EQ(result.status_code, EVMC_OUT_OF_GAS);
+}
+
+// Meters the bench corpus natively and with the Sentinel contract read from
+// the file named by ATHENA_SENTINEL. Skipped when it is not set. The injector
+// charges a whole block when it is entered while Sentinel ends a metered
+// block at every branch, so native metering charges at least as much: the
+// instructions a branch out of a block skips are charged as well.
+TEST_P(AthenaTest, injectedMeteringChargesAtLeastSentinel) {
+  char const *path = std::getenv("ATHENA_SENTINEL");
+  if (!path)
+    GTEST_SKIP() << "ATHENA_SENTINEL is not set";
+  std::ifstream file(path, std::ios::binary);
+  ASSERT_TRUE(file) << "cannot read " << path;
+  const bytes sentinel{std::istreambuf_iterator<char>(file),
+                       std::istreambuf_iterator<char>()};
+
+  auto nativeVm = vm({{"metering", "native"}});
+  if (!nativeVm)
+    GTEST_SKIP() << GetParam() << " is not built";
+  auto sentinelVm = vm({{"metering", "true"}});
+  MockHost nativeHost(nativeVm.get());
+  MockHost sentinelHost(sentinelVm.get());
+  evmc::address sentinelAddress{};
+  sentinelAddress.bytes[19] = 0x0a;
+  sentinelHost.code[sentinelAddress] = sentinel;
+
+  for (auto const &benchCase : athena::bench::corpus(1)) {
+    for (MockHost *host : {&nativeHost, &sentinelHost}) {
+      auto deployed = host->create(benchCase.code);
+      ASSERT_EQ(deployed.status_code, EVMC_SUCCESS) << benchCase.name;
+      host->code[benchCase.address] = output(deployed);
+    }
+    auto native = nativeHost.execute(benchCase.address, benchCase.input);
+    auto metered = sentinelHost.execute(benchCase.address, benchCase.input);
+    ASSERT_EQ(native.status_code, EVMC_SUCCESS) << benchCase.name;
+    EXPECT_EQ(metered.status_code, EVMC_SUCCESS) << benchCase.name;
+    EXPECT_LE(native.gas_left, metered.gas_left) << benchCase.name;
+  }
+}
+
+TEST_P(AthenaTest, moduleCacheHitsSkipCompilation) {
+  for (bool cached : {true, false}) {
+    auto cacheVm = vm({{"module-cache-size", cached ? "256" : "0"}});
+    if (!cacheVm)
+      GTEST_SKIP() << GetParam() << " is not built";
+    MockHost host(cacheVm.get());
+    const auto address = makeAddress(1);
+    host.code[address] = meteredContract();
+
+    cacheVm->set_option(cacheVm.get(), "benchmark", "reset");
+    cacheVm->set_option(cacheVm.get(), "benchmark", "true");
+    EXPECT_EQ(host.execute(address).status_code, EVMC_SUCCESS);
+    EXPECT_EQ(compilations(), 1u);
+    EXPECT_EQ(host.execute(address).status_code, EVMC_SUCCESS);
+    EXPECT_EQ(compilations(), cached ? 1u : 2u) << "cached=" << cached;
+    cacheVm->set_option(cacheVm.get(), "benchmark", "false");
+  }
+}
+
+TEST_P(AthenaTest, optionsStayWithTheirInstance) {
+  auto benchmarkedVm = vm({{"benchmark", "true"}});
+  if (!benchmarkedVm)
+    GTEST_SKIP() << GetParam() << " is not built";
+  auto otherVm = vm();
+  MockHost benchmarkedHost(benchmarkedVm.get());
+  MockHost otherHost(otherVm.get());
+  const auto address = makeAddress(1);
+  benchmarkedHost.code[address] = meteredContract();
+  otherHost.code[address] = meteredContract();
+
+  benchmarkedVm->set_option(benchmarkedVm.get(), "benchmark", "reset");
+  EXPECT_EQ(otherHost.execute(address).status_code, EVMC_SUCCESS);
+  EXPECT_EQ(compilations(), 0u);
+  EXPECT_EQ(benchmarkedHost.execute(address).status_code, EVMC_SUCCESS);
+  EXPECT_EQ(compilations(), 1u);
+  benchmarkedVm->set_option(benchmarkedVm.get(), "benchmark", "false");
+}
+
+// Calls itself with the depth in the call data decremented until it is
+// zero. Every level keeps its depth in memory and in a global and traps if
+// a nested call failed or changed either.
+bytes reentrantContract(evmc::address const &self) {
+  enum { CallDataCopy, Call, Finish };
+  enum { depth };
+  Contract contract;
+  contract.imports = {callDataCopy(), call(), finish()};
+  contract.locals = {I32};
+  contract.globals = {-1};
+  contract.segments = {{0, bytes(self.bytes, self.bytes + sizeof(self.bytes))}};
+
+  Code c;
+  c.i32(100).i32(0).i32(4).call(CallDataCopy);
+  c.i32(0).i32Load(100).set(depth);
+  c.i32(0).get(depth).i32Store(64);
+  c.get(depth).globalSet(0);
+  c.get(depth).if_();
+  c.i32(0).get(depth).i32(1).op(0x6b).i32Store(104);
+  // value at 32
+  c.i64(100000000).i32(0).i32(32).i32(104).i32(4).call(Call);
+  c.if_().op(0x00).end();
+  c.end();
+  c.i32(0).i32Load(64).get(depth).op(0x47).if_().op(0x00).end();
+  c.globalGet(0).get(depth).op(0x47).if_().op(0x00).end();
+  c.i32(0).globalGet(0).i32Store(68);
+  c.i32(64).i32(8).call(Finish);
+  return buildModule(contract, c);
+}
+
+TEST_P(AthenaTest, reentrantCallsKeepTheirState) {
+  for (char const *cacheSize : {"256", "0"}) {
+    auto reentrantVm = vm({{"module-cache-size", cacheSize}});
+    if (!reentrantVm)
+      GTEST_SKIP() << GetParam() << " is not built";
+    MockHost host(reentrantVm.get());
+    const auto address = makeAddress(1);
+    host.code[address] = reentrantContract(address);
+
+    for (uint32_t depth : {0u, 1u, 5u}) {
+      auto result = host.execute(address, encodeU32(depth));
+      ASSERT_EQ(result.status_code, EVMC_SUCCESS)
+          << "depth " << depth << ", module-cache-size=" << cacheSize;
+      bytes expected = encodeU32(depth);
+      const bytes global = encodeU32(depth);
+      expected.insert(expected.end(), global.begin(), global.end());
+      EXPECT_EQ(output(result), expected);
+    }
+  }
+}
+
+// Ends with finish, or with revert if there is call data. A storage store
+// follows, which must not be executed.
+bytes exitContract() {
+  enum { GetCallDataSize, Finish, Revert, StorageStore };
+  Contract contract;
+  contract.imports = {getCallDataSize(), finish(), revert(), storageStore()};
+  contract.segments = {{0, {0xef, 0xbe, 0xad, 0xde}}, {64, {1}}};
+  Code c;
+  c.call(GetCallDataSize).if_();
+  c.i32(0).i32(4).call(Revert);
+  c.end();
+  c.i32(0).i32(4).call(Finish);
+  c.i32(32).i32(64).call(StorageStore);
+  return buildModule(contract, c);
+}
+
+TEST_P(AthenaTest, finishAndRevertEndTheExecution) {
+  auto exitVm = vm();
+  if (!exitVm)
+    GTEST_SKIP() << GetParam() << " is not built";
+  MockHost host(exitVm.get());
+  const auto address = makeAddress(1);
+  host.code[address] = exitContract();
+  const bytes word{0xef, 0xbe, 0xad, 0xde};
+
+  for (int i = 0; i < 2; i++) {
+    auto finished = host.execute(address);
+    EXPECT_EQ(finished.status_code, EVMC_SUCCESS);
+    EXPECT_EQ(output(finished), word);
+    EXPECT_GT(finished.gas_left, 0);
+
+    auto reverted = host.execute(address, {1});
+    EXPECT_EQ(reverted.status_code, EVMC_REVERT);
+    EXPECT_EQ(output(reverted), word);
+    EXPECT_GT(reverted.gas_left, 0);
+  }
+  EXPECT_TRUE(host.storage.empty());
+}
+
+TEST_P(AthenaTest, finishOutsideMemoryFails) {
+  auto exitVm = vm();
+  if (!exitVm)
+    GTEST_SKIP() << GetParam() << " is not built";
+  MockHost host(exitVm.get());
+  const auto address = makeAddress(1);
+  Contract contract;
+  contract.imports = {finish()};
+  Code c;
+  c.i32(0).i32(-1).call(0);
+  host.code[address] = buildModule(contract, c);
+
+  auto result = host.execute(address);
+  EXPECT_NE(result.status_code, EVMC_SUCCESS);
+  EXPECT_EQ(result.output_size, 0u);
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, AthenaTest, testing::ValuesIn(engines()));
+
+struct PrecompileVector {
+  uint8_t address;
+  std::string input;
+  std::string output;
+};
+
+TEST(PrecompileTest, knownVectors) {
+  VmPtr vm;
+  for (auto const &engine : engines())
+    if ((vm = createVm(engine, {{"native-precompiles", "true"}})))
+      break;
+  ASSERT_TRUE(vm);
+  MockHost host(vm.get());
+
+  const PrecompileVector vectors[] = {
+      // ecrecover, a valid signature and one with an invalid v
+      {1,
+       "18c547e4f7b0f325ad1e56f57e26c745b09a3e503d86e00e5255ff7f715d3d1c"
+       "000000000000000000000000000000000000000000000000000000000000001c"
+       "73b1693892219d736caba55bdb67216e485557ea6b6af75f37096c9aa6a5a75f"
+       "eeb940b1d03b21e36b0e47e79769f095fe2ab855bd91e3a38756b7d75a9c4549",
+       "000000000000000000000000a94f5374fce5edbc8e2a8697c15331677e6ebf0b"},
+      {1,
+       "18c547e4f7b0f325ad1e56f57e26c745b09a3e503d86e00e5255ff7f715d3d1c"
+       "000000000000000000000000000000000000000000000000000000000000001d"
+       "73b1693892219d736caba55bdb67216e485557ea6b6af75f37096c9aa6a5a75f"
+       "eeb940b1d03b21e36b0e47e79769f095fe2ab855bd91e3a38756b7d75a9c4549",
+       ""},
+      // sha256 of "", "abc" and the two block FIPS 180-2 message
+      {2, "", "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"},
+      {2, "616263",
+       "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"},
+      {2,
+       "6162636462636465636465666465666765666768666768696768696a68696a6b"
+       "696a6b6c6a6b6c6d6b6c6d6e6c6d6e6f6d6e6f706e6f7071",
+       "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"},
+      // ripemd160 of "abc", left padded
+      {3, "616263",
+       "0000000000000000000000008eb208f7e05d987a9b044a8e98c6b087f15a0bfc"},
+      {4, "0102030405", "0102030405"},
+      // keccak256 of "" and "abc"
+      {9, "", "c5d2460186f7233c927e7db2dcc703c0e500b653ca82273b7bfad8045d85a470"},
+      {9, "616263",
+       "4e03657aea45a94fc7d47ba826c8d667c0d1e6e33a64a036ec44f58fa12d6c45"},
+  };
+  for (auto const &vector : vectors) {
+    evmc::address address{};
+    address.bytes[19] = vector.address;
+    // executed by the VM, which never looks at the code
+    host.code[address] = {};
+    auto result = host.execute(address, fromHex(vector.input));
+    ASSERT_EQ(result.status_code, EVMC_SUCCESS);
+    EXPECT_EQ(output(result), fromHex(vector.output))
+        << "precompile " << int(vector.address) << " of " << vector.input;
+  }
+
+  // 60 gas and 12 per word
+  evmc::address sha256{};
+  sha256.bytes[19] = 2;
+  auto result = host.execute(sha256, fromHex("616263"), 1000);
+  EXPECT_EQ(result.gas_left, 1000 - 72);
+  result = host.execute(sha256, fromHex("616263"), 71);
+  EXPECT_EQ(result.status_code, EVMC_OUT_OF_GAS);
+}
+
+} // namespace
@@ -0,0 +1,105 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Calls into the eos-vm backends directly, every test runs on the jit, the
+// threaded and the tree interpreter.
+
+#include <cstdint>
+#include <vector>
+
+#include <eosio/vm/backend.hpp>
+#include <gtest/gtest.h>
+
+using namespace eosio::vm;
+
+namespace {
+
+struct Host {};
+
+// (func (export "add") (param i32 i32) (result i32)
+//   local.get 0  local.get 1  i32.add)
+// (func (export "widen") (param i64 i32) (result i64)
+//   local.get 0  local.get 1  i64.extend_i32_u  i64.add)
+const std::vector<uint8_t> argsModule = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    // types
+    0x01, 0x0d, 0x02, 0x60, 0x02, 0x7f, 0x7f, 0x01, 0x7f, 0x60, 0x02, 0x7e,
+    0x7f, 0x01, 0x7e,
+    // functions
+    0x03, 0x03, 0x02, 0x00, 0x01,
+    // exports
+    0x07, 0x0f, 0x02, 0x03, 'a', 'd', 'd', 0x00, 0x00, 0x05, 'w', 'i', 'd',
+    'e', 'n', 0x00, 0x01,
+    // code
+    0x0a, 0x12, 0x02, 0x07, 0x00, 0x20, 0x00, 0x20, 0x01, 0x6a, 0x0b, 0x08,
+    0x00, 0x20, 0x00, 0x20, 0x01, 0xad, 0x7c, 0x0b};
+
+// (memory 2) (data (i32.const 0) "\2a")
+const std::vector<uint8_t> memoryModule = {
+    0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00,
+    // memory
+    0x05, 0x03, 0x01, 0x00, 0x02,
+    // data
+    0x0b, 0x07, 0x01, 0x00, 0x41, 0x00, 0x0b, 0x01, 0x2a};
+
+template <typename Impl> class EosVmTest : public testing::Test {};
+using Backends = testing::Types<jit, threaded, interpreter>;
+TYPED_TEST_SUITE(EosVmTest, Backends);
+
+TYPED_TEST(EosVmTest, callWithArguments) {
+  std::vector<uint8_t> code = argsModule;
+  wasm_code_ptr ptr(code.data(), code.size());
+  backend<Host, TypeParam> bk(ptr, code.size());
+  wasm_allocator walloc;
+  bk.set_wasm_allocator(&walloc);
+  Host host;
+  bk.initialize(&host);
+
+  auto sum = bk.call_with_return(&host, "env", "add", uint32_t(40), 2);
+  ASSERT_TRUE(sum);
+  EXPECT_EQ(sum->to_ui32(), 42u);
+
+  auto wide =
+      bk.call_with_return(&host, "env", "widen", uint64_t(1) << 40, 0xffffffffu);
+  ASSERT_TRUE(wide);
+  EXPECT_EQ(wide->to_ui64(), (uint64_t(1) << 40) + 0xffffffffu);
+
+  // by index, the path the athena engine takes for exports
+  EXPECT_TRUE(bk.call(&host, 0, uint32_t(1), uint32_t(2)));
+}
+
+TYPED_TEST(EosVmTest, snapshotKeepsPageLimit) {
+  std::vector<uint8_t> code = memoryModule;
+  wasm_code_ptr ptr(code.data(), code.size());
+  backend<Host, TypeParam> bk(ptr, code.size());
+  wasm_allocator walloc;
+  bk.set_wasm_allocator(&walloc);
+  bk.initialize();
+  bk.take_snapshot();
+
+  walloc.get_base_ptr<uint8_t>()[0] = 0;
+  bk.initialize();
+  EXPECT_EQ(walloc.get_base_ptr<uint8_t>()[0], 0x2a);
+  EXPECT_EQ(walloc.get_current_page(), 2);
+
+  bk.get_context().set_max_pages(1);
+  EXPECT_THROW(bk.initialize(), wasm_bad_alloc);
+  bk.get_context().set_max_pages(2);
+  bk.initialize();
+  EXPECT_EQ(walloc.get_base_ptr<uint8_t>()[0], 0x2a);
+}
+
+} // namespace
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Executions reuse the instances of cached modules, each must still start
+// from the initial memory and globals of its contract, and a reentrant call
+// must leave the state of the outer call alone.
+
+#include <gtest/gtest.h>
+
+#include "mockhost.h"
+
+using namespace athena::test;
+
+namespace {
+
+enum Import : uint32_t { GetCallDataSize, Call, ReturnDataCopy, Finish };
+
+constexpr int32_t initialGlobal = 7;
+constexpr uint32_t initialWord = 0x11111111;
+
+// Reports the global and the memory word it finds, then increments both.
+// With call data it calls itself and also reports its state after the call
+// and what the inner call reported.
+bytes stateContract(evmc::address const &self) {
+  Contract contract;
+  contract.imports = {getCallDataSize(), call(), returnDataCopy(), finish()};
+  contract.globals = {initialGlobal};
+  contract.segments = {{0, bytes(self.bytes, self.bytes + sizeof(self.bytes))},
+                       {64, encodeU32(initialWord)}};
+
+  Code c;
+  c.i32(128).globalGet(0).i32Store(0);
+  c.i32(132).i32(0).i32Load(64).i32Store(0);
+  c.globalGet(0).i32(1).op(0x6a).globalSet(0);
+  c.i32(0).i32(0).i32Load(64).i32(1).op(0x6a).i32Store(64);
+  c.call(GetCallDataSize).if_();
+  // value at 96, no call data
+  c.i64(10000000).i32(0).i32(96).i32(0).i32(0).call(Call).drop();
+  c.i32(136).globalGet(0).i32Store(0);
+  c.i32(140).i32(0).i32Load(64).i32Store(0);
+  c.i32(144).i32(0).i32(8).call(ReturnDataCopy);
+  c.i32(128).i32(24).call(Finish);
+  c.end();
+  c.i32(128).i32(8).call(Finish);
+  return buildModule(contract, c);
+}
+
+std::vector<uint32_t> words(evmc::result const &result) {
+  std::vector<uint32_t> out;
+  for (size_t i = 0; i + 4 <= result.output_size; i += 4)
+    out.push_back(decodeU32(result.output_data + i));
+  return out;
+}
+
+class InstanceTest : public testing::TestWithParam<std::string> {
+protected:
+  void run(VmPtr vm) {
+    if (!vm)
+      GTEST_SKIP() << GetParam() << " is not built";
+    MockHost host(vm.get());
+    const auto address = makeAddress(1);
+    host.code[address] = stateContract(address);
+
+    const std::vector<uint32_t> initial{initialGlobal, initialWord};
+    for (int i = 0; i < 2; i++) {
+      auto result = host.execute(address);
+      ASSERT_EQ(result.status_code, EVMC_SUCCESS);
+      EXPECT_EQ(words(result), initial);
+    }
+
+    auto result = host.execute(address, {1});
+    ASSERT_EQ(result.status_code, EVMC_SUCCESS);
+    const std::vector<uint32_t> reentered{
+        initialGlobal,     initialWord,   initialGlobal + 1,
+        initialWord + 1,   initialGlobal, initialWord};
+    EXPECT_EQ(words(result), reentered);
+
+    result = host.execute(address);
+    ASSERT_EQ(result.status_code, EVMC_SUCCESS);
+    EXPECT_EQ(words(result), initial);
+  }
+};
+
+TEST_P(InstanceTest, stateIsRestored) { run(createVm(GetParam())); }
+
+TEST_P(InstanceTest, stateIsRestoredWithoutModuleCache) {
+  run(createVm(GetParam(), {{"module-cache-size", "0"}}));
+}
+
+TEST_P(InstanceTest, stateIsRestoredFromSnapshot) {
+  if (GetParam() == "wabt")
+    GTEST_SKIP() << "wabt takes no snapshots";
+  run(createVm(GetParam(), {{"eosvm-snapshot-threshold", "1"}}));
+}
+
+INSTANTIATE_TEST_SUITE_P(Engines, InstanceTest, testing::ValuesIn(engines()));
+
+} // namespace
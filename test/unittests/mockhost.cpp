@@ -0,0 +1,149 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <cstring>
+
+#include <athena/athena.h>
+
+#include "mockhost.h"
+
+using namespace std;
+
+namespace athena {
+namespace test {
+
+namespace {
+
+MockHost &self(evmc_host_context *context) noexcept {
+  return *reinterpret_cast<MockHost *>(context);
+}
+
+bytes const *findCode(MockHost &host, evmc::address const &address) {
+  auto it = host.code.find(address);
+  return it != host.code.end() ? &it->second : nullptr;
+}
+
+} // anonymous namespace
+
+vector<string> const &engines() {
+  static const vector<string> all{"wabt", "eosvm", "eosvm-threaded",
+                                  "eosvm-tiered", "eosvm-interpreter"};
+  return all;
+}
+
+VmPtr createVm(string const &engine,
+               vector<pair<char const *, char const *>> const &options) {
+  VmPtr vm{evmc_create_athena()};
+  if (vm->set_option(vm.get(), "engine", engine.c_str()) !=
+      EVMC_SET_OPTION_SUCCESS)
+    return nullptr;
+  for (auto const &option : options)
+    if (vm->set_option(vm.get(), option.first, option.second) !=
+        EVMC_SET_OPTION_SUCCESS)
+      return nullptr;
+  return vm;
+}
+
+MockHost::MockHost(evmc_vm *_vm) : vm(_vm) {
+  m_interface.account_exists = [](evmc_host_context *, evmc_address const *) {
+    return true;
+  };
+  m_interface.get_storage = [](evmc_host_context *context,
+                               evmc_address const *address,
+                               evmc_bytes32 const *key) -> evmc_bytes32 {
+    auto &storage = self(context).storage;
+    auto it = storage.find({*address, *key});
+    return it != storage.end() ? it->second : evmc::bytes32{};
+  };
+  m_interface.set_storage =
+      [](evmc_host_context *context, evmc_address const *address,
+         evmc_bytes32 const *key, evmc_bytes32 const *value) {
+        self(context).storage[{*address, *key}] = *value;
+        return EVMC_STORAGE_MODIFIED;
+      };
+  m_interface.get_balance = [](evmc_host_context *,
+                               evmc_address const *) -> evmc_uint256be {
+    return {};
+  };
+  m_interface.get_code_size = [](evmc_host_context *context,
+                                 evmc_address const *address) -> size_t {
+    auto const *code = findCode(self(context), *address);
+    return code ? code->size() : 0;
+  };
+  m_interface.get_code_hash = [](evmc_host_context *,
+                                 evmc_address const *address) {
+    // unique per contract, enough for the module cache
+    evmc::bytes32 hash{};
+    memcpy(hash.bytes, address->bytes, sizeof(address->bytes));
+    hash.bytes[31] = 1;
+    return evmc_bytes32(hash);
+  };
+  m_interface.copy_code = [](evmc_host_context *context,
+                             evmc_address const *address, size_t offset,
+                             uint8_t *buffer, size_t size) -> size_t {
+    auto const *code = findCode(self(context), *address);
+    if (!code || offset >= code->size())
+      return 0;
+    const size_t n = min(size, code->size() - offset);
+    memcpy(buffer, code->data() + offset, n);
+    return n;
+  };
+  m_interface.selfdestruct = [](evmc_host_context *, evmc_address const *,
+                                evmc_address const *) {};
+  m_interface.call = [](evmc_host_context *context,
+                        evmc_message const *msg) -> evmc_result {
+    return self(context).call(*msg).release_raw();
+  };
+  m_interface.get_tx_context = [](evmc_host_context *) -> evmc_tx_context {
+    return {};
+  };
+  m_interface.get_block_hash = [](evmc_host_context *,
+                                  int64_t) -> evmc_bytes32 { return {}; };
+  m_interface.emit_log = [](evmc_host_context *, evmc_address const *,
+                            uint8_t const *, size_t, evmc_bytes32 const[],
+                            size_t) {};
+}
+
+evmc::result MockHost::call(evmc_message const &msg) {
+  auto const *contract = findCode(*this, msg.destination);
+  if (!contract)
+    return evmc::result{EVMC_SUCCESS, msg.gas, nullptr, 0};
+  return evmc::result{vm->execute(vm, &m_interface, context(), EVMC_BYZANTIUM,
+                                  &msg, contract->data(), contract->size())};
+}
+
+evmc::result MockHost::execute(evmc::address const &destination,
+                               bytes const &input, int64_t gas) {
+  evmc_message msg{};
+  msg.kind = EVMC_CALL;
+  msg.gas = gas;
+  msg.destination = destination;
+  msg.input_data = input.data();
+  msg.input_size = input.size();
+  return call(msg);
+}
+
+evmc::result MockHost::create(bytes const &contract, int64_t gas) {
+  evmc_message msg{};
+  msg.kind = EVMC_CREATE;
+  msg.gas = gas;
+  return evmc::result{vm->execute(vm, &m_interface, context(), EVMC_BYZANTIUM,
+                                  &msg, contract.data(), contract.size())};
+}
+
+} // namespace test
+} // namespace athena
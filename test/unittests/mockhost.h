@@ -0,0 +1,73 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+#include "contracts.h"
+
+namespace athena {
+namespace test {
+
+// The engines a VM can be asked for, not all of them may be built.
+std::vector<std::string> const &engines();
+
+struct VmDeleter {
+  void operator()(evmc_vm *vm) const noexcept { vm->destroy(vm); }
+};
+using VmPtr = std::unique_ptr<evmc_vm, VmDeleter>;
+
+// @returns a VM running on @engine with the @options set, or nullptr if
+// @engine is not built.
+VmPtr createVm(std::string const &engine,
+               std::vector<std::pair<char const *, char const *>> const
+                   &options = {});
+
+// In-memory state of the contracts. Calls are executed by the VM under test
+// with the code registered for the destination.
+class MockHost {
+public:
+  explicit MockHost(evmc_vm *vm);
+
+  evmc_vm *vm;
+  std::map<evmc::address, bytes> code;
+  std::map<std::pair<evmc::address, evmc::bytes32>, evmc::bytes32> storage;
+
+  evmc::result call(evmc_message const &msg);
+  // Calls the contract at @destination from the outside.
+  evmc::result execute(evmc::address const &destination,
+                       bytes const &input = {}, int64_t gas = 1000000000);
+  // Deploys @contract, @returns its deployed code in the output.
+  evmc::result create(bytes const &contract, int64_t gas = 1000000000);
+
+  evmc_host_context *context() noexcept {
+    return reinterpret_cast<evmc_host_context *>(this);
+  }
+
+private:
+  evmc_host_interface m_interface{};
+};
+
+} // namespace test
+} // namespace athena
@@ -0,0 +1,242 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string>
+
+#include "contracts.h"
+
+using namespace std;
+
+namespace athena {
+namespace test {
+
+namespace {
+
+void writeULEB(bytes &out, uint64_t value) {
+  do {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    if (value)
+      b |= 0x80;
+    out.push_back(b);
+  } while (value);
+}
+
+void writeSLEB(bytes &out, int64_t value) {
+  bool more = true;
+  while (more) {
+    uint8_t b = value & 0x7f;
+    value >>= 7;
+    more = !((value == 0 && !(b & 0x40)) || (value == -1 && (b & 0x40)));
+    if (more)
+      b |= 0x80;
+    out.push_back(b);
+  }
+}
+
+void writeName(bytes &out, char const *name) {
+  const string str{name};
+  writeULEB(out, str.size());
+  out.insert(out.end(), str.begin(), str.end());
+}
+
+void writeSection(bytes &out, uint8_t id, bytes const &payload) {
+  out.push_back(id);
+  writeULEB(out, payload.size());
+  out.insert(out.end(), payload.begin(), payload.end());
+}
+
+void writeValueTypes(bytes &out, bytes const &types) {
+  writeULEB(out, types.size());
+  out.insert(out.end(), types.begin(), types.end());
+}
+
+} // anonymous namespace
+
+Import const &storageLoad() {
+  static const Import import{"ethereum", "storageLoad", {I32, I32}, {}};
+  return import;
+}
+
+Import const &callDataCopy() {
+  static const Import import{"ethereum", "callDataCopy", {I32, I32, I32}, {}};
+  return import;
+}
+
+Import const &getCallDataSize() {
+  static const Import import{"ethereum", "getCallDataSize", {}, {I32}};
+  return import;
+}
+
+Import const &storageStore() {
+  static const Import import{"ethereum", "storageStore", {I32, I32}, {}};
+  return import;
+}
+
+Import const &finish() {
+  static const Import import{"ethereum", "finish", {I32, I32}, {}};
+  return import;
+}
+
+Import const &revert() {
+  static const Import import{"ethereum", "revert", {I32, I32}, {}};
+  return import;
+}
+
+Import const &call() {
+  static const Import import{
+      "ethereum", "call", {I64, I32, I32, I32, I32}, {I32}};
+  return import;
+}
+
+Import const &returnDataCopy() {
+  static const Import import{
+      "ethereum", "returnDataCopy", {I32, I32, I32}, {}};
+  return import;
+}
+
+Code &Code::i32(int32_t value) {
+  op(0x41);
+  writeSLEB(body, value);
+  return *this;
+}
+
+Code &Code::i64(int64_t value) {
+  op(0x42);
+  writeSLEB(body, value);
+  return *this;
+}
+
+Code &Code::index(uint8_t opcode, uint32_t value) {
+  op(opcode);
+  writeULEB(body, value);
+  return *this;
+}
+
+Code &Code::memory(uint8_t opcode, uint32_t align, uint32_t offset) {
+  op(opcode);
+  writeULEB(body, align);
+  writeULEB(body, offset);
+  return *this;
+}
+
+bytes buildModule(Contract const &contract, Code const &main) {
+  bytes out{0x00, 0x61, 0x73, 0x6d, 0x01, 0x00, 0x00, 0x00};
+  const uint32_t importCount = uint32_t(contract.imports.size());
+
+  // one type per import, then () -> () of main
+  bytes types;
+  writeULEB(types, importCount + 1);
+  for (auto const &import : contract.imports) {
+    types.push_back(0x60);
+    writeValueTypes(types, import.params);
+    writeValueTypes(types, import.results);
+  }
+  types.insert(types.end(), {0x60, 0x00, 0x00});
+  writeSection(out, 1, types);
+
+  if (importCount) {
+    bytes imports;
+    writeULEB(imports, importCount);
+    for (uint32_t i = 0; i < importCount; i++) {
+      writeName(imports, contract.imports[i].module);
+      writeName(imports, contract.imports[i].name);
+      imports.push_back(0x00);
+      writeULEB(imports, i);
+    }
+    writeSection(out, 2, imports);
+  }
+
+  bytes functions{0x01};
+  writeULEB(functions, importCount);
+  writeSection(out, 3, functions);
+
+  bytes memory{0x01, 0x00};
+  writeULEB(memory, contract.pages);
+  writeSection(out, 5, memory);
+
+  if (!contract.globals.empty()) {
+    bytes globals;
+    writeULEB(globals, contract.globals.size());
+    for (int32_t value : contract.globals) {
+      globals.insert(globals.end(), {I32, 0x01, 0x41});
+      writeSLEB(globals, value);
+      globals.push_back(0x0b);
+    }
+    writeSection(out, 6, globals);
+  }
+
+  bytes exports{0x02};
+  writeName(exports, "memory");
+  exports.push_back(0x02);
+  exports.push_back(0x00);
+  writeName(exports, "main");
+  exports.push_back(0x00);
+  writeULEB(exports, importCount);
+  writeSection(out, 7, exports);
+
+  bytes function;
+  writeULEB(function, contract.locals.size());
+  for (uint8_t type : contract.locals) {
+    function.push_back(0x01);
+    function.push_back(type);
+  }
+  function.insert(function.end(), main.body.begin(), main.body.end());
+  function.push_back(0x0b);
+  bytes code{0x01};
+  writeULEB(code, function.size());
+  code.insert(code.end(), function.begin(), function.end());
+  writeSection(out, 10, code);
+
+  if (!contract.segments.empty()) {
+    bytes data;
+    writeULEB(data, contract.segments.size());
+    for (auto const &segment : contract.segments) {
+      data.push_back(0x00);
+      data.push_back(0x41);
+      writeSLEB(data, int32_t(segment.offset));
+      data.push_back(0x0b);
+      writeULEB(data, segment.data.size());
+      data.insert(data.end(), segment.data.begin(), segment.data.end());
+    }
+    writeSection(out, 11, data);
+  }
+  return out;
+}
+
+bytes encodeU32(uint32_t value) {
+  return {uint8_t(value), uint8_t(value >> 8), uint8_t(value >> 16),
+          uint8_t(value >> 24)};
+}
+
+uint32_t decodeU32(uint8_t const *data) {
+  return uint32_t(data[0]) | uint32_t(data[1]) << 8 | uint32_t(data[2]) << 16 |
+         uint32_t(data[3]) << 24;
+}
+
+evmc::address makeAddress(uint32_t id) {
+  evmc::address address{};
+  address.bytes[0] = 0xce;
+  address.bytes[16] = uint8_t(id >> 24);
+  address.bytes[17] = uint8_t(id >> 16);
+  address.bytes[18] = uint8_t(id >> 8);
+  address.bytes[19] = uint8_t(id);
+  return address;
+}
+
+} // namespace test
+} // namespace athena
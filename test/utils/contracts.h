@@ -0,0 +1,122 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+namespace athena {
+namespace test {
+
+using bytes = std::vector<uint8_t>;
+
+constexpr uint8_t I32 = 0x7f;
+constexpr uint8_t I64 = 0x7e;
+
+// A host function imported by a contract, the imports take the function
+// indices from 0 in the order they are listed.
+struct Import {
+  char const *module;
+  char const *name;
+  bytes params;
+  bytes results;
+};
+
+// The ethereum imports used by the tests and the benchmark corpus.
+Import const &storageLoad();
+Import const &callDataCopy();
+Import const &getCallDataSize();
+Import const &storageStore();
+Import const &finish();
+Import const &revert();
+Import const &call();
+Import const &returnDataCopy();
+
+// Emits the body of the exported main function.
+class Code {
+public:
+  bytes body;
+
+  Code &op(uint8_t opcode) {
+    body.push_back(opcode);
+    return *this;
+  }
+  Code &i32(int32_t value);
+  Code &i64(int64_t value);
+  Code &get(uint32_t local) { return index(0x20, local); }
+  Code &set(uint32_t local) { return index(0x21, local); }
+  Code &globalGet(uint32_t global) { return index(0x23, global); }
+  Code &globalSet(uint32_t global) { return index(0x24, global); }
+  Code &call(uint32_t function) { return index(0x10, function); }
+  Code &br(uint32_t depth) { return index(0x0c, depth); }
+  Code &brIf(uint32_t depth) { return index(0x0d, depth); }
+  Code &block() { return op(0x02).op(0x40); }
+  Code &loop() { return op(0x03).op(0x40); }
+  Code &if_() { return op(0x04).op(0x40); }
+  Code &end() { return op(0x0b); }
+  Code &drop() { return op(0x1a); }
+
+  Code &i32Load(uint32_t offset) { return memory(0x28, 2, offset); }
+  Code &i64Load(uint32_t offset) { return memory(0x29, 3, offset); }
+  Code &i64Load32U(uint32_t offset) { return memory(0x35, 2, offset); }
+  Code &i32Store(uint32_t offset) { return memory(0x36, 2, offset); }
+  Code &i64Store(uint32_t offset) { return memory(0x37, 3, offset); }
+  // (dest, src, length) and (dest, value, length)
+  Code &memoryCopy() { return op(0xfc).op(0x0a).op(0x00).op(0x00); }
+  Code &memoryFill() { return op(0xfc).op(0x0b).op(0x00); }
+
+  // local += 1
+  Code &increment(uint32_t local) {
+    return get(local).i32(1).op(0x6a).set(local);
+  }
+  // br_if 1 when local >= limit
+  Code &exitIfGreaterEqual(uint32_t local, uint32_t limit) {
+    return get(local).get(limit).op(0x4f).brIf(1);
+  }
+
+private:
+  Code &index(uint8_t opcode, uint32_t value);
+  Code &memory(uint8_t opcode, uint32_t align, uint32_t offset);
+};
+
+struct Segment {
+  uint32_t offset;
+  bytes data;
+};
+
+// Everything but the code of a contract, which exports its memory and a
+// main function taking the function index after the imports.
+struct Contract {
+  std::vector<Import> imports;
+  std::vector<uint8_t> locals;
+  uint32_t pages = 1;
+  std::vector<Segment> segments;
+  // initial values of mutable i32 globals
+  std::vector<int32_t> globals;
+};
+
+bytes buildModule(Contract const &contract, Code const &main);
+
+bytes encodeU32(uint32_t value);
+uint32_t decodeU32(uint8_t const *data);
+evmc::address makeAddress(uint32_t id);
+
+} // namespace test
+} // namespace athena
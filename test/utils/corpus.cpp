@@ -0,0 +1,232 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+
+#include <dirent.h>
+
+#include "contracts.h"
+#include "corpus.h"
+
+using namespace std;
+
+namespace athena {
+namespace bench {
+
+namespace {
+
+using test::Code;
+using test::I32;
+using test::I64;
+using test::Segment;
+using test::encodeU32;
+using test::makeAddress;
+
+// Every contract imports these, in this order.
+enum Import : uint32_t {
+  StorageLoad,
+  StorageStore,
+  CallDataCopy,
+  GetCallDataSize,
+  Finish,
+  Call,
+};
+
+bytes buildModule(Code const &main, vector<uint8_t> const &locals,
+                  uint32_t pages, vector<Segment> const &segments = {}) {
+  test::Contract contract;
+  contract.imports = {test::storageLoad(),  test::storageStore(),
+                      test::callDataCopy(), test::getCallDataSize(),
+                      test::finish(),       test::call()};
+  contract.locals = locals;
+  contract.pages = pages;
+  contract.segments = segments;
+  return test::buildModule(contract, main);
+}
+
+bool readFile(string const &path, bytes &contents) {
+  ifstream file(path, ios::binary);
+  if (!file)
+    return false;
+  contents.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+  return true;
+}
+
+// Token transfers: two storage loads and two stores per iteration.
+BenchCase erc20Transfers(unsigned scale) {
+  enum { iteration, count };
+  Code c;
+  c.i32(200).i32(0).i32(4).call(CallDataCopy);
+  c.i32(0).i32Load(200).set(count);
+  c.block().loop();
+  c.exitIfGreaterEqual(iteration, count);
+  // sender and recipient keys at 0 and 32, balances at 64 and 96
+  c.i32(0).get(iteration).i32Store(28);
+  c.i32(0).get(iteration).i32(1).op(0x6a).i32Store(60);
+  c.i32(0).i32(64).call(StorageLoad);
+  c.i32(32).i32(96).call(StorageLoad);
+  c.i32(0).i32(0).i64Load(88).i64(1).op(0x7d).i64Store(88);
+  c.i32(0).i32(0).i64Load(120).i64(1).op(0x7c).i64Store(120);
+  c.i32(0).i32(64).call(StorageStore);
+  c.i32(32).i32(96).call(StorageStore);
+  c.increment(iteration).br(0);
+  c.end().end();
+  c.i32(64).i32(64).call(Finish);
+
+  const auto address = makeAddress(1);
+  return {"erc20-transfer", "token transfers, storage bound", address,
+          buildModule(c, {I32, I32}, 1), encodeU32(100 * scale)};
+}
+
+// 256-bit schoolbook multiplications on 32-bit limbs, the arithmetic
+// evm2wasm emits for MUL.
+BenchCase bignumMultiply(unsigned scale) {
+  enum { iteration, count, i, j, carry, t };
+  constexpr uint32_t a = 0, b = 32, r = 64;
+  Code c;
+  c.i32(256).i32(0).i32(4).call(CallDataCopy);
+  c.i32(0).i32Load(256).set(count);
+  c.block().loop();
+  c.exitIfGreaterEqual(iteration, count);
+  for (uint32_t k = 0; k < 8; k++)
+    c.i32(0).i64(0).i64Store(r + 8 * k);
+  c.i32(0).set(i);
+  c.block().loop();
+  c.get(i).i32(8).op(0x4f).brIf(1);
+  c.i64(0).set(carry).i32(0).set(j);
+  c.block().loop();
+  c.get(j).i32(8).op(0x4f).brIf(1);
+  // t = a[i] * b[j] + r[i + j] + carry
+  c.get(i).i32(2).op(0x74).i64Load32U(a);
+  c.get(j).i32(2).op(0x74).i64Load32U(b);
+  c.op(0x7e);
+  c.get(i).get(j).op(0x6a).i32(2).op(0x74).i64Load32U(r);
+  c.op(0x7c).get(carry).op(0x7c).set(t);
+  c.get(i).get(j).op(0x6a).i32(2).op(0x74).get(t).op(0xa7).i32Store(r);
+  c.get(t).i64(32).op(0x88).set(carry);
+  c.increment(j).br(0);
+  c.end().end();
+  c.get(i).i32(2).op(0x74).get(carry).op(0xa7).i32Store(r + 32);
+  c.increment(i).br(0);
+  c.end().end();
+  // a = r mod 2^256, b is odd so a never becomes zero
+  for (uint32_t k = 0; k < 4; k++)
+    c.i32(0).i32(0).i64Load(r + 8 * k).i64Store(a + 8 * k);
+  c.increment(iteration).br(0);
+  c.end().end();
+  c.i32(a).i32(32).call(Finish);
+
+  bytes limbs(64);
+  for (size_t k = 0; k < limbs.size(); k++)
+    limbs[k] = uint8_t(0x9d * (k + 1));
+  limbs[32] |= 1;
+  const auto address = makeAddress(2);
+  return {"bignum-mul", "256-bit multiplications, compute bound", address,
+          buildModule(c, {I32, I32, I32, I32, I64, I64}, 1, {{a, limbs}}),
+          encodeU32(200 * scale)};
+}
+
+// Copies the call data into memory and then word by word within memory.
+BenchCase memoryCopy(unsigned scale) {
+  enum { iteration, count, size, k };
+  const uint32_t payload = min(16384u * scale, 1u << 20);
+  constexpr uint32_t src = 1024;
+  const uint32_t dst = src + payload;
+  Code c;
+  c.i32(0).i32(0).i32(4).call(CallDataCopy);
+  c.i32(0).i32Load(0).set(count);
+  c.call(GetCallDataSize).i32(4).op(0x6b).set(size);
+  c.block().loop();
+  c.exitIfGreaterEqual(iteration, count);
+  c.i32(src).i32(4).get(size).call(CallDataCopy);
+  c.i32(0).set(k);
+  c.block().loop();
+  c.exitIfGreaterEqual(k, size);
+  c.get(k).get(k).i64Load(src).i64Store(dst);
+  c.get(k).i32(8).op(0x6a).set(k);
+  c.br(0);
+  c.end().end();
+  c.increment(iteration).br(0);
+  c.end().end();
+  c.i32(int32_t(dst)).get(size).call(Finish);
+
+  bytes input = encodeU32(20);
+  for (uint32_t n = 0; n < payload; n++)
+    input.push_back(uint8_t(n * 7));
+  const auto address = makeAddress(3);
+  return {"memory-copy", "call data and memory copies, copy bound", address,
+          buildModule(c, {I32, I32, I32, I32}, (dst + payload) / 65536 + 1),
+          input};
+}
+
+// Calls itself until the depth in the call data reaches zero.
+BenchCase callChain(unsigned scale) {
+  enum { depth };
+  Code c;
+  c.i32(100).i32(0).i32(4).call(CallDataCopy);
+  c.i32(0).i32Load(100).set(depth);
+  c.get(depth).if_();
+  c.i32(104).get(depth).i32(1).op(0x6b).i32Store(0);
+  c.i64(1000000000).i32(0).i32(32).i32(104).i32(4).call(Call).op(0x1a);
+  c.end();
+  c.i32(100).i32(4).call(Finish);
+
+  const auto address = makeAddress(4);
+  const bytes self(address.bytes, address.bytes + sizeof(address.bytes));
+  return {"call-chain", "nested self calls, call overhead bound", address,
+          buildModule(c, {I32}, 1, {{0, self}}),
+          encodeU32(min(32 * scale, 1000u))};
+}
+
+} // anonymous namespace
+
+vector<BenchCase> corpus(unsigned scale) {
+  return {erc20Transfers(scale), bignumMultiply(scale), memoryCopy(scale),
+          callChain(scale)};
+}
+
+void loadCorpus(string const &directory, vector<BenchCase> &cases) {
+  DIR *dir = opendir(directory.c_str());
+  if (!dir)
+    return;
+  vector<string> names;
+  while (dirent *entry = readdir(dir)) {
+    const string file = entry->d_name;
+    if (file.size() > 5 && file.compare(file.size() - 5, 5, ".wasm") == 0)
+      names.push_back(file.substr(0, file.size() - 5));
+  }
+  closedir(dir);
+  // in a stable order, readdir() has none
+  sort(names.begin(), names.end());
+
+  // after the addresses of the generated cases
+  uint32_t id = 0x100;
+  for (auto const &name : names) {
+    BenchCase loaded{name, "loaded from " + directory, makeAddress(id++), {},
+                     {}};
+    if (!readFile(directory + "/" + name + ".wasm", loaded.code))
+      continue;
+    readFile(directory + "/" + name + ".input", loaded.input);
+    loaded.mustSucceed = false;
+    cases.push_back(move(loaded));
+  }
+}
+
+} // namespace bench
+} // namespace athena
@@ -0,0 +1,52 @@
+/*
+ * Copyright 2019-2020 Jesse Kuang
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <evmc/evmc.hpp>
+
+namespace athena {
+namespace bench {
+
+using bytes = std::vector<uint8_t>;
+
+// A contract deployed at @address, called with @input.
+struct BenchCase {
+  std::string name;
+  std::string description;
+  evmc::address address;
+  bytes code;
+  bytes input;
+  // loaded cases may trap, they are timed all the same
+  bool mustSucceed = true;
+};
+
+// @returns the built-in corpus, every contract is generated so that the
+// workload size can be tuned by @scale (1 is the default size).
+std::vector<BenchCase> corpus(unsigned scale);
+
+// @returns a case for every <name>.wasm module in @directory, such as the
+// outliers saved by athena-fuzzer, called with the contents of <name>.input
+// if there is one. Appends nothing if @directory cannot be read.
+void loadCorpus(std::string const &directory, std::vector<BenchCase> &cases);
+
+} // namespace bench
+} // namespace athena